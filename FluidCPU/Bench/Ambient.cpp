@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "AmbientVolume.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Divisors of the ambient volume against the grid
+static const uint3 g_divisors[] =
+{
+	uint3(1, 1, 1),
+	uint3(2, 2, 2),
+	uint3(4, 4, 4)
+};
+
+struct AmbientRun
+{
+	double Milliseconds;
+	uint64_t NumRays;
+	uint64_t NumSamples;
+	double ErrorSum;	// Against the rays traced per cell, at the dense cells
+	float MaxError;
+};
+
+//--------------------------------------------------------------------------------------
+// Occlusion along an AO ray, as CastLightRay of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static float CastAORay(const QuantizedDensity& density, const float3& rayOrigin, const float3& rayDir,
+	uint64_t& numSamples)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + rayDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto d = density.Sample(pos * 0.5f + 0.5f);
+		++numSamples;
+
+		const auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// The ray marchers before the ambient volume: an AO ray at every dense sample, here one
+// per dense cell
+//--------------------------------------------------------------------------------------
+static void TraceAO(ThreadPool* pThreadPool, Grid3D<float>& occlusion, const QuantizedDensity& density,
+	atomic<uint64_t>& numRays, atomic<uint64_t>& numSamples)
+{
+	const auto& gridSize = occlusion.GetSize();
+	pThreadPool->Dispatch(gridSize.y * gridSize.z, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t rays = 0, samples = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < gridSize.x; ++x)
+			{
+				const uint3 cell(x, i % gridSize.y, i / gridSize.y);
+				const auto pos = (float3(cell) + 0.5f) / float3(gridSize) * 2.0f - 1.0f;
+				if (density.Sample(pos * 0.5f + 0.5f) < g_zeroThreshold) continue;
+
+				occlusion[cell] = CastAORay(density, pos, AmbientVolume::GetRayDir(density, pos), samples);
+				++rays;
+			}
+		}
+		numRays += rays;
+		numSamples += samples;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Slices of the ambient volume of CSAmbient.hlsl refreshed this frame: an AO ray at every
+// texel with density under it, and none elsewhere
+//--------------------------------------------------------------------------------------
+static void UpdateAmbient(ThreadPool* pThreadPool, AmbientVolume& volume, const QuantizedDensity& density,
+	const DensityPyramid& pyramid, uint32_t sliceBegin, uint32_t sliceEnd, atomic<uint64_t>& numRays,
+	atomic<uint64_t>& numSamples)
+{
+	auto& texels = volume.GetTexels();
+	const auto& size = volume.GetSize();
+	pThreadPool->Dispatch(size.y * (sliceEnd - sliceBegin), [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t rays = 0, samples = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 texel(x, i % size.y, sliceBegin + i / size.y);
+				const auto pos = volume.GetRayOrigin(texel);
+				const auto hasDensity = volume.HasDensity(density, pyramid, texel, g_zeroThreshold);
+				texels[texel] = hasDensity ? CastAORay(density, pos, AmbientVolume::GetRayDir(density, pos), samples) : 1.0f;
+				rays += hasDensity ? 1 : 0;
+			}
+		}
+		numRays += rays;
+		numSamples += samples;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the brick
+// maxima as the GPU does before rendering, then traces an AO ray at every dense cell as the
+// ray marchers did per sample, and refreshes an ambient volume at each divisor, a share of
+// its slices per frame at the light-map refresh interval of the options; reports the rays,
+// the density samples, the time and the error of the occlusion that the view rays filter
+// at the dense cells against the traced rays
+//--------------------------------------------------------------------------------------
+int BenchAmbient(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+	const auto interval = (max)(options.LightMapRefresh, 1u);
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The ambient benchmark occludes a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	// The divisor of the options or the defaults
+	vector<uint3> divisors;
+	const auto& divisor = options.AmbientDivisor;
+	if (divisor.x > 0 || divisor.y > 0 || divisor.z > 0)
+		divisors.emplace_back((max)(divisor.x, 1u), (max)(divisor.y, 1u), (max)(divisor.z, 1u));
+	else divisors.assign(begin(g_divisors), end(g_divisors));
+
+	const auto numVolumes = divisors.size();
+	vector<AmbientVolume> volumes(numVolumes);
+	for (size_t j = 0; j < numVolumes; ++j) volumes[j].Create(gridSize, divisors[j]);
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, AO samples: %u, refresh interval: %u\n", gridSize.x,
+		gridSize.y, gridSize.z, pThreadPool->GetNumThreads(), numFrames, g_numLightSamples, interval);
+
+	Grid3D<float> occlusion;
+	occlusion.Create(gridSize);
+	AmbientRun traced = {};
+	vector<AmbientRun> runs(numVolumes, AmbientRun());
+	uint64_t numDenseCells = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+
+		{
+			atomic<uint64_t> numRays(0), numSamples(0);
+			const auto start = chrono::steady_clock::now();
+			TraceAO(pThreadPool, occlusion, density, numRays, numSamples);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+			traced.Milliseconds += duration.count();
+			traced.NumRays += numRays;
+			traced.NumSamples += numSamples;
+		}
+
+		for (size_t j = 0; j < numVolumes; ++j)
+		{
+			// The first frame refreshes all, as the GPU after any change of the light probe
+			uint32_t sliceBegin, sliceEnd;
+			volumes[j].ScheduleRefresh(interval, i == 0, sliceBegin, sliceEnd);
+
+			atomic<uint64_t> numRays(0), numSamples(0);
+			const auto start = chrono::steady_clock::now();
+			UpdateAmbient(pThreadPool, volumes[j], density, pyramid, sliceBegin, sliceEnd, numRays, numSamples);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+			auto& run = runs[j];
+			run.Milliseconds += duration.count();
+			run.NumRays += numRays;
+			run.NumSamples += numSamples;
+		}
+
+		// The dense cells are the ones the view rays shade
+		for (auto z = 0u; z < gridSize.z; ++z)
+			for (auto y = 0u; y < gridSize.y; ++y)
+				for (auto x = 0u; x < gridSize.x; ++x)
+				{
+					const uint3 cell(x, y, z);
+					const auto uvw = (float3(cell) + 0.5f) / float3(gridSize);
+					if (density.Sample(uvw) < g_zeroThreshold) continue;
+					++numDenseCells;
+
+					for (size_t j = 0; j < numVolumes; ++j)
+					{
+						const auto error = fabsf(volumes[j].Sample(uvw) - occlusion[cell]);
+						runs[j].ErrorSum += error;
+						runs[j].MaxError = (max)(error, runs[j].MaxError);
+					}
+				}
+	}
+
+	// Per-frame means; the errors are over the dense cells, which the view rays shade
+	printf("Mean per frame: dense cells %.0f\n", static_cast<double>(numDenseCells) / numFrames);
+	printf("%-7s %-12s %10s %12s %9s %10s %12s %12s\n", "Pass", "Size", "Rays", "Samples", "Saved",
+		"Time (ms)", "Mean error", "Max error");
+	printf("%-7s %-12s %10.0f %12.0f %8.2f%% %10.3f %12.4e %12.4e\n", "traced", "-",
+		static_cast<double>(traced.NumRays) / numFrames, static_cast<double>(traced.NumSamples) / numFrames,
+		0.0, traced.Milliseconds / numFrames, 0.0, 0.0);
+	for (size_t j = 0; j < numVolumes; ++j)
+	{
+		const auto& run = runs[j];
+		const auto& size = volumes[j].GetSize();
+		char sizeName[32];
+		snprintf(sizeName, sizeof(sizeName), "%ux%ux%u", size.x, size.y, size.z);
+		const auto saving = traced.NumSamples > 0 ?
+			1.0 - static_cast<double>(run.NumSamples) / traced.NumSamples : 0.0;
+		printf("%-7s %-12s %10.0f %12.0f %8.2f%% %10.3f %12.4e %12.4e\n", "volume", sizeName,
+			static_cast<double>(run.NumRays) / numFrames, static_cast<double>(run.NumSamples) / numFrames,
+			saving * 100.0, run.Milliseconds / numFrames, numDenseCells > 0 ? run.ErrorSum / numDenseCells : 0.0,
+			run.MaxError);
+	}
+
+	return EXIT_SUCCESS;
+}
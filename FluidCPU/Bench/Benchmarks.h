@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SamplerSIMD.h"
+#include "FluidCPU.h"
+
+struct BenchOptions
+{
+	uint3 GridSize;
+	uint32_t NumFrames;		// 0 selects the default of each benchmark
+	uint32_t NumThreads;
+	float TimeStep;
+	float Tolerance;		// 0 keeps the solver default; the target residual of adaptive Jacobi
+	uint32_t MinIterations;	// 0 keeps the solver default; adaptive Jacobi only
+	uint32_t MaxIterations;	// 0 keeps the solver default
+	float Omega;			// 0 keeps the solver default
+	uint8_t PressureLevel;	// 0 solves at full resolution, 1 at half and 2 at quarter
+	float CFLNumber;		// 0 takes each frame in one step
+	uint32_t MaxSubsteps;	// 0 keeps the default of 4
+	FluidCPU::ProjectionMode ProjectionMode;
+	FluidCPU::VelocityLayout VelocityLayout;
+	FluidCPU::AdvectionScheme AdvectionScheme;
+	bool IsSparse;			// Active bricks only
+	bool IsSplitDensity;	// Rounds the color to the split storage of the GPU
+	SamplerISA Sampler;		// Instruction set of the batched advection samplers
+	uint3 LightMapDivisor;	// Per axis; 0 selects the defaults of the light-map and sweep benchmarks
+	uint32_t LightMapRefresh;	// Frames of a full light-map refresh; 0 selects the defaults of the refresh benchmark
+	uint3 AmbientDivisor;	// Per axis; 0 selects the defaults of the ambient benchmark
+	uint32_t Checkerboard;	// Interleave of the cube-map marching; 0 selects the defaults of the checkerboard benchmark
+};
+
+//--------------------------------------------------------------------------------------
+// Benchmarks; each returns a process exit code
+//--------------------------------------------------------------------------------------
+int BenchSimulate(const BenchOptions& options);
+int BenchPoisson(const BenchOptions& options);
+int BenchSharpness(const BenchOptions& options);
+int BenchLayout(const BenchOptions& options);
+int BenchSampler(const BenchOptions& options);
+int BenchStorage(const BenchOptions& options);
+int BenchSkipping(const BenchOptions& options);
+int BenchCone(const BenchOptions& options);
+int BenchLightMap(const BenchOptions& options);
+int BenchSweep(const BenchOptions& options);
+int BenchRefresh(const BenchOptions& options);
+int BenchAmbient(const BenchOptions& options);
+int BenchGradient(const BenchOptions& options);
+int BenchCheckerboard(const BenchOptions& options);
+
+//--------------------------------------------------------------------------------------
+// Shared helpers
+//--------------------------------------------------------------------------------------
+bool InitFluid(FluidCPU& fluid, const BenchOptions& options);
+const char* GetProjectionModeName(FluidCPU::ProjectionMode mode);
+const char* GetVelocityLayoutName(FluidCPU::VelocityLayout layout);
+const char* GetAdvectionSchemeName(FluidCPU::AdvectionScheme scheme);
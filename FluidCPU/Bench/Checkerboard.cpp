@@ -0,0 +1,235 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "CubeMap.h"
+#include "DensityPyramid.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Interleaves of the checkerboard marching against the full march
+static const uint32_t g_interleaves[] = { 2, 4 };
+
+// Orbit of the eye around the volume, in the local space of the volume
+static const float g_eyeRadius = 3.0f;
+static const float g_eyeHeight = 1.5f;
+static const float g_eyeStep = 3.14159265f / 180.0f;	// Per frame
+
+struct CheckerboardRun
+{
+	double Milliseconds;
+	uint64_t NumSamples;
+	uint64_t NumRebuilt;
+	uint64_t NumRejected;
+	double ErrorSum;	// Of the rebuilt texels against the full march
+	float MaxError;
+};
+
+static float3 GetEyePt(uint32_t frame)
+{
+	const auto angle = g_eyeStep * frame;
+
+	return float3(g_eyeRadius * sinf(angle), g_eyeHeight, -g_eyeRadius * cosf(angle));
+}
+
+//--------------------------------------------------------------------------------------
+// Opacity of the view rays of CSRayMarch.hlsl from the eye through the texels of the
+// visible faces marched at this phase, with empty-space skipping; the others are left
+//--------------------------------------------------------------------------------------
+static void RayMarch(ThreadPool* pThreadPool, CubeMap& cubeMap, const QuantizedDensity& density,
+	const DensityPyramid& pyramid, const float3& eyePt, uint32_t interleave, uint32_t phase, uint64_t& numSamples)
+{
+	auto& texels = cubeMap.GetTexels();
+	const auto size = cubeMap.GetSize();
+	const auto stepScale = g_maxDist / g_numSamples;
+	atomic<uint64_t> count(0);
+	pThreadPool->Dispatch(6 * size, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t n = 0, numLoads = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto face = static_cast<uint8_t>(i / size);
+			const auto y = i % size;
+			if (!CubeMap::IsVisible(face, eyePt)) continue;
+
+			for (auto x = 0u; x < size; ++x)
+			{
+				if (!CubeMap::IsMarched(x, y, interleave, phase)) continue;
+
+				const auto target = CubeMap::GetLocalPos(x, y, face, size);
+				const auto rayDir = normalize(target - eyePt);
+				auto rayOrigin = eyePt;
+				if (!CubeMap::ComputeRayOrigin(rayOrigin, rayDir)) continue;
+
+				// ComputeTargetHit of RayMarch.hlsli
+				const auto u = (target - rayOrigin) / rayDir;
+				const auto tMax = (max)((max)(u.x, u.y), u.z);
+
+				auto opacity = 0.0f;
+				auto t = 0.0f;
+				auto prevDensity = 0.0f;
+				auto isEmpty = true;
+				for (auto j = 0u; j < g_numSamples; ++j)
+				{
+					const auto pos = rayOrigin + rayDir * t;
+					if (!IsInside(pos)) break;
+
+					const auto uvw = pos * 0.5f + 0.5f;
+					const auto numEmptySteps = isEmpty ?
+						pyramid.GetEmptySteps(uvw, rayDir * 0.5f, stepScale, g_zeroThreshold, numLoads) : 0;
+					if (numEmptySteps > 0)
+					{
+						j += numEmptySteps - 1;
+						t += stepScale * numEmptySteps;
+						if (t > tMax) break;
+						continue;
+					}
+
+					const auto d = density.Sample(uvw);
+					auto newStep = stepScale;
+					isEmpty = d <= g_zeroThreshold;
+					++n;
+
+					if (!isEmpty)
+					{
+						const auto transm = 1.0f - opacity;
+						newStep = GetStep(d - prevDensity, transm, d, stepScale);
+						prevDensity = d;
+
+						opacity += d * g_absorption * transm;
+						if (transm < g_zeroThreshold) break;
+					}
+
+					t += newStep;
+					if (t > tMax) break;
+				}
+
+				texels(x, y, face) = opacity;
+			}
+		}
+		count += n;
+	});
+
+	numSamples += count;
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the max-density
+// pyramid as the GPU does before rendering, then marches the cube map from an eye orbiting
+// the volume by a degree per frame, in full and with the checkerboard marching at each
+// interleave, which marches all texels in the first frame for want of a history; reports
+// the density samples per frame, the saving, the time, the errors of the rebuilt texels
+// against the full march and the share of them whose history was rejected
+//--------------------------------------------------------------------------------------
+int BenchCheckerboard(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The checkerboard benchmark marches a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	// The interleave of the options or the defaults
+	vector<uint32_t> interleaves;
+	if (options.Checkerboard > 1) interleaves.push_back(options.Checkerboard >= 4 ? 4 : 2);
+	else interleaves.assign(begin(g_interleaves), end(g_interleaves));
+
+	// The cube map as the GPU sizes it, and ping-ponged with its history at each interleave
+	const auto numInterleaves = interleaves.size();
+	CubeMap reference;
+	vector<CubeMap> cubeMaps(numInterleaves * 2);
+	reference.Create(gridSize.x);
+	for (auto& cubeMap : cubeMaps) cubeMap.Create(gridSize.x);
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, cube map: %u, samples: %u\n", gridSize.x, gridSize.y,
+		gridSize.z, pThreadPool->GetNumThreads(), numFrames, gridSize.x, g_numSamples);
+
+	CheckerboardRun fullRun = {};
+	vector<CheckerboardRun> runs(numInterleaves, CheckerboardRun());
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+
+		const auto eyePt = GetEyePt(i);
+		{
+			const auto start = chrono::steady_clock::now();
+			RayMarch(pThreadPool, reference, density, pyramid, eyePt, 1, 0, fullRun.NumSamples);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+			fullRun.Milliseconds += duration.count();
+		}
+
+		for (size_t j = 0; j < numInterleaves; ++j)
+		{
+			auto& run = runs[j];
+			auto& cubeMap = cubeMaps[j * 2 + (i & 1)];
+			const auto& history = cubeMaps[j * 2 + !(i & 1)];
+			const auto interleave = i > 0 ? interleaves[j] : 1;
+			const auto phase = CubeMap::GetPhase(interleave, i);
+			{
+				const auto start = chrono::steady_clock::now();
+				RayMarch(pThreadPool, cubeMap, density, pyramid, eyePt, interleave, phase, run.NumSamples);
+				if (interleave > 1) cubeMap.Reconstruct(pThreadPool, history, eyePt, GetEyePt(i - 1),
+					interleave, phase, run.NumRebuilt, run.NumRejected);
+				const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+				run.Milliseconds += duration.count();
+			}
+
+			// Errors of the rebuilt texels of the visible faces
+			if (interleave > 1)
+			{
+				const auto size = cubeMap.GetSize();
+				for (uint8_t face = 0; face < 6; ++face)
+				{
+					if (!CubeMap::IsVisible(face, eyePt)) continue;
+					for (auto y = 0u; y < size; ++y)
+						for (auto x = 0u; x < size; ++x)
+						{
+							if (CubeMap::IsMarched(x, y, interleave, phase)) continue;
+							const auto error = fabsf(cubeMap.GetTexels()(x, y, face) - reference.GetTexels()(x, y, face));
+							run.ErrorSum += error;
+							run.MaxError = (max)(error, run.MaxError);
+						}
+				}
+			}
+		}
+	}
+
+	// Per-frame means for the samples and the time, per rebuilt texel for the errors
+	printf("%-11s %12s %9s %10s %12s %12s %10s\n", "Interleave", "Samples", "Saved", "Time (ms)",
+		"Mean error", "Max error", "Rejected");
+	printf("%-11u %12.0f %8.2f%% %10.3f %12.4e %12.4e %9.2f%%\n", 1u, static_cast<double>(fullRun.NumSamples) / numFrames,
+		0.0, fullRun.Milliseconds / numFrames, 0.0, 0.0, 0.0);
+	for (size_t j = 0; j < numInterleaves; ++j)
+	{
+		const auto& run = runs[j];
+		const auto numRebuilt = static_cast<double>((max)(run.NumRebuilt, static_cast<uint64_t>(1)));
+		const auto saving = 1.0 - static_cast<double>(run.NumSamples) / (max)(fullRun.NumSamples, static_cast<uint64_t>(1));
+		printf("%-11u %12.0f %8.2f%% %10.3f %12.4e %12.4e %9.2f%%\n", interleaves[j],
+			static_cast<double>(run.NumSamples) / numFrames, saving * 100.0, run.Milliseconds / numFrames,
+			run.ErrorSum / numRebuilt, run.MaxError, run.NumRejected / numRebuilt * 100.0);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "DensityMips.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Footprint schedule of the light and AO rays, as Fluid::SetLightFootprint: texels at the
+// origin, and the growth per texel travelled
+struct LightFootprint
+{
+	float Footprint;
+	float Spread;
+};
+
+// The first marches at full resolution, the reference of the others
+static const LightFootprint g_footprints[] =
+{
+	{ 0.0f, 0.0f },
+	{ 1.0f, 0.125f },
+	{ 1.0f, 0.25f },
+	{ 1.0f, 0.5f },
+	{ 1.0f, 1.0f }
+};
+
+static const uint8_t g_numFootprints = static_cast<uint8_t>(sizeof(g_footprints) / sizeof(g_footprints[0]));
+
+enum LightRay : uint8_t
+{
+	LIGHT_RAY_SHADOW,
+	LIGHT_RAY_AO,
+
+	NUM_LIGHT_RAY
+};
+
+struct ConeRun
+{
+	double Milliseconds;
+	uint64_t NumSamples;
+	double ErrorSum;	// Against the reference
+	float MaxError;
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli with a footprint
+// schedule; the pyramid leaps, exact for the light rays, are left out
+//--------------------------------------------------------------------------------------
+static float CastLightRay(const QuantizedDensity& density, const DensityMips& mips, const float3& rayOrigin,
+	const float3& rayDir, const LightFootprint& footprint, uint64_t& numSamples)
+{
+	const auto& gridSize = density.GetCodes().GetSize();
+	const auto texelsPerUnit = 0.5f * (max)((max)(gridSize.x, gridSize.y), gridSize.z);
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + rayDir * t;
+		if (!IsInside(pos)) break;
+
+		// At the mip level of the footprint
+		const auto span = footprint.Footprint + footprint.Spread * t * texelsPerUnit;
+		const auto d = mips.Sample(density, pos * 0.5f + 0.5f, log2f((max)(span, 1.0f)));
+		++numSamples;
+
+		auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		// A sample whose footprint spans more than its step stands for the steps in it
+		const auto weight = span / texelsPerUnit / newStep;
+		if (weight > 1.0f)
+		{
+			transm *= powf((max)(1.0f - d * g_absorption, 0.0f), weight);
+			newStep = span / texelsPerUnit;
+		}
+		else transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Direction of the AO ray of CSRayMarchL.hlsl, against the density gradient
+//--------------------------------------------------------------------------------------
+static float3 GetAODirection(const QuantizedDensity& density, const float3& rayOrigin)
+{
+	const auto& gridSize = density.GetCodes().GetSize();
+	const auto uvw = rayOrigin * 0.5f + 0.5f;
+	const float3 dx(1.0f / gridSize.x, 0.0f, 0.0f), dy(0.0f, 1.0f / gridSize.y, 0.0f), dz(0.0f, 0.0f, 1.0f / gridSize.z);
+	const float3 gradient(density.Sample(uvw + dx) - density.Sample(uvw - dx),
+		density.Sample(uvw + dy) - density.Sample(uvw - dy), density.Sample(uvw + dz) - density.Sample(uvw - dz));
+
+	// Avoid 0-gradient caused by uniform density field
+	const auto hasGradient = gradient.x != 0.0f || gradient.y != 0.0f || gradient.z != 0.0f;
+
+	return normalize(hasGradient ? gradient * -1.0f : rayOrigin);
+}
+
+// Cell of the light map holding density, which casts the rays
+struct DenseCell
+{
+	float3 RayOrigin;
+	float3 RayDirs[NUM_LIGHT_RAY];
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance of the light map of CSRayMarchL.hlsl along one of its rays at each dense cell
+//--------------------------------------------------------------------------------------
+static void RayMarchL(ThreadPool* pThreadPool, vector<float>& lightMap, const QuantizedDensity& density,
+	const DensityMips& mips, const vector<DenseCell>& cells, LightRay ray, const LightFootprint& footprint,
+	atomic<uint64_t>& numSamples)
+{
+	pThreadPool->Dispatch(static_cast<uint32_t>(cells.size()), [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t n = 0;
+		for (auto i = begin; i < end; ++i)
+			lightMap[i] = CastLightRay(density, mips, cells[i].RayOrigin, cells[i].RayDirs[ray], footprint, n);
+		numSamples += n;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and generates the density
+// mips as the GPU does before rendering, then lights it with the shadow and AO rays of the
+// light map, marched at full resolution and cone-traced with each footprint schedule;
+// reports the density samples, the time and the transmittance error against full resolution
+//--------------------------------------------------------------------------------------
+int BenchCone(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The cone benchmark lights a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityMips mips;
+	density.Create(gridSize);
+	mips.Create(gridSize);
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, light samples: %u, mip levels: %u\n",
+		gridSize.x, gridSize.y, gridSize.z, pThreadPool->GetNumThreads(), numFrames, g_numLightSamples,
+		mips.GetNumLevels() + 1);
+
+	vector<DenseCell> cells;
+	vector<float> lightMaps[g_numFootprints][NUM_LIGHT_RAY];
+	ConeRun runs[g_numFootprints][NUM_LIGHT_RAY] = {};
+	auto mipTime = 0.0;
+	uint64_t numDenseCells = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+
+		const auto start = chrono::steady_clock::now();
+		mips.Generate(pThreadPool, fluid.GetColor());
+		const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		mipTime += duration.count();
+
+		// The cells casting rays, with the AO rays of every schedule along the same directions,
+		// of the full-resolution density
+		cells.clear();
+		for (auto z = 0u; z < gridSize.z; ++z)
+			for (auto y = 0u; y < gridSize.y; ++y)
+				for (auto x = 0u; x < gridSize.x; ++x)
+				{
+					DenseCell cell;
+					cell.RayOrigin = (float3(uint3(x, y, z)) + 0.5f) / float3(gridSize) * 2.0f - 1.0f;
+					if (density.Sample(cell.RayOrigin * 0.5f + 0.5f) < g_zeroThreshold) continue;
+
+					cell.RayDirs[LIGHT_RAY_SHADOW] = g_lightDir;
+					cell.RayDirs[LIGHT_RAY_AO] = GetAODirection(density, cell.RayOrigin);
+					cells.push_back(cell);
+				}
+		numDenseCells += cells.size();
+
+		for (uint8_t j = 0; j < g_numFootprints; ++j)
+		{
+			for (uint8_t k = 0; k < NUM_LIGHT_RAY; ++k)
+			{
+				auto& lightMap = lightMaps[j][k];
+				lightMap.resize(cells.size());
+
+				atomic<uint64_t> numSamples(0);
+				const auto start = chrono::steady_clock::now();
+				RayMarchL(pThreadPool, lightMap, density, mips, cells, static_cast<LightRay>(k), g_footprints[j], numSamples);
+				const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+				auto& run = runs[j][k];
+				run.Milliseconds += duration.count();
+				run.NumSamples += numSamples;
+
+				const auto& reference = lightMaps[0][k];
+				for (size_t c = 0; c < cells.size(); ++c)
+				{
+					const auto error = fabsf(lightMap[c] - reference[c]);
+					run.ErrorSum += error;
+					run.MaxError = (max)(error, run.MaxError);
+				}
+			}
+		}
+	}
+
+	// Per-frame means; the errors are over the dense cells, as the others cast no rays
+	printf("Mean per frame: mip generation %.3f ms, dense cells %.0f\n", mipTime / numFrames,
+		static_cast<double>(numDenseCells) / numFrames);
+	printf("%-5s %-10s %-7s %12s %9s %10s %12s %12s\n", "Ray", "Footprint", "Spread", "Samples", "Saved",
+		"Time (ms)", "Mean error", "Max error");
+	const char* rayNames[] = { "light", "AO" };
+	for (uint8_t k = 0; k < NUM_LIGHT_RAY; ++k)
+	{
+		for (uint8_t j = 0; j < g_numFootprints; ++j)
+		{
+			const auto& run = runs[j][k];
+			const auto saving = runs[0][k].NumSamples > 0 ?
+				1.0 - static_cast<double>(run.NumSamples) / runs[0][k].NumSamples : 0.0;
+			printf("%-5s %-10.2f %-7.3f %12.0f %8.2f%% %10.3f %12.4e %12.4e\n", rayNames[k],
+				g_footprints[j].Footprint, g_footprints[j].Spread, static_cast<double>(run.NumSamples) / numFrames,
+				saving * 100.0, run.Milliseconds / numFrames, numDenseCells > 0 ? run.ErrorSum / numDenseCells : 0.0,
+				run.MaxError);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
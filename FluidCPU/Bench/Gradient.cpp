@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "AmbientVolume.h"
+#include "Brick.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Divisors of the ambient volume against the grid: the gradient is evaluated at its texels
+static const uint3 g_divisors[] =
+{
+	uint3(1, 1, 1),
+	uint3(2, 2, 2)
+};
+
+// Cost model of the shaders, counted from the HLSL per thread: GetDensity of RayMarch.hlsli
+// takes a range load and a filtered fetch of R8 codes within a brick, and 8 code and 8 range
+// loads across bricks; CSDensityGradient.hlsl decodes its 6x6x6 tile with 64 threads and
+// writes an R8G8B8A8_SNORM texel, which GetDensityGradient then fetches filtered
+static const double g_sampleFetches = 2.0;
+static const double g_sampleBytes = 4.0 + 8.0 * 1.0;
+static const double g_sampleALU = 13.0;
+static const double g_crossSampleFetches = 16.0;
+static const double g_crossSampleBytes = 8.0 * (1.0 + 4.0);
+static const double g_crossSampleALU = 58.0;
+static const double g_gradientALU = 3.0;
+static const double g_tileLoads = 6.0 * 6.0 * 6.0 / 64.0;
+static const double g_buildFetches = 2.0 * g_tileLoads;
+static const double g_buildBytes = g_tileLoads * (1.0 + 4.0) + 4.0;
+static const double g_buildALU = g_tileLoads * 13.0 + 14.0;
+static const double g_cachedFetches = 1.0;
+static const double g_cachedBytes = 8.0 * 4.0;
+static const double g_cachedALU = 3.0;
+
+struct GradientRun
+{
+	double Milliseconds;
+	uint64_t NumEvals;
+	double NumFetches;
+	double NumBytes;
+	double NumALU;
+	double AngleSum;	// Of the AO rays against the direct evaluation, in degrees
+	float MaxAngle;
+	double MagnitudeErrorSum;
+};
+
+//--------------------------------------------------------------------------------------
+// Whether the trilinear footprint of GetDensity at uvw falls within one brick
+//--------------------------------------------------------------------------------------
+static bool IsWithinBrick(const uint3& gridSize, const float3& uvw)
+{
+	const auto extent = GetBrickExtent(gridSize);
+	const auto f = GetLinearFootprint(gridSize, uvw, AddressMode::CLAMP);
+
+	return f.x[0] / extent.x == f.x[1] / extent.x && f.y[0] / extent.y == f.y[1] / extent.y &&
+		f.z[0] / extent.z == f.z[1] / extent.z;
+}
+
+//--------------------------------------------------------------------------------------
+// Slices of the ambient volume of CSAmbient.hlsl refreshed this frame, each texel taking the
+// AO-ray direction from the 6 density samples of GetDensityGradient, or from the gradient
+// volume when given; the directions are kept for the errors
+//--------------------------------------------------------------------------------------
+static void EvaluateRayDirs(ThreadPool* pThreadPool, Grid3D<float3>& rayDirs, const AmbientVolume& volume,
+	const QuantizedDensity& density, const GradientVolume* pGradient, uint32_t sliceBegin, uint32_t sliceEnd)
+{
+	const auto& size = volume.GetSize();
+	pThreadPool->Dispatch(size.y * (sliceEnd - sliceBegin), [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 texel(x, i % size.y, sliceBegin + i / size.y);
+				const auto pos = volume.GetRayOrigin(texel);
+				rayDirs[texel] = pGradient ? AmbientVolume::GetRayDir(*pGradient, pos) :
+					AmbientVolume::GetRayDir(density, pos);
+			}
+		}
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density as the GPU does before
+// rendering, then evaluates the AO-ray directions of an ambient volume at each divisor, a
+// share of its slices per frame at the light-map refresh interval of the options, from 6
+// density samples per texel and from a gradient volume built once per frame; reports the
+// fetches, bytes and ALU per evaluation of the shader cost model, the cached ones with the
+// build amortized over the evaluations, the time and the angle and magnitude errors against
+// the direct evaluation
+//--------------------------------------------------------------------------------------
+int BenchGradient(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+	const auto interval = (max)(options.LightMapRefresh, 1u);
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The gradient benchmark shades a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	GradientVolume gradient;
+	density.Create(gridSize);
+	gradient.Create(gridSize);
+
+	// The divisor of the options or the defaults
+	vector<uint3> divisors;
+	const auto& divisor = options.AmbientDivisor;
+	if (divisor.x > 0 || divisor.y > 0 || divisor.z > 0)
+		divisors.emplace_back((max)(divisor.x, 1u), (max)(divisor.y, 1u), (max)(divisor.z, 1u));
+	else divisors.assign(begin(g_divisors), end(g_divisors));
+
+	const auto numVolumes = divisors.size();
+	vector<AmbientVolume> volumes(numVolumes);
+	vector<Grid3D<float3>> directDirs(numVolumes), cachedDirs(numVolumes);
+	for (size_t j = 0; j < numVolumes; ++j)
+	{
+		volumes[j].Create(gridSize, divisors[j]);
+		directDirs[j].Create(volumes[j].GetSize());
+		cachedDirs[j].Create(volumes[j].GetSize());
+	}
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, refresh interval: %u\n", gridSize.x, gridSize.y,
+		gridSize.z, pThreadPool->GetNumThreads(), numFrames, interval);
+
+	const auto numCells = static_cast<double>(gridSize.x) * gridSize.y * gridSize.z;
+	double buildMilliseconds = 0.0;
+	vector<GradientRun> directRuns(numVolumes, GradientRun()), cachedRuns(numVolumes, GradientRun());
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+
+		// Once per frame, shared by the ambient volumes
+		double buildTime;
+		{
+			const auto start = chrono::steady_clock::now();
+			gradient.Build(pThreadPool, density);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+			buildTime = duration.count();
+			buildMilliseconds += buildTime;
+		}
+
+		for (size_t j = 0; j < numVolumes; ++j)
+		{
+			// The first frame refreshes all, as the GPU after any change of the light probe
+			uint32_t sliceBegin, sliceEnd;
+			volumes[j].ScheduleRefresh(interval, i == 0, sliceBegin, sliceEnd);
+
+			auto& direct = directRuns[j];
+			auto& cached = cachedRuns[j];
+			{
+				const auto start = chrono::steady_clock::now();
+				EvaluateRayDirs(pThreadPool, directDirs[j], volumes[j], density, nullptr, sliceBegin, sliceEnd);
+				const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+				direct.Milliseconds += duration.count();
+			}
+
+			{
+				const auto start = chrono::steady_clock::now();
+				EvaluateRayDirs(pThreadPool, cachedDirs[j], volumes[j], density, &gradient, sliceBegin, sliceEnd);
+				const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+				cached.Milliseconds += duration.count() + buildTime;
+			}
+
+			// The cost model and the errors over the texels evaluated this frame
+			const auto& size = volumes[j].GetSize();
+			const auto numEvals = static_cast<uint64_t>(size.x) * size.y * (sliceEnd - sliceBegin);
+			direct.NumEvals += numEvals;
+			cached.NumEvals += numEvals;
+			cached.NumFetches += numEvals * g_cachedFetches + numCells * g_buildFetches;
+			cached.NumBytes += numEvals * g_cachedBytes + numCells * g_buildBytes;
+			cached.NumALU += numEvals * g_cachedALU + numCells * g_buildALU;
+			for (auto z = sliceBegin; z < sliceEnd; ++z)
+				for (auto y = 0u; y < size.y; ++y)
+					for (auto x = 0u; x < size.x; ++x)
+					{
+						const uint3 texel(x, y, z);
+						const auto pos = volumes[j].GetRayOrigin(texel);
+						const auto uvw = pos * 0.5f + 0.5f;
+						for (uint8_t k = 0; k < 6; ++k)
+						{
+							auto offset = float3(0.0f, 0.0f, 0.0f);
+							offset[k / 2] = (k & 1 ? 1.0f : -1.0f) / gridSize[k / 2];
+							const auto isWithinBrick = IsWithinBrick(gridSize, uvw + offset);
+							direct.NumFetches += isWithinBrick ? g_sampleFetches : g_crossSampleFetches;
+							direct.NumBytes += isWithinBrick ? g_sampleBytes : g_crossSampleBytes;
+							direct.NumALU += isWithinBrick ? g_sampleALU : g_crossSampleALU;
+						}
+						direct.NumALU += g_gradientALU;
+
+						const auto cosine = clamp(dot(directDirs[j][texel], cachedDirs[j][texel]), -1.0f, 1.0f);
+						const auto angle = acosf(cosine) * 180.0f / 3.14159265f;
+						cached.AngleSum += angle;
+						cached.MaxAngle = (max)(angle, cached.MaxAngle);
+
+						const auto magnitude = (min)(length(GradientVolume::Evaluate(density, uvw)), 1.0f);
+						cached.MagnitudeErrorSum += fabsf(length(gradient.Sample(uvw)) - magnitude);
+					}
+		}
+	}
+
+	// Per-frame means for the time, per evaluation for the rest
+	printf("Build per frame: %.3f ms; per texel: fetches %.2f, bytes %.2f, ALU %.1f\n",
+		buildMilliseconds / numFrames, g_buildFetches, g_buildBytes, g_buildALU);
+	printf("%-7s %-12s %10s %9s %9s %9s %10s %12s %12s %12s\n", "Pass", "Size", "Evals", "Fetches",
+		"Bytes", "ALU", "Time (ms)", "Mean angle", "Max angle", "Mag. error");
+	for (size_t j = 0; j < numVolumes; ++j)
+	{
+		const auto& size = volumes[j].GetSize();
+		char sizeName[32];
+		snprintf(sizeName, sizeof(sizeName), "%ux%ux%u", size.x, size.y, size.z);
+
+		const GradientRun* runs[] = { &directRuns[j], &cachedRuns[j] };
+		const char* names[] = { "direct", "cached" };
+		for (uint8_t k = 0; k < 2; ++k)
+		{
+			const auto& run = *runs[k];
+			const auto numEvals = static_cast<double>((max)(run.NumEvals, static_cast<uint64_t>(1)));
+			printf("%-7s %-12s %10.0f %9.2f %9.2f %9.1f %10.3f %12.4e %12.4e %12.4e\n", names[k], sizeName,
+				static_cast<double>(run.NumEvals) / numFrames, run.NumFetches / numEvals, run.NumBytes / numEvals,
+				run.NumALU / numEvals, run.Milliseconds / numFrames, run.AngleSum / numEvals, run.MaxAngle,
+				run.MagnitudeErrorSum / numEvals);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
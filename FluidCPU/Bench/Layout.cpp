@@ -0,0 +1,317 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "Sampler.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const uint8_t g_numRepeats = 3;
+static const uint8_t g_numLevels = 3;	// Quarter, half and full grid size
+
+//--------------------------------------------------------------------------------------
+// Last-level cache misses of the process, including the threads it starts afterwards;
+// negative where the hardware counter is unavailable, and GetStatus tells why
+//--------------------------------------------------------------------------------------
+class CacheMissCounter
+{
+public:
+	CacheMissCounter() : m_fd(-1), m_error(0)
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (m_fd < 0) m_error = errno;
+#endif
+	}
+
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (m_fd >= 0) close(m_fd);
+#endif
+	}
+
+	int64_t Read() const
+	{
+		int64_t count = -1;
+#ifdef __linux__
+		// Inherited counters of the worker threads are summed into the value
+		if (m_fd >= 0 && read(m_fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+#endif
+
+		return count;
+	}
+
+	// Why the counter is unavailable: the error of perf_event_open, and the level of
+	// perf_event_paranoid, which denies it to unprivileged processes above 2
+	string GetStatus() const
+	{
+		if (Read() >= 0) return "last level";
+
+#ifdef __linux__
+		string status = "unavailable (perf_event_open: ";
+		status += m_fd < 0 ? strerror(m_error) : "read failed";
+
+		auto paranoid = 0;
+		const auto pFile = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+		if (pFile && fscanf(pFile, "%d", &paranoid) == 1) status += ", perf_event_paranoid: " + to_string(paranoid);
+		if (pFile) fclose(pFile);
+
+		return status + ")";
+#else
+		return "unavailable (no perf_event_open)";
+#endif
+	}
+
+protected:
+	int m_fd;
+	int m_error;	// errno of perf_event_open
+};
+
+enum LayoutKernel : uint8_t
+{
+	KERNEL_JACOBI,	// Clamped-neighbor stencil of CSPoisson.hlsli
+	KERNEL_ADVECT,	// Trilinear back-trace of CSAdvect.hlsl
+
+	NUM_LAYOUT_KERNEL
+};
+
+static const char* g_kernelNames[] =
+{
+	"jacobi",
+	"advect"
+};
+
+static_assert(sizeof(g_kernelNames) / sizeof(g_kernelNames[0]) == NUM_LAYOUT_KERNEL, "Missing kernel name");
+
+struct KernelRun
+{
+	double Milliseconds;	// Best pass
+	double CacheMisses;		// Per cell and pass; negative if unavailable
+	double Checksum;
+};
+
+//--------------------------------------------------------------------------------------
+// Runs func(cell) for every cell, walking the tiles of the layout so that each thread
+// sweeps its storage in order
+//--------------------------------------------------------------------------------------
+template<typename Layout, typename Func>
+static void ForEachTileCell(ThreadPool* pThreadPool, const uint3& gridSize, const Layout& layout, const Func& func)
+{
+	const auto extent = layout.GetTileExtent();
+	const uint3 tileGridSize((gridSize.x + extent.x - 1) / extent.x, (gridSize.y + extent.y - 1) / extent.y,
+		(gridSize.z + extent.z - 1) / extent.z);
+	pThreadPool->Dispatch(tileGridSize.x * tileGridSize.y * tileGridSize.z, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const uint3 tileBegin(i % tileGridSize.x * extent.x, i / tileGridSize.x % tileGridSize.y * extent.y,
+				i / (tileGridSize.x * tileGridSize.y) * extent.z);
+			const uint3 tileEnd((min)(tileBegin.x + extent.x, gridSize.x),
+				(min)(tileBegin.y + extent.y, gridSize.y), (min)(tileBegin.z + extent.z, gridSize.z));
+
+			uint3 cell;
+			for (cell.z = tileBegin.z; cell.z < tileEnd.z; ++cell.z)
+				for (cell.y = tileBegin.y; cell.y < tileEnd.y; ++cell.y)
+					for (cell.x = tileBegin.x; cell.x < tileEnd.x; ++cell.x)
+						func(cell);
+		}
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Smooth, non-trivial inputs that are identical for every layout
+//--------------------------------------------------------------------------------------
+static float GetPattern(const uint3& cell, const uint3& gridSize)
+{
+	const auto uvw = (float3(cell) + 0.5f) / float3(gridSize);
+
+	return sinf(6.2831853f * uvw.x) * cosf(9.424778f * uvw.y) + 0.5f * sinf(12.566371f * uvw.z);
+}
+
+static float3 GetSwirl(const uint3& cell, const uint3& gridSize)
+{
+	// A few cells per step around the vertical axis, rising, as the plume of the demo
+	const auto pos = (float3(cell) + 0.5f) / float3(gridSize) * 2.0f - 1.0f;
+
+	return float3(-pos.z, 0.5f, gridSize.z > 1 ? pos.x : 0.0f) * 4.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// Times passes of a kernel on the grids of one layout; best of a few runs
+//--------------------------------------------------------------------------------------
+template<typename Layout>
+static KernelRun RunKernel(ThreadPool* pThreadPool, const CacheMissCounter& counter,
+	const uint3& gridSize, LayoutKernel kernel, uint32_t numPasses)
+{
+	Grid3D<float, Layout> x[2], b;
+	Grid3D<float3, Layout> velocity;
+	Grid3D<float4, Layout> color[2];
+	const auto isJacobi = kernel == KERNEL_JACOBI;
+	if (isJacobi)
+	{
+		x[0].Create(gridSize);
+		x[1].Create(gridSize);
+		b.Create(gridSize);
+	}
+	else
+	{
+		velocity.Create(gridSize);
+		color[0].Create(gridSize);
+		color[1].Create(gridSize);
+	}
+
+	uint3 cell;
+	for (cell.z = 0; cell.z < gridSize.z; ++cell.z)
+	{
+		for (cell.y = 0; cell.y < gridSize.y; ++cell.y)
+		{
+			for (cell.x = 0; cell.x < gridSize.x; ++cell.x)
+			{
+				const auto value = GetPattern(cell, gridSize);
+				if (isJacobi)
+				{
+					x[0][cell] = value;
+					b[cell] = 0.25f * value * value;
+				}
+				else
+				{
+					velocity[cell] = GetSwirl(cell, gridSize);
+					color[0][cell] = float4(saturate(value), 0.5f, 1.0f - saturate(value), saturate(value + 0.5f));
+				}
+			}
+		}
+	}
+
+	const auto numNeighbors = GetNumNeighbors(gridSize);
+	const auto& layout = isJacobi ? x[0].GetLayout() : color[0].GetLayout();
+	const auto pass = [&](uint32_t i)
+	{
+		const auto src = i & 1;
+		const auto dst = src ^ 1;
+		if (isJacobi)
+		{
+			ForEachTileCell(pThreadPool, gridSize, layout, [&](const uint3& cell)
+			{
+				size_t cells[NUM_NEIGHBOR];
+				x[src].GetNeighbors(cells, cell);
+				auto q = -b[cell];
+				for (uint8_t n = 0; n < numNeighbors; ++n) q += x[src][cells[n]];
+				x[dst][cell] = q / numNeighbors;
+			});
+		}
+		else
+		{
+			const auto texelSize = 1.0f / float3(gridSize);
+			ForEachTileCell(pThreadPool, gridSize, layout, [&](const uint3& cell)
+			{
+				const auto uvw = (float3(cell) + 0.5f) * texelSize - velocity[cell] * texelSize;
+				color[dst][cell] = SampleLinear(color[src], uvw, AddressMode::CLAMP);
+			});
+		}
+	};
+
+	KernelRun run = {};
+	auto cacheMisses = 0.0;
+	for (uint8_t r = 0; r < g_numRepeats; ++r)
+	{
+		const auto misses = counter.Read();
+		const auto start = chrono::steady_clock::now();
+		for (auto i = 0u; i < numPasses; ++i) pass(i);
+		const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		cacheMisses += counter.Read() - misses;
+
+		const auto elapsed = duration.count() / numPasses;
+		run.Milliseconds = r > 0 ? (min)(elapsed, run.Milliseconds) : elapsed;
+	}
+
+	const auto numCells = static_cast<double>(gridSize.x) * gridSize.y * gridSize.z;
+	run.CacheMisses = counter.Read() >= 0 ? cacheMisses / (numCells * numPasses * g_numRepeats) : -1.0;
+
+	// Same cells in the same order for every layout, so the checksums must match
+	const auto dst = numPasses & 1;
+	for (cell.z = 0; cell.z < gridSize.z; ++cell.z)
+		for (cell.y = 0; cell.y < gridSize.y; ++cell.y)
+			for (cell.x = 0; cell.x < gridSize.x; ++cell.x)
+				run.Checksum += isJacobi ? x[dst][cell] : color[dst][cell].w;
+
+	return run;
+}
+
+template<typename Layout>
+static void RunLayout(ThreadPool* pThreadPool, const CacheMissCounter& counter, const uint3& gridSize, uint32_t numPasses)
+{
+	const auto numCells = static_cast<double>(gridSize.x) * gridSize.y * gridSize.z;
+	for (uint8_t k = 0; k < NUM_LAYOUT_KERNEL; ++k)
+	{
+		const auto kernel = static_cast<LayoutKernel>(k);
+		const auto run = RunKernel<Layout>(pThreadPool, counter, gridSize, kernel, numPasses);
+
+		char size[32];
+		snprintf(size, sizeof(size), "%ux%ux%u", gridSize.x, gridSize.y, gridSize.z);
+		printf("%-12s %-8s %-8s %10.3f %12.2f", size, Layout::GetName(), g_kernelNames[kernel],
+			run.Milliseconds, numCells / run.Milliseconds / 1.0e3);
+		if (run.CacheMisses >= 0.0) printf(" %14.4f", run.CacheMisses);
+		else printf(" %14s", "n/a");
+		printf(" %16.8e\n", run.Checksum);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Runs the projection stencil and the advection back-trace on grids of each storage
+// layout at a quarter, half and the full grid size, and reports the throughput and the
+// last-level cache misses
+//--------------------------------------------------------------------------------------
+int BenchLayout(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numPasses = options.NumFrames > 0 ? options.NumFrames : 4;
+
+	// Opened before the workers start, so that they inherit the counter
+	CacheMissCounter counter;
+	ThreadPool threadPool;
+	if (!threadPool.Init(options.NumThreads))
+	{
+		fprintf(stderr, "Failed to start the threads\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Grid: %ux%ux%u, threads: %u, passes: %u, cache misses: %s\n", gridSize.x, gridSize.y, gridSize.z,
+		threadPool.GetNumThreads(), numPasses, counter.GetStatus().c_str());
+	printf("%-12s %-8s %-8s %10s %12s %14s %16s\n", "Grid", "Layout", "Kernel", "Time (ms)", "Mcells/s",
+		"Misses/cell", "Checksum");
+
+	const auto is3D = gridSize.z > 1;
+	for (auto level = g_numLevels; level-- > 0;)
+	{
+		const uint3 levelSize((max)(gridSize.x >> level, 1u), (max)(gridSize.y >> level, 1u),
+			is3D ? (max)(gridSize.z >> level, 2u) : 1);
+		RunLayout<LinearLayout>(&threadPool, counter, levelSize, numPasses);
+		RunLayout<BrickLayout<4>>(&threadPool, counter, levelSize, numPasses);
+		RunLayout<BrickLayout<8>>(&threadPool, counter, levelSize, numPasses);
+		RunLayout<MortonLayout>(&threadPool, counter, levelSize, numPasses);
+	}
+
+	return EXIT_SUCCESS;
+}
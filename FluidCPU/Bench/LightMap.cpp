@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "LightMap.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Divisors of the light map against the grid, after the reference at the grid resolution
+static const uint3 g_divisors[] =
+{
+	uint3(2, 2, 2),
+	uint3(3, 3, 3),
+	uint3(4, 4, 4),
+	uint3(8, 8, 8)
+};
+
+struct LightMapRun
+{
+	double Milliseconds;
+	uint64_t NumRays;
+	uint64_t NumSamples;
+	double ErrorSum;	// Against the reference, at the dense cells
+	float MaxError;
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static float CastLightRay(const QuantizedDensity& density, const float3& rayOrigin, uint64_t& numSamples)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + g_lightDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto d = density.Sample(pos * 0.5f + 0.5f);
+		++numSamples;
+
+		const auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Light map of CSRayMarchL.hlsl: the transmittance towards the light at every texel with
+// density under it, and none elsewhere
+//--------------------------------------------------------------------------------------
+static void RayMarchL(ThreadPool* pThreadPool, LightMap& lightMap, const QuantizedDensity& density,
+	const DensityPyramid& pyramid, atomic<uint64_t>& numRays, atomic<uint64_t>& numSamples)
+{
+	auto& texels = lightMap.GetTexels();
+	const auto& size = lightMap.GetSize();
+	pThreadPool->Dispatch(size.y * size.z, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t rays = 0, samples = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 texel(x, i % size.y, i / size.y);
+				const auto hasDensity = lightMap.HasDensity(density, pyramid, texel, g_zeroThreshold);
+				texels[texel] = hasDensity ? CastLightRay(density, lightMap.GetRayOrigin(texel), samples) : 1.0f;
+				rays += hasDensity ? 1 : 0;
+			}
+		}
+		numRays += rays;
+		numSamples += samples;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the brick
+// maxima as the GPU does before rendering, then lights it into a light map at the grid
+// resolution and at each divisor; reports the rays, the density samples, the time and the
+// error of the light that the view rays filter at the dense cells against the grid
+// resolution
+//--------------------------------------------------------------------------------------
+int BenchLightMap(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	// The reference, then the divisor of the options or the defaults
+	vector<uint3> divisors(1, uint3(1, 1, 1));
+	const auto& divisor = options.LightMapDivisor;
+	if (divisor.x > 0 || divisor.y > 0 || divisor.z > 0)
+		divisors.emplace_back((max)(divisor.x, 1u), (max)(divisor.y, 1u), (max)(divisor.z, 1u));
+	else divisors.insert(divisors.end(), begin(g_divisors), end(g_divisors));
+
+	const auto numMaps = divisors.size();
+	vector<LightMap> lightMaps(numMaps);
+	for (size_t j = 0; j < numMaps; ++j) lightMaps[j].Create(gridSize, divisors[j]);
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, light samples: %u\n", gridSize.x, gridSize.y, gridSize.z,
+		pThreadPool->GetNumThreads(), numFrames, g_numLightSamples);
+
+	vector<LightMapRun> runs(numMaps, LightMapRun());
+	uint64_t numDenseCells = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+
+		for (size_t j = 0; j < numMaps; ++j)
+		{
+			atomic<uint64_t> numRays(0), numSamples(0);
+			const auto start = chrono::steady_clock::now();
+			RayMarchL(pThreadPool, lightMaps[j], density, pyramid, numRays, numSamples);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+			auto& run = runs[j];
+			run.Milliseconds += duration.count();
+			run.NumRays += numRays;
+			run.NumSamples += numSamples;
+		}
+
+		// The reference texels are the cells, so the dense cells are the ones it cast rays at
+		const auto& reference = lightMaps[0];
+		for (auto z = 0u; z < gridSize.z; ++z)
+			for (auto y = 0u; y < gridSize.y; ++y)
+				for (auto x = 0u; x < gridSize.x; ++x)
+				{
+					const uint3 cell(x, y, z);
+					if (!reference.HasDensity(density, pyramid, cell, g_zeroThreshold)) continue;
+					++numDenseCells;
+
+					const auto uvw = reference.GetRayOrigin(cell) * 0.5f + 0.5f;
+					for (size_t j = 1; j < numMaps; ++j)
+					{
+						const auto error = fabsf(lightMaps[j].Sample(uvw) - reference.GetTexels()[cell]);
+						runs[j].ErrorSum += error;
+						runs[j].MaxError = (max)(error, runs[j].MaxError);
+					}
+				}
+	}
+
+	// Per-frame means; the errors are over the dense cells, which the view rays shade
+	printf("Mean per frame: dense cells %.0f\n", static_cast<double>(numDenseCells) / numFrames);
+	printf("%-9s %-12s %10s %12s %9s %10s %12s %12s\n", "Divisor", "Size", "Rays", "Samples", "Saved",
+		"Time (ms)", "Mean error", "Max error");
+	for (size_t j = 0; j < numMaps; ++j)
+	{
+		const auto& run = runs[j];
+		const auto& size = lightMaps[j].GetSize();
+		char divisorName[32], sizeName[32];
+		snprintf(divisorName, sizeof(divisorName), "%ux%ux%u", divisors[j].x, divisors[j].y, divisors[j].z);
+		snprintf(sizeName, sizeof(sizeName), "%ux%ux%u", size.x, size.y, size.z);
+		const auto saving = runs[0].NumSamples > 0 ?
+			1.0 - static_cast<double>(run.NumSamples) / runs[0].NumSamples : 0.0;
+		printf("%-9s %-12s %10.0f %12.0f %8.2f%% %10.3f %12.4e %12.4e\n", divisorName, sizeName,
+			static_cast<double>(run.NumRays) / numFrames, static_cast<double>(run.NumSamples) / numFrames,
+			saving * 100.0, run.Milliseconds / numFrames, numDenseCells > 0 ? run.ErrorSum / numDenseCells : 0.0,
+			run.MaxError);
+	}
+
+	return EXIT_SUCCESS;
+}
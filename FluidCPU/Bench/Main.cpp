@@ -0,0 +1,337 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Benchmarks.h"
+
+using namespace std;
+
+enum Benchmark : uint8_t
+{
+	BENCH_SIMULATE,
+	BENCH_POISSON,
+	BENCH_SHARPNESS,
+	BENCH_LAYOUT,
+	BENCH_SAMPLER,
+	BENCH_STORAGE,
+	BENCH_SKIPPING,
+	BENCH_CONE,
+	BENCH_LIGHT_MAP,
+	BENCH_SWEEP,
+	BENCH_REFRESH,
+	BENCH_AMBIENT,
+	BENCH_GRADIENT,
+	BENCH_CHECKERBOARD,
+
+	NUM_BENCHMARK
+};
+
+static const char* g_benchNames[] =
+{
+	"simulate",
+	"poisson",
+	"sharpness",
+	"layout",
+	"sampler",
+	"storage",
+	"skipping",
+	"cone",
+	"lightMap",
+	"sweep",
+	"refresh",
+	"ambient",
+	"gradient",
+	"checkerboard"
+};
+
+static const char* g_benchDescriptions[] =
+{
+	"Steps the frames and reports cells/second, the solver and sub-step statistics",
+	"Solves one frame's pressure with each solver from zero; residual reduction per ms",
+	"Runs both advection schemes at 1, 1/2 and 1/4 resolution; gradient and RMS errors",
+	"Projection stencil and back-trace on linear, brick and Morton grids; cache misses",
+	"Batched AVX2 and AVX-512 samplers against the scalar sampler",
+	"Ray marches RGBA32F, RGBA16F, split and 8-bit per-brick density; bytes and error",
+	"Ray marches with and without the max-density pyramid; fetches skipped and error",
+	"Shadow and AO rays at full resolution and cone-traced over the density mips",
+	"Light maps at the grid resolution and at divisors of it; rays, samples and error",
+	"Per-texel shadow rays against the slice sweep; samples, time and error",
+	"Full and round-robin light-map refreshes; time per frame, staleness and error",
+	"Per-sample AO rays against ambient volumes at divisors of the grid",
+	"AO directions from 6 density samples against the gradient volume; cost and error",
+	"Cube map marched in full and in a checkerboard of 2 and 4; saving and error"
+};
+
+static const char* g_projectionModeNames[] =
+{
+	"jacobi",
+	"multigridV",
+	"multigridF",
+	"dct",
+	"pcg",
+	"sor",
+	"jacobiAdaptive"
+};
+
+static const char* g_velocityLayoutNames[] =
+{
+	"collocated",
+	"staggered"
+};
+
+static const char* g_advectionSchemeNames[] =
+{
+	"semiLagrangian",
+	"maccormack"
+};
+
+static_assert(sizeof(g_benchNames) / sizeof(g_benchNames[0]) == NUM_BENCHMARK, "Missing benchmark name");
+static_assert(sizeof(g_benchDescriptions) / sizeof(g_benchDescriptions[0]) == NUM_BENCHMARK,
+	"Missing benchmark description");
+static_assert(sizeof(g_projectionModeNames) / sizeof(g_projectionModeNames[0]) == FluidCPU::NUM_PROJECTION_MODE,
+	"Missing projection mode name");
+static_assert(sizeof(g_velocityLayoutNames) / sizeof(g_velocityLayoutNames[0]) == FluidCPU::NUM_VELOCITY_LAYOUT,
+	"Missing velocity layout name");
+static_assert(sizeof(g_advectionSchemeNames) / sizeof(g_advectionSchemeNames[0]) == FluidCPU::NUM_ADVECTION_SCHEME,
+	"Missing advection scheme name");
+
+static bool IsArg(const char* arg, const char* name)
+{
+	return (arg[0] == '-' || arg[0] == '/') && strcmp(arg + 1, name) == 0;
+}
+
+template<size_t N>
+static bool ParseName(uint8_t& index, const char* arg, const char* (&names)[N])
+{
+	for (uint8_t i = 0; i < N; ++i)
+	{
+		if (strcmp(arg, names[i]) == 0)
+		{
+			index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool InitFluid(FluidCPU& fluid, const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	auto isValid = fluid.SetVelocityLayout(options.VelocityLayout) && fluid.SetAdvectionScheme(options.AdvectionScheme) &&
+		fluid.SetSparseBricks(options.IsSparse) && fluid.SetSplitDensity(options.IsSplitDensity) && fluid.Init(gridSize, options.NumThreads) && fluid.SetProjectionMode(options.ProjectionMode);
+	if (isValid && options.ProjectionMode == FluidCPU::PROJECT_JACOBI_ADAPTIVE)
+	{
+		isValid = fluid.SetAdaptiveBudget(options.Tolerance > 0.0f ? options.Tolerance : 0.1f,
+			options.MinIterations > 0 ? options.MinIterations : 4, options.MaxIterations > 0 ? options.MaxIterations : 64);
+	}
+	else if (isValid && (options.Tolerance > 0.0f || options.MaxIterations > 0))
+	{
+		const auto tolerance = options.Tolerance > 0.0f ? options.Tolerance : 1.0e-2f;
+		isValid = fluid.SetProjectionBudget(tolerance, options.MaxIterations > 0 ? options.MaxIterations : 128);
+	}
+	if (isValid && options.Omega > 0.0f) isValid = fluid.SetOverRelaxation(options.Omega);
+	if (isValid && options.PressureLevel > 0) isValid = fluid.SetPressureLevel(options.PressureLevel);
+	if (isValid && options.CFLNumber > 0.0f)
+		isValid = fluid.SetSubstepping(options.CFLNumber, options.MaxSubsteps > 0 ? options.MaxSubsteps : 4);
+
+	if (!isValid)
+	{
+		fprintf(stderr, "Failed to initialize a %ux%ux%u grid\n", gridSize.x, gridSize.y, gridSize.z);
+		return false;
+	}
+
+	return true;
+}
+
+const char* GetProjectionModeName(FluidCPU::ProjectionMode mode)
+{
+	return g_projectionModeNames[mode];
+}
+
+const char* GetVelocityLayoutName(FluidCPU::VelocityLayout layout)
+{
+	return g_velocityLayoutNames[layout];
+}
+
+const char* GetAdvectionSchemeName(FluidCPU::AdvectionScheme scheme)
+{
+	return g_advectionSchemeNames[scheme];
+}
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options = {};
+	options.GridSize = uint3(128, 128, 128);
+	options.ProjectionMode = FluidCPU::PROJECT_JACOBI;
+	options.VelocityLayout = FluidCPU::VELOCITY_COLLOCATED;
+	options.AdvectionScheme = FluidCPU::ADVECT_SEMI_LAGRANGIAN;
+	options.Sampler = GetSupportedSamplerISA();
+	uint8_t bench = BENCH_SIMULATE;
+	auto isValid = true;
+
+	for (auto i = 1; i < argc && isValid; ++i)
+	{
+		if (IsArg(argv[i], "gridSize"))
+		{
+			if (i + 1 < argc) options.GridSize.x = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.GridSize.y = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.GridSize.z = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "lightMapDivisor"))
+		{
+			if (i + 1 < argc) options.LightMapDivisor.x = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.LightMapDivisor.y = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.LightMapDivisor.z = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "ambientDivisor"))
+		{
+			if (i + 1 < argc) options.AmbientDivisor.x = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.AmbientDivisor.y = strtoul(argv[++i], nullptr, 10);
+			if (i + 1 < argc) options.AmbientDivisor.z = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "checkerboard"))
+		{
+			if (i + 1 < argc) options.Checkerboard = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "lightMapRefresh"))
+		{
+			if (i + 1 < argc) options.LightMapRefresh = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "frames"))
+		{
+			if (i + 1 < argc) options.NumFrames = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "threads"))
+		{
+			if (i + 1 < argc) options.NumThreads = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "timeStep"))
+		{
+			if (i + 1 < argc) options.TimeStep = strtof(argv[++i], nullptr);
+		}
+		else if (IsArg(argv[i], "tolerance"))
+		{
+			if (i + 1 < argc) options.Tolerance = strtof(argv[++i], nullptr);
+		}
+		else if (IsArg(argv[i], "minIterations"))
+		{
+			if (i + 1 < argc) options.MinIterations = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "maxIterations"))
+		{
+			if (i + 1 < argc) options.MaxIterations = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "omega"))
+		{
+			if (i + 1 < argc) options.Omega = strtof(argv[++i], nullptr);
+		}
+		else if (IsArg(argv[i], "pressureLevel"))
+		{
+			if (i + 1 < argc) options.PressureLevel = static_cast<uint8_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (IsArg(argv[i], "cfl"))
+		{
+			if (i + 1 < argc) options.CFLNumber = strtof(argv[++i], nullptr);
+		}
+		else if (IsArg(argv[i], "maxSubsteps"))
+		{
+			if (i + 1 < argc) options.MaxSubsteps = strtoul(argv[++i], nullptr, 10);
+		}
+		else if (IsArg(argv[i], "projection"))
+		{
+			uint8_t mode = 0;
+			isValid = i + 1 < argc && ParseName(mode, argv[++i], g_projectionModeNames);
+			options.ProjectionMode = static_cast<FluidCPU::ProjectionMode>(mode);
+		}
+		else if (IsArg(argv[i], "layout"))
+		{
+			uint8_t layout = 0;
+			isValid = i + 1 < argc && ParseName(layout, argv[++i], g_velocityLayoutNames);
+			options.VelocityLayout = static_cast<FluidCPU::VelocityLayout>(layout);
+		}
+		else if (IsArg(argv[i], "advection"))
+		{
+			uint8_t scheme = 0;
+			isValid = i + 1 < argc && ParseName(scheme, argv[++i], g_advectionSchemeNames);
+			options.AdvectionScheme = static_cast<FluidCPU::AdvectionScheme>(scheme);
+		}
+		else if (IsArg(argv[i], "sparse")) options.IsSparse = true;
+		else if (IsArg(argv[i], "split")) options.IsSplitDensity = true;
+		else if (IsArg(argv[i], "isa"))
+		{
+			isValid = false;
+			for (uint8_t j = 0; j < static_cast<uint8_t>(SamplerISA::NUM_SAMPLER_ISA) && i + 1 < argc && !isValid; ++j)
+			{
+				isValid = strcmp(argv[i + 1], GetSamplerISAName(static_cast<SamplerISA>(j))) == 0;
+				if (isValid) options.Sampler = static_cast<SamplerISA>(j);
+			}
+			++i;
+		}
+		else if (IsArg(argv[i], "bench"))
+		{
+			isValid = i + 1 < argc && ParseName(bench, argv[++i], g_benchNames);
+		}
+		else isValid = false;
+
+		if (!isValid)
+		{
+			printf("Usage: %s [-bench simulate|poisson|sharpness|layout|sampler|storage|skipping|cone|lightMap|sweep|refresh|ambient|gradient|checkerboard] [-gridSize x y z] [-frames n] [-threads n] [-timeStep dt]\n"
+				"\t[-projection jacobi|multigridV|multigridF|dct|pcg|sor|jacobiAdaptive] [-layout collocated|staggered]\n"
+				"\t[-advection semiLagrangian|maccormack] [-sparse] [-split] [-isa scalar|avx2|avx512]\n"
+				"\t[-tolerance t] [-minIterations n] [-maxIterations n] [-omega w] [-pressureLevel 0|1|2]\n"
+				"\t[-cfl c] [-maxSubsteps n] [-lightMapDivisor x y z] [-lightMapRefresh n] [-ambientDivisor x y z]\n"
+				"\t[-checkerboard 2|4]\n", argv[0]);
+			const auto isHelp = IsArg(argv[i], "h") || IsArg(argv[i], "help") || IsArg(argv[i], "?");
+			if (isHelp)
+			{
+				printf("Benchmarks (see Doc/FluidBench.md):\n");
+				for (uint8_t j = 0; j < NUM_BENCHMARK; ++j) printf("\t%-13s%s\n", g_benchNames[j], g_benchDescriptions[j]);
+			}
+
+			return isHelp ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	// Same default step as FluidX::OnUpdate
+	const auto& gridSize = options.GridSize;
+	if (options.TimeStep <= 0.0f) options.TimeStep = (gridSize.z > 1 ? 2.0f : 1.0f) / gridSize.y;
+
+	// Falls back to the widest supported instruction set
+	options.Sampler = SetSamplerISA(options.Sampler);
+
+	switch (bench)
+	{
+	case BENCH_POISSON:
+		return BenchPoisson(options);
+	case BENCH_SHARPNESS:
+		return BenchSharpness(options);
+	case BENCH_LAYOUT:
+		return BenchLayout(options);
+	case BENCH_SAMPLER:
+		return BenchSampler(options);
+	case BENCH_STORAGE:
+		return BenchStorage(options);
+	case BENCH_SKIPPING:
+		return BenchSkipping(options);
+	case BENCH_CONE:
+		return BenchCone(options);
+	case BENCH_LIGHT_MAP:
+		return BenchLightMap(options);
+	case BENCH_SWEEP:
+		return BenchSweep(options);
+	case BENCH_REFRESH:
+		return BenchRefresh(options);
+	case BENCH_AMBIENT:
+		return BenchAmbient(options);
+	case BENCH_GRADIENT:
+		return BenchGradient(options);
+	case BENCH_CHECKERBOARD:
+		return BenchCheckerboard(options);
+	default:
+		return BenchSimulate(options);
+	}
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "PoissonDCT.h"
+#include "PoissonJacobi.h"
+#include "PoissonMultigrid.h"
+#include "PoissonPCG.h"
+#include "PoissonSOR.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const uint8_t g_numRepeats = 3;
+
+struct SolverRun
+{
+	string Name;
+	unique_ptr<PoissonSolver> Solver;
+};
+
+static SolverRun MakeJacobi(uint32_t tileSize, uint32_t timeBlock)
+{
+	auto jacobi = make_unique<PoissonJacobi>();
+	jacobi->SetBlocking(tileSize, timeBlock);
+
+	char name[32];
+	if (timeBlock == 0) snprintf(name, sizeof(name), "Jacobi x64 (autotuned)");
+	else if (timeBlock == 1) snprintf(name, sizeof(name), "Jacobi x64");
+	else snprintf(name, sizeof(name), "Jacobi x64 tile %u T %u", tileSize, timeBlock);
+	SolverRun run = { name, move(jacobi) };
+
+	return run;
+}
+
+static SolverRun MakeDCT()
+{
+	SolverRun run = { "DCT direct", make_unique<PoissonDCT>() };
+
+	return run;
+}
+
+static SolverRun MakePCG(PoissonPCG::Preconditioner preconditioner, float tolerance)
+{
+	auto pcg = make_unique<PoissonPCG>();
+	pcg->SetPreconditioner(preconditioner);
+	pcg->SetTolerance(tolerance);
+	pcg->SetMaxIterations(1024);
+
+	char name[32];
+	snprintf(name, sizeof(name), "PCG %s (tol %.0e)", preconditioner == PoissonPCG::JACOBI ? "Jacobi" : "IC", tolerance);
+	SolverRun run = { name, move(pcg) };
+
+	return run;
+}
+
+static SolverRun MakeSOR(float omega, uint32_t numSweeps)
+{
+	auto sor = make_unique<PoissonSOR>();
+	sor->SetOmega(omega);
+	sor->SetNumSweeps(numSweeps);
+
+	char name[32];
+	snprintf(name, sizeof(name), "RB-SOR (w %.2f) x%u", omega, numSweeps);
+	SolverRun run = { name, move(sor) };
+
+	return run;
+}
+
+static SolverRun MakeMultigrid(PoissonMultigrid::CycleType cycleType, uint32_t numCycles)
+{
+	auto multigrid = make_unique<PoissonMultigrid>();
+	multigrid->SetCycleType(cycleType);
+	multigrid->SetNumCycles(numCycles);
+
+	SolverRun run = { string("Multigrid ") + (cycleType == PoissonMultigrid::F_CYCLE ? "F" : "V") +
+		"-cycle x" + to_string(numCycles), move(multigrid) };
+
+	return run;
+}
+
+//--------------------------------------------------------------------------------------
+// Solves the pressure equation of a simulated frame from a zero initial guess with each
+// solver, and reports the residual reduction per millisecond
+//--------------------------------------------------------------------------------------
+int BenchPoisson(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 8;
+
+	// Warm up the simulation for a realistic divergence field
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+	for (auto i = 0u; i < numFrames; ++i) fluid.Simulate(options.TimeStep);
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	const auto& b = fluid.GetDivergence();
+	Grid3D<float> x(gridSize, 0.0f);
+	const auto r0 = PoissonSolver::GetResidualNorm(pThreadPool, x, b);
+
+	printf("Grid: %ux%ux%u, threads: %u, warm-up frames: %u, initial RMS residual: %.4e\n",
+		gridSize.x, gridSize.y, gridSize.z, pThreadPool->GetNumThreads(), numFrames, r0);
+
+	vector<SolverRun> runs;
+	runs.emplace_back(MakeJacobi(0, 1));
+	runs.emplace_back(MakeJacobi(16, 4));
+	runs.emplace_back(MakeJacobi(32, 8));
+	runs.emplace_back(MakeJacobi(0, 0));
+	runs.emplace_back(MakeSOR(1.0f, 32));
+	runs.emplace_back(MakeSOR(1.0f, 64));
+	runs.emplace_back(MakeSOR(1.5f, 64));
+	runs.emplace_back(MakeSOR(1.8f, 64));
+	runs.emplace_back(MakeSOR(1.8f, 32));
+	runs.emplace_back(MakeMultigrid(PoissonMultigrid::V_CYCLE, 1));
+	runs.emplace_back(MakeMultigrid(PoissonMultigrid::V_CYCLE, 2));
+	runs.emplace_back(MakeMultigrid(PoissonMultigrid::V_CYCLE, 4));
+	runs.emplace_back(MakeMultigrid(PoissonMultigrid::F_CYCLE, 1));
+	runs.emplace_back(MakeMultigrid(PoissonMultigrid::F_CYCLE, 2));
+	runs.emplace_back(MakeDCT());
+	runs.emplace_back(MakePCG(PoissonPCG::JACOBI, 1.0e-2f));
+	runs.emplace_back(MakePCG(PoissonPCG::JACOBI, 1.0e-4f));
+	runs.emplace_back(MakePCG(PoissonPCG::INCOMPLETE_CHOLESKY, 1.0e-2f));
+	runs.emplace_back(MakePCG(PoissonPCG::INCOMPLETE_CHOLESKY, 1.0e-4f));
+
+	printf("%-24s %6s %10s %12s %12s %14s\n", "Solver", "Iters", "Time (ms)", "Residual", "Reduction", "Digits per ms");
+	for (auto& run : runs)
+	{
+		if (!run.Solver->Init(pThreadPool, gridSize)) return EXIT_FAILURE;
+
+		// Best of a few runs
+		auto numIterations = 0u;
+		auto elapsed = 0.0;
+		for (uint8_t i = 0; i < g_numRepeats; ++i)
+		{
+			x.Fill(0.0f);
+			const auto start = chrono::steady_clock::now();
+			numIterations = run.Solver->Solve(x, b);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+			elapsed = i > 0 ? (min)(duration.count(), elapsed) : duration.count();
+		}
+
+		const auto r = PoissonSolver::GetResidualNorm(pThreadPool, x, b);
+		const auto reduction = r0 / r;
+		printf("%-24s %6u %10.3f %12.4e %12.4g %14.4f\n", run.Name.c_str(), numIterations,
+			elapsed, r, reduction, log10(reduction) / elapsed);
+	}
+
+	return EXIT_SUCCESS;
+}
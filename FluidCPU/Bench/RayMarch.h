@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cmath>
+#include "ShaderMath.h"
+
+//--------------------------------------------------------------------------------------
+// Constants of the ray-march benchmarks, mirrored from RayMarch.hlsli and Fluid.cpp
+//--------------------------------------------------------------------------------------
+static const float		g_absorption = 0.8f;
+static const float		g_zeroThreshold = 0.01f;
+static const float		g_maxDist = 2.0f * 1.7320508f;
+static const uint32_t	g_numSamples = 192;
+static const uint32_t	g_numLightSamples = 64;
+static const float3		g_lightDir = float3(0.48f, 0.8f, -0.36f);	// Normalized
+
+//--------------------------------------------------------------------------------------
+// GetStep of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static inline float GetStep(float dDensity, float transm, float density, float step)
+{
+	const auto factorEv = (std::min)(1.0f / 256.0f / fabsf(dDensity), 2.0f);
+	const auto factorUi = (std::min)(1.0f - density, 1.0f);
+	const auto factorTh = 1.0f - transm;
+
+	return step * (std::max)(1.5f * factorEv * factorUi * factorTh, 1.0f);
+}
+
+static inline bool IsInside(const float3& pos)
+{
+	return fabsf(pos.x) <= 1.0f && fabsf(pos.y) <= 1.0f && fabsf(pos.z) <= 1.0f;
+}
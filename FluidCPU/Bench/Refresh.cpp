@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "LightMap.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Frames of a full refresh, after the reference refreshing every frame
+static const uint32_t g_intervals[] = { 2, 4, 8 };
+
+struct RefreshRun
+{
+	double Milliseconds;
+	double MaxMilliseconds;	// Of a frame
+	uint64_t NumSamples;
+	uint32_t MaxStaleFrames;
+	double ErrorSum;	// Against the reference, at the dense cells
+	float MaxError;
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static float CastLightRay(const QuantizedDensity& density, const float3& rayOrigin, uint64_t& numSamples)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + g_lightDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto d = density.Sample(pos * 0.5f + 0.5f);
+		++numSamples;
+
+		const auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Slices of the light map of CSRayMarchL.hlsl refreshed this frame; the others keep the
+// light of earlier frames
+//--------------------------------------------------------------------------------------
+static void RayMarchL(ThreadPool* pThreadPool, LightMap& lightMap, const QuantizedDensity& density,
+	const DensityPyramid& pyramid, uint32_t sliceBegin, uint32_t sliceEnd, atomic<uint64_t>& numSamples)
+{
+	auto& texels = lightMap.GetTexels();
+	const auto& size = lightMap.GetSize();
+	pThreadPool->Dispatch(size.y * (sliceEnd - sliceBegin), [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t samples = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 texel(x, i % size.y, sliceBegin + i / size.y);
+				texels[texel] = lightMap.HasDensity(density, pyramid, texel, g_zeroThreshold) ?
+					CastLightRay(density, lightMap.GetRayOrigin(texel), samples) : 1.0f;
+			}
+		}
+		numSamples += samples;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the brick
+// maxima as the GPU does before rendering, then refreshes a light map fully and, at each
+// interval, a round-robin share of its slices; reports the samples, the mean and max time
+// per frame, the staleness bound and the error of the light that the view rays filter at
+// the dense cells against the full refresh
+//--------------------------------------------------------------------------------------
+int BenchRefresh(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 32;
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The refresh benchmark lights a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	// The reference, then the interval of the options or the defaults
+	vector<uint32_t> intervals(1, 1);
+	if (options.LightMapRefresh > 1) intervals.push_back(options.LightMapRefresh);
+	else intervals.insert(intervals.end(), begin(g_intervals), end(g_intervals));
+
+	const auto& divisor = options.LightMapDivisor;
+	const uint3 lightMapDivisor((max)(divisor.x, 1u), (max)(divisor.y, 1u), (max)(divisor.z, 1u));
+	const auto numMaps = intervals.size();
+	vector<LightMap> lightMaps(numMaps);
+	vector<vector<uint32_t>> refreshFrames(numMaps);	// Last refresh of each slice
+	for (size_t j = 0; j < numMaps; ++j)
+	{
+		lightMaps[j].Create(gridSize, lightMapDivisor);
+		refreshFrames[j].assign(lightMaps[j].GetSize().z, 0);
+	}
+
+	const auto& size = lightMaps[0].GetSize();
+	printf("Grid: %ux%ux%u, light map: %ux%ux%u, threads: %u, frames: %u, light samples: %u\n",
+		gridSize.x, gridSize.y, gridSize.z, size.x, size.y, size.z, pThreadPool->GetNumThreads(),
+		numFrames, g_numLightSamples);
+
+	vector<RefreshRun> runs(numMaps, RefreshRun());
+	uint64_t numDenseCells = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+
+		for (size_t j = 0; j < numMaps; ++j)
+		{
+			// The first frame refreshes all, as the GPU after any change of the light
+			uint32_t sliceBegin, sliceEnd;
+			lightMaps[j].ScheduleRefresh(intervals[j], i == 0, sliceBegin, sliceEnd);
+
+			atomic<uint64_t> numSamples(0);
+			const auto start = chrono::steady_clock::now();
+			RayMarchL(pThreadPool, lightMaps[j], density, pyramid, sliceBegin, sliceEnd, numSamples);
+			const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+			auto& run = runs[j];
+			run.Milliseconds += duration.count();
+			if (i > 0) run.MaxMilliseconds = (max)(duration.count(), run.MaxMilliseconds);
+			run.NumSamples += numSamples;
+
+			auto& frames = refreshFrames[j];
+			for (auto s = sliceBegin; s < sliceEnd; ++s) frames[s] = i;
+			for (const auto& frame : frames) run.MaxStaleFrames = (max)(i - frame, run.MaxStaleFrames);
+		}
+
+		// The dense cells are the ones the view rays shade
+		const auto& reference = lightMaps[0];
+		for (auto z = 0u; z < gridSize.z; ++z)
+			for (auto y = 0u; y < gridSize.y; ++y)
+				for (auto x = 0u; x < gridSize.x; ++x)
+				{
+					const auto uvw = (float3(uint3(x, y, z)) + 0.5f) / float3(gridSize);
+					if (density.Sample(uvw) < g_zeroThreshold) continue;
+					++numDenseCells;
+
+					const auto light = reference.Sample(uvw);
+					for (size_t j = 1; j < numMaps; ++j)
+					{
+						const auto error = fabsf(lightMaps[j].Sample(uvw) - light);
+						runs[j].ErrorSum += error;
+						runs[j].MaxError = (max)(error, runs[j].MaxError);
+					}
+				}
+	}
+
+	// Per-frame means, past the full refresh of the first frame for the max time
+	printf("Mean per frame: dense cells %.0f\n", static_cast<double>(numDenseCells) / numFrames);
+	printf("%-9s %12s %9s %10s %10s %6s %12s %12s\n", "Interval", "Samples", "Saved", "Time (ms)",
+		"Max (ms)", "Stale", "Mean error", "Max error");
+	for (size_t j = 0; j < numMaps; ++j)
+	{
+		const auto& run = runs[j];
+		const auto saving = runs[0].NumSamples > 0 ?
+			1.0 - static_cast<double>(run.NumSamples) / runs[0].NumSamples : 0.0;
+		printf("%-9u %12.0f %8.2f%% %10.3f %10.3f %6u %12.4e %12.4e\n", intervals[j],
+			static_cast<double>(run.NumSamples) / numFrames, saving * 100.0, run.Milliseconds / numFrames,
+			run.MaxMilliseconds, run.MaxStaleFrames, numDenseCells > 0 ? run.ErrorSum / numDenseCells : 0.0,
+			run.MaxError);
+	}
+
+	return EXIT_SUCCESS;
+}
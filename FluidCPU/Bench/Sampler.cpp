@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "SamplerSIMD.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const uint8_t g_numRepeats = 3;
+static const uint32_t g_numBatchSamples = 64;	// As FluidCPU::advect
+
+//--------------------------------------------------------------------------------------
+// Samples every position in batches over the threads; best of a few runs in milliseconds
+//--------------------------------------------------------------------------------------
+template<typename R, typename T>
+static double TimeSampler(ThreadPool* pThreadPool, vector<R>& results, const Grid3D<T>& grid, const vector<float3>& positions)
+{
+	const auto numSamples = static_cast<uint32_t>(positions.size());
+	const auto numBatches = (numSamples + g_numBatchSamples - 1) / g_numBatchSamples;
+	results.resize(numSamples);
+
+	auto elapsed = 0.0;
+	for (uint8_t i = 0; i < g_numRepeats; ++i)
+	{
+		const auto start = chrono::steady_clock::now();
+		pThreadPool->Dispatch(numBatches, [&](uint32_t begin, uint32_t end)
+		{
+			for (auto b = begin; b < end; ++b)
+			{
+				const auto s = b * g_numBatchSamples;
+				SampleLinear(&results[s], grid, &positions[s], (min)(numSamples - s, g_numBatchSamples), AddressMode::MIRROR);
+			}
+		});
+		const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		elapsed = i > 0 ? (min)(duration.count(), elapsed) : duration.count();
+	}
+
+	return elapsed;
+}
+
+template<typename R>
+static bool IsBitwiseEqual(const vector<R>& a, const vector<R>& b)
+{
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(R)) == 0;
+}
+
+template<typename R, typename T>
+static void RunSampler(ThreadPool* pThreadPool, const char* format, const Grid3D<T>& grid, const vector<float3>& positions)
+{
+	vector<R> baseline, results;
+	auto baselineTime = 0.0;
+	for (uint8_t i = 0; i <= static_cast<uint8_t>(GetSupportedSamplerISA()); ++i)
+	{
+		const auto isa = SetSamplerISA(static_cast<SamplerISA>(i));
+		const auto isBaseline = isa == SamplerISA::SCALAR;
+		const auto elapsed = TimeSampler(pThreadPool, isBaseline ? baseline : results, grid, positions);
+		if (isBaseline) baselineTime = elapsed;
+
+		printf("%-8s %-8s %10.3f %12.2f %8.2fx %8s\n", format, GetSamplerISAName(isa), elapsed,
+			positions.size() / elapsed / 1.0e3, baselineTime / elapsed, isBaseline || IsBitwiseEqual(baseline, results) ? "yes" : "NO");
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Samples the velocity and color of a simulated frame at the back-traced positions of
+// every cell, with each instruction set up to the widest supported one, and reports the
+// speedup over the scalar sampler; the color is also sampled from RGBA16F, as the GPU
+// stores it
+//--------------------------------------------------------------------------------------
+int BenchSampler(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 8;
+	const auto isa = GetSamplerISA();
+
+	// Warm up the simulation for a realistic velocity field
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+	for (auto i = 0u; i < numFrames; ++i) fluid.Simulate(options.TimeStep);
+
+	const auto& velocity = fluid.GetVelocity();
+	const auto& color = fluid.GetColor();
+	Grid3D<half4> halfColor(gridSize);
+	for (size_t i = 0; i < color.GetStorageSize(); ++i) halfColor[i] = f32tof16(color[i]);
+
+	// Semi-Lagrangian back-trace of CSAdvect.hlsl
+	vector<float3> positions(color.GetNumCells());
+	const float3 cells(gridSize);
+	uint3 cell;
+	for (cell.z = 0; cell.z < gridSize.z; ++cell.z)
+		for (cell.y = 0; cell.y < gridSize.y; ++cell.y)
+			for (cell.x = 0; cell.x < gridSize.x; ++cell.x)
+				positions[velocity.Index(cell.x, cell.y, cell.z)] = (float3(cell) + 0.5f) / cells - velocity[cell] * options.TimeStep;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	printf("Grid: %ux%ux%u, threads: %u, warm-up frames: %u, widest ISA: %s\n", gridSize.x, gridSize.y, gridSize.z,
+		pThreadPool->GetNumThreads(), numFrames, GetSamplerISAName(GetSupportedSamplerISA()));
+	printf("%-8s %-8s %10s %12s %9s %8s\n", "Texel", "ISA", "Time (ms)", "Msamples/s", "Speedup", "Exact");
+	RunSampler<float3>(pThreadPool, "RGB32F", velocity, positions);
+	RunSampler<float4>(pThreadPool, "RGBA32F", color, positions);
+	RunSampler<float4>(pThreadPool, "RGBA16F", halfColor, positions);
+	SetSamplerISA(isa);
+
+	return EXIT_SUCCESS;
+}
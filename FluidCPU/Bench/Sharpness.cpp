@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const uint8_t g_numLevels = 3;	// Full, half and quarter resolution
+
+struct SharpnessRun
+{
+	FluidCPU::AdvectionScheme Scheme;
+	Grid3D<float> Density;
+	double Sharpness;
+	double Seconds;
+	uint32_t NumFrames;
+};
+
+static uint3 GetLevelSize(const uint3& gridSize, uint8_t level)
+{
+	const auto is3D = gridSize.z > 1;
+
+	return uint3(gridSize.x >> level, gridSize.y >> level, is3D ? gridSize.z >> level : 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Mean magnitude of the density gradient in simulation space; numerical diffusion
+// flattens the plume edges and lowers it
+//--------------------------------------------------------------------------------------
+static double GetSharpness(const Grid3D<float>& density)
+{
+	const auto& gridSize = density.GetSize();
+	const uint8_t numAxes = gridSize.z > 1 ? 3 : 2;
+
+	auto sum = 0.0;
+	uint3 cell;
+	for (cell.z = 0; cell.z < gridSize.z; ++cell.z)
+	{
+		for (cell.y = 0; cell.y < gridSize.y; ++cell.y)
+		{
+			for (cell.x = 0; cell.x < gridSize.x; ++cell.x)
+			{
+				auto sqLen = 0.0;
+				for (uint8_t i = 0; i < numAxes; ++i)
+				{
+					auto prev = cell, next = cell;
+					prev[i] = cell[i] > 0 ? cell[i] - 1 : 0;
+					next[i] = (min)(cell[i] + 1, gridSize[i] - 1);
+					const auto d = (density[next] - density[prev]) * 0.5 * gridSize[i];
+					sqLen += d * d;
+				}
+				sum += sqrt(sqLen);
+			}
+		}
+	}
+
+	return sum / density.GetNumCells();
+}
+
+//--------------------------------------------------------------------------------------
+// RMS difference against the reference, box-filtered down to the resolution of the run
+//--------------------------------------------------------------------------------------
+static double GetError(const Grid3D<float>& density, const Grid3D<float>& reference)
+{
+	const auto& gridSize = density.GetSize();
+	const auto& refSize = reference.GetSize();
+	const uint3 scale(refSize.x / gridSize.x, refSize.y / gridSize.y, refSize.z / gridSize.z);
+	const auto numTexels = scale.x * scale.y * scale.z;
+
+	auto sqSum = 0.0;
+	uint3 cell;
+	for (cell.z = 0; cell.z < gridSize.z; ++cell.z)
+	{
+		for (cell.y = 0; cell.y < gridSize.y; ++cell.y)
+		{
+			for (cell.x = 0; cell.x < gridSize.x; ++cell.x)
+			{
+				auto filtered = 0.0;
+				uint3 texel;
+				for (texel.z = 0; texel.z < scale.z; ++texel.z)
+					for (texel.y = 0; texel.y < scale.y; ++texel.y)
+						for (texel.x = 0; texel.x < scale.x; ++texel.x)
+							filtered += reference(cell.x * scale.x + texel.x, cell.y * scale.y + texel.y, cell.z * scale.z + texel.z);
+
+				const auto d = density[cell] - filtered / numTexels;
+				sqSum += d * d;
+			}
+		}
+	}
+
+	return sqrt(sqSum / density.GetNumCells());
+}
+
+//--------------------------------------------------------------------------------------
+// Runs each advection scheme over the same simulated time on the full grid and on coarser
+// grids at the same Courant number (MacCormack sub-steps at a CFL number of at most 1), and
+// compares the plume sharpness and the errors against the full-resolution run of each scheme;
+// neither is a converged solution, so a coarse run is only as good as a finer one if it is
+// close to both
+//--------------------------------------------------------------------------------------
+int BenchSharpness(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 64;
+	const auto is3D = gridSize.z > 1;
+	const auto numLevels = static_cast<uint8_t>(gridSize.x % (1u << (g_numLevels - 1)) == 0 &&
+		gridSize.y % (1u << (g_numLevels - 1)) == 0 && (!is3D || gridSize.z % (1u << (g_numLevels - 1)) == 0) ?
+		g_numLevels : 1);
+
+	vector<SharpnessRun> runs;
+	auto numThreads = options.NumThreads;
+	for (uint8_t level = 0; level < numLevels; ++level)
+	{
+		for (uint8_t scheme = 0; scheme < FluidCPU::NUM_ADVECTION_SCHEME; ++scheme)
+		{
+			auto levelOptions = options;
+			levelOptions.GridSize = GetLevelSize(gridSize, level);
+			levelOptions.TimeStep = options.TimeStep * (1u << level);
+			levelOptions.AdvectionScheme = static_cast<FluidCPU::AdvectionScheme>(scheme);
+
+			FluidCPU fluid;
+			if (!InitFluid(fluid, levelOptions)) return EXIT_FAILURE;
+			numThreads = fluid.GetThreadPool()->GetNumThreads();
+
+			SharpnessRun run = {};
+			run.Scheme = levelOptions.AdvectionScheme;
+			run.NumFrames = (max)(numFrames >> level, 1u);
+			const auto start = chrono::steady_clock::now();
+			for (auto i = 0u; i < run.NumFrames; ++i) fluid.Simulate(levelOptions.TimeStep);
+			const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			run.Seconds = elapsed.count();
+
+			const auto& color = fluid.GetColor();
+			run.Density.Create(color.GetSize());
+			for (size_t i = 0; i < color.GetStorageSize(); ++i) run.Density[i] = color[i].w;
+			run.Sharpness = GetSharpness(run.Density);
+			runs.push_back(move(run));
+		}
+	}
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, time step: %g, projection: %s, velocity: %s\n",
+		gridSize.x, gridSize.y, gridSize.z, numThreads, numFrames, options.TimeStep,
+		GetProjectionModeName(options.ProjectionMode), GetVelocityLayoutName(options.VelocityLayout));
+	printf("%-12s %-16s %8s %12s %12s %12s %12s\n", "Grid", "Advection", "Frames", "ms/frame", "Sharpness",
+		"RMS vs SL", "RMS vs MC");
+	for (const auto& run : runs)
+	{
+		const auto& runSize = run.Density.GetSize();
+		char grid[32];
+		snprintf(grid, sizeof(grid), "%ux%ux%u", runSize.x, runSize.y, runSize.z);
+		printf("%-12s %-16s %8u %12.3f %12.4f %12.4e %12.4e\n", grid, GetAdvectionSchemeName(run.Scheme), run.NumFrames,
+			run.Seconds * 1000.0 / run.NumFrames, run.Sharpness,
+			GetError(run.Density, runs[FluidCPU::ADVECT_SEMI_LAGRANGIAN].Density),
+			GetError(run.Density, runs[FluidCPU::ADVECT_MACCORMACK].Density));
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "Benchmarks.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Steps the full simulation and reports the throughput; a sparse run is followed by a dense
+// run of the same options, and reports its time and the differences of the last frame
+//--------------------------------------------------------------------------------------
+int BenchSimulate(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 100;
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	// Per-frame solver statistics; the residual is only tracked by PCG and adaptive Jacobi
+	auto numIterations = 0.0;
+	auto maxIterations = 0u;
+	auto maxResidual = -1.0f;
+	auto numCappedFrames = 0u;
+	auto divergenceError = 0.0;
+	auto maxDivergenceError = 0.0f;
+
+	// Sub-steps under the CFL number, which may cut the simulated time short of the frames
+	auto numSubsteps = 0.0;
+	auto maxSubsteps = 0u;
+	auto simulatedTime = 0.0;
+	auto maxCourant = 0.0f;
+
+	// Share of the bricks simulated in sparse mode
+	auto activeBricks = 0.0;
+	auto maxActiveBricks = 0.0f;
+
+	const auto start = chrono::steady_clock::now();
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+
+		const auto& stats = fluid.GetProjectionStats();
+		numIterations += stats.NumIterations;
+		maxIterations = (max)(stats.NumIterations, maxIterations);
+		maxResidual = (max)(stats.Residual, maxResidual);
+		numCappedFrames += stats.IsCapped ? 1 : 0;
+		divergenceError += stats.DivergenceError;
+		maxDivergenceError = (max)(stats.DivergenceError, maxDivergenceError);
+
+		const auto& stepStats = fluid.GetStepStats();
+		numSubsteps += stepStats.NumSubsteps;
+		maxSubsteps = (max)(stepStats.NumSubsteps, maxSubsteps);
+		simulatedTime += stepStats.NumSubsteps * stepStats.TimeStep;
+		maxCourant = (max)(stepStats.Courant, maxCourant);
+
+		activeBricks += fluid.GetActiveBrickFraction();
+		maxActiveBricks = (max)(fluid.GetActiveBrickFraction(), maxActiveBricks);
+	}
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	// Total density serves as a checksum for comparing runs
+	const auto& color = fluid.GetColor();
+	auto density = 0.0;
+	for (size_t i = 0; i < color.GetStorageSize(); ++i) density += color[i].w;
+
+	const auto numCells = static_cast<double>(gridSize.x) * gridSize.y * gridSize.z;
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, time step: %g, projection: %s", gridSize.x, gridSize.y, gridSize.z,
+		fluid.GetThreadPool()->GetNumThreads(), numFrames, options.TimeStep, GetProjectionModeName(options.ProjectionMode));
+	if (fluid.GetPressureLevel() > 0) printf(" at 1/%u resolution", 1u << fluid.GetPressureLevel());
+	printf(", velocity: %s, advection: %s, sampler: %s, color: %s\n", GetVelocityLayoutName(fluid.GetVelocityLayout()),
+		GetAdvectionSchemeName(fluid.GetAdvectionScheme()), GetSamplerISAName(GetSamplerISA()),
+		fluid.IsSplitDensity() ? "split" : "RGBA32F");
+	printf("Time: %.3f s (%.3f ms/frame)\n", elapsed.count(), elapsed.count() * 1000.0 / numFrames);
+	printf("Throughput: %.3f Mcells/s\n", numCells * numFrames / elapsed.count() / 1.0e6);
+	printf("Solver iterations: %.2f/frame (max %u)", numIterations / numFrames, maxIterations);
+	if (maxResidual >= 0.0f) printf(", max relative residual: %.4e", maxResidual);
+	if (numCappedFrames > 0) printf(", capped short of the tolerance in %u frames", numCappedFrames);
+	printf("\n");
+	printf("Divergence error: %.4e mean, %.4e max\n", divergenceError / numFrames, maxDivergenceError);
+	if (fluid.GetStepStats().CFLNumber > 0.0f)
+	{
+		printf("Sub-steps (CFL %g): %.2f/frame (max %u), max Courant: %.3f, simulated time: %.4g of %.4g\n",
+			fluid.GetStepStats().CFLNumber, numSubsteps / numFrames, maxSubsteps, maxCourant, simulatedTime,
+			static_cast<double>(options.TimeStep) * numFrames);
+	}
+	if (fluid.IsSparseBricks())
+		printf("Active bricks: %.2f%% mean, %.2f%% max\n", activeBricks * 100.0 / numFrames, maxActiveBricks * 100.0f);
+	printf("Total density: %.6g\n", density);
+
+	// The skipped cells are neither advected nor attenuated below the skipping thresholds, so
+	// the sparse run drifts from the dense one by a tolerance rather than round-off
+	if (fluid.IsSparseBricks())
+	{
+		auto denseOptions = options;
+		denseOptions.IsSparse = false;
+		FluidCPU dense;
+		if (!InitFluid(dense, denseOptions)) return EXIT_FAILURE;
+
+		const auto denseStart = chrono::steady_clock::now();
+		for (auto i = 0u; i < numFrames; ++i) dense.Simulate(options.TimeStep);
+		const chrono::duration<double> denseElapsed = chrono::steady_clock::now() - denseStart;
+
+		const auto& denseColor = dense.GetColor();
+		auto denseDensity = 0.0;
+		auto maxDensityDiff = 0.0f;
+		for (size_t i = 0; i < denseColor.GetStorageSize(); ++i)
+		{
+			denseDensity += denseColor[i].w;
+			maxDensityDiff = (max)(fabsf(color[i].w - denseColor[i].w), maxDensityDiff);
+		}
+
+		const auto& velocity = fluid.GetVelocity();
+		const auto& denseVelocity = dense.GetVelocity();
+		auto maxVelocityDiff = 0.0f;
+		for (size_t i = 0; i < denseVelocity.GetStorageSize(); ++i)
+			maxVelocityDiff = (max)(length(velocity[i] - denseVelocity[i]), maxVelocityDiff);
+
+		printf("Dense: %.3f ms/frame, total density: %.6g (%+.4f%%), max density diff: %.4e, max velocity diff: %.4e\n",
+			denseElapsed.count() * 1000.0 / numFrames, denseDensity, (density - denseDensity) / denseDensity * 100.0,
+			maxDensityDiff, maxVelocityDiff);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "DensityPyramid.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+// Density samples of the ray marches and the pyramid loads of their leaps; a thread counts
+// its own, then adds them up
+struct MarchCount
+{
+	uint64_t NumSamples = 0;
+	uint64_t NumLoads = 0;
+};
+
+struct MarchTotal
+{
+	atomic<uint64_t> NumSamples;
+	atomic<uint64_t> NumLoads;
+
+	MarchTotal() : NumSamples(0), NumLoads(0) {}
+	void Add(const MarchCount& count) { NumSamples += count.NumSamples; NumLoads += count.NumLoads; }
+};
+
+struct PassRun
+{
+	double Milliseconds;
+	uint64_t NumSamples;
+	uint64_t NumLoads;
+	float MaxError;		// Against the pass without skipping
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli; with a pyramid, the
+// cells without any density are leapt over in the steps that zero density would take
+//--------------------------------------------------------------------------------------
+static float CastLightRay(const QuantizedDensity& density, const DensityPyramid* pPyramid, const float3& rayOrigin,
+	MarchCount& count)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+	const auto dir = g_lightDir * 0.5f;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	auto isEmpty = true;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + g_lightDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto uvw = pos * 0.5f + 0.5f;
+		const auto emptyStep = GetStep(0.0f, transm, 0.0f, stepScale);
+		const auto numEmptySteps = pPyramid && isEmpty ?
+			pPyramid->GetEmptySteps(uvw, dir, emptyStep, 0.0f, count.NumLoads) : 0;
+		if (numEmptySteps > 0)
+		{
+			i += numEmptySteps - 1;
+			t += emptyStep * numEmptySteps;
+			continue;
+		}
+
+		const auto d = density.Sample(uvw);
+		isEmpty = d <= 0.0f;
+		++count.NumSamples;
+
+		const auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Light map of CSRayMarchL.hlsl: the transmittance towards the light at every dense cell
+//--------------------------------------------------------------------------------------
+static void RayMarchL(ThreadPool* pThreadPool, vector<float>& lightMap, const QuantizedDensity& density,
+	const DensityPyramid* pPyramid, MarchTotal& count)
+{
+	const auto& size = density.GetCodes().GetSize();
+	pThreadPool->Dispatch(size.y * size.z, [&](uint32_t begin, uint32_t end)
+	{
+		MarchCount n;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 cell(x, i % size.y, i / size.y);
+				const auto rayOrigin = (float3(cell) + 0.5f) / float3(size) * 2.0f - 1.0f;
+				const auto d = density.Sample(rayOrigin * 0.5f + 0.5f);
+				++n.NumSamples;
+
+				lightMap[i * size.x + x] = d >= g_zeroThreshold ? CastLightRay(density, pPyramid, rayOrigin, n) : 1.0f;
+			}
+		}
+		count.Add(n);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Opacity of the view rays of CSRayMarch.hlsl, down the z axis from every texel of the top
+// face; the empty samples step at the fixed step, which the leaps keep, so skipping them
+// leaves the samples of the dense cells where they were, up to the rounding of the ray
+// parameter
+//--------------------------------------------------------------------------------------
+static void RayMarch(ThreadPool* pThreadPool, vector<float>& image, const QuantizedDensity& density,
+	const DensityPyramid* pPyramid, MarchTotal& count)
+{
+	const auto& size = density.GetCodes().GetSize();
+	const auto stepScale = g_maxDist / g_numSamples;
+	const float3 dir(0.0f, 0.0f, -0.5f);
+	pThreadPool->Dispatch(size.y, [&](uint32_t begin, uint32_t end)
+	{
+		MarchCount n;
+		for (auto y = begin; y < end; ++y)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const float3 rayOrigin((x + 0.5f) / size.x * 2.0f - 1.0f, (y + 0.5f) / size.y * 2.0f - 1.0f, 1.0f);
+
+				auto opacity = 0.0f;
+				auto t = 0.0f;
+				auto prevDensity = 0.0f;
+				auto isEmpty = true;
+				for (auto i = 0u; i < g_numSamples; ++i)
+				{
+					const auto pos = rayOrigin - float3(0.0f, 0.0f, t);
+					if (!IsInside(pos)) break;
+
+					const auto uvw = pos * 0.5f + 0.5f;
+					const auto numEmptySteps = pPyramid && isEmpty ?
+						pPyramid->GetEmptySteps(uvw, dir, stepScale, g_zeroThreshold, n.NumLoads) : 0;
+					if (numEmptySteps > 0)
+					{
+						i += numEmptySteps - 1;
+						t += stepScale * numEmptySteps;
+						continue;
+					}
+
+					const auto d = density.Sample(uvw);
+					auto newStep = stepScale;
+					isEmpty = d <= g_zeroThreshold;
+					++n.NumSamples;
+
+					if (!isEmpty)
+					{
+						const auto transm = 1.0f - opacity;
+						newStep = GetStep(d - prevDensity, transm, d, stepScale);
+						prevDensity = d;
+
+						opacity += d * g_absorption * transm;
+						if (transm < g_zeroThreshold) break;
+					}
+
+					t += newStep;
+				}
+
+				image[y * size.x + x] = opacity;
+			}
+		}
+		count.Add(n);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Runs a pass with and without skipping, and the error of the skipping one
+//--------------------------------------------------------------------------------------
+template<typename Pass>
+static void RunPass(const Pass& pass, vector<float>& reference, vector<float>& result,
+	const DensityPyramid& pyramid, PassRun& fullRun, PassRun& skipRun)
+{
+	const DensityPyramid* pPyramids[] = { nullptr, &pyramid };
+	PassRun* pRuns[] = { &fullRun, &skipRun };
+	vector<float>* pResults[] = { &reference, &result };
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		MarchTotal count;
+		const auto start = chrono::steady_clock::now();
+		pass(*pResults[i], pPyramids[i], count);
+		const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		pRuns[i]->Milliseconds = duration.count();
+		pRuns[i]->NumSamples = count.NumSamples;
+		pRuns[i]->NumLoads = count.NumLoads;
+	}
+
+	skipRun.MaxError = 0.0f;
+	for (size_t i = 0; i < reference.size(); ++i)
+		skipRun.MaxError = (max)(fabsf(result[i] - reference[i]), skipRun.MaxError);
+}
+
+static double GetSaving(const PassRun& fullRun, const PassRun& skipRun)
+{
+	return 1.0 - static_cast<double>(skipRun.NumSamples + skipRun.NumLoads) / fullRun.NumSamples;
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the max-density
+// pyramid as the GPU does before rendering, then runs the light-map and view ray marches on
+// it with and without empty-space skipping; reports the density fetches of both, the pyramid
+// loads of the leaps and the fetches saved per frame
+//--------------------------------------------------------------------------------------
+int BenchSkipping(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, samples: %u view, %u light, pyramid levels: %u\n",
+		gridSize.x, gridSize.y, gridSize.z, pThreadPool->GetNumThreads(), numFrames, g_numSamples,
+		g_numLightSamples, pyramid.GetNumLevels());
+	printf("%-6s %-6s %12s %12s %10s %9s %10s %10s %12s\n", "Frame", "Pass", "Fetches", "Skipping", "Loads",
+		"Saved", "Time (ms)", "Skip (ms)", "Max error");
+
+	const auto numCells = static_cast<size_t>(gridSize.x) * gridSize.y * gridSize.z;
+	const auto numPixels = static_cast<size_t>(gridSize.x) * gridSize.y;
+	vector<float> lightMaps[2] = { vector<float>(numCells), vector<float>(numCells) };
+	vector<float> images[2] = { vector<float>(numPixels), vector<float>(numPixels) };
+	PassRun lightTotals[2] = {}, viewTotals[2] = {};
+	auto buildTime = 0.0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+
+		const auto start = chrono::steady_clock::now();
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+		const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		buildTime += duration.count();
+
+		PassRun lightRuns[2], viewRuns[2];
+		RunPass([&](vector<float>& lightMap, const DensityPyramid* pPyramid, MarchTotal& count)
+		{
+			RayMarchL(pThreadPool, lightMap, density, pPyramid, count);
+		}, lightMaps[0], lightMaps[1], pyramid, lightRuns[0], lightRuns[1]);
+		RunPass([&](vector<float>& image, const DensityPyramid* pPyramid, MarchTotal& count)
+		{
+			RayMarch(pThreadPool, image, density, pPyramid, count);
+		}, images[0], images[1], pyramid, viewRuns[0], viewRuns[1]);
+
+		const char* passes[] = { "light", "view" };
+		const PassRun* pRuns[] = { lightRuns, viewRuns };
+		PassRun* pTotals[] = { lightTotals, viewTotals };
+		for (uint8_t j = 0; j < 2; ++j)
+		{
+			const auto& fullRun = pRuns[j][0];
+			const auto& skipRun = pRuns[j][1];
+			printf("%-6u %-6s %12llu %12llu %10llu %8.2f%% %10.3f %10.3f %12.4e\n", i, passes[j],
+				static_cast<unsigned long long>(fullRun.NumSamples), static_cast<unsigned long long>(skipRun.NumSamples),
+				static_cast<unsigned long long>(skipRun.NumLoads), GetSaving(fullRun, skipRun) * 100.0,
+				fullRun.Milliseconds, skipRun.Milliseconds, skipRun.MaxError);
+
+			for (uint8_t k = 0; k < 2; ++k)
+			{
+				pTotals[j][k].Milliseconds += pRuns[j][k].Milliseconds;
+				pTotals[j][k].NumSamples += pRuns[j][k].NumSamples;
+				pTotals[j][k].NumLoads += pRuns[j][k].NumLoads;
+				pTotals[j][k].MaxError = (max)(pRuns[j][k].MaxError, pTotals[j][k].MaxError);
+			}
+		}
+	}
+
+	// Per-frame means; the pyramid build includes the quantization it follows
+	printf("Mean per frame: quantization and pyramid %.3f ms\n", buildTime / numFrames);
+	const char* passes[] = { "light", "view" };
+	const PassRun* pTotals[] = { lightTotals, viewTotals };
+	for (uint8_t j = 0; j < 2; ++j)
+	{
+		const auto& fullRun = pTotals[j][0];
+		const auto& skipRun = pTotals[j][1];
+		printf("%-6s %-6s %12.0f %12.0f %10.0f %8.2f%% %10.3f %10.3f %12.4e\n", "mean", passes[j],
+			static_cast<double>(fullRun.NumSamples) / numFrames, static_cast<double>(skipRun.NumSamples) / numFrames,
+			static_cast<double>(skipRun.NumLoads) / numFrames, GetSaving(fullRun, skipRun) * 100.0,
+			fullRun.Milliseconds / numFrames, skipRun.Milliseconds / numFrames, skipRun.MaxError);
+	}
+
+	return EXIT_SUCCESS;
+}
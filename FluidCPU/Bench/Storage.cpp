@@ -0,0 +1,441 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Brick.h"
+#include "QuantizedDensity.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+static const uint8_t g_numRepeats = 3;
+
+enum ColorStorage : uint8_t
+{
+	STORAGE_RGBA32F,	// Reference, as FluidCPU keeps the color
+	STORAGE_RGBA16F,	// Premultiplied color and density in one texel, as the GPU stored them before
+	STORAGE_SPLIT,		// R16F density and R10G10B10A2 UNORM albedo, as the GPU simulates them
+	STORAGE_QUANTIZED,	// 8-bit density per brick and the albedo, as the GPU ray marches them
+
+	NUM_COLOR_STORAGE
+};
+
+static const char* g_storageNames[] =
+{
+	"RGBA32F",
+	"RGBA16F",
+	"R16F+RGB10",
+	"R8+RGB10"
+};
+
+static_assert(sizeof(g_storageNames) / sizeof(g_storageNames[0]) == NUM_COLOR_STORAGE, "Missing storage name");
+
+// Bytes of a texel fetched for the density, and fetched in addition for the color
+static const uint32_t g_densityBytes[] = { sizeof(float4), sizeof(half4), sizeof(uint16_t), sizeof(uint8_t) };
+static const uint32_t g_colorBytes[] = { 0, 0, sizeof(uint32_t), sizeof(uint32_t) };
+static const uint32_t g_rangeBytes = 2 * sizeof(uint16_t);	// R16G16_FLOAT of a brick
+
+struct ColorVolumes
+{
+	Grid3D<float4>		Color;		// Premultiplied
+	Grid3D<half4>		HalfColor;	// Premultiplied
+	Grid3D<uint16_t>	Density;	// Half
+	Grid3D<uint32_t>	Albedo;		// R10G10B10A2 UNORM, unpremultiplied
+	QuantizedDensity	Quantized;
+};
+
+// Density samples and the bytes they fetch; a thread counts its own, then adds them up
+struct FetchCount
+{
+	uint64_t NumSamples = 0;
+	uint64_t NumBytes = 0;
+
+	void Add(uint32_t numBytes) { ++NumSamples; NumBytes += numBytes; }
+};
+
+struct FetchTotal
+{
+	atomic<uint64_t> NumSamples;
+	atomic<uint64_t> NumBytes;
+
+	FetchTotal() : NumSamples(0), NumBytes(0) {}
+	void Add(const FetchCount& count) { NumSamples += count.NumSamples; NumBytes += count.NumBytes; }
+};
+
+struct PassRun
+{
+	double Milliseconds;	// Best pass
+	double NumSamples;		// Density samples
+	double NumBytes;		// Fetched from the texels of the samples, and the brick ranges of the quantized density
+	float MeanError;		// Against the RGBA32F reference
+	float MaxError;			// A flip across the zero threshold of the light rays takes the whole transmittance
+};
+
+//--------------------------------------------------------------------------------------
+// Texel loads of each storage
+//--------------------------------------------------------------------------------------
+template<ColorStorage S>
+static inline float LoadDensity(const ColorVolumes& volumes, uint32_t x, uint32_t y, uint32_t z)
+{
+	switch (S)
+	{
+	case STORAGE_RGBA16F:
+		return f16tof32(volumes.HalfColor(x, y, z).w);
+	case STORAGE_SPLIT:
+		return f16tof32(volumes.Density(x, y, z));
+	case STORAGE_QUANTIZED:
+		return volumes.Quantized.Load(x, y, z);
+	default:
+		return volumes.Color(x, y, z).w;
+	}
+}
+
+// Premultiplied color, except for the albedo of the split storage
+template<ColorStorage S>
+static inline float3 LoadColor(const ColorVolumes& volumes, uint32_t x, uint32_t y, uint32_t z)
+{
+	switch (S)
+	{
+	case STORAGE_RGBA16F:
+		return f16tof32(volumes.HalfColor(x, y, z)).xyz();
+	case STORAGE_SPLIT:
+	case STORAGE_QUANTIZED:
+	{
+		const auto albedo = volumes.Albedo(x, y, z);
+
+		return float3(static_cast<float>(albedo & 0x3ff), static_cast<float>(albedo >> 10 & 0x3ff),
+			static_cast<float>(albedo >> 20 & 0x3ff)) / 1023.0f;
+	}
+	default:
+		return volumes.Color(x, y, z).xyz();
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Trilinear sampling with clamped addressing, as the ray-march sampler
+//--------------------------------------------------------------------------------------
+template<typename T, typename Load>
+static T SampleTexels(const uint3& size, const float3& uvw, const Load& load)
+{
+	const auto f = GetLinearFootprint(size, uvw, AddressMode::CLAMP);
+
+	T planes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		const auto row0 = load(f.x[0], f.y[0], f.z[k]) * (1.0f - f.wx) + load(f.x[1], f.y[0], f.z[k]) * f.wx;
+		const auto row1 = load(f.x[0], f.y[1], f.z[k]) * (1.0f - f.wx) + load(f.x[1], f.y[1], f.z[k]) * f.wx;
+		planes[k] = row0 * (1.0f - f.wy) + row1 * f.wy;
+	}
+
+	return planes[0] * (1.0f - f.wz) + planes[1] * f.wz;
+}
+
+// GetDensity of RayMarch.hlsli
+template<ColorStorage S>
+static inline float GetDensity(const ColorVolumes& volumes, const uint3& size, const float3& uvw)
+{
+	return SampleTexels<float>(size, uvw, [&](uint32_t x, uint32_t y, uint32_t z)
+	{
+		return LoadDensity<S>(volumes, x, y, z);
+	});
+}
+
+// GetColor of RayMarch.hlsli; the split storages filter the albedo and premultiply it after
+template<ColorStorage S>
+static inline float4 GetColor(const ColorVolumes& volumes, const uint3& size, const float3& uvw, float density)
+{
+	const auto color = SampleTexels<float3>(size, uvw, [&](uint32_t x, uint32_t y, uint32_t z)
+	{
+		return LoadColor<S>(volumes, x, y, z);
+	});
+
+	return float4(S >= STORAGE_SPLIT ? color * density : color, density);
+}
+
+// Bytes that a density sample fetches; the quantized density also fetches the range of each
+// brick that its footprint covers
+template<ColorStorage S>
+static inline uint32_t GetDensityBytes(const uint3& size, const float3& uvw)
+{
+	auto numBytes = 8 * g_densityBytes[S];
+	if (S == STORAGE_QUANTIZED)
+	{
+		const auto f = GetLinearFootprint(size, uvw, AddressMode::CLAMP);
+		const auto numX = f.x[0] / BrickSize == f.x[1] / BrickSize ? 1u : 2u;
+		const auto numY = f.y[0] / BrickSize == f.y[1] / BrickSize ? 1u : 2u;
+		const auto numZ = f.z[0] / BrickSize == f.z[1] / BrickSize ? 1u : 2u;
+		numBytes += numX * numY * numZ * g_rangeBytes;
+	}
+
+	return numBytes;
+}
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+template<ColorStorage S>
+static float CastLightRay(const ColorVolumes& volumes, const uint3& size, const float3& rayOrigin, FetchCount& count)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + g_lightDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto uvw = pos * 0.5f + 0.5f;
+		const auto density = GetDensity<S>(volumes, size, uvw);
+		count.Add(GetDensityBytes<S>(size, uvw));
+
+		const auto newStep = GetStep(density - prevDensity, transm, density, stepScale);
+		prevDensity = density;
+
+		transm *= 1.0f - density * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Light map of CSRayMarchL.hlsl: the transmittance towards the light at every dense cell
+//--------------------------------------------------------------------------------------
+template<ColorStorage S>
+static void RayMarchL(ThreadPool* pThreadPool, vector<float>& lightMap, const ColorVolumes& volumes,
+	const uint3& size, FetchTotal& count)
+{
+	pThreadPool->Dispatch(size.y * size.z, [&](uint32_t begin, uint32_t end)
+	{
+		FetchCount n;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 cell(x, i % size.y, i / size.y);
+				const auto rayOrigin = (float3(cell) + 0.5f) / float3(size) * 2.0f - 1.0f;
+				const auto uvw = rayOrigin * 0.5f + 0.5f;
+				const auto density = GetDensity<S>(volumes, size, uvw);
+				n.Add(GetDensityBytes<S>(size, uvw));
+
+				lightMap[i * size.x + x] = density >= g_zeroThreshold ? CastLightRay<S>(volumes, size, rayOrigin, n) : 1.0f;
+			}
+		}
+		count.Add(n);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// View rays of CSRayMarch.hlsl, down the z axis from every texel of the top face under a
+// white light; the color is only fetched where the density is not empty
+//--------------------------------------------------------------------------------------
+template<ColorStorage S>
+static void RayMarch(ThreadPool* pThreadPool, vector<float4>& image, const ColorVolumes& volumes,
+	const uint3& size, FetchTotal& count)
+{
+	const auto stepScale = g_maxDist / g_numSamples;
+	pThreadPool->Dispatch(size.y, [&](uint32_t begin, uint32_t end)
+	{
+		FetchCount n;
+		for (auto y = begin; y < end; ++y)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const float3 rayOrigin((x + 0.5f) / size.x * 2.0f - 1.0f, (y + 0.5f) / size.y * 2.0f - 1.0f, 1.0f);
+
+				float4 scatter(0.0f);
+				auto t = 0.0f;
+				auto prevDensity = 0.0f;
+				for (auto i = 0u; i < g_numSamples; ++i)
+				{
+					const auto pos = rayOrigin - float3(0.0f, 0.0f, t);
+					if (!IsInside(pos)) break;
+
+					const auto uvw = pos * 0.5f + 0.5f;
+					const auto density = GetDensity<S>(volumes, size, uvw);
+					auto newStep = stepScale;
+					n.Add(GetDensityBytes<S>(size, uvw));
+
+					// Skip empty space, where the color is not fetched
+					if (density > g_zeroThreshold)
+					{
+						const auto transm = 1.0f - scatter.w;
+						newStep = GetStep(density - prevDensity, transm, density, stepScale);
+						prevDensity = density;
+
+						scatter = scatter + GetColor<S>(volumes, size, uvw, density) * (g_absorption * transm);
+						n.NumBytes += 8 * g_colorBytes[S];
+
+						if (transm < g_zeroThreshold) break;
+					}
+
+					t += newStep;
+				}
+
+				image[y * size.x + x] = scatter;
+			}
+		}
+		count.Add(n);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Times the light and view passes on one storage; best of a few runs
+//--------------------------------------------------------------------------------------
+template<ColorStorage S>
+static void RunStorage(ThreadPool* pThreadPool, const ColorVolumes& volumes, vector<float>& lightMap,
+	vector<float4>& image, PassRun& lightRun, PassRun& viewRun)
+{
+	const auto& size = volumes.Color.GetSize();
+	for (uint8_t r = 0; r < g_numRepeats; ++r)
+	{
+		FetchTotal lightCount;
+		auto start = chrono::steady_clock::now();
+		RayMarchL<S>(pThreadPool, lightMap, volumes, size, lightCount);
+		chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+		lightRun.Milliseconds = r > 0 ? (min)(duration.count(), lightRun.Milliseconds) : duration.count();
+		lightRun.NumSamples = static_cast<double>(lightCount.NumSamples);
+		lightRun.NumBytes = static_cast<double>(lightCount.NumBytes);
+
+		FetchTotal viewCount;
+		start = chrono::steady_clock::now();
+		RayMarch<S>(pThreadPool, image, volumes, size, viewCount);
+		duration = chrono::steady_clock::now() - start;
+		viewRun.Milliseconds = r > 0 ? (min)(duration.count(), viewRun.Milliseconds) : duration.count();
+		viewRun.NumSamples = static_cast<double>(viewCount.NumSamples);
+		viewRun.NumBytes = static_cast<double>(viewCount.NumBytes);
+	}
+}
+
+static void PrintRun(const char* storage, const char* pass, const PassRun& run, const PassRun& baseline)
+{
+	printf("%-12s %-6s %10.3f %12.2f %12.2f %8.2fx %12.4e %12.4e\n", storage, pass, run.Milliseconds,
+		run.NumSamples / run.Milliseconds / 1.0e3, run.NumBytes / run.NumSamples,
+		baseline.NumBytes / run.NumBytes, run.MeanError, run.MaxError);
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume, then runs the light-map and view ray marches on its color in each
+// storage, reporting the fetched bytes and the error against RGBA32F; the quantized density
+// is that of the reference, as the GPU quantizes the density it simulated. Also compares
+// the simulation rounding its writes to the split storage with the RGBA32F one
+//--------------------------------------------------------------------------------------
+int BenchStorage(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 32;
+
+	FluidCPU fluid, splitFluid;
+	auto splitOptions = options;
+	splitOptions.IsSplitDensity = true;
+	auto referenceOptions = options;
+	referenceOptions.IsSplitDensity = false;
+	if (!InitFluid(fluid, referenceOptions) || !InitFluid(splitFluid, splitOptions)) return EXIT_FAILURE;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		splitFluid.Simulate(options.TimeStep);
+	}
+
+	// The storages of the reference color
+	ColorVolumes volumes;
+	volumes.Color = fluid.GetColor();
+	volumes.HalfColor.Create(gridSize);
+	volumes.Density.Create(gridSize);
+	volumes.Albedo.Create(gridSize);
+	volumes.Quantized.Create(gridSize);
+	volumes.Quantized.Quantize(fluid.GetThreadPool(), volumes.Color);
+	for (size_t i = 0; i < volumes.Color.GetStorageSize(); ++i)
+	{
+		const auto& color = volumes.Color[i];
+		volumes.HalfColor[i] = f32tof16(color);
+		volumes.Density[i] = f32tof16(color.w);
+
+		uint32_t albedo = 0;
+		if (color.w > 0.0f) for (uint8_t j = 0; j < 3; ++j)
+			albedo |= static_cast<uint32_t>(floorf(saturate(color[j] / color.w) * 1023.0f + 0.5f)) << (10 * j);
+		volumes.Albedo[i] = albedo;
+	}
+
+	// Simulations with either storage
+	const auto& splitColor = splitFluid.GetColor();
+	auto density = 0.0, splitDensity = 0.0;
+	auto maxDensityError = 0.0f;
+	for (size_t i = 0; i < splitColor.GetStorageSize(); ++i)
+	{
+		density += volumes.Color[i].w;
+		splitDensity += splitColor[i].w;
+		maxDensityError = (max)(fabsf(splitColor[i].w - volumes.Color[i].w), maxDensityError);
+	}
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, samples: %u view, %u light\n", gridSize.x, gridSize.y, gridSize.z,
+		pThreadPool->GetNumThreads(), numFrames, g_numSamples, g_numLightSamples);
+	printf("Simulated total density: %.6g RGBA32F, %.6g %s, max density difference: %.4e\n",
+		density, splitDensity, g_storageNames[STORAGE_SPLIT], maxDensityError);
+	printf("%-12s %-6s %10s %12s %12s %9s %12s %12s\n", "Storage", "Pass", "Time (ms)", "Msamples/s", "Bytes/sample",
+		"Saving", "Mean error", "Max error");
+
+	const auto numCells = volumes.Color.GetNumCells();
+	const auto numPixels = static_cast<size_t>(gridSize.x) * gridSize.y;
+	vector<float> lightMaps[NUM_COLOR_STORAGE];
+	vector<float4> images[NUM_COLOR_STORAGE];
+	PassRun lightRuns[NUM_COLOR_STORAGE] = {}, viewRuns[NUM_COLOR_STORAGE] = {};
+	for (uint8_t s = 0; s < NUM_COLOR_STORAGE; ++s)
+	{
+		lightMaps[s].resize(numCells);
+		images[s].resize(numPixels);
+		switch (s)
+		{
+		case STORAGE_RGBA16F:
+			RunStorage<STORAGE_RGBA16F>(pThreadPool, volumes, lightMaps[s], images[s], lightRuns[s], viewRuns[s]);
+			break;
+		case STORAGE_SPLIT:
+			RunStorage<STORAGE_SPLIT>(pThreadPool, volumes, lightMaps[s], images[s], lightRuns[s], viewRuns[s]);
+			break;
+		case STORAGE_QUANTIZED:
+			RunStorage<STORAGE_QUANTIZED>(pThreadPool, volumes, lightMaps[s], images[s], lightRuns[s], viewRuns[s]);
+			break;
+		default:
+			RunStorage<STORAGE_RGBA32F>(pThreadPool, volumes, lightMaps[s], images[s], lightRuns[s], viewRuns[s]);
+		}
+
+		auto errorSum = 0.0;
+		for (size_t i = 0; i < numCells; ++i)
+		{
+			const auto error = fabsf(lightMaps[s][i] - lightMaps[STORAGE_RGBA32F][i]);
+			lightRuns[s].MaxError = (max)(error, lightRuns[s].MaxError);
+			errorSum += error;
+		}
+		lightRuns[s].MeanError = static_cast<float>(errorSum / numCells);
+
+		errorSum = 0.0;
+		for (size_t i = 0; i < numPixels; ++i)
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				const auto error = fabsf(images[s][i][j] - images[STORAGE_RGBA32F][i][j]);
+				viewRuns[s].MaxError = (max)(error, viewRuns[s].MaxError);
+				errorSum += error;
+			}
+		viewRuns[s].MeanError = static_cast<float>(errorSum / (numPixels * 4));
+	}
+
+	// Savings of fetched bytes against the RGBA16F texels of the GPU before
+	for (uint8_t s = 0; s < NUM_COLOR_STORAGE; ++s)
+	{
+		PrintRun(g_storageNames[s], "light", lightRuns[s], lightRuns[STORAGE_RGBA16F]);
+		PrintRun(g_storageNames[s], "view", viewRuns[s], viewRuns[STORAGE_RGBA16F]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,264 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "LightMap.h"
+#include "Benchmarks.h"
+#include "RayMarch.h"
+
+using namespace std;
+
+enum LightPass : uint8_t
+{
+	LIGHT_RAY_MARCH,
+	LIGHT_SLICE_SWEEP,
+
+	NUM_LIGHT_PASS
+};
+
+struct SweepRun
+{
+	double Milliseconds;
+	uint64_t NumSamples;
+	double ErrorSum;	// Against the reference, at the dense cells
+	float MaxError;
+};
+
+//--------------------------------------------------------------------------------------
+// Transmittance along a light ray, as CastLightRay of RayMarch.hlsli
+//--------------------------------------------------------------------------------------
+static float CastLightRay(const QuantizedDensity& density, const float3& rayOrigin, uint64_t& numSamples)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+
+	auto transm = 1.0f;
+	auto t = stepScale;
+	auto prevDensity = 0.0f;
+	for (auto i = 0u; i < g_numLightSamples; ++i)
+	{
+		const auto pos = rayOrigin + g_lightDir * t;
+		if (!IsInside(pos)) break;
+
+		const auto d = density.Sample(pos * 0.5f + 0.5f);
+		++numSamples;
+
+		const auto newStep = GetStep(d - prevDensity, transm, d, stepScale);
+		prevDensity = d;
+
+		transm *= 1.0f - d * g_absorption;
+		if (transm < g_zeroThreshold) break;
+		t += newStep;
+	}
+
+	return transm;
+}
+
+//--------------------------------------------------------------------------------------
+// Light map of CSRayMarchL.hlsl: a light ray from every texel with density under it
+//--------------------------------------------------------------------------------------
+static void RayMarchL(ThreadPool* pThreadPool, LightMap& lightMap, const QuantizedDensity& density,
+	const DensityPyramid& pyramid, atomic<uint64_t>& numSamples)
+{
+	auto& texels = lightMap.GetTexels();
+	const auto& size = lightMap.GetSize();
+	pThreadPool->Dispatch(size.y * size.z, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t samples = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			for (auto x = 0u; x < size.x; ++x)
+			{
+				const uint3 texel(x, i % size.y, i / size.y);
+				texels[texel] = lightMap.HasDensity(density, pyramid, texel, g_zeroThreshold) ?
+					CastLightRay(density, lightMap.GetRayOrigin(texel), samples) : 1.0f;
+			}
+		}
+		numSamples += samples;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Light map of CSLightSweep.hlsl: slice by slice along the dominant axis of the light
+// direction, away from the light, each texel takes the transmittance of the previous slice
+// where its ray towards the light crosses it, attenuated by the density there over the
+// segment; every texel carries it on, with or without density
+//--------------------------------------------------------------------------------------
+static void SweepLight(ThreadPool* pThreadPool, LightMap& lightMap, const QuantizedDensity& density,
+	Grid3D<float> slices[2], atomic<uint64_t>& numSamples)
+{
+	const auto stepScale = g_maxDist / g_numLightSamples;
+	const float absDir[] = { fabsf(g_lightDir.x), fabsf(g_lightDir.y), fabsf(g_lightDir.z) };
+	const uint8_t axis = absDir[0] >= absDir[1] && absDir[0] >= absDir[2] ? 0 : (absDir[1] >= absDir[2] ? 1 : 2);
+	const auto isFromMax = g_lightDir[axis] > 0.0f;
+	const uint8_t planeX = (axis + 1) % 3, planeY = (axis + 2) % 3;
+
+	auto& texels = lightMap.GetTexels();
+	const auto& size = lightMap.GetSize();
+	const auto dirAxis = fabsf(g_lightDir[axis]);
+	const auto t = 2.0f / size[axis] / dirAxis;
+	const auto attenuationExp = t / stepScale;
+	for (auto s = 0u; s < size[axis]; ++s)
+	{
+		const auto& prev = slices[(s & 1) ^ 1];
+		auto& transms = slices[s & 1];
+		pThreadPool->Dispatch(size[planeY], [&](uint32_t begin, uint32_t end)
+		{
+			uint64_t samples = 0;
+			uint3 texel;
+			texel[axis] = isFromMax ? size[axis] - 1 - s : s;
+			for (texel[planeY] = begin; texel[planeY] < end; ++texel[planeY])
+			{
+				for (texel[planeX] = 0; texel[planeX] < size[planeX]; ++texel[planeX])
+				{
+					auto transm = 1.0f;
+					const auto pos = lightMap.GetRayOrigin(texel) + g_lightDir * t;
+					if (s > 0 && fabsf(pos[planeX]) <= 1.0f && fabsf(pos[planeY]) <= 1.0f)
+					{
+						// The slices are sized as the light map across the axis, so their
+						// filtering clamps as the texels of the shader
+						const float3 uvw(pos[planeX] * 0.5f + 0.5f, pos[planeY] * 0.5f + 0.5f, 0.5f);
+						const auto d = density.Sample(pos * 0.5f + 0.5f);
+						++samples;
+
+						transm = SampleLinear(prev, uvw, AddressMode::CLAMP) *
+							powf((max)(1.0f - d * g_absorption, 0.0f), attenuationExp);
+					}
+
+					transms[uint3(texel[planeX], texel[planeY], 0)] = transm;
+					texels[texel] = transm;
+				}
+			}
+			numSamples += samples;
+		});
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Simulates a plume and, after each frame, quantizes its density and builds the brick
+// maxima as the GPU does before rendering, then lights it into a light map with the
+// per-texel light rays and with the slice sweep, at the grid resolution and at the divisor
+// of the options if any; reports the density samples, the time and the error of the light
+// that the view rays filter at the dense cells against the light rays at the grid resolution
+//--------------------------------------------------------------------------------------
+int BenchSweep(const BenchOptions& options)
+{
+	const auto& gridSize = options.GridSize;
+	const auto numFrames = options.NumFrames > 0 ? options.NumFrames : 16;
+
+	if (gridSize.z < 2)
+	{
+		fprintf(stderr, "The sweep benchmark lights a 3D grid\n");
+		return EXIT_FAILURE;
+	}
+
+	FluidCPU fluid;
+	if (!InitFluid(fluid, options)) return EXIT_FAILURE;
+
+	const auto pThreadPool = fluid.GetThreadPool();
+	QuantizedDensity density;
+	DensityPyramid pyramid;
+	density.Create(gridSize);
+	pyramid.Create(gridSize);
+
+	// The reference resolution, then the divisor of the options
+	vector<uint3> divisors(1, uint3(1, 1, 1));
+	const auto& divisor = options.LightMapDivisor;
+	if (divisor.x > 1 || divisor.y > 1 || divisor.z > 1)
+		divisors.emplace_back((max)(divisor.x, 1u), (max)(divisor.y, 1u), (max)(divisor.z, 1u));
+
+	const auto numMaps = divisors.size();
+	vector<LightMap> lightMaps[NUM_LIGHT_PASS];
+	vector<SweepRun> runs[NUM_LIGHT_PASS];
+	Grid3D<float> slices[2];
+	for (uint8_t k = 0; k < NUM_LIGHT_PASS; ++k)
+	{
+		lightMaps[k].resize(numMaps);
+		runs[k].assign(numMaps, SweepRun());
+		for (size_t j = 0; j < numMaps; ++j) lightMaps[k][j].Create(gridSize, divisors[j]);
+	}
+
+	printf("Grid: %ux%ux%u, threads: %u, frames: %u, light samples: %u\n", gridSize.x, gridSize.y, gridSize.z,
+		pThreadPool->GetNumThreads(), numFrames, g_numLightSamples);
+
+	uint64_t numDenseCells = 0;
+	for (auto i = 0u; i < numFrames; ++i)
+	{
+		fluid.Simulate(options.TimeStep);
+		density.Quantize(pThreadPool, fluid.GetColor());
+		pyramid.Build(pThreadPool, density);
+
+		for (size_t j = 0; j < numMaps; ++j)
+		{
+			for (uint8_t k = 0; k < NUM_LIGHT_PASS; ++k)
+			{
+				auto& lightMap = lightMaps[k][j];
+				const auto& size = lightMap.GetSize();
+				const auto sliceSize = (max)((max)(size.x, size.y), size.z);
+				for (auto& slice : slices) slice.Create(uint3(sliceSize, sliceSize, 1));
+
+				atomic<uint64_t> numSamples(0);
+				const auto start = chrono::steady_clock::now();
+				if (k == LIGHT_SLICE_SWEEP) SweepLight(pThreadPool, lightMap, density, slices, numSamples);
+				else RayMarchL(pThreadPool, lightMap, density, pyramid, numSamples);
+				const chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+
+				auto& run = runs[k][j];
+				run.Milliseconds += duration.count();
+				run.NumSamples += numSamples;
+			}
+		}
+
+		// The reference texels are the cells, so the dense cells are the ones it cast rays at
+		const auto& reference = lightMaps[LIGHT_RAY_MARCH][0];
+		for (auto z = 0u; z < gridSize.z; ++z)
+			for (auto y = 0u; y < gridSize.y; ++y)
+				for (auto x = 0u; x < gridSize.x; ++x)
+				{
+					const uint3 cell(x, y, z);
+					if (!reference.HasDensity(density, pyramid, cell, g_zeroThreshold)) continue;
+					++numDenseCells;
+
+					const auto uvw = reference.GetRayOrigin(cell) * 0.5f + 0.5f;
+					for (uint8_t k = 0; k < NUM_LIGHT_PASS; ++k)
+					{
+						for (size_t j = 0; j < numMaps; ++j)
+						{
+							auto& run = runs[k][j];
+							const auto error = fabsf(lightMaps[k][j].Sample(uvw) - reference.GetTexels()[cell]);
+							run.ErrorSum += error;
+							run.MaxError = (max)(error, run.MaxError);
+						}
+					}
+				}
+	}
+
+	// Per-frame means; the errors are over the dense cells, which the view rays shade
+	printf("Mean per frame: dense cells %.0f\n", static_cast<double>(numDenseCells) / numFrames);
+	printf("%-6s %-12s %12s %9s %10s %12s %12s\n", "Pass", "Size", "Samples", "Saved", "Time (ms)",
+		"Mean error", "Max error");
+	const char* passNames[] = { "march", "sweep" };
+	for (size_t j = 0; j < numMaps; ++j)
+	{
+		for (uint8_t k = 0; k < NUM_LIGHT_PASS; ++k)
+		{
+			const auto& run = runs[k][j];
+			const auto& size = lightMaps[k][j].GetSize();
+			char sizeName[32];
+			snprintf(sizeName, sizeof(sizeName), "%ux%ux%u", size.x, size.y, size.z);
+			const auto& baseline = runs[LIGHT_RAY_MARCH][j];
+			const auto saving = baseline.NumSamples > 0 ?
+				1.0 - static_cast<double>(run.NumSamples) / baseline.NumSamples : 0.0;
+			printf("%-6s %-12s %12.0f %8.2f%% %10.3f %12.4e %12.4e\n", passNames[k], sizeName,
+				static_cast<double>(run.NumSamples) / numFrames, saving * 100.0, run.Milliseconds / numFrames,
+				numDenseCells > 0 ? run.ErrorSum / numDenseCells : 0.0, run.MaxError);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------------------------------
+// Bricks of the sparse passes, as in Brick.hlsli: BrickSize cells per edge (a single slice
+// in 2D), indexed linearly over the brick grid
+//--------------------------------------------------------------------------------------
+static const uint32_t BrickSize = 8;
+
+inline uint3 GetBrickExtent(const uint3& gridSize)
+{
+	return uint3(BrickSize, BrickSize, gridSize.z > 1 ? BrickSize : 1);
+}
+
+inline uint3 GetBrickGridSize(const uint3& gridSize)
+{
+	const auto extent = GetBrickExtent(gridSize);
+
+	return uint3((gridSize.x + extent.x - 1) / extent.x, (gridSize.y + extent.y - 1) / extent.y,
+		(gridSize.z + extent.z - 1) / extent.z);
+}
+
+//--------------------------------------------------------------------------------------
+// Runs func(i, begin, end) over the cells of the i-th listed brick, the CPU analog of an
+// indirect dispatch over the active bricks; a brick is never split between threads
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void ForEachBrick(ThreadPool* pThreadPool, const uint3& gridSize, const std::vector<uint32_t>& bricks, const Func& func)
+{
+	const auto extent = GetBrickExtent(gridSize);
+	const auto brickGridSize = GetBrickGridSize(gridSize);
+	pThreadPool->Dispatch(static_cast<uint32_t>(bricks.size()), [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto brick = bricks[i];
+			const uint3 brickBegin(brick % brickGridSize.x * extent.x, brick / brickGridSize.x % brickGridSize.y * extent.y,
+				brick / (brickGridSize.x * brickGridSize.y) * extent.z);
+			const uint3 brickEnd((std::min)(brickBegin.x + extent.x, gridSize.x),
+				(std::min)(brickBegin.y + extent.y, gridSize.y), (std::min)(brickBegin.z + extent.z, gridSize.z));
+			func(i, brickBegin, brickEnd);
+		}
+	});
+}
+
+template<typename Func>
+void ForEachBrickCell(ThreadPool* pThreadPool, const uint3& gridSize, const std::vector<uint32_t>& bricks, const Func& func)
+{
+	ForEachBrick(pThreadPool, gridSize, bricks, [&](uint32_t, const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x)
+					func(cell);
+	});
+}
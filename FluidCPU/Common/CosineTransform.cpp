@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "CosineTransform.h"
+
+using namespace std;
+
+static const double g_pi = 3.14159265358979323846;
+
+//--------------------------------------------------------------------------------------
+// Complex product without the inf/nan recovery of operator*, which is not inlined
+//--------------------------------------------------------------------------------------
+static inline complex<double> Mul(const complex<double>& a, const complex<double>& b)
+{
+	return complex<double>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+CosineTransform::CosineTransform() :
+	m_size(0),
+	m_maxFactor(0)
+{
+}
+
+CosineTransform::~CosineTransform()
+{
+}
+
+bool CosineTransform::Init(uint32_t size)
+{
+	if (size == 0) return false;
+
+	m_size = size;
+	m_twiddles.resize(size);
+	m_shifts.resize(size);
+	for (auto i = 0u; i < size; ++i)
+	{
+		m_twiddles[i] = polar(1.0, -2.0 * g_pi * i / size);
+		m_shifts[i] = polar(1.0, -g_pi * i / (2.0 * size));
+	}
+
+	// Radices 2, 3, 5 first, then any remaining primes (handled by plain DFT butterflies)
+	m_factors.clear();
+	auto n = size;
+	for (auto p = 2u; n > 1; p = p > 2 ? p + 2 : 3)
+	{
+		if (p * p > n) p = n;
+		while (n % p == 0)
+		{
+			m_factors.push_back(p);
+			n /= p;
+		}
+	}
+	if (m_factors.empty()) m_factors.push_back(1);
+	m_maxFactor = *max_element(m_factors.cbegin(), m_factors.cend());
+
+	return true;
+}
+
+void CosineTransform::Forward(double* pData, complex<double>* pWork) const
+{
+	const auto n = m_size;
+	if (n < 2) return;
+
+	// Even samples in order, then odd samples reversed
+	const auto pV = pWork;
+	for (auto i = 0u; i < (n + 1) / 2; ++i) pV[i] = pData[2 * i];
+	for (auto i = 0u; i < n / 2; ++i) pV[n - 1 - i] = pData[2 * i + 1];
+
+	const auto pF = pWork + n;
+	fft(pF, pV, n, 1, m_factors.data(), pWork + 2 * n);
+
+	for (auto k = 0u; k < n; ++k) pData[k] = pF[k].real() * m_shifts[k].real() - pF[k].imag() * m_shifts[k].imag();
+}
+
+void CosineTransform::Inverse(double* pData, complex<double>* pWork) const
+{
+	const auto n = m_size;
+	if (n < 2) return;
+
+	// Rebuild the half-sample-shifted spectrum, conjugated for an inverse FFT
+	const auto pV = pWork;
+	pV[0] = pData[0];
+	for (auto k = 1u; k < n; ++k) pV[k] = conj(Mul(conj(m_shifts[k]), complex<double>(pData[k], -pData[n - k])));
+
+	const auto pF = pWork + n;
+	fft(pF, pV, n, 1, m_factors.data(), pWork + 2 * n);
+
+	// Undo the reordering of Forward
+	for (auto i = 0u; i < (n + 1) / 2; ++i) pData[2 * i] = pF[i].real() / n;
+	for (auto i = 0u; i < n / 2; ++i) pData[2 * i + 1] = pF[n - 1 - i].real() / n;
+}
+
+uint32_t CosineTransform::GetSize() const
+{
+	return m_size;
+}
+
+size_t CosineTransform::GetWorkSize() const
+{
+	return 2 * static_cast<size_t>(m_size) + m_maxFactor;
+}
+
+void CosineTransform::fft(complex<double>* pOut, const complex<double>* pIn,
+	uint32_t n, size_t stride, const uint32_t* pFactors, complex<double>* pScratch) const
+{
+	// Decimation in time: p sub-transforms of length m over the strided input
+	const auto p = *pFactors;
+	const auto m = n / p;
+	if (m == 1) for (auto j = 0u; j < p; ++j) pOut[j] = pIn[j * stride];
+	else for (auto j = 0u; j < p; ++j) fft(pOut + j * m, pIn + j * stride, m, stride * p, pFactors + 1, pScratch);
+
+	// Butterflies; twiddles of length n are every (N / n)-th twiddle of length N
+	const auto twiddleStride = m_size / n;
+	if (p == 2)
+	{
+		for (auto k = 0u; k < m; ++k)
+		{
+			const auto t = Mul(pOut[k + m], m_twiddles[k * twiddleStride]);
+			pOut[k + m] = pOut[k] - t;
+			pOut[k] += t;
+		}
+	}
+	else
+	{
+		for (auto k = 0u; k < m; ++k)
+		{
+			for (auto j = 0u; j < p; ++j) pScratch[j] = pOut[j * m + k];
+			for (auto q = 0u; q < p; ++q)
+			{
+				const auto kq = k + q * m;
+				auto sum = pScratch[0];
+				for (auto j = 1u; j < p; ++j) sum += Mul(pScratch[j], m_twiddles[(static_cast<size_t>(j) * kq % n) * twiddleStride]);
+				pOut[kq] = sum;
+			}
+		}
+	}
+}
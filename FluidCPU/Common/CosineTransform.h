@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <cstdint>
+
+//--------------------------------------------------------------------------------------
+// Unnormalized DCT-II and its exact inverse (DCT-III) of a fixed length, computed
+// through a mixed-radix complex FFT of the same length (Makhoul's reordering)
+//--------------------------------------------------------------------------------------
+class CosineTransform
+{
+public:
+	CosineTransform();
+	virtual ~CosineTransform();
+
+	bool Init(uint32_t size);
+
+	// X[k] = sum(x[n] * cos(pi * k * (n + 0.5) / N)), in place; pWork holds GetWorkSize() elements
+	void Forward(double* pData, std::complex<double>* pWork) const;
+
+	// Inverse of Forward, in place
+	void Inverse(double* pData, std::complex<double>* pWork) const;
+
+	uint32_t GetSize() const;
+	size_t GetWorkSize() const;
+
+protected:
+	void fft(std::complex<double>* pOut, const std::complex<double>* pIn,
+		uint32_t n, size_t stride, const uint32_t* pFactors, std::complex<double>* pScratch) const;
+
+	std::vector<std::complex<double>>	m_twiddles;	// exp(-2 * pi * i * j / N)
+	std::vector<std::complex<double>>	m_shifts;	// exp(-pi * i * k / 2N)
+	std::vector<uint32_t>				m_factors;
+
+	uint32_t	m_size;
+	uint32_t	m_maxFactor;
+};
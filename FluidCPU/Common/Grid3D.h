@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "GridLayout.h"
+
+enum NeighborIndex : uint8_t
+{
+	NEIGHBOR_L,
+	NEIGHBOR_R,
+	NEIGHBOR_U,
+	NEIGHBOR_D,
+	NEIGHBOR_F,
+	NEIGHBOR_B,
+
+	NUM_NEIGHBOR
+};
+
+//--------------------------------------------------------------------------------------
+// Dense 3D grid, the CPU counterpart of a Texture3D with a single mip level; the layout
+// selects the storage order at compile time (see GridLayout.h)
+//--------------------------------------------------------------------------------------
+template<typename T, typename Layout = LinearLayout>
+class Grid3D
+{
+public:
+	Grid3D() : m_size(0, 0, 0) {}
+	Grid3D(const uint3& size, const T& value = T()) { Create(size, value); }
+
+	void Create(const uint3& size, const T& value = T())
+	{
+		m_size = size;
+		m_layout.Create(size);
+		m_data.assign(m_layout.GetStorageSize(), value);
+	}
+
+	void Fill(const T& value) { std::fill(m_data.begin(), m_data.end(), value); }
+	void Swap(Grid3D& grid)
+	{
+		m_data.swap(grid.m_data);
+		std::swap(m_size, grid.m_size);
+		std::swap(m_layout, grid.m_layout);
+	}
+
+	size_t Index(uint32_t x, uint32_t y, uint32_t z) const { return m_layout.Index(x, y, z); }
+
+	// Elements of the neighbors of a cell in the order of NeighborIndex, with clamped boundaries
+	void GetNeighbors(size_t cells[NUM_NEIGHBOR], const uint3& cell) const
+	{
+		const auto i = Index(cell.x, cell.y, cell.z);
+		cells[NEIGHBOR_L] = cell.x > 0 ? m_layout.Step(i, cell, 0, -1) : i;
+		cells[NEIGHBOR_R] = cell.x + 1 < m_size.x ? m_layout.Step(i, cell, 0, 1) : i;
+		cells[NEIGHBOR_U] = cell.y > 0 ? m_layout.Step(i, cell, 1, -1) : i;
+		cells[NEIGHBOR_D] = cell.y + 1 < m_size.y ? m_layout.Step(i, cell, 1, 1) : i;
+		cells[NEIGHBOR_F] = cell.z > 0 ? m_layout.Step(i, cell, 2, -1) : i;
+		cells[NEIGHBOR_B] = cell.z + 1 < m_size.z ? m_layout.Step(i, cell, 2, 1) : i;
+	}
+
+	T& operator()(uint32_t x, uint32_t y, uint32_t z) { return m_data[Index(x, y, z)]; }
+	const T& operator()(uint32_t x, uint32_t y, uint32_t z) const { return m_data[Index(x, y, z)]; }
+	T& operator[](const uint3& idx) { return (*this)(idx.x, idx.y, idx.z); }
+	const T& operator[](const uint3& idx) const { return (*this)(idx.x, idx.y, idx.z); }
+	T& operator[](size_t i) { return m_data[i]; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+
+	T* GetData() { return m_data.data(); }
+	const T* GetData() const { return m_data.data(); }
+	const uint3& GetSize() const { return m_size; }
+	const Layout& GetLayout() const { return m_layout; }
+	size_t GetNumCells() const { return static_cast<size_t>(m_size.x) * m_size.y * m_size.z; }
+	size_t GetStorageSize() const { return m_data.size(); }	// Including the padding of a tiled layout
+
+protected:
+	std::vector<T>	m_data;
+	uint3			m_size;
+	Layout			m_layout;
+};
@@ -0,0 +1,157 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include "ShaderMath.h"
+
+//--------------------------------------------------------------------------------------
+// Storage orders of Grid3D. A layout maps a cell to its element in the storage, which
+// may be padded, steps from an element to that of an adjacent cell along an axis, and
+// names the tile that a kernel should traverse to walk the storage in order.
+//--------------------------------------------------------------------------------------
+
+// Rows of x, then y and z, as a Texture3D is addressed
+class LinearLayout
+{
+public:
+	static const char* GetName() { return "linear"; }
+
+	void Create(const uint3& size) { m_size = size; }
+
+	size_t Index(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return (static_cast<size_t>(z) * m_size.y + y) * m_size.x + x;
+	}
+
+	size_t Step(size_t i, const uint3&, uint8_t axis, int32_t delta) const
+	{
+		const auto stride = axis > 0 ? (axis > 1 ? static_cast<size_t>(m_size.x) * m_size.y : m_size.x) : 1;
+
+		return delta > 0 ? i + stride : i - stride;
+	}
+
+	size_t GetStorageSize() const { return static_cast<size_t>(m_size.x) * m_size.y * m_size.z; }
+	uint3 GetTileExtent() const { return uint3(m_size.x, 1, 1); }
+
+protected:
+	uint3 m_size;
+};
+
+// Bricks of N^3 cells (N^2 in 2D) stored contiguously with their cells in linear order,
+// and the bricks in linear order over the grid padded to whole bricks
+template<uint32_t N>
+class BrickLayout
+{
+public:
+	static_assert(N > 1 && (N & (N - 1)) == 0, "The brick size must be a power of two");
+
+	static const char* GetName() { return N == 4 ? "brick4" : (N == 8 ? "brick8" : "brick"); }
+
+	void Create(const uint3& size)
+	{
+		const auto depth = size.z > 1 ? N : 1;
+		m_brickGridSize = uint3((size.x + N - 1) / N, (size.y + N - 1) / N, (size.z + depth - 1) / depth);
+		m_depthMask = depth - 1;
+		m_depthShift = size.z > 1 ? s_shift : 0;
+	}
+
+	size_t Index(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		const auto brick = (static_cast<size_t>(z >> m_depthShift) * m_brickGridSize.y + (y >> s_shift)) *
+			m_brickGridSize.x + (x >> s_shift);
+		const auto cell = (((z & m_depthMask) << s_shift | (y & s_mask)) << s_shift) | (x & s_mask);
+
+		return (brick << (2 * s_shift + m_depthShift)) | cell;
+	}
+
+	size_t Step(size_t i, const uint3& cell, uint8_t axis, int32_t delta) const
+	{
+		// Within the brick, the cells are linear
+		const auto local = cell[axis] & (axis > 1 ? m_depthMask : s_mask);
+		if (delta > 0 ? local < (axis > 1 ? m_depthMask : s_mask) : local > 0)
+		{
+			const auto stride = static_cast<size_t>(1) << (s_shift * axis);
+
+			return delta > 0 ? i + stride : i - stride;
+		}
+
+		auto neighbor = cell;
+		neighbor[axis] += delta;
+
+		return Index(neighbor.x, neighbor.y, neighbor.z);
+	}
+
+	size_t GetStorageSize() const
+	{
+		return static_cast<size_t>(m_brickGridSize.x) * m_brickGridSize.y * m_brickGridSize.z * N * N * (m_depthMask + 1);
+	}
+
+	uint3 GetTileExtent() const { return uint3(N, N, m_depthMask + 1); }
+
+protected:
+	static const uint32_t s_shift = N == 2 ? 1 : (N == 4 ? 2 : (N == 8 ? 3 : (N == 16 ? 4 : 5)));
+	static const uint32_t s_mask = N - 1;
+
+	uint3		m_brickGridSize;
+	uint32_t	m_depthMask;
+	uint32_t	m_depthShift;
+};
+
+// Z-order curve over the grid padded to powers of two per axis; the bits of x, y and z
+// are interleaved in turn until an axis runs out of them, so a flat grid is not padded
+// to a cube. The index is separable, and each axis looks its bits up in a table.
+class MortonLayout
+{
+public:
+	static const char* GetName() { return "morton"; }
+
+	void Create(const uint3& size)
+	{
+		uint8_t numBits[3];
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			numBits[i] = 0;
+			while ((1u << numBits[i]) < size[i]) ++numBits[i];
+			m_offsets[i].assign(size[i], 0);
+		}
+
+		auto bit = 0u;
+		m_masks[0] = m_masks[1] = m_masks[2] = 0;
+		for (uint8_t b = 0; b < 32; ++b)
+		{
+			for (uint8_t i = 0; i < 3; ++i)
+			{
+				if (b >= numBits[i]) continue;
+				for (auto j = 0u; j < size[i]; ++j)
+					m_offsets[i][j] |= static_cast<size_t>(j >> b & 1) << bit;
+				m_masks[i] |= static_cast<size_t>(1) << bit++;
+			}
+		}
+
+		m_storageSize = static_cast<size_t>(1) << bit;
+		m_tileExtent = uint3((std::min)(8u, size.x), (std::min)(8u, size.y), (std::min)(8u, size.z));
+	}
+
+	size_t Index(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return m_offsets[0][x] | m_offsets[1][y] | m_offsets[2][z];
+	}
+
+	size_t Step(size_t i, const uint3& cell, uint8_t axis, int32_t delta) const
+	{
+		// Only the bits of the axis change
+		return (i & ~m_masks[axis]) | m_offsets[axis][cell[axis] + delta];
+	}
+
+	size_t GetStorageSize() const { return m_storageSize; }
+	uint3 GetTileExtent() const { return m_tileExtent; }	// Aligned 8^3 blocks are contiguous
+
+protected:
+	std::vector<size_t>	m_offsets[3];
+	size_t				m_masks[3];
+	size_t				m_storageSize;
+	uint3				m_tileExtent;
+};
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Grid3D.h"
+
+enum class AddressMode : uint8_t
+{
+	CLAMP,
+	MIRROR
+};
+
+//--------------------------------------------------------------------------------------
+// Apply the texture address mode to a texel index
+//--------------------------------------------------------------------------------------
+inline uint32_t AddressTexel(int32_t i, int32_t n, AddressMode mode)
+{
+	if (mode == AddressMode::MIRROR)
+	{
+		const auto period = n << 1;
+		i %= period;
+		i = i < 0 ? i + period : i;
+
+		return i < n ? i : period - 1 - i;
+	}
+
+	return (std::min)((std::max)(i, 0), n - 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Texels and weights of a trilinear footprint
+//--------------------------------------------------------------------------------------
+struct LinearFootprint
+{
+	uint32_t x[2], y[2], z[2];
+	float wx, wy, wz;
+};
+
+inline LinearFootprint GetLinearFootprint(const uint3& size, const float3& uvw, AddressMode mode)
+{
+	const auto tx = uvw.x * size.x - 0.5f;
+	const auto ty = uvw.y * size.y - 0.5f;
+	const auto tz = uvw.z * size.z - 0.5f;
+	const auto fx = floorf(tx), fy = floorf(ty), fz = floorf(tz);
+
+	const auto ix = static_cast<int32_t>(fx), iy = static_cast<int32_t>(fy), iz = static_cast<int32_t>(fz);
+	LinearFootprint footprint;
+	footprint.x[0] = AddressTexel(ix, size.x, mode);
+	footprint.x[1] = AddressTexel(ix + 1, size.x, mode);
+	footprint.y[0] = AddressTexel(iy, size.y, mode);
+	footprint.y[1] = AddressTexel(iy + 1, size.y, mode);
+	footprint.z[0] = AddressTexel(iz, size.z, mode);
+	footprint.z[1] = AddressTexel(iz + 1, size.z, mode);
+	footprint.wx = tx - fx;
+	footprint.wy = ty - fy;
+	footprint.wz = tz - fz;
+
+	return footprint;
+}
+
+//--------------------------------------------------------------------------------------
+// Trilinear sampling, equivalent to SampleLevel(sampler, uvw, 0.0) on the GPU
+//--------------------------------------------------------------------------------------
+template<typename T, typename Layout>
+T SampleLinear(const Grid3D<T, Layout>& grid, const float3& uvw, AddressMode mode)
+{
+	const auto f = GetLinearFootprint(grid.GetSize(), uvw, mode);
+
+	T planes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		const auto& t00 = grid(f.x[0], f.y[0], f.z[k]);
+		const auto& t10 = grid(f.x[1], f.y[0], f.z[k]);
+		const auto& t01 = grid(f.x[0], f.y[1], f.z[k]);
+		const auto& t11 = grid(f.x[1], f.y[1], f.z[k]);
+		const auto row0 = t00 * (1.0f - f.wx) + t10 * f.wx;
+		const auto row1 = t01 * (1.0f - f.wx) + t11 * f.wx;
+		planes[k] = row0 * (1.0f - f.wy) + row1 * f.wy;
+	}
+
+	return planes[0] * (1.0f - f.wz) + planes[1] * f.wz;
+}
+
+//--------------------------------------------------------------------------------------
+// Trilinear sampling of a single component, SampleLevel(sampler, uvw, 0.0)[component]
+//--------------------------------------------------------------------------------------
+template<typename T, typename Layout>
+float SampleLinear(const Grid3D<T, Layout>& grid, const float3& uvw, uint8_t component, AddressMode mode)
+{
+	const auto f = GetLinearFootprint(grid.GetSize(), uvw, mode);
+
+	float planes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		const auto t00 = grid(f.x[0], f.y[0], f.z[k])[component];
+		const auto t10 = grid(f.x[1], f.y[0], f.z[k])[component];
+		const auto t01 = grid(f.x[0], f.y[1], f.z[k])[component];
+		const auto t11 = grid(f.x[1], f.y[1], f.z[k])[component];
+		const auto row0 = t00 * (1.0f - f.wx) + t10 * f.wx;
+		const auto row1 = t01 * (1.0f - f.wx) + t11 * f.wx;
+		planes[k] = row0 * (1.0f - f.wy) + row1 * f.wy;
+	}
+
+	return planes[0] * (1.0f - f.wz) + planes[1] * f.wz;
+}
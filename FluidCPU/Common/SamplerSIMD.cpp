@@ -0,0 +1,416 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <climits>
+#include "SamplerSIMD.h"
+
+// The vector paths are compiled for their instruction sets per function and only run
+// where the CPU reports them; they multiply and add separately (see CMakeLists.txt), so
+// that the filtering rounds as the scalar SampleLinear does
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SAMPLER_X86
+#define SAMPLER_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define SAMPLER_X86
+#define SAMPLER_TARGET(isa)
+#endif
+
+using namespace std;
+
+static const char* g_samplerISANames[] =
+{
+	"scalar",
+	"avx2",
+	"avx512"
+};
+
+static_assert(sizeof(g_samplerISANames) / sizeof(g_samplerISANames[0]) ==
+	static_cast<uint8_t>(SamplerISA::NUM_SAMPLER_ISA), "Missing sampler ISA name");
+
+static SamplerISA DetectSamplerISA()
+{
+#if defined(SAMPLER_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return SamplerISA::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) return SamplerISA::AVX2;
+#elif defined(SAMPLER_X86)
+	int info[4];
+	__cpuid(info, 0);
+	const auto maxLeaf = info[0];
+	__cpuid(info, 1);
+	const auto hasF16C = (info[2] & (1 << 29)) != 0;
+	const auto hasAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+	if (maxLeaf >= 7 && hasAVX)
+	{
+		// The OS must save the vector registers
+		const auto xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) return SamplerISA::AVX512;
+		if ((info[1] & (1 << 5)) && hasF16C && (xcr0 & 0x6) == 0x6) return SamplerISA::AVX2;
+	}
+#endif
+
+	return SamplerISA::SCALAR;
+}
+
+static atomic<uint8_t>& GetSamplerISAState()
+{
+	static atomic<uint8_t> isa(static_cast<uint8_t>(GetSupportedSamplerISA()));
+
+	return isa;
+}
+
+SamplerISA GetSupportedSamplerISA()
+{
+	static const auto isa = DetectSamplerISA();
+
+	return isa;
+}
+
+SamplerISA SetSamplerISA(SamplerISA isa)
+{
+	isa = (min)(isa, GetSupportedSamplerISA());
+	GetSamplerISAState().store(static_cast<uint8_t>(isa), memory_order_relaxed);
+
+	return isa;
+}
+
+SamplerISA GetSamplerISA()
+{
+	return static_cast<SamplerISA>(GetSamplerISAState().load(memory_order_relaxed));
+}
+
+const char* GetSamplerISAName(SamplerISA isa)
+{
+	return g_samplerISANames[static_cast<uint8_t>(isa)];
+}
+
+//--------------------------------------------------------------------------------------
+// Scalar baseline
+//--------------------------------------------------------------------------------------
+static float4 SampleLinear(const Grid3D<half4>& grid, const float3& uvw, AddressMode mode)
+{
+	const auto f = GetLinearFootprint(grid.GetSize(), uvw, mode);
+
+	float4 planes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		const auto t00 = f16tof32(grid(f.x[0], f.y[0], f.z[k]));
+		const auto t10 = f16tof32(grid(f.x[1], f.y[0], f.z[k]));
+		const auto t01 = f16tof32(grid(f.x[0], f.y[1], f.z[k]));
+		const auto t11 = f16tof32(grid(f.x[1], f.y[1], f.z[k]));
+		const auto row0 = t00 * (1.0f - f.wx) + t10 * f.wx;
+		const auto row1 = t01 * (1.0f - f.wx) + t11 * f.wx;
+		planes[k] = row0 * (1.0f - f.wy) + row1 * f.wy;
+	}
+
+	return planes[0] * (1.0f - f.wz) + planes[1] * f.wz;
+}
+
+template<typename R, typename T>
+static void SampleScalar(R* pResults, const Grid3D<T>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	for (auto i = 0u; i < numSamples; ++i) pResults[i] = SampleLinear(grid, pUVWs[i], mode);
+}
+
+#ifdef SAMPLER_X86
+//--------------------------------------------------------------------------------------
+// Channels of the texel formats; half4 texels are fetched as two pairs of channels
+//--------------------------------------------------------------------------------------
+template<typename T> struct TexelFormat;
+template<> struct TexelFormat<float3> { static const uint8_t NumChannels = 3; };
+template<> struct TexelFormat<float4> { static const uint8_t NumChannels = 4; };
+template<> struct TexelFormat<half4> { static const uint8_t NumChannels = 4; };
+
+// The gathers take 32-bit offsets
+template<typename T>
+static bool IsGatherable(const Grid3D<T>& grid)
+{
+	return grid.GetStorageSize() <= static_cast<size_t>(INT_MAX) / TexelFormat<T>::NumChannels;
+}
+
+//--------------------------------------------------------------------------------------
+// AVX2 with F16C: 8 positions per step
+//--------------------------------------------------------------------------------------
+SAMPLER_TARGET("avx2,f16c")
+static inline __m256i AddressTexels8(__m256i i, int32_t n, AddressMode mode)
+{
+	if (mode == AddressMode::MIRROR)
+	{
+		// i mod period, through the float quotient, corrected into [0, period)
+		const auto period = _mm256_set1_epi32(n << 1);
+		const auto q = _mm256_floor_ps(_mm256_div_ps(_mm256_cvtepi32_ps(i), _mm256_cvtepi32_ps(period)));
+		i = _mm256_sub_epi32(i, _mm256_mullo_epi32(_mm256_cvttps_epi32(q), period));
+		i = _mm256_add_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), i), period));
+		i = _mm256_sub_epi32(i, _mm256_andnot_si256(_mm256_cmpgt_epi32(period, i), period));
+
+		// Reflect the second half of the period
+		const auto mirrored = _mm256_sub_epi32(_mm256_sub_epi32(period, _mm256_set1_epi32(1)), i);
+
+		return _mm256_blendv_epi8(mirrored, i, _mm256_cmpgt_epi32(_mm256_set1_epi32(n), i));
+	}
+
+	return _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()), _mm256_set1_epi32(n - 1));
+}
+
+SAMPLER_TARGET("avx2,f16c")
+static inline void FetchTexels8(__m256 values[4], const float3* pData, __m256i texels)
+{
+	const auto offsets = _mm256_mullo_epi32(texels, _mm256_set1_epi32(3));
+	for (uint8_t c = 0; c < 3; ++c) values[c] = _mm256_i32gather_ps(&pData->x + c, offsets, 4);
+}
+
+SAMPLER_TARGET("avx2,f16c")
+static inline void FetchTexels8(__m256 values[4], const float4* pData, __m256i texels)
+{
+	const auto offsets = _mm256_slli_epi32(texels, 2);
+	for (uint8_t c = 0; c < 4; ++c) values[c] = _mm256_i32gather_ps(&pData->x + c, offsets, 4);
+}
+
+SAMPLER_TARGET("avx2,f16c")
+static inline void FetchTexels8(__m256 values[4], const half4* pData, __m256i texels)
+{
+	const auto offsets = _mm256_slli_epi32(texels, 1);
+	for (uint8_t c = 0; c < 4; c += 2)
+	{
+		// Split the pairs, and order the low and the high halves across the 128-bit lanes
+		const auto pairs = _mm256_i32gather_epi32(reinterpret_cast<const int*>(pData) + (c >> 1), offsets, 4);
+		const auto halves = _mm256_packus_epi32(_mm256_and_si256(pairs, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(pairs, 16));
+		const auto ordered = _mm256_permute4x64_epi64(halves, _MM_SHUFFLE(3, 1, 2, 0));
+		values[c] = _mm256_cvtph_ps(_mm256_castsi256_si128(ordered));
+		values[c + 1] = _mm256_cvtph_ps(_mm256_extracti128_si256(ordered, 1));
+	}
+}
+
+SAMPLER_TARGET("avx2,f16c")
+static inline __m256 Lerp8(__m256 a, __m256 b, __m256 w)
+{
+	// a * (1 - w) + b * w, in the order of SampleLinear
+	return _mm256_add_ps(_mm256_mul_ps(a, _mm256_sub_ps(_mm256_set1_ps(1.0f), w)), _mm256_mul_ps(b, w));
+}
+
+template<typename R, typename T>
+SAMPLER_TARGET("avx2,f16c")
+static void SampleAVX2(R* pResults, const Grid3D<T>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	const uint8_t numChannels = TexelFormat<T>::NumChannels;
+	const auto& size = grid.GetSize();
+	const auto pData = grid.GetData();
+	const auto lanes = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	const auto strideY = _mm256_set1_epi32(size.x);
+	const auto strideZ = _mm256_set1_epi32(size.x * size.y);
+
+	for (auto s = 0u; s < numSamples; s += 8)
+	{
+		// The last step repeats its last position in the unused lanes
+		const auto n = (min)(numSamples - s, 8u);
+		auto pUVW = pUVWs + s;
+		float3 uvws[8];
+		if (n < 8)
+		{
+			for (uint8_t i = 0; i < 8; ++i) uvws[i] = pUVW[(min)(i, static_cast<uint8_t>(n - 1))];
+			pUVW = uvws;
+		}
+
+		// Footprint
+		__m256i texels[3][2];
+		__m256 weights[3];
+		for (uint8_t a = 0; a < 3; ++a)
+		{
+			const auto uvw = _mm256_i32gather_ps(&pUVW->x + a, lanes, 4);
+			const auto t = _mm256_sub_ps(_mm256_mul_ps(uvw, _mm256_set1_ps(static_cast<float>(size[a]))), _mm256_set1_ps(0.5f));
+			const auto f = _mm256_floor_ps(t);
+			const auto i = _mm256_cvttps_epi32(f);
+			texels[a][0] = AddressTexels8(i, size[a], mode);
+			texels[a][1] = AddressTexels8(_mm256_add_epi32(i, _mm256_set1_epi32(1)), size[a], mode);
+			weights[a] = _mm256_sub_ps(t, f);
+		}
+
+		__m256 planes[2][4];
+		for (uint8_t k = 0; k < 2; ++k)
+		{
+			__m256 rows[2][4];
+			for (uint8_t j = 0; j < 2; ++j)
+			{
+				const auto row = _mm256_add_epi32(_mm256_mullo_epi32(texels[2][k], strideZ), _mm256_mullo_epi32(texels[1][j], strideY));
+				__m256 t0[4], t1[4];
+				FetchTexels8(t0, pData, _mm256_add_epi32(row, texels[0][0]));
+				FetchTexels8(t1, pData, _mm256_add_epi32(row, texels[0][1]));
+				for (uint8_t c = 0; c < numChannels; ++c) rows[j][c] = Lerp8(t0[c], t1[c], weights[0]);
+			}
+			for (uint8_t c = 0; c < numChannels; ++c) planes[k][c] = Lerp8(rows[0][c], rows[1][c], weights[1]);
+		}
+
+		float results[4][8];
+		for (uint8_t c = 0; c < numChannels; ++c) _mm256_storeu_ps(results[c], Lerp8(planes[0][c], planes[1][c], weights[2]));
+		for (auto i = 0u; i < n; ++i)
+			for (uint8_t c = 0; c < numChannels; ++c) pResults[s + i][c] = results[c][i];
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// AVX-512F: 16 positions per step. The unmasked intrinsics pass an undefined source,
+// which GCC 12 reports as uninitialized, so their full-mask forms with a zero source are
+// called instead; they compile to the same instructions
+//--------------------------------------------------------------------------------------
+static const __mmask16 g_allLanes = 0xffff;
+
+SAMPLER_TARGET("avx512f")
+static inline __m512i AddressTexels16(__m512i i, int32_t n, AddressMode mode)
+{
+	if (mode == AddressMode::MIRROR)
+	{
+		// i mod period, through the float quotient, corrected into [0, period)
+		const auto period = _mm512_set1_epi32(n << 1);
+		const auto q = _mm512_maskz_roundscale_ps(g_allLanes, _mm512_div_ps(_mm512_maskz_cvtepi32_ps(g_allLanes, i),
+			_mm512_maskz_cvtepi32_ps(g_allLanes, period)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		i = _mm512_sub_epi32(i, _mm512_mullo_epi32(_mm512_maskz_cvttps_epi32(g_allLanes, q), period));
+		i = _mm512_mask_add_epi32(i, _mm512_cmplt_epi32_mask(i, _mm512_setzero_si512()), i, period);
+		i = _mm512_mask_sub_epi32(i, _mm512_cmpge_epi32_mask(i, period), i, period);
+
+		// Reflect the second half of the period
+		const auto mirrored = _mm512_sub_epi32(_mm512_sub_epi32(period, _mm512_set1_epi32(1)), i);
+
+		return _mm512_mask_blend_epi32(_mm512_cmplt_epi32_mask(i, _mm512_set1_epi32(n)), mirrored, i);
+	}
+
+	return _mm512_maskz_min_epi32(g_allLanes, _mm512_maskz_max_epi32(g_allLanes, i, _mm512_setzero_si512()),
+		_mm512_set1_epi32(n - 1));
+}
+
+SAMPLER_TARGET("avx512f")
+static inline void FetchTexels16(__m512 values[4], const float3* pData, __m512i texels)
+{
+	const auto offsets = _mm512_mullo_epi32(texels, _mm512_set1_epi32(3));
+	for (uint8_t c = 0; c < 3; ++c)
+		values[c] = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), g_allLanes, offsets, &pData->x + c, 4);
+}
+
+SAMPLER_TARGET("avx512f")
+static inline void FetchTexels16(__m512 values[4], const float4* pData, __m512i texels)
+{
+	const auto offsets = _mm512_maskz_slli_epi32(g_allLanes, texels, 2);
+	for (uint8_t c = 0; c < 4; ++c)
+		values[c] = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), g_allLanes, offsets, &pData->x + c, 4);
+}
+
+SAMPLER_TARGET("avx512f")
+static inline void FetchTexels16(__m512 values[4], const half4* pData, __m512i texels)
+{
+	const auto offsets = _mm512_maskz_slli_epi32(g_allLanes, texels, 1);
+	for (uint8_t c = 0; c < 4; c += 2)
+	{
+		// The down-conversions keep the low halves
+		const auto pairs = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), g_allLanes, offsets,
+			reinterpret_cast<const int*>(pData) + (c >> 1), 4);
+		values[c] = _mm512_maskz_cvtph_ps(g_allLanes, _mm512_maskz_cvtepi32_epi16(g_allLanes, pairs));
+		values[c + 1] = _mm512_maskz_cvtph_ps(g_allLanes,
+			_mm512_maskz_cvtepi32_epi16(g_allLanes, _mm512_maskz_srli_epi32(g_allLanes, pairs, 16)));
+	}
+}
+
+SAMPLER_TARGET("avx512f")
+static inline __m512 Lerp16(__m512 a, __m512 b, __m512 w)
+{
+	// a * (1 - w) + b * w, in the order of SampleLinear
+	return _mm512_add_ps(_mm512_mul_ps(a, _mm512_sub_ps(_mm512_set1_ps(1.0f), w)), _mm512_mul_ps(b, w));
+}
+
+template<typename R, typename T>
+SAMPLER_TARGET("avx512f")
+static void SampleAVX512(R* pResults, const Grid3D<T>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	const uint8_t numChannels = TexelFormat<T>::NumChannels;
+	const auto& size = grid.GetSize();
+	const auto pData = grid.GetData();
+	const auto lanes = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32(3));
+	const auto strideY = _mm512_set1_epi32(size.x);
+	const auto strideZ = _mm512_set1_epi32(size.x * size.y);
+
+	for (auto s = 0u; s < numSamples; s += 16)
+	{
+		// The last step masks off the unused lanes
+		const auto n = (min)(numSamples - s, 16u);
+		const auto mask = static_cast<__mmask16>((1u << n) - 1);
+		const auto pUVW = pUVWs + s;
+
+		// Footprint
+		__m512i texels[3][2];
+		__m512 weights[3];
+		for (uint8_t a = 0; a < 3; ++a)
+		{
+			const auto uvw = _mm512_mask_i32gather_ps(_mm512_set1_ps(0.5f), mask, lanes, &pUVW->x + a, 4);
+			const auto t = _mm512_sub_ps(_mm512_mul_ps(uvw, _mm512_set1_ps(static_cast<float>(size[a]))), _mm512_set1_ps(0.5f));
+			const auto f = _mm512_maskz_roundscale_ps(g_allLanes, t, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+			const auto i = _mm512_maskz_cvttps_epi32(g_allLanes, f);
+			texels[a][0] = AddressTexels16(i, size[a], mode);
+			texels[a][1] = AddressTexels16(_mm512_add_epi32(i, _mm512_set1_epi32(1)), size[a], mode);
+			weights[a] = _mm512_sub_ps(t, f);
+		}
+
+		__m512 planes[2][4];
+		for (uint8_t k = 0; k < 2; ++k)
+		{
+			__m512 rows[2][4];
+			for (uint8_t j = 0; j < 2; ++j)
+			{
+				const auto row = _mm512_add_epi32(_mm512_mullo_epi32(texels[2][k], strideZ), _mm512_mullo_epi32(texels[1][j], strideY));
+				__m512 t0[4], t1[4];
+				FetchTexels16(t0, pData, _mm512_add_epi32(row, texels[0][0]));
+				FetchTexels16(t1, pData, _mm512_add_epi32(row, texels[0][1]));
+				for (uint8_t c = 0; c < numChannels; ++c) rows[j][c] = Lerp16(t0[c], t1[c], weights[0]);
+			}
+			for (uint8_t c = 0; c < numChannels; ++c) planes[k][c] = Lerp16(rows[0][c], rows[1][c], weights[1]);
+		}
+
+		float results[4][16];
+		for (uint8_t c = 0; c < numChannels; ++c) _mm512_storeu_ps(results[c], Lerp16(planes[0][c], planes[1][c], weights[2]));
+		for (auto i = 0u; i < n; ++i)
+			for (uint8_t c = 0; c < numChannels; ++c) pResults[s + i][c] = results[c][i];
+	}
+}
+#endif
+
+template<typename R, typename T>
+static void Sample(R* pResults, const Grid3D<T>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+#ifdef SAMPLER_X86
+	if (IsGatherable(grid))
+	{
+		switch (GetSamplerISA())
+		{
+		case SamplerISA::AVX512:
+			SampleAVX512(pResults, grid, pUVWs, numSamples, mode);
+			return;
+		case SamplerISA::AVX2:
+			SampleAVX2(pResults, grid, pUVWs, numSamples, mode);
+			return;
+		default:
+			break;
+		}
+	}
+#endif
+
+	SampleScalar(pResults, grid, pUVWs, numSamples, mode);
+}
+
+void SampleLinear(float3* pResults, const Grid3D<float3>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	Sample(pResults, grid, pUVWs, numSamples, mode);
+}
+
+void SampleLinear(float4* pResults, const Grid3D<float4>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	Sample(pResults, grid, pUVWs, numSamples, mode);
+}
+
+void SampleLinear(float4* pResults, const Grid3D<half4>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode)
+{
+	Sample(pResults, grid, pUVWs, numSamples, mode);
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Sampler.h"
+
+enum class SamplerISA : uint8_t
+{
+	SCALAR,
+	AVX2,	// With F16C; 8 positions per step
+	AVX512,	// AVX-512F; 16 positions per step
+
+	NUM_SAMPLER_ISA
+};
+
+//--------------------------------------------------------------------------------------
+// Instruction set of the batched samplers, selected at runtime. The default is the
+// widest one the CPU supports; SetSamplerISA falls back to the widest supported one
+// below the request and returns the selection.
+//--------------------------------------------------------------------------------------
+SamplerISA GetSupportedSamplerISA();
+SamplerISA SetSamplerISA(SamplerISA isa);
+SamplerISA GetSamplerISA();
+const char* GetSamplerISAName(SamplerISA isa);
+
+//--------------------------------------------------------------------------------------
+// Trilinear sampling of numSamples positions, as SampleLinear per position; the results
+// match it bit for bit. Texels of half4 grids are decoded to float before filtering.
+//--------------------------------------------------------------------------------------
+void SampleLinear(float3* pResults, const Grid3D<float3>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode);
+void SampleLinear(float4* pResults, const Grid3D<float4>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode);
+void SampleLinear(float4* pResults, const Grid3D<half4>& grid, const float3* pUVWs, uint32_t numSamples, AddressMode mode);
@@ -0,0 +1,185 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------
+// HLSL-like vector types, so that the CPU kernels read like their shader counterparts
+//--------------------------------------------------------------------------------------
+struct uint3
+{
+	uint32_t x, y, z;
+
+	uint3() = default;
+	constexpr uint3(uint32_t x, uint32_t y, uint32_t z) : x(x), y(y), z(z) {}
+
+	uint32_t& operator[](uint8_t i) { return (&x)[i]; }
+	uint32_t operator[](uint8_t i) const { return (&x)[i]; }
+	bool operator==(const uint3& v) const { return x == v.x && y == v.y && z == v.z; }
+	bool operator!=(const uint3& v) const { return !(*this == v); }
+};
+
+struct float3
+{
+	float x, y, z;
+
+	float3() = default;
+	constexpr float3(float s) : x(s), y(s), z(s) {}
+	constexpr float3(float x, float y, float z) : x(x), y(y), z(z) {}
+	explicit float3(const uint3& v) :
+		x(static_cast<float>(v.x)), y(static_cast<float>(v.y)), z(static_cast<float>(v.z)) {}
+
+	float& operator[](uint8_t i) { return (&x)[i]; }
+	float operator[](uint8_t i) const { return (&x)[i]; }
+
+	float3 operator-() const { return float3(-x, -y, -z); }
+	float3& operator+=(const float3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+	float3& operator-=(const float3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	float3& operator*=(const float3& v) { x *= v.x; y *= v.y; z *= v.z; return *this; }
+	float3& operator/=(const float3& v) { x /= v.x; y /= v.y; z /= v.z; return *this; }
+};
+
+struct float4
+{
+	float x, y, z, w;
+
+	float4() = default;
+	constexpr float4(float s) : x(s), y(s), z(s), w(s) {}
+	constexpr float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	constexpr float4(const float3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+	float& operator[](uint8_t i) { return (&x)[i]; }
+	float operator[](uint8_t i) const { return (&x)[i]; }
+	float3 xyz() const { return float3(x, y, z); }
+
+	float4& operator+=(const float4& v) { x += v.x; y += v.y; z += v.z; w += v.w; return *this; }
+	float4& operator-=(const float4& v) { x -= v.x; y -= v.y; z -= v.z; w -= v.w; return *this; }
+	float4& operator*=(const float4& v) { x *= v.x; y *= v.y; z *= v.z; w *= v.w; return *this; }
+};
+
+inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline float3 operator/(const float3& a, const float3& b) { return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+inline float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+inline float3 operator*(float s, const float3& a) { return a * s; }
+inline float3 operator/(const float3& a, float s) { return float3(a.x / s, a.y / s, a.z / s); }
+
+// RGBA16F texel, as the GPU stores velocity and color; see f16tof32 and f32tof16
+struct half4
+{
+	uint16_t x, y, z, w;
+};
+
+inline float4 operator+(const float4& a, const float4& b) { return float4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+inline float4 operator-(const float4& a, const float4& b) { return float4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+inline float4 operator*(const float4& a, const float4& b) { return float4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
+inline float4 operator*(const float4& a, float s) { return float4(a.x * s, a.y * s, a.z * s, a.w * s); }
+inline float4 operator*(float s, const float4& a) { return a * s; }
+
+//--------------------------------------------------------------------------------------
+// HLSL-like intrinsics
+//--------------------------------------------------------------------------------------
+inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const float3& v) { return sqrtf(dot(v, v)); }
+inline float3 normalize(const float3& v) { return v / length(v); }
+inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+inline float frac(float v) { return v - floorf(v); }
+inline float clamp(float v, float lo, float hi) { return (std::min)((std::max)(v, lo), hi); }
+inline float saturate(float v) { return clamp(v, 0.0f, 1.0f); }
+inline float4 saturate(const float4& v) { return float4(saturate(v.x), saturate(v.y), saturate(v.z), saturate(v.w)); }
+
+inline float3 min(const float3& a, const float3& b) { return float3((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z)); }
+inline float3 max(const float3& a, const float3& b) { return float3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z)); }
+inline float3 clamp(const float3& v, const float3& lo, const float3& hi) { return min(max(v, lo), hi); }
+
+inline float4 min(const float4& a, const float4& b)
+{
+	return float4((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z), (std::min)(a.w, b.w));
+}
+
+inline float4 max(const float4& a, const float4& b)
+{
+	return float4((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z), (std::max)(a.w, b.w));
+}
+
+inline float4 clamp(const float4& v, const float4& lo, const float4& hi) { return min(max(v, lo), hi); }
+
+//--------------------------------------------------------------------------------------
+// Half-precision conversions, as f16tof32 and f32tof16 in HLSL (rounded to nearest even,
+// as F16C does)
+//--------------------------------------------------------------------------------------
+inline float f16tof32(uint16_t h)
+{
+	const auto sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	auto exponent = static_cast<uint32_t>(h >> 10 & 0x1f);
+	auto mantissa = static_cast<uint32_t>(h & 0x3ff);
+
+	uint32_t bits = sign;
+	if (exponent == 0x1f) bits |= 0x7f800000 | mantissa << 13;
+	else if (exponent > 0) bits |= (exponent + 112) << 23 | mantissa << 13;
+	else if (mantissa > 0)
+	{
+		// Normalize the denormal
+		exponent = 113;
+		while (!(mantissa & 0x400))
+		{
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits |= exponent << 23 | (mantissa & 0x3ff) << 13;
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+inline uint16_t f32tof16(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const auto sign = static_cast<uint16_t>(bits >> 16 & 0x8000);
+	bits &= 0x7fffffff;
+
+	if (bits > 0x7f800000) return sign | 0x7e00;	// NaN
+	if (bits >= 0x477ff000) return sign | 0x7c00;	// Rounds to infinity
+	if (bits < 0x38800000)
+	{
+		// Denormal or zero
+		if (bits < 0x33000000) return sign;
+		const auto mantissa = (bits & 0x7fffff) | 0x800000;
+		const auto shift = 126 - (bits >> 23);
+		auto h = mantissa >> shift;
+		const auto rest = mantissa & ((1u << shift) - 1);
+		const auto halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (h & 1))) ++h;
+
+		return sign | static_cast<uint16_t>(h);
+	}
+
+	auto h = (bits - 0x38000000) >> 13;
+	const auto rest = bits & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) ++h;
+
+	return sign | static_cast<uint16_t>(h);
+}
+
+inline float4 f16tof32(const half4& v)
+{
+	return float4(f16tof32(v.x), f16tof32(v.y), f16tof32(v.z), f16tof32(v.w));
+}
+
+inline half4 f32tof16(const float4& v)
+{
+	const half4 h = { f32tof16(v.x), f32tof16(v.y), f32tof16(v.z), f32tof16(v.w) };
+
+	return h;
+}
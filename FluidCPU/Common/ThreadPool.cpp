@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool() :
+	m_pFunc(nullptr),
+	m_generation(0),
+	m_numThreads(1),
+	m_numItems(0),
+	m_numSlabs(0),
+	m_numPending(0),
+	m_isQuitting(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isQuitting = true;
+	}
+	m_workCondition.notify_all();
+
+	for (auto& worker : m_workers) worker.join();
+}
+
+bool ThreadPool::Init(uint32_t numThreads)
+{
+	if (!m_workers.empty()) return false;
+
+	m_numThreads = numThreads ? numThreads : (max)(thread::hardware_concurrency(), 1u);
+
+	// The calling thread always runs slab 0
+	m_workers.reserve(m_numThreads - 1);
+	for (auto i = 1u; i < m_numThreads; ++i)
+		m_workers.emplace_back(&ThreadPool::workerMain, this, i);
+
+	return true;
+}
+
+void ThreadPool::Dispatch(uint32_t numItems, const SlabFunc& func)
+{
+	const auto numSlabs = (min)(m_numThreads, numItems);
+	if (numSlabs <= 1)
+	{
+		if (numItems > 0) func(0, numItems);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_pFunc = &func;
+		m_numItems = numItems;
+		m_numSlabs = numSlabs;
+		m_numPending = numSlabs - 1;
+		++m_generation;
+	}
+	m_workCondition.notify_all();
+
+	runSlab(0);
+
+	unique_lock<mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this] { return m_numPending == 0; });
+	m_pFunc = nullptr;
+}
+
+uint32_t ThreadPool::GetNumThreads() const
+{
+	return m_numThreads;
+}
+
+void ThreadPool::workerMain(uint32_t slab)
+{
+	uint64_t generation = 0;
+
+	unique_lock<mutex> lock(m_mutex);
+	while (true)
+	{
+		m_workCondition.wait(lock, [&] { return m_isQuitting || m_generation != generation; });
+		if (m_isQuitting) return;
+
+		generation = m_generation;
+		if (slab >= m_numSlabs) continue;
+
+		lock.unlock();
+		runSlab(slab);
+		lock.lock();
+
+		if (--m_numPending == 0) m_doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runSlab(uint32_t slab)
+{
+	// Static partition: slab boundaries only depend on the item and slab counts
+	const auto begin = static_cast<uint32_t>(static_cast<uint64_t>(m_numItems) * slab / m_numSlabs);
+	const auto end = static_cast<uint32_t>(static_cast<uint64_t>(m_numItems) * (slab + 1) / m_numSlabs);
+	(*m_pFunc)(begin, end);
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ShaderMath.h"
+
+//--------------------------------------------------------------------------------------
+// Persistent worker threads; each dispatch is split into one contiguous slab per thread
+//--------------------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+	using SlabFunc = std::function<void(uint32_t begin, uint32_t end)>;
+
+	ThreadPool();
+	virtual ~ThreadPool();
+
+	// numThreads = 0 uses all hardware threads
+	bool Init(uint32_t numThreads = 0);
+
+	// Runs func over [0, numItems) and returns when all slabs are done; dispatches must not nest
+	void Dispatch(uint32_t numItems, const SlabFunc& func);
+
+	uint32_t GetNumThreads() const;
+
+protected:
+	void workerMain(uint32_t slab);
+	void runSlab(uint32_t slab);
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_mutex;
+	std::condition_variable		m_workCondition;
+	std::condition_variable		m_doneCondition;
+
+	const SlabFunc*	m_pFunc;
+	uint64_t		m_generation;
+	uint32_t		m_numThreads;
+	uint32_t		m_numItems;
+	uint32_t		m_numSlabs;
+	uint32_t		m_numPending;
+	bool			m_isQuitting;
+};
+
+//--------------------------------------------------------------------------------------
+// Splits a grid into z-slabs (y-bands for 2D grids) and runs func(begin, end) per slab
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void ForEachSlab(ThreadPool* pThreadPool, const uint3& gridSize, const Func& func)
+{
+	const auto is3D = gridSize.z > 1;
+	pThreadPool->Dispatch(is3D ? gridSize.z : gridSize.y, [&](uint32_t begin, uint32_t end)
+	{
+		const auto slabBegin = is3D ? uint3(0, 0, begin) : uint3(0, begin, 0);
+		const auto slabEnd = is3D ? uint3(gridSize.x, gridSize.y, end) : uint3(gridSize.x, end, gridSize.z);
+		func(slabBegin, slabEnd);
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Runs func(cell) for every cell of the grid, the CPU analog of a compute dispatch
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void ForEachCell(ThreadPool* pThreadPool, const uint3& gridSize, const Func& func)
+{
+	ForEachSlab(pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x)
+					func(cell);
+	});
+}
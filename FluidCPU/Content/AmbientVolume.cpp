@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "AmbientVolume.h"
+
+using namespace std;
+
+AmbientVolume::AmbientVolume() :
+	LightMap()
+{
+}
+
+AmbientVolume::~AmbientVolume()
+{
+}
+
+static float3 GetRayDir(const float3& gradient, const float3& pos)
+{
+	const auto rayDir = gradient.x != 0.0f || gradient.y != 0.0f || gradient.z != 0.0f ? -gradient : pos;
+
+	return normalize(rayDir);
+}
+
+float3 AmbientVolume::GetRayDir(const QuantizedDensity& density, const float3& pos)
+{
+	return ::GetRayDir(GradientVolume::Evaluate(density, pos * 0.5f + 0.5f), pos);
+}
+
+float3 AmbientVolume::GetRayDir(const GradientVolume& gradient, const float3& pos)
+{
+	return ::GetRayDir(gradient.Sample(pos * 0.5f + 0.5f), pos);
+}
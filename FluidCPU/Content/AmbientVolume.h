@@ -0,0 +1,27 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "GradientVolume.h"
+#include "LightMap.h"
+
+//--------------------------------------------------------------------------------------
+// Ambient volume of CSAmbient.hlsl: texels as the light map, each holding the occlusion of
+// the light probe along the density gradient at its center, which the ray marchers filter
+// in place of an AO ray per sample; the GPU weighs it by the irradiance of the probe, which
+// is left out here
+//--------------------------------------------------------------------------------------
+class AmbientVolume :
+	public LightMap
+{
+public:
+	AmbientVolume();
+	virtual ~AmbientVolume();
+
+	// Direction of the AO ray at pos in the [-1, 1] volume space, as CSAmbient.hlsl: against the
+	// density gradient, or outwards where the density is uniform
+	static float3 GetRayDir(const QuantizedDensity& density, const float3& pos);
+	static float3 GetRayDir(const GradientVolume& gradient, const float3& pos);	// As CSAmbientG.hlsl
+};
@@ -0,0 +1,230 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include "CubeMap.h"
+
+using namespace std;
+
+const float CubeMap::HistoryTolerance = 0.05f;
+
+//--------------------------------------------------------------------------------------
+// Reproject of CSCubeReconstruct.hlsl: the ray of a texel is represented by its midpoint
+// within the volume, and the ray of the last eye through that point leaves the cube on a
+// face that the history holds
+//--------------------------------------------------------------------------------------
+static float3 Reproject(const float3& target, const float3& eyePt, const float3& prevEyePt)
+{
+	auto rayOrigin = eyePt;
+	if (!CubeMap::ComputeRayOrigin(rayOrigin, normalize(target - eyePt))) rayOrigin = target;
+	const auto pos = (rayOrigin + target) * 0.5f;
+
+	// The exit of the ray through pos, which is inside the cube on every axis
+	const auto rayDir = pos - prevEyePt;
+	auto u = FLT_MAX;
+	for (uint8_t i = 0; i < 3; ++i)
+		u = (min)(((rayDir[i] >= 0.0f ? 1.0f : -1.0f) - prevEyePt[i]) / rayDir[i], u);
+
+	return prevEyePt + rayDir * u;
+}
+
+CubeMap::CubeMap()
+{
+}
+
+CubeMap::~CubeMap()
+{
+}
+
+void CubeMap::Create(uint32_t size)
+{
+	m_texels.Create(uint3(size, size, 6));
+}
+
+void CubeMap::Reconstruct(ThreadPool* pThreadPool, const CubeMap& history, const float3& eyePt,
+	const float3& prevEyePt, uint32_t interleave, uint32_t phase, uint64_t& numRebuilt, uint64_t& numRejected)
+{
+	// The marched texels are only read, so the rebuilt ones may be written in place
+	const auto size = GetSize();
+	atomic<uint64_t> rebuilt(0), rejected(0);
+	pThreadPool->Dispatch(6 * size, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t n = 0, r = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto face = static_cast<uint8_t>(i / size);
+			const auto y = i % size;
+			if (!IsVisible(face, eyePt)) continue;
+
+			for (auto x = 0u; x < size; ++x)
+			{
+				if (IsMarched(x, y, interleave, phase)) continue;
+
+				// Range and mean of the 3x3 neighbors marched this frame, 1 to 4 of them
+				auto minOpacity = 1.0f, maxOpacity = 0.0f, sum = 0.0f;
+				auto numNeighbors = 0u;
+				for (auto j = -1; j <= 1; ++j)
+					for (auto k = -1; k <= 1; ++k)
+					{
+						const auto u = static_cast<int32_t>(x) + k;
+						const auto v = static_cast<int32_t>(y) + j;
+						if (u < 0 || v < 0 || u >= static_cast<int32_t>(size) || v >= static_cast<int32_t>(size)) continue;
+						if (!IsMarched(u, v, interleave, phase)) continue;
+
+						const auto opacity = m_texels(u, v, face);
+						minOpacity = (min)(opacity, minOpacity);
+						maxOpacity = (max)(opacity, maxOpacity);
+						sum += opacity;
+						++numNeighbors;
+					}
+
+				// The history at the face where the last eye saw the ray
+				const auto pos = Reproject(GetLocalPos(x, y, face, size), eyePt, prevEyePt);
+				const auto opacity = history.Sample(pos);
+
+				minOpacity -= HistoryTolerance;
+				maxOpacity += HistoryTolerance;
+				const auto isRejected = opacity < minOpacity || opacity > maxOpacity;
+				m_texels(x, y, face) = isRejected ? sum / (max)(numNeighbors, 1u) : clamp(opacity, minOpacity, maxOpacity);
+				r += isRejected ? 1 : 0;
+				++n;
+			}
+		}
+		rebuilt += n;
+		rejected += r;
+	});
+
+	numRebuilt += rebuilt;
+	numRejected += rejected;
+}
+
+float CubeMap::Sample(const float3& dir) const
+{
+	// The face of the major axis, as TextureCube selects it
+	const float3 absDir(fabsf(dir.x), fabsf(dir.y), fabsf(dir.z));
+	const uint8_t axis = absDir.x >= absDir.y && absDir.x >= absDir.z ? 0 : (absDir.y >= absDir.z ? 1 : 2);
+	const uint8_t face = axis * 2 + (dir[axis] < 0.0f ? 1 : 0);
+	const auto pos = dir / absDir[axis];
+
+	// Inverse of GetLocalPos
+	float px, py;
+	switch (face)
+	{
+	case 0: px = -pos.z; py = pos.y; break;
+	case 1: px = pos.z; py = pos.y; break;
+	case 2: px = pos.x; py = -pos.z; break;
+	case 3: px = pos.x; py = pos.z; break;
+	case 4: px = pos.x; py = pos.y; break;
+	default: px = -pos.x; py = pos.y;
+	}
+
+	const auto size = GetSize();
+	const auto u = (px + 1.0f) * 0.5f * size - 0.5f;
+	const auto v = (1.0f - py) * 0.5f * size - 0.5f;
+	const auto u0 = floorf(u), v0 = floorf(v);
+	const auto fu = u - u0, fv = v - v0;
+	const auto last = static_cast<int32_t>(size) - 1;
+	const auto x0 = (min)((max)(static_cast<int32_t>(u0), 0), last);
+	const auto y0 = (min)((max)(static_cast<int32_t>(v0), 0), last);
+	const auto x1 = (min)((max)(static_cast<int32_t>(u0) + 1, 0), last);
+	const auto y1 = (min)((max)(static_cast<int32_t>(v0) + 1, 0), last);
+
+	return lerp(lerp(m_texels(x0, y0, face), m_texels(x1, y0, face), fu),
+		lerp(m_texels(x0, y1, face), m_texels(x1, y1, face), fu), fv);
+}
+
+uint32_t CubeMap::GetSize() const
+{
+	return m_texels.GetSize().x;
+}
+
+Grid3D<float>& CubeMap::GetTexels()
+{
+	return m_texels;
+}
+
+const Grid3D<float>& CubeMap::GetTexels() const
+{
+	return m_texels;
+}
+
+float3 CubeMap::GetLocalPos(uint32_t x, uint32_t y, uint8_t face, uint32_t size)
+{
+	const auto px = (x + 0.5f) / size * 2.0f - 1.0f;
+	const auto py = -((y + 0.5f) / size * 2.0f - 1.0f);
+
+	switch (face)
+	{
+	case 0: // +X
+		return float3(1.0f, py, -px);
+	case 1: // -X
+		return float3(-1.0f, py, px);
+	case 2: // +Y
+		return float3(px, 1.0f, -py);
+	case 3: // -Y
+		return float3(px, -1.0f, py);
+	case 4: // +Z
+		return float3(px, py, 1.0f);
+	case 5: // -Z
+		return float3(-px, py, -1.0f);
+	default:
+		return float3(0.0f);
+	}
+}
+
+bool CubeMap::IsVisible(uint8_t face, const float3& localEyePt)
+{
+	const auto viewComp = localEyePt[face >> 1];
+
+	return (face & 0x1) ? viewComp > -1.0f : viewComp < 1.0f;
+}
+
+bool CubeMap::IsMarched(uint32_t x, uint32_t y, uint32_t interleave, uint32_t phase)
+{
+	switch (interleave)
+	{
+	case 2:
+		return ((x + y + phase) & 1) == 0;
+	case 4:
+		return (x & 1) == (phase & 1) && (y & 1) == (phase >> 1);
+	default:
+		return true;
+	}
+}
+
+bool CubeMap::ComputeRayOrigin(float3& rayOrigin, const float3& rayDir)
+{
+	if (fabsf(rayOrigin.x) <= 1.0f && fabsf(rayOrigin.y) <= 1.0f && fabsf(rayOrigin.z) <= 1.0f) return true;
+
+	auto U = FLT_MAX;
+	auto isHit = false;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto sign = rayDir[i] > 0.0f ? 1.0f : (rayDir[i] < 0.0f ? -1.0f : 0.0f);
+		const auto u = (-sign - rayOrigin[i]) / rayDir[i];
+		if (u < 0.0f) continue;
+
+		const uint8_t j = (i + 1) % 3, k = (i + 2) % 3;
+		if (fabsf(rayDir[j] * u + rayOrigin[j]) > 1.0f) continue;
+		if (fabsf(rayDir[k] * u + rayOrigin[k]) > 1.0f) continue;
+		if (u < U)
+		{
+			U = u;
+			isHit = true;
+		}
+	}
+
+	rayOrigin = clamp(rayDir * U + rayOrigin, float3(-1.0f), float3(1.0f));
+
+	return isHit;
+}
+
+uint32_t CubeMap::GetPhase(uint32_t interleave, uint32_t frame)
+{
+	static const uint32_t phases[] = { 0, 3, 1, 2 };
+
+	return interleave == 4 ? phases[frame % 4] : (interleave > 1 ? frame % interleave : 0);
+}
@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Grid3D.h"
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------------------------------
+// Cube map of CSRayMarch.hlsl at a single LOD, holding the opacity of the view ray of each
+// texel, a face per slice; kept in float rather than rounded to the R8G8B8A8_UNORM of the
+// GPU. The checkerboard marching marches 1 of interleave texels per frame and rebuilds the
+// others from the cube map of the last frame as CSCubeReconstruct.hlsl
+//--------------------------------------------------------------------------------------
+class CubeMap
+{
+public:
+	CubeMap();
+	virtual ~CubeMap();
+
+	void Create(uint32_t size);
+
+	// CSCubeReconstruct.hlsl: each texel of the visible faces not marched this frame takes the
+	// history where the last eye saw its ray, clamped to the range of its marched neighbors,
+	// or their mean where the history falls out of it; the rebuilt and the rejected texels add
+	// to numRebuilt and numRejected
+	void Reconstruct(ThreadPool* pThreadPool, const CubeMap& history, const float3& eyePt, const float3& prevEyePt,
+		uint32_t interleave, uint32_t phase, uint64_t& numRebuilt, uint64_t& numRejected);
+
+	// Filtered within the face that dir points at, clamped at its edges, where TextureCube
+	// filters across the seams instead
+	float Sample(const float3& dir) const;
+
+	uint32_t GetSize() const;
+	Grid3D<float>& GetTexels();
+	const Grid3D<float>& GetTexels() const;
+
+	// Of CubeMap.hlsli and RayMarch.hlsli, in the [-1, 1] volume space
+	static float3 GetLocalPos(uint32_t x, uint32_t y, uint8_t face, uint32_t size);
+	static bool IsVisible(uint8_t face, const float3& localEyePt);
+	static bool IsMarched(uint32_t x, uint32_t y, uint32_t interleave, uint32_t phase);
+	static bool ComputeRayOrigin(float3& rayOrigin, const float3& rayDir);
+
+	// Phase of a frame, as Fluid::UpdateFrame cycles them: the diagonals of the 2x2 blocks
+	// first, so that 2 consecutive frames of interleave 4 cover a checkerboard
+	static uint32_t GetPhase(uint32_t interleave, uint32_t frame);
+
+	static const float HistoryTolerance;	// Beyond the range of the marched neighbors
+
+protected:
+	Grid3D<float> m_texels;
+};
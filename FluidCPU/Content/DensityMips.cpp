@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "DensityMips.h"
+
+using namespace std;
+
+DensityMips::DensityMips()
+{
+}
+
+DensityMips::~DensityMips()
+{
+}
+
+void DensityMips::Create(const uint3& gridSize)
+{
+	// Full mip chain below the density, halved down to a single cell
+	auto size = gridSize;
+	m_levels.clear();
+	do
+	{
+		size = uint3((max)(size.x >> 1, 1u), (max)(size.y >> 1, 1u), (max)(size.z >> 1, 1u));
+		m_levels.emplace_back(size);
+	} while (size.x > 1 || size.y > 1 || size.z > 1);
+}
+
+void DensityMips::Generate(ThreadPool* pThreadPool, const Grid3D<float4>& color)
+{
+	// One pass per level, as the GPU; a cell averages its 2x2x2 children, clamped to the
+	// level below as the mips of a single cell along an axis
+	for (size_t l = 0; l < m_levels.size(); ++l)
+	{
+		auto& dst = m_levels[l];
+		const auto& srcSize = l > 0 ? m_levels[l - 1].GetSize() : color.GetSize();
+		const auto& size = dst.GetSize();
+		pThreadPool->Dispatch(size.z, [&](uint32_t begin, uint32_t end)
+		{
+			uint3 cell;
+			for (cell.z = begin; cell.z < end; ++cell.z)
+				for (cell.y = 0; cell.y < size.y; ++cell.y)
+					for (cell.x = 0; cell.x < size.x; ++cell.x)
+					{
+						auto density = 0.0f;
+						for (uint8_t k = 0; k < 8; ++k)
+						{
+							const uint3 child((min)(cell.x * 2 + (k & 1), srcSize.x - 1),
+								(min)(cell.y * 2 + (k >> 1 & 1), srcSize.y - 1), (min)(cell.z * 2 + (k >> 2), srcSize.z - 1));
+							density += l > 0 ? m_levels[l - 1][child] : f16tof32(f32tof16(color[child].w));
+						}
+						dst[cell] = f16tof32(f32tof16(density / 8.0f));
+					}
+		});
+	}
+}
+
+float DensityMips::Sample(const QuantizedDensity& density, const float3& uvw, float mip) const
+{
+	if (mip <= 0.0f) return density.Sample(uvw);
+
+	// Trilinear between the levels around mip - 1, clamped to the coarsest
+	const auto level = (max)(mip - 1.0f, 0.0f);
+	const auto lo = (min)(static_cast<uint8_t>(level), static_cast<uint8_t>(GetNumLevels() - 1));
+	const auto hi = (min)(static_cast<uint8_t>(lo + 1), static_cast<uint8_t>(GetNumLevels() - 1));
+	const auto w = (min)(level - lo, 1.0f);
+	const auto coarse = lerp(SampleLinear(m_levels[lo], uvw, AddressMode::CLAMP),
+		SampleLinear(m_levels[hi], uvw, AddressMode::CLAMP), w);
+
+	return mip < 1.0f ? lerp(density.Sample(uvw), coarse, mip) : coarse;
+}
+
+uint8_t DensityMips::GetNumLevels() const
+{
+	return static_cast<uint8_t>(m_levels.size());
+}
+
+const Grid3D<float>& DensityMips::GetLevel(uint8_t level) const
+{
+	return m_levels[level];
+}
@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "QuantizedDensity.h"
+
+//--------------------------------------------------------------------------------------
+// Density mips of CSDensityMip.hlsl for the cone-traced light rays: level 0 is mip 1 of the
+// density, averaging 2x2x2 texels of the R16_FLOAT volume, and each coarser level averages
+// 2x2x2 cells of the level below; the levels round to half as their storage on the GPU
+//--------------------------------------------------------------------------------------
+class DensityMips
+{
+public:
+	DensityMips();
+	virtual ~DensityMips();
+
+	void Create(const uint3& gridSize);
+	void Generate(ThreadPool* pThreadPool, const Grid3D<float4>& color);	// Of the density (w)
+
+	// GetDensity of RayMarch.hlsli at a mip level, with the full resolution below level 1
+	float Sample(const QuantizedDensity& density, const float3& uvw, float mip) const;
+
+	uint8_t GetNumLevels() const;
+	const Grid3D<float>& GetLevel(uint8_t level) const;
+
+protected:
+	std::vector<Grid3D<float>> m_levels;
+};
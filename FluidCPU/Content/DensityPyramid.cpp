@@ -0,0 +1,144 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cfloat>
+#include "Brick.h"
+#include "DensityPyramid.h"
+
+using namespace std;
+
+DensityPyramid::DensityPyramid() :
+	m_gridSize(0, 0, 0)
+{
+}
+
+DensityPyramid::~DensityPyramid()
+{
+}
+
+void DensityPyramid::Create(const uint3& gridSize)
+{
+	m_gridSize = gridSize;
+
+	// Full mip chain of the brick grid, halved down to a single cell
+	auto size = GetBrickGridSize(gridSize);
+	m_levels.clear();
+	m_levels.emplace_back(size);
+	while (size.x > 1 || size.y > 1 || size.z > 1)
+	{
+		size = uint3((max)(size.x >> 1, 1u), (max)(size.y >> 1, 1u), (max)(size.z >> 1, 1u));
+		m_levels.emplace_back(size);
+	}
+}
+
+void DensityPyramid::Build(ThreadPool* pThreadPool, const QuantizedDensity& density)
+{
+	const auto& gridSize = m_gridSize;
+	const auto extent = GetBrickExtent(gridSize);
+	const auto& brickGridSize = m_levels[0].GetSize();
+	const auto numBricks = brickGridSize.x * brickGridSize.y * brickGridSize.z;
+
+	// One brick per thread group, as the GPU pass; the footprint of a sample in the brick
+	// reaches one texel past it on each side, clamped to the grid
+	pThreadPool->Dispatch(numBricks, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const uint3 brick(i % brickGridSize.x, i / brickGridSize.x % brickGridSize.y,
+				i / (brickGridSize.x * brickGridSize.y));
+
+			uint3 lo, hi;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				const auto first = brick[j] * extent[j];
+				lo[j] = first > 0 ? first - 1 : 0;
+				hi[j] = (min)(first + extent[j], gridSize[j] - 1);
+			}
+
+			auto maxDensity = 0.0f;
+			for (auto z = lo.z; z <= hi.z; ++z)
+				for (auto y = lo.y; y <= hi.y; ++y)
+					for (auto x = lo.x; x <= hi.x; ++x)
+						maxDensity = (max)(density.Load(x, y, z), maxDensity);
+
+			m_levels[0][brick] = maxDensity;
+		}
+	});
+
+	// Coarser levels, one pass per level; a cell covers its 2x2x2 children, clamped to the
+	// level below as the mips of a single cell along an axis
+	for (size_t l = 1; l < m_levels.size(); ++l)
+	{
+		const auto& src = m_levels[l - 1];
+		auto& dst = m_levels[l];
+		const auto& srcSize = src.GetSize();
+		const auto& size = dst.GetSize();
+		pThreadPool->Dispatch(size.z, [&](uint32_t begin, uint32_t end)
+		{
+			uint3 cell;
+			for (cell.z = begin; cell.z < end; ++cell.z)
+				for (cell.y = 0; cell.y < size.y; ++cell.y)
+					for (cell.x = 0; cell.x < size.x; ++cell.x)
+					{
+						auto maxDensity = 0.0f;
+						for (uint8_t k = 0; k < 8; ++k)
+						{
+							const uint3 child((min)(cell.x * 2 + (k & 1), srcSize.x - 1),
+								(min)(cell.y * 2 + (k >> 1 & 1), srcSize.y - 1), (min)(cell.z * 2 + (k >> 2), srcSize.z - 1));
+							maxDensity = (max)(src[child], maxDensity);
+						}
+						dst[cell] = maxDensity;
+					}
+		});
+	}
+}
+
+uint32_t DensityPyramid::GetEmptySteps(const float3& uvw, const float3& dir, float step, float threshold,
+	uint64_t& numLoads) const
+{
+	const auto extent = GetBrickExtent(m_gridSize);
+	const auto texel = uvw * float3(m_gridSize);
+	uint3 brick;
+	for (uint8_t i = 0; i < 3; ++i) brick[i] = static_cast<uint32_t>((max)(texel[i], 0.0f)) / extent[i];
+
+	// Coarsest empty cell around the texel; the cells past the brick grid of a finer level
+	// are not covered by the coarser ones, so the climb stops there
+	auto level = -1;
+	for (uint8_t l = 0; l < GetNumLevels(); ++l)
+	{
+		const auto& maxima = m_levels[l];
+		const auto& size = maxima.GetSize();
+		const uint3 cell(brick.x >> l, brick.y >> l, brick.z >> l);
+		if (cell.x >= size.x || cell.y >= size.y || cell.z >= size.z) break;
+
+		++numLoads;
+		if (maxima[cell] > threshold) break;
+		level = l;
+	}
+	if (level < 0) return 0;
+
+	// Exit of the ray from the cell, in texels
+	auto tExit = FLT_MAX;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto cellSize = static_cast<float>(extent[i] << level);
+		const auto cellMin = static_cast<float>(brick[i] >> level) * cellSize;
+		const auto d = dir[i] * m_gridSize[i];
+		if (d > 0.0f) tExit = (min)((cellMin + cellSize - texel[i]) / d, tExit);
+		else if (d < 0.0f) tExit = (min)((cellMin - texel[i]) / d, tExit);
+	}
+
+	// The samples up to the exit, inclusive, have their footprints in the cell and its apron
+	return static_cast<uint32_t>((min)(tExit / step, 65535.0f)) + 1;
+}
+
+uint8_t DensityPyramid::GetNumLevels() const
+{
+	return static_cast<uint8_t>(m_levels.size());
+}
+
+const Grid3D<float>& DensityPyramid::GetLevel(uint8_t level) const
+{
+	return m_levels[level];
+}
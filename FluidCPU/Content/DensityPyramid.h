@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "QuantizedDensity.h"
+
+//--------------------------------------------------------------------------------------
+// Max-density pyramid of CSDensityPyramid.hlsl and CSDensityPyramidMip.hlsl for empty-space
+// skipping: level 0 holds the max of the decoded density over each brick and the texels
+// that the trilinear footprints of its samples reach, and each coarser level the max of
+// 2x2x2 cells of the level below
+//--------------------------------------------------------------------------------------
+class DensityPyramid
+{
+public:
+	DensityPyramid();
+	virtual ~DensityPyramid();
+
+	void Create(const uint3& gridSize);
+	void Build(ThreadPool* pThreadPool, const QuantizedDensity& density);
+
+	// GetEmptySteps of RayMarch.hlsli: the samples of a ray stepping at a fixed step from uvw,
+	// along dir in texture space, that fall in the coarsest cell around uvw with a max within
+	// the threshold; 0 if the brick of uvw exceeds it. The pyramid loads add to numLoads
+	uint32_t GetEmptySteps(const float3& uvw, const float3& dir, float step, float threshold,
+		uint64_t& numLoads) const;
+
+	uint8_t GetNumLevels() const;
+	const Grid3D<float>& GetLevel(uint8_t level) const;
+
+protected:
+	std::vector<Grid3D<float>> m_levels;
+	uint3 m_gridSize;
+};
@@ -0,0 +1,1017 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.h"
+#include "SamplerSIMD.h"
+#include "PoissonCoarse.h"
+#include "PoissonDCT.h"
+#include "PoissonJacobi.h"
+#include "PoissonMultigrid.h"
+#include "PoissonPCG.h"
+#include "PoissonSOR.h"
+#include "FluidCPU.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Constants, mirrored from CSAdvect.hlsl, Impulse.hlsli and CSProject[2|3]D.hlsl
+//--------------------------------------------------------------------------------------
+static const float3	g_extForce = float3(0.0f, 48.0f, 0.0f);
+static const float	g_forceScl3D = 4.0f;
+static const float	g_vortScl = 200.0f;
+static const float	g_dissipation = 0.2f;
+
+static const float3	g_impulsePos = float3(0.5f, 0.1f, 0.5f);
+static const float	g_impulseR = 1.0f / 16.0f;
+static const float3	g_impulseColor = float3(0.2f, 0.4f, 1.0f);
+static const float	g_impulseDensity = 40.0f;
+static const float4	g_impulse = float4(g_impulseColor, 1.0f) * g_impulseDensity;
+
+static const float	g_density2D = 1.0f;
+static const float	g_density3D = 0.48f;
+
+// Coarsest pressure solve, at quarter resolution
+static const uint8_t	g_maxPressureLevel = 2;
+
+// Back-traced positions per call of the batched samplers
+static const uint32_t	g_numBatchSamples = 64;
+
+// MacCormack correction, mirrored from CSAdvect.hlsl: beyond a cell per step the back-trace
+// no longer inverts the forward trace, so the error it estimates is meaningless
+static const float		g_maxCorrectedCells = 1.0f;
+
+// Sub-steps that MacCormack may take per frame when sub-stepping is off, mirrored in Fluid.cpp
+static const uint32_t	g_maxCorrectedSubsteps = 16;
+
+// Sparse bricks, mirrored from Brick.hlsli
+static const float		g_activeDensity = 1.0f / 256.0f;
+static const float		g_activeSpeed = 1.0e-2f;
+static const uint8_t	g_maxIdleSteps = 2;
+
+//--------------------------------------------------------------------------------------
+// The direct and Krylov solvers of Fluid::Simulate only run at full resolution
+//--------------------------------------------------------------------------------------
+static inline bool IsCoarseSolvable(FluidCPU::ProjectionMode mode)
+{
+	return mode != FluidCPU::PROJECT_DCT && mode != FluidCPU::PROJECT_PCG;
+}
+
+//--------------------------------------------------------------------------------------
+// Adaptive Jacobi budget, mirrored in Fluid.cpp: grows by half while the residual misses
+// the target and sinks by an eighth once it is below half of the target, so bursts are
+// caught within a few frames and calm flows settle at a few sweeps
+//--------------------------------------------------------------------------------------
+static inline uint32_t AdaptIterations(uint32_t numIterations, float residual,
+	float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	if (residual > targetResidual) numIterations += (max)(numIterations / 2, 1u);
+	else if (residual >= 0.0f && residual < 0.5f * targetResidual) numIterations -= (max)(numIterations / 8, 1u);
+
+	return (min)((max)(numIterations, minIterations), maxIterations);
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-steps of a frame, mirrored in Fluid.cpp: as few equal steps as cover the frame time
+// without any cell travelling more than cflNumber cells at the largest speed (in cells per
+// unit time); past maxSubsteps, the frame time is cut rather than the CFL number exceeded
+//--------------------------------------------------------------------------------------
+static inline uint32_t ScheduleSubsteps(float& timeStep, float frameTime, float maxCellSpeed,
+	float cflNumber, uint32_t maxSubsteps)
+{
+	const auto stableStep = maxCellSpeed > 0.0f ? cflNumber / maxCellSpeed : frameTime;
+	const auto numSubsteps = (min)(static_cast<uint32_t>((max)(ceilf(frameTime / stableStep), 1.0f)), maxSubsteps);
+	timeStep = (min)(frameTime / numSubsteps, stableStep);
+
+	return numSubsteps;
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-stepping of MacCormack advection, mirrored in Fluid.cpp: the correction only holds
+// while the trace moves at most a cell per step, so the CFL number is capped at that, and
+// sub-stepping that is off turns on with up to g_maxCorrectedSubsteps per frame
+//--------------------------------------------------------------------------------------
+static inline void LimitCorrectedSubstepping(float& cflNumber, uint32_t& maxSubsteps)
+{
+	if (cflNumber <= 0.0f) maxSubsteps = (max)(maxSubsteps, g_maxCorrectedSubsteps);
+	cflNumber = cflNumber > 0.0f ? (min)(cflNumber, g_maxCorrectedCells) : g_maxCorrectedCells;
+}
+
+//--------------------------------------------------------------------------------------
+// Largest speed in cells per unit time over all components, as reduced by CSMaxSpeed.hlsl
+//--------------------------------------------------------------------------------------
+static float GetMaxCellSpeed(ThreadPool* pThreadPool, const Grid3D<float3>& u)
+{
+	const auto& gridSize = u.GetSize();
+	const auto is3D = gridSize.z > 1;
+
+	// One partial maximum per slice
+	vector<float3> sliceMaxima(is3D ? gridSize.z : gridSize.y, float3(0.0f));
+	ForEachSlab(pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+		{
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+			{
+				auto& sliceMax = sliceMaxima[is3D ? cell.z : cell.y];
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x)
+				{
+					const auto& v = u[cell];
+					for (uint8_t i = 0; i < 3; ++i) sliceMax[i] = (max)(fabsf(v[i]), sliceMax[i]);
+				}
+			}
+		}
+	});
+
+	float3 maxSpeed(0.0f);
+	for (const auto& sliceMax : sliceMaxima)
+		for (uint8_t i = 0; i < 3; ++i) maxSpeed[i] = (max)(sliceMax[i], maxSpeed[i]);
+
+	return (max)((max)(maxSpeed.x * gridSize.x, maxSpeed.y * gridSize.y), maxSpeed.z * gridSize.z);
+}
+
+//--------------------------------------------------------------------------------------
+// Runs func(cell) over the listed bricks, or over the whole grid without a list
+//--------------------------------------------------------------------------------------
+template<typename Func>
+static void ForEachActiveCell(ThreadPool* pThreadPool, const uint3& gridSize, const vector<uint32_t>* pBricks, const Func& func)
+{
+	if (pBricks) ForEachBrickCell(pThreadPool, gridSize, *pBricks, func);
+	else ForEachCell(pThreadPool, gridSize, func);
+}
+
+//--------------------------------------------------------------------------------------
+// Runs func(begin, width) over the rows of the listed bricks, or of the whole grid
+// without a list, so that the samples along a row can be batched; the listed bricks that
+// follow each other along x are walked as one run, so a row spans the whole run
+//--------------------------------------------------------------------------------------
+template<typename Func>
+static void ForEachActiveRow(ThreadPool* pThreadPool, const uint3& gridSize, const vector<uint32_t>* pBricks, const Func& func)
+{
+	const auto forEachRow = [&](const uint3& begin, const uint3& end)
+	{
+		for (auto z = begin.z; z < end.z; ++z)
+			for (auto y = begin.y; y < end.y; ++y) func(uint3(begin.x, y, z), end.x - begin.x);
+	};
+
+	if (!pBricks)
+	{
+		ForEachSlab(pThreadPool, gridSize, forEachRow);
+		return;
+	}
+
+	// The list is sorted, so a run is the listed bricks of consecutive indices within a brick row
+	const auto& bricks = *pBricks;
+	const auto extent = GetBrickExtent(gridSize);
+	const auto brickGridSize = GetBrickGridSize(gridSize);
+	vector<uint32_t> runs;
+	for (size_t i = 0; i < bricks.size(); ++i)
+		if (i == 0 || bricks[i] != bricks[i - 1] + 1 || bricks[i] % brickGridSize.x == 0)
+			runs.push_back(static_cast<uint32_t>(i));
+	const auto numRuns = static_cast<uint32_t>(runs.size());
+	runs.push_back(static_cast<uint32_t>(bricks.size()));
+
+	// A brick is still handled by one thread, with its run
+	pThreadPool->Dispatch(numRuns, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const auto first = bricks[runs[i]];
+			const auto last = bricks[runs[i + 1] - 1];
+			const uint3 runBegin(first % brickGridSize.x * extent.x, first / brickGridSize.x % brickGridSize.y * extent.y,
+				first / (brickGridSize.x * brickGridSize.y) * extent.z);
+			const uint3 runEnd((min)((last % brickGridSize.x + 1) * extent.x, gridSize.x),
+				(min)(runBegin.y + extent.y, gridSize.y), (min)(runBegin.z + extent.z, gridSize.z));
+			forEachRow(runBegin, runEnd);
+		}
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Whether an advected cell keeps its brick active, as marked by CSAdvect.hlsl with _SPARSE_
+//--------------------------------------------------------------------------------------
+static inline bool IsCellBusy(const float3& u, const float4& color)
+{
+	return color.w > g_activeDensity || fabsf(u.x) > g_activeSpeed || fabsf(u.y) > g_activeSpeed || fabsf(u.z) > g_activeSpeed;
+}
+
+//--------------------------------------------------------------------------------------
+// Color as CSAdvect.hlsl writes it, with the albedo unpremultiplied in R10G10B10A2_UNORM
+// and the attenuated density in R16_FLOAT, then premultiplied again as it is read
+//--------------------------------------------------------------------------------------
+static inline float4 StoreSplitColor(const float4& color, float atten)
+{
+	const auto density = f16tof32(f32tof16(color.w * atten));
+	float3 albedo(0.0f);
+	if (color.w > 0.0f)
+		for (uint8_t i = 0; i < 3; ++i) albedo[i] = floorf(saturate(color[i] / color.w) * 1023.0f + 0.5f) / 1023.0f;
+
+	return float4(albedo * density, density);
+}
+
+static inline uint3 GetBrick(const uint3& cell, const uint3& extent)
+{
+	return uint3(cell.x / extent.x, cell.y / extent.y, cell.z / extent.z);
+}
+
+//--------------------------------------------------------------------------------------
+// Grid space to simulation space
+//--------------------------------------------------------------------------------------
+static inline float3 GridToSimulationSpace(const uint3& index, const float3& gridSize)
+{
+	return (float3(index) + 0.5f) / gridSize;
+}
+
+//--------------------------------------------------------------------------------------
+// Gaussian function
+//--------------------------------------------------------------------------------------
+static inline float Gaussian(const float3& disp, float r)
+{
+	return expf(-4.0f * dot(disp, disp) / (r * r));
+}
+
+//--------------------------------------------------------------------------------------
+// External force of the impulse at a displacement from its center
+//--------------------------------------------------------------------------------------
+static inline float3 GetImpulseForce(const float3& disp, float basis, bool is3D)
+{
+	const auto vortForce = float3(-disp.z, 0.0f, disp.x) * g_vortScl;
+	const auto extForce = g_extForce * basis;
+
+	return is3D ? extForce * g_forceScl3D + vortForce : extForce;
+}
+
+//--------------------------------------------------------------------------------------
+// Sample a component of the staggered velocity, stored half a cell before the center
+//--------------------------------------------------------------------------------------
+static inline float SampleFace(const Grid3D<float3>& u, float3 pos, const float3& gridSize, uint8_t axis)
+{
+	pos[axis] += 0.5f / gridSize[axis];
+
+	return SampleLinear(u, pos, axis, AddressMode::MIRROR);
+}
+
+//--------------------------------------------------------------------------------------
+// MacCormack limiter: a corrected value out of the range of the texels that the forward
+// semi-Lagrangian sample interpolated reverts to that sample, so the scheme creates no new
+// extrema; clamping instead pins such values to the extremes of the range, which adds mass
+// and noise at the plume edges
+//--------------------------------------------------------------------------------------
+template<typename T>
+static inline T LimitToFootprint(const Grid3D<T>& grid, const LinearFootprint& f, const T& value, const T& fallback)
+{
+	auto minValue = grid(f.x[0], f.y[0], f.z[0]);
+	auto maxValue = minValue;
+	for (uint8_t i = 1; i < 8; ++i)
+	{
+		const auto& texel = grid(f.x[i & 1], f.y[i >> 1 & 1], f.z[i >> 2]);
+		minValue = min(texel, minValue);
+		maxValue = max(texel, maxValue);
+	}
+
+	auto result = value;
+	for (uint8_t i = 0; i < sizeof(T) / sizeof(float); ++i)
+		if (value[i] < minValue[i] || value[i] > maxValue[i]) result[i] = fallback[i];
+
+	return result;
+}
+
+static inline float LimitToFootprint(const Grid3D<float3>& grid, const LinearFootprint& f, uint8_t component,
+	float value, float fallback)
+{
+	auto minValue = grid(f.x[0], f.y[0], f.z[0])[component];
+	auto maxValue = minValue;
+	for (uint8_t i = 1; i < 8; ++i)
+	{
+		const auto texel = grid(f.x[i & 1], f.y[i >> 1 & 1], f.z[i >> 2])[component];
+		minValue = (min)(texel, minValue);
+		maxValue = (max)(texel, maxValue);
+	}
+
+	return value < minValue || value > maxValue ? fallback : value;
+}
+
+//--------------------------------------------------------------------------------------
+// Whether a displacement in simulation space is short enough for the MacCormack correction
+//--------------------------------------------------------------------------------------
+static inline bool IsCorrectable(const float3& disp, const float3& gridSize)
+{
+	return fabsf(disp.x) * gridSize.x <= g_maxCorrectedCells && fabsf(disp.y) * gridSize.y <= g_maxCorrectedCells &&
+		fabsf(disp.z) * gridSize.z <= g_maxCorrectedCells;
+}
+
+//--------------------------------------------------------------------------------------
+// Staggered velocity at a cell center, or at the face of the component along an axis;
+// the same as sampling there, but averaging the nearest faces directly
+//--------------------------------------------------------------------------------------
+static inline float3 GetStaggeredVelocity(const Grid3D<float3>& u, const uint3& cell, const uint3& gridSize)
+{
+	float3 v;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		auto next = cell;
+		next[i] = (min)(cell[i] + 1, gridSize[i] - 1);
+		v[i] = 0.5f * (u[cell][i] + u[next][i]);
+	}
+
+	return v;
+}
+
+static inline float3 GetStaggeredVelocity(const Grid3D<float3>& u, const uint3& cell, const uint3& gridSize, uint8_t axis)
+{
+	auto prev = cell;
+	prev[axis] = cell[axis] > 0 ? cell[axis] - 1 : 0;
+
+	auto v = u[cell];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		if (i == axis) continue;
+		auto next = cell, prevNext = prev;
+		next[i] = prevNext[i] = (min)(cell[i] + 1, gridSize[i] - 1);
+		v[i] = 0.25f * (u[cell][i] + u[prev][i] + u[next][i] + u[prevNext][i]);
+	}
+
+	return v;
+}
+
+//--------------------------------------------------------------------------------------
+// Compute divergence using central differences
+//--------------------------------------------------------------------------------------
+static inline float GetDivergence(const Grid3D<float3>& u, const size_t cells[NUM_NEIGHBOR])
+{
+	const auto fL = u[cells[NEIGHBOR_L]].x;
+	const auto fR = u[cells[NEIGHBOR_R]].x;
+	const auto fU = u[cells[NEIGHBOR_U]].y;
+	const auto fD = u[cells[NEIGHBOR_D]].y;
+	const auto fF = u[cells[NEIGHBOR_F]].z;
+	const auto fB = u[cells[NEIGHBOR_B]].z;
+
+	return 0.5f * ((fR - fL) + (fD - fU) + (fB - fF));
+}
+
+//--------------------------------------------------------------------------------------
+// Compute divergence of the staggered velocity using compact differences; the faces on
+// the domain boundary are solid walls
+//--------------------------------------------------------------------------------------
+static inline float GetStaggeredDivergence(const Grid3D<float3>& u, const size_t cells[NUM_NEIGHBOR], size_t cell)
+{
+	const auto fL = cells[NEIGHBOR_L] != cell ? u[cell].x : 0.0f;
+	const auto fR = cells[NEIGHBOR_R] != cell ? u[cells[NEIGHBOR_R]].x : 0.0f;
+	const auto fU = cells[NEIGHBOR_U] != cell ? u[cell].y : 0.0f;
+	const auto fD = cells[NEIGHBOR_D] != cell ? u[cells[NEIGHBOR_D]].y : 0.0f;
+	const auto fF = cells[NEIGHBOR_F] != cell ? u[cell].z : 0.0f;
+	const auto fB = cells[NEIGHBOR_B] != cell ? u[cells[NEIGHBOR_B]].z : 0.0f;
+
+	return (fR - fL) + (fD - fU) + (fB - fF);
+}
+
+//--------------------------------------------------------------------------------------
+// Project the velocity onto its divergence-free component
+//--------------------------------------------------------------------------------------
+static inline void Project(float3& u, const Grid3D<float>& q, const size_t cells[NUM_NEIGHBOR], float density)
+{
+	// Compute the gradient using central differences
+	const float3 grad(q[cells[NEIGHBOR_R]] - q[cells[NEIGHBOR_L]],
+		q[cells[NEIGHBOR_D]] - q[cells[NEIGHBOR_U]], q[cells[NEIGHBOR_B]] - q[cells[NEIGHBOR_F]]);
+	u -= 0.5f * grad / density;
+}
+
+//--------------------------------------------------------------------------------------
+// Project the staggered velocity onto its divergence-free component; the compact gradient
+// is the exact adjoint of the divergence, so no density scaling is needed
+//--------------------------------------------------------------------------------------
+static inline void ProjectStaggered(float3& u, const Grid3D<float>& q, const size_t cells[NUM_NEIGHBOR], size_t cell)
+{
+	const auto qC = q[cell];
+	u.x = cells[NEIGHBOR_L] != cell ? u.x - (qC - q[cells[NEIGHBOR_L]]) : 0.0f;
+	u.y = cells[NEIGHBOR_U] != cell ? u.y - (qC - q[cells[NEIGHBOR_U]]) : 0.0f;
+	u.z = cells[NEIGHBOR_F] != cell ? u.z - (qC - q[cells[NEIGHBOR_F]]) : 0.0f;
+}
+
+FluidCPU::FluidCPU() :
+	m_gridSize(0, 0, 0),
+	m_projectionMode(PROJECT_JACOBI),
+	m_projectionStats(),
+	m_maxIterations(128),
+	m_tolerance(1.0e-2f),
+	m_omega(1.8f),
+	m_pressureLevel(0),
+	m_velocityLayout(VELOCITY_COLLOCATED),
+	m_advectionScheme(ADVECT_SEMI_LAGRANGIAN),
+	m_isSparse(false),
+	m_isSplitDensity(false),
+	m_residuals(),
+	m_targetResidual(0.1f),
+	m_numIterations(64),
+	m_minIterations(4),
+	m_maxAdaptiveIterations(64),	// ITER
+	m_stepStats(),
+	m_maxCellSpeeds(),
+	m_cflNumber(0.0f),
+	m_maxSubsteps(1),
+	m_frameIndex(0),
+	m_frameParity(0)
+{
+}
+
+FluidCPU::~FluidCPU()
+{
+}
+
+bool FluidCPU::Init(const uint3& gridSize, uint32_t numThreads)
+{
+	if (gridSize.x == 0 || gridSize.y == 0 || gridSize.z == 0) return false;
+
+	m_gridSize = gridSize;
+	m_threadPool = make_unique<ThreadPool>();
+	if (!m_threadPool->Init(numThreads)) return false;
+
+	// Create resources
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		m_velocities[i].Create(gridSize, 0.0f);
+		m_colors[i].Create(gridSize, 0.0f);
+	}
+
+	m_incompress.Create(gridSize, 0.0f);
+	m_divergence.Create(gridSize, 0.0f);
+	if (!SetAdvectionScheme(m_advectionScheme)) return false;
+	if (!SetSparseBricks(m_isSparse)) return false;
+
+	return SetProjectionMode(m_projectionMode);
+}
+
+bool FluidCPU::SetProjectionMode(ProjectionMode mode)
+{
+	switch (mode)
+	{
+	case PROJECT_MULTIGRID_V:
+	case PROJECT_MULTIGRID_F:
+	{
+		auto multigrid = make_unique<PoissonMultigrid>();
+		multigrid->SetCycleType(mode == PROJECT_MULTIGRID_F ? PoissonMultigrid::F_CYCLE : PoissonMultigrid::V_CYCLE);
+		m_poissonSolver = move(multigrid);
+		break;
+	}
+	case PROJECT_DCT:
+		m_poissonSolver = make_unique<PoissonDCT>();
+		break;
+	case PROJECT_PCG:
+	{
+		auto pcg = make_unique<PoissonPCG>();
+		pcg->SetTolerance(m_tolerance);
+		pcg->SetMaxIterations(m_maxIterations);
+		m_poissonSolver = move(pcg);
+		break;
+	}
+	case PROJECT_SOR:
+	{
+		auto sor = make_unique<PoissonSOR>();
+		sor->SetOmega(m_omega);
+		m_poissonSolver = move(sor);
+		break;
+	}
+	default:
+		m_poissonSolver = make_unique<PoissonJacobi>();
+	}
+
+	if (m_pressureLevel > 0 && IsCoarseSolvable(mode))
+		m_poissonSolver = make_unique<PoissonCoarse>(move(m_poissonSolver), m_pressureLevel);
+
+	m_projectionMode = mode;
+
+	// Start from the full budget until residuals arrive
+	for (auto& residual : m_residuals) residual = -1.0f;
+	m_numIterations = m_maxAdaptiveIterations;
+
+	return m_poissonSolver->Init(m_threadPool.get(), m_gridSize);
+}
+
+bool FluidCPU::SetProjectionBudget(float tolerance, uint32_t maxIterations)
+{
+	m_tolerance = tolerance;
+	m_maxIterations = maxIterations;
+
+	return m_projectionMode == PROJECT_PCG && m_threadPool ? SetProjectionMode(m_projectionMode) : true;
+}
+
+bool FluidCPU::SetOverRelaxation(float omega)
+{
+	// Diverges outside (0, 2)
+	if (omega <= 0.0f || omega >= 2.0f) return false;
+	m_omega = omega;
+
+	return m_projectionMode == PROJECT_SOR && m_threadPool ? SetProjectionMode(m_projectionMode) : true;
+}
+
+bool FluidCPU::SetAdaptiveBudget(float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	if (targetResidual <= 0.0f || minIterations == 0 || minIterations > maxIterations) return false;
+
+	m_targetResidual = targetResidual;
+	m_minIterations = minIterations;
+	m_maxAdaptiveIterations = maxIterations;
+	m_numIterations = (min)((max)(m_numIterations, minIterations), maxIterations);
+
+	return true;
+}
+
+bool FluidCPU::SetPressureLevel(uint8_t level)
+{
+	if (level > g_maxPressureLevel) return false;
+	m_pressureLevel = level;
+
+	return m_threadPool ? SetProjectionMode(m_projectionMode) : true;
+}
+
+bool FluidCPU::SetVelocityLayout(VelocityLayout layout)
+{
+	if (layout >= NUM_VELOCITY_LAYOUT) return false;
+	m_velocityLayout = layout;
+
+	return true;
+}
+
+bool FluidCPU::SetAdvectionScheme(AdvectionScheme scheme)
+{
+	if (scheme >= NUM_ADVECTION_SCHEME) return false;
+	m_advectionScheme = scheme;
+
+	// The predictions are only kept for MacCormack
+	if (scheme == ADVECT_MACCORMACK && m_gridSize.x > 0)
+	{
+		m_predictedVelocity.Create(m_gridSize, 0.0f);
+		m_predictedColor.Create(m_gridSize, 0.0f);
+	}
+	else
+	{
+		m_predictedVelocity = Grid3D<float3>();
+		m_predictedColor = Grid3D<float4>();
+	}
+
+	return true;
+}
+
+bool FluidCPU::SetSubstepping(float cflNumber, uint32_t maxSubsteps)
+{
+	if (cflNumber < 0.0f || maxSubsteps == 0) return false;
+
+	m_cflNumber = cflNumber;
+	m_maxSubsteps = maxSubsteps;
+
+	return true;
+}
+
+bool FluidCPU::SetSparseBricks(bool isSparse)
+{
+	m_isSparse = isSparse;
+
+	// Every brick starts active, until the advection marks the busy ones
+	if (isSparse && m_gridSize.x > 0)
+	{
+		const auto brickGridSize = GetBrickGridSize(m_gridSize);
+		m_brickMask.Create(brickGridSize, 0);
+		m_idleSteps.Create(brickGridSize, 0);
+	}
+	else
+	{
+		m_brickMask = Grid3D<uint8_t>();
+		m_idleSteps = Grid3D<uint8_t>();
+	}
+	m_activeBricks.clear();
+
+	return true;
+}
+
+bool FluidCPU::SetSplitDensity(bool isSplit)
+{
+	m_isSplitDensity = isSplit;
+
+	return true;
+}
+
+void FluidCPU::Simulate(float timeStep)
+{
+	if (timeStep <= 0.0f) return;
+
+	// Adapt to the residual and speed of ReadbackLatency frames ago, as the GPU reads them back
+	if (m_projectionMode == PROJECT_JACOBI_ADAPTIVE)
+	{
+		const auto residual = m_residuals[m_frameIndex];
+		m_numIterations = AdaptIterations(m_numIterations, residual, m_targetResidual,
+			m_minIterations, m_maxAdaptiveIterations);
+		m_projectionStats.Residual = residual;
+
+		auto pSolver = m_poissonSolver.get();
+		if (GetPressureLevel() > 0) pSolver = static_cast<PoissonCoarse*>(pSolver)->GetSolver();
+		static_cast<PoissonJacobi*>(pSolver)->SetMaxIterations(m_numIterations);
+	}
+
+	auto cflNumber = m_cflNumber;
+	auto maxSubsteps = m_maxSubsteps;
+	if (m_advectionScheme == ADVECT_MACCORMACK) LimitCorrectedSubstepping(cflNumber, maxSubsteps);
+
+	const auto maxCellSpeed = m_maxCellSpeeds[m_frameIndex];
+	m_stepStats.NumSubsteps = 1;
+	m_stepStats.TimeStep = timeStep;
+	if (cflNumber > 0.0f) m_stepStats.NumSubsteps = ScheduleSubsteps(m_stepStats.TimeStep,
+		timeStep, maxCellSpeed, cflNumber, maxSubsteps);
+	m_stepStats.Courant = maxCellSpeed * m_stepStats.TimeStep;
+	m_stepStats.CFLNumber = cflNumber;
+
+	for (auto i = 0u; i < m_stepStats.NumSubsteps; ++i)
+	{
+		m_frameParity = !m_frameParity;
+		if (m_isSparse) buildBricks();
+		if (m_velocityLayout == VELOCITY_STAGGERED) advectStaggered(m_stepStats.TimeStep);
+		else advect(m_stepStats.TimeStep);
+		project();
+	}
+
+	// Divergence error of the last sub-step: the residual of the pressure on the full grid,
+	// relative to the divergence, as measured by CSResidualNorm.hlsl
+	{
+		const auto pThreadPool = m_threadPool.get();
+		const auto b = PoissonSolver::GetDeviation(pThreadPool, m_divergence);
+		const auto r = PoissonSolver::GetResidualNorm(pThreadPool, m_incompress, m_divergence);
+		m_projectionStats.DivergenceError = b > 0.0 ? static_cast<float>(r / b) : 0.0f;
+	}
+
+	m_residuals[m_frameIndex] = m_projectionStats.DivergenceError;
+	m_maxCellSpeeds[m_frameIndex] = cflNumber > 0.0f ? GetMaxCellSpeed(m_threadPool.get(), m_velocities[0]) : 0.0f;
+	m_frameIndex = (m_frameIndex + 1) % ReadbackLatency;
+}
+
+const Grid3D<float3>& FluidCPU::GetVelocity() const
+{
+	return m_velocities[0];
+}
+
+const Grid3D<float4>& FluidCPU::GetColor() const
+{
+	return m_colors[m_frameParity];
+}
+
+const Grid3D<float>& FluidCPU::GetIncompress() const
+{
+	return m_incompress;
+}
+
+const Grid3D<float>& FluidCPU::GetDivergence() const
+{
+	return m_divergence;
+}
+
+FluidCPU::ProjectionMode FluidCPU::GetProjectionMode() const
+{
+	return m_projectionMode;
+}
+
+uint8_t FluidCPU::GetPressureLevel() const
+{
+	return IsCoarseSolvable(m_projectionMode) ? m_pressureLevel : 0;
+}
+
+FluidCPU::VelocityLayout FluidCPU::GetVelocityLayout() const
+{
+	return m_velocityLayout;
+}
+
+FluidCPU::AdvectionScheme FluidCPU::GetAdvectionScheme() const
+{
+	return m_advectionScheme;
+}
+
+bool FluidCPU::IsSparseBricks() const
+{
+	return m_isSparse;
+}
+
+bool FluidCPU::IsSplitDensity() const
+{
+	return m_isSplitDensity;
+}
+
+float FluidCPU::GetActiveBrickFraction() const
+{
+	return m_isSparse ? static_cast<float>(m_activeBricks.size()) / m_idleSteps.GetNumCells() : 1.0f;
+}
+
+const FluidCPU::ProjectionStats& FluidCPU::GetProjectionStats() const
+{
+	return m_projectionStats;
+}
+
+const FluidCPU::StepStats& FluidCPU::GetStepStats() const
+{
+	return m_stepStats;
+}
+
+PoissonSolver* FluidCPU::GetPoissonSolver() const
+{
+	return m_poissonSolver.get();
+}
+
+const uint3& FluidCPU::GetGridSize() const
+{
+	return m_gridSize;
+}
+
+ThreadPool* FluidCPU::GetThreadPool() const
+{
+	return m_threadPool.get();
+}
+
+void FluidCPU::advect(float timeStep)
+{
+	const auto& txVelocity = m_velocities[0];
+	const auto& txColor = m_colors[!m_frameParity];
+	auto& rwVelocity = m_velocities[1];
+	auto& rwColor = m_colors[m_frameParity];
+
+	const float3 gridSize(m_gridSize);
+	const auto is3D = m_gridSize.z > 1;
+	const auto impulseR = is3D ? g_impulseR : g_impulseR * 0.5f;
+	const auto atten = (max)(1.0f - g_dissipation * timeStep, 0.0f);
+	const auto pBricks = m_isSparse ? &m_activeBricks : nullptr;
+	const auto brickExtent = GetBrickExtent(m_gridSize);
+
+	// Forward semi-Lagrangian prediction, without forces (CSAdvect.hlsl with _PREDICTOR_)
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+	if (isMacCormack) ForEachActiveRow(m_threadPool.get(), m_gridSize, pBricks, [&](const uint3& begin, uint32_t width)
+	{
+		float3 positions[g_numBatchSamples];
+		for (auto x = 0u; x < width; x += g_numBatchSamples)
+		{
+			const auto n = (min)(width - x, g_numBatchSamples);
+			const uint3 batchBegin(begin.x + x, begin.y, begin.z);
+			for (auto i = 0u; i < n; ++i)
+			{
+				const uint3 cell(batchBegin.x + i, batchBegin.y, batchBegin.z);
+				positions[i] = GridToSimulationSpace(cell, gridSize) - txVelocity[cell] * timeStep;
+			}
+			SampleLinear(&m_predictedVelocity[batchBegin], txVelocity, positions, n, AddressMode::MIRROR);
+			const auto pPredictedColors = &m_predictedColor[batchBegin];
+			SampleLinear(pPredictedColors, txColor, positions, n, AddressMode::MIRROR);
+			if (m_isSplitDensity) for (auto i = 0u; i < n; ++i) pPredictedColors[i] = StoreSplitColor(pPredictedColors[i], 1.0f);
+		}
+	});
+
+	ForEachActiveRow(m_threadPool.get(), m_gridSize, pBricks, [&](const uint3& begin, uint32_t width)
+	{
+		float3 positions[g_numBatchSamples], velocities[g_numBatchSamples];
+		float4 colors[g_numBatchSamples];
+		for (auto x = 0u; x < width; x += g_numBatchSamples)
+		{
+			// Advections, batched along the row; MacCormack traces the predicted color back
+			const auto n = (min)(width - x, g_numBatchSamples);
+			for (auto i = 0u; i < n; ++i)
+			{
+				const uint3 cell(begin.x + x + i, begin.y, begin.z);
+				const auto pos = GridToSimulationSpace(cell, gridSize);
+				positions[i] = isMacCormack ? pos + txVelocity[cell] * timeStep : pos - txVelocity[cell] * timeStep;
+			}
+			if (!isMacCormack) SampleLinear(velocities, txVelocity, positions, n, AddressMode::MIRROR);
+			SampleLinear(colors, isMacCormack ? m_predictedColor : txColor, positions, n, AddressMode::MIRROR);
+
+			for (auto i = 0u; i < n; ++i)
+			{
+				const uint3 cell(begin.x + x + i, begin.y, begin.z);
+				auto u = txVelocity[cell];
+				const auto pos = GridToSimulationSpace(cell, gridSize);
+				float4 color;
+				if (isMacCormack)
+				{
+					// Compensate half of the error of the predicted color within the range of the forward
+					// footprint; the velocity keeps the prediction, as the collocated projection does not
+					// see the checkerboard modes that an undamped velocity grows into
+					const auto footprint = GetLinearFootprint(m_gridSize, pos - u * timeStep, AddressMode::MIRROR);
+					color = IsCorrectable(u * timeStep, gridSize) ? LimitToFootprint(txColor, footprint, m_predictedColor[cell] +
+						(txColor[cell] - colors[i]) * 0.5f, m_predictedColor[cell]) : m_predictedColor[cell];
+					u = m_predictedVelocity[cell];
+				}
+				else
+				{
+					u = velocities[i];
+					color = colors[i];
+				}
+
+				// Impulse
+				const auto disp = pos - g_impulsePos;
+				const auto basis = Gaussian(disp, impulseR);
+				if (basis >= expf(-4.0f))
+				{
+					u += GetImpulseForce(disp, basis, is3D) * timeStep;
+					color = saturate(color + g_impulse * timeStep * basis);
+				}
+
+				// Output (pre-multiplied color)
+				rwVelocity[cell] = u * atten;
+				rwColor[cell] = m_isSplitDensity ? StoreSplitColor(color, atten) : color * atten;
+
+				// A brick is only handled by one thread, so the marks do not race
+				if (pBricks && IsCellBusy(rwVelocity[cell], rwColor[cell])) m_brickMask[GetBrick(cell, brickExtent)] = 1;
+			}
+		}
+	});
+}
+
+void FluidCPU::advectStaggered(float timeStep)
+{
+	const auto& txVelocity = m_velocities[0];
+	const auto& txColor = m_colors[!m_frameParity];
+	auto& rwVelocity = m_velocities[1];
+	auto& rwColor = m_colors[m_frameParity];
+
+	const float3 gridSize(m_gridSize);
+	const auto is3D = m_gridSize.z > 1;
+	const uint8_t numAxes = is3D ? 3 : 2;
+	const auto impulseR = is3D ? g_impulseR : g_impulseR * 0.5f;
+	const auto atten = (max)(1.0f - g_dissipation * timeStep, 0.0f);
+	const auto pBricks = m_isSparse ? &m_activeBricks : nullptr;
+	const auto brickExtent = GetBrickExtent(m_gridSize);
+
+	// Forward semi-Lagrangian prediction, without forces (CSAdvect.hlsl with _PREDICTOR_)
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+	if (isMacCormack) ForEachActiveCell(m_threadPool.get(), m_gridSize, pBricks, [&](const uint3& cell)
+	{
+		const auto pos = GridToSimulationSpace(cell, gridSize);
+		float3 u(0.0f);
+		for (uint8_t i = 0; i < numAxes; ++i)
+		{
+			auto facePos = pos;
+			facePos[i] -= 0.5f / gridSize[i];
+			const auto adv = facePos - GetStaggeredVelocity(txVelocity, cell, m_gridSize, i) * timeStep;
+			u[i] = SampleFace(txVelocity, adv, gridSize, i);
+		}
+		m_predictedVelocity[cell] = u;
+
+		const auto adv = pos - GetStaggeredVelocity(txVelocity, cell, m_gridSize) * timeStep;
+		const auto color = SampleLinear(txColor, adv, AddressMode::MIRROR);
+		m_predictedColor[cell] = m_isSplitDensity ? StoreSplitColor(color, 1.0f) : color;
+	});
+
+	ForEachActiveCell(m_threadPool.get(), m_gridSize, pBricks, [&](const uint3& cell)
+	{
+		// Advect each component from its own face
+		const auto pos = GridToSimulationSpace(cell, gridSize);
+		float3 u(0.0f);
+		for (uint8_t i = 0; i < numAxes; ++i)
+		{
+			auto facePos = pos;
+			facePos[i] -= 0.5f / gridSize[i];
+			const auto v = GetStaggeredVelocity(txVelocity, cell, m_gridSize, i);
+			const auto adv = facePos - v * timeStep;
+			if (isMacCormack)
+			{
+				auto footprintPos = adv;
+				footprintPos[i] += 0.5f / gridSize[i];
+				const auto footprint = GetLinearFootprint(m_gridSize, footprintPos, AddressMode::MIRROR);
+				const auto traced = SampleFace(m_predictedVelocity, facePos + v * timeStep, gridSize, i);
+				u[i] = IsCorrectable(v * timeStep, gridSize) ? LimitToFootprint(txVelocity, footprint, i,
+					m_predictedVelocity[cell][i] + 0.5f * (txVelocity[cell][i] - traced), m_predictedVelocity[cell][i]) :
+					m_predictedVelocity[cell][i];
+			}
+			else u[i] = SampleFace(txVelocity, adv, gridSize, i);
+
+			// Impulse
+			const auto disp = facePos - g_impulsePos;
+			const auto basis = Gaussian(disp, impulseR);
+			if (basis >= expf(-4.0f)) u[i] += GetImpulseForce(disp, basis, is3D)[i] * timeStep;
+		}
+
+		// Advect the color at the cell center
+		const auto v = GetStaggeredVelocity(txVelocity, cell, m_gridSize);
+		const auto adv = pos - v * timeStep;
+		float4 color;
+		if (isMacCormack)
+		{
+			const auto footprint = GetLinearFootprint(m_gridSize, adv, AddressMode::MIRROR);
+			color = IsCorrectable(v * timeStep, gridSize) ? LimitToFootprint(txColor, footprint, m_predictedColor[cell] +
+				(txColor[cell] - SampleLinear(m_predictedColor, pos + v * timeStep, AddressMode::MIRROR)) * 0.5f,
+				m_predictedColor[cell]) : m_predictedColor[cell];
+		}
+		else color = SampleLinear(txColor, adv, AddressMode::MIRROR);
+
+		const auto basis = Gaussian(pos - g_impulsePos, impulseR);
+		if (basis >= expf(-4.0f)) color = saturate(color + g_impulse * timeStep * basis);
+
+		// Output (pre-multiplied color)
+		rwVelocity[cell] = u * atten;
+		rwColor[cell] = m_isSplitDensity ? StoreSplitColor(color, atten) : color * atten;
+
+		// A brick is only handled by one thread, so the marks do not race
+		if (pBricks && IsCellBusy(rwVelocity[cell], rwColor[cell])) m_brickMask[GetBrick(cell, brickExtent)] = 1;
+	});
+}
+
+void FluidCPU::project()
+{
+	const auto& txVelocity = m_velocities[1];
+	auto& rwVelocity = m_velocities[0];
+
+	// The pressure is global, so the projection runs on the whole grid even when sparse; the
+	// skipped cells hold the velocity projected when their bricks were dropped (buildBricks)
+	const auto isStaggered = m_velocityLayout == VELOCITY_STAGGERED;
+
+	// Compute divergence
+	ForEachCell(m_threadPool.get(), m_gridSize, [&](const uint3& cell)
+	{
+		size_t cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, cell, m_gridSize);
+		const auto i = m_divergence.Index(cell.x, cell.y, cell.z);
+		m_divergence[i] = isStaggered ? GetStaggeredDivergence(txVelocity, cells, i) : ::GetDivergence(txVelocity, cells);
+	});
+
+	// Poisson solver, with the budget of adaptive Jacobi set per frame by Simulate
+	if (m_projectionMode == PROJECT_JACOBI_ADAPTIVE)
+	{
+		m_poissonSolver->Solve(m_incompress, m_divergence);
+		m_projectionStats.NumIterations = m_numIterations;
+	}
+	else
+	{
+		m_projectionStats.NumIterations = m_poissonSolver->Solve(m_incompress, m_divergence);
+		m_projectionStats.Residual = m_poissonSolver->GetRelativeResidual();
+	}
+	m_projectionStats.IsCapped = m_projectionMode == PROJECT_PCG && m_projectionStats.Residual > m_tolerance;
+
+	// Projection
+	const auto& q = m_incompress;
+	const auto density = m_gridSize.z > 1 ? g_density3D : g_density2D;
+	const float3 gridSize(m_gridSize);
+	ForEachCell(m_threadPool.get(), m_gridSize, [&](const uint3& cell)
+	{
+		size_t cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, cell, m_gridSize);
+
+		const auto i = q.Index(cell.x, cell.y, cell.z);
+		auto u = txVelocity[i];
+		if (isStaggered) ProjectStaggered(u, q, cells, i);
+		else Project(u, q, cells, density);
+
+		// Boundary process; the staggered faces on the boundary are already walls
+		if (!isStaggered)
+		{
+			const auto pos = GridToSimulationSpace(cell, gridSize) * 2.0f - 1.0f;
+			for (uint8_t i = 0; i < 3; ++i)
+				u[i] *= u[i] * pos[i] > 0.0f ? clamp((0.97f - fabsf(pos[i])) / 0.03f, -1.0f, 1.0f) : 1.0f;
+		}
+
+		rwVelocity[i] = u;
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// Active bricks of the next sub-step (CSBuildBricks.hlsl): a brick is busy if any brick of
+// its neighborhood was marked by the last advection, and stays active until its
+// neighborhood has been quiet for g_maxIdleSteps steps, so both color buffers are quiet
+// where it is skipped. A dropped brick copies its projected velocity over the advected one,
+// which the whole-grid projection reads in place of a stale advection
+//--------------------------------------------------------------------------------------
+void FluidCPU::buildBricks()
+{
+	const auto& brickGridSize = m_brickMask.GetSize();
+	const auto extent = GetBrickExtent(m_gridSize);
+
+	m_activeBricks.clear();
+	uint3 brick;
+	for (brick.z = 0; brick.z < brickGridSize.z; ++brick.z)
+	{
+		for (brick.y = 0; brick.y < brickGridSize.y; ++brick.y)
+		{
+			for (brick.x = 0; brick.x < brickGridSize.x; ++brick.x)
+			{
+				const uint3 begin((max)(brick.x, 1u) - 1, (max)(brick.y, 1u) - 1, (max)(brick.z, 1u) - 1);
+				const uint3 end((min)(brick.x + 2, brickGridSize.x), (min)(brick.y + 2, brickGridSize.y),
+					(min)(brick.z + 2, brickGridSize.z));
+
+				auto isBusy = false;
+				for (auto z = begin.z; z < end.z; ++z)
+					for (auto y = begin.y; y < end.y; ++y)
+						for (auto x = begin.x; x < end.x; ++x)
+							isBusy = isBusy || m_brickMask(x, y, z);
+
+				const auto i = m_idleSteps.Index(brick.x, brick.y, brick.z);
+				auto& idleSteps = m_idleSteps[i];
+				const auto wasActive = idleSteps < g_maxIdleSteps;
+				idleSteps = isBusy ? 0 : (min)(static_cast<uint8_t>(idleSteps + 1), g_maxIdleSteps);
+				if (idleSteps < g_maxIdleSteps) m_activeBricks.push_back(static_cast<uint32_t>(i));
+				else if (wasActive)
+				{
+					const uint3 cellBegin(brick.x * extent.x, brick.y * extent.y, brick.z * extent.z);
+					const uint3 cellEnd((min)(cellBegin.x + extent.x, m_gridSize.x),
+						(min)(cellBegin.y + extent.y, m_gridSize.y), (min)(cellBegin.z + extent.z, m_gridSize.z));
+					for (auto z = cellBegin.z; z < cellEnd.z; ++z)
+						for (auto y = cellBegin.y; y < cellEnd.y; ++y)
+							for (auto x = cellBegin.x; x < cellEnd.x; ++x)
+								m_velocities[1](x, y, z) = m_velocities[0](x, y, z);
+				}
+			}
+		}
+	}
+
+	// Cleared for the marks of the coming advection
+	m_brickMask.Fill(0);
+}
@@ -0,0 +1,144 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Headless CPU counterpart of Fluid::Simulate (CSAdvect.hlsl + CSProject[2|3]D.hlsl)
+//--------------------------------------------------------------------------------------
+class FluidCPU
+{
+public:
+	enum ProjectionMode : uint8_t
+	{
+		PROJECT_JACOBI,
+		PROJECT_MULTIGRID_V,
+		PROJECT_MULTIGRID_F,
+		PROJECT_DCT,
+		PROJECT_PCG,
+		PROJECT_SOR,
+		PROJECT_JACOBI_ADAPTIVE,
+
+		NUM_PROJECTION_MODE
+	};
+
+	enum VelocityLayout : uint8_t
+	{
+		VELOCITY_COLLOCATED,
+		VELOCITY_STAGGERED,	// MAC: component i on the face between cells (index - 1) and index along axis i
+
+		NUM_VELOCITY_LAYOUT
+	};
+
+	enum AdvectionScheme : uint8_t
+	{
+		ADVECT_SEMI_LAGRANGIAN,
+		ADVECT_MACCORMACK,	// Experimental second order, limited; always sub-steps at a CFL number of at most 1
+
+		NUM_ADVECTION_SCHEME
+	};
+
+	struct ProjectionStats
+	{
+		uint32_t NumIterations;
+		float Residual;		// Relative to the divergence; negative if the solver does not track it
+		float DivergenceError;	// RMS residual of the pressure on the full grid, relative to the RMS divergence
+		bool IsCapped;		// PCG stopped at its iteration cap short of the tolerance
+	};
+
+	struct StepStats
+	{
+		uint32_t NumSubsteps;
+		float TimeStep;		// Of each sub-step
+		float Courant;		// Cells travelled per sub-step at the largest speed it was scheduled for
+		float CFLNumber;	// Scheduled under, capped for MacCormack; 0 takes the frame in one step
+	};
+
+	FluidCPU();
+	virtual ~FluidCPU();
+
+	// numThreads = 0 uses all hardware threads
+	bool Init(const uint3& gridSize, uint32_t numThreads = 0);
+
+	bool SetProjectionMode(ProjectionMode mode);
+	bool SetProjectionBudget(float tolerance, uint32_t maxIterations);	// PCG only
+	bool SetOverRelaxation(float omega);	// SOR only; 1 is Gauss-Seidel
+	bool SetAdaptiveBudget(float targetResidual, uint32_t minIterations, uint32_t maxIterations);	// Adaptive Jacobi only
+	bool SetPressureLevel(uint8_t level);	// 0 is full, 1 half and 2 quarter resolution; not for DCT and PCG
+	bool SetVelocityLayout(VelocityLayout layout);	// Reinterprets the current velocity
+	bool SetAdvectionScheme(AdvectionScheme scheme);
+	bool SetSubstepping(float cflNumber, uint32_t maxSubsteps);	// cflNumber = 0 takes each frame in one step
+	bool SetSparseBricks(bool isSparse);	// Skips the bricks far from density and motion; projects on the full grid
+	bool SetSplitDensity(bool isSplit);	// Rounds the written color to the GPU storage: R16F density and RGB10 UNORM albedo
+	void Simulate(float timeStep);	// timeStep covers the frame, split into sub-steps under the CFL number
+
+	const Grid3D<float3>& GetVelocity() const;
+	const Grid3D<float4>& GetColor() const;
+	const Grid3D<float>& GetIncompress() const;
+	const Grid3D<float>& GetDivergence() const;
+	ProjectionMode GetProjectionMode() const;
+	uint8_t GetPressureLevel() const;	// 0 for the projection modes without a coarse solve
+	VelocityLayout GetVelocityLayout() const;
+	AdvectionScheme GetAdvectionScheme() const;
+	bool IsSparseBricks() const;
+	bool IsSplitDensity() const;
+	float GetActiveBrickFraction() const;	// Of the last sub-step; 1 without sparse bricks
+	const ProjectionStats& GetProjectionStats() const;
+	const StepStats& GetStepStats() const;
+	PoissonSolver* GetPoissonSolver() const;
+	const uint3& GetGridSize() const;
+	ThreadPool* GetThreadPool() const;
+
+	// Frames between measuring a residual or speed and acting on it, as the readback of Fluid::FrameCount
+	static const uint8_t ReadbackLatency = 3;
+
+protected:
+	void advect(float timeStep);
+	void advectStaggered(float timeStep);
+	void project();
+	void buildBricks();
+
+	std::unique_ptr<ThreadPool>		m_threadPool;
+	std::unique_ptr<PoissonSolver>	m_poissonSolver;
+
+	Grid3D<float>	m_incompress;
+	Grid3D<float>	m_divergence;
+	Grid3D<float3>	m_velocities[2];
+	Grid3D<float4>	m_colors[2];
+	Grid3D<float3>	m_predictedVelocity;	// MacCormack only
+	Grid3D<float4>	m_predictedColor;
+	Grid3D<uint8_t>	m_brickMask;	// Bricks left busy by the last advection
+	Grid3D<uint8_t>	m_idleSteps;	// Consecutive quiet steps of each brick's neighborhood
+
+	std::vector<uint32_t> m_activeBricks;
+
+	uint3			m_gridSize;
+	ProjectionMode	m_projectionMode;
+	ProjectionStats	m_projectionStats;
+	uint32_t		m_maxIterations;
+	float			m_tolerance;
+	float			m_omega;
+	uint8_t			m_pressureLevel;
+	VelocityLayout	m_velocityLayout;
+	AdvectionScheme	m_advectionScheme;
+	bool			m_isSparse;
+	bool			m_isSplitDensity;
+
+	// Adaptive Jacobi budget, driven by residuals of ReadbackLatency frames ago
+	float			m_residuals[ReadbackLatency];
+	float			m_targetResidual;
+	uint32_t		m_numIterations;
+	uint32_t		m_minIterations;
+	uint32_t		m_maxAdaptiveIterations;
+
+	// Sub-steps, driven by the largest speeds (in cells per unit time) of ReadbackLatency frames ago
+	StepStats		m_stepStats;
+	float			m_maxCellSpeeds[ReadbackLatency];
+	float			m_cflNumber;
+	uint32_t		m_maxSubsteps;
+	uint8_t			m_frameIndex;
+	uint8_t			m_frameParity;
+};
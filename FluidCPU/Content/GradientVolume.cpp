@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "GradientVolume.h"
+
+using namespace std;
+
+static float RoundSNorm8(float v)
+{
+	return floorf(clamp(v, -1.0f, 1.0f) * 127.0f + 0.5f) / 127.0f;
+}
+
+GradientVolume::GradientVolume()
+{
+}
+
+GradientVolume::~GradientVolume()
+{
+}
+
+void GradientVolume::Create(const uint3& gridSize)
+{
+	m_texels.Create(gridSize);
+}
+
+void GradientVolume::Build(ThreadPool* pThreadPool, const QuantizedDensity& density)
+{
+	// At the texel centers, the offset samples of Evaluate are the neighboring texels,
+	// clamped to the grid as the sampler
+	const auto& size = m_texels.GetSize();
+	pThreadPool->Dispatch(size.z, [&](uint32_t begin, uint32_t end)
+	{
+		uint3 cell;
+		for (cell.z = begin; cell.z < end; ++cell.z)
+			for (cell.y = 0; cell.y < size.y; ++cell.y)
+				for (cell.x = 0; cell.x < size.x; ++cell.x)
+				{
+					float3 gradient;
+					for (uint8_t i = 0; i < 3; ++i)
+					{
+						auto lo = cell, hi = cell;
+						lo[i] = cell[i] > 0 ? cell[i] - 1 : 0;
+						hi[i] = (min)(cell[i] + 1, size[i] - 1);
+						gradient[i] = density.Load(hi.x, hi.y, hi.z) - density.Load(lo.x, lo.y, lo.z);
+					}
+
+					const auto magnitude = length(gradient);
+					const auto direction = magnitude > 0.0f ? gradient / magnitude : float3(0.0f, 0.0f, 0.0f);
+					m_texels[cell] = magnitude > 0.0f ? float4(RoundSNorm8(direction.x), RoundSNorm8(direction.y),
+						RoundSNorm8(direction.z), RoundSNorm8((max)(magnitude, 1.0f / 127.0f))) : float4(0.0f, 0.0f, 0.0f, 0.0f);
+				}
+	});
+}
+
+float3 GradientVolume::Sample(const float3& uvw) const
+{
+	const auto gradient = SampleLinear(m_texels, uvw, AddressMode::CLAMP);
+
+	return gradient.xyz() * gradient.w;
+}
+
+float3 GradientVolume::Evaluate(const QuantizedDensity& density, const float3& uvw)
+{
+	// Central differences of a texel
+	const auto& gridSize = density.GetCodes().GetSize();
+	float3 gradient;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		auto offset = float3(0.0f, 0.0f, 0.0f);
+		offset[i] = 1.0f / gridSize[i];
+		gradient[i] = density.Sample(uvw + offset) - density.Sample(uvw - offset);
+	}
+
+	return gradient;
+}
+
+const Grid3D<float4>& GradientVolume::GetTexels() const
+{
+	return m_texels;
+}
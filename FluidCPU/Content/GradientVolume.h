@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "QuantizedDensity.h"
+
+//--------------------------------------------------------------------------------------
+// Density gradient of CSDensityGradient.hlsl, cached at the texel centers of the grid: the
+// central differences of the decoded density, packed as a unit direction and a magnitude
+// clamped to [1 / 127, 1], and rounded to 8-bit SNORM as the R8G8B8A8_SNORM volume of the GPU
+//--------------------------------------------------------------------------------------
+class GradientVolume
+{
+public:
+	GradientVolume();
+	virtual ~GradientVolume();
+
+	void Create(const uint3& gridSize);
+	void Build(ThreadPool* pThreadPool, const QuantizedDensity& density);
+
+	// GetDensityGradient of RayMarch.hlsli: 1 filtered fetch from the volume, with clamped addressing
+	float3 Sample(const float3& uvw) const;
+
+	// GetDensityGradient of RayMarch.hlsli without the volume: 6 filtered density samples
+	static float3 Evaluate(const QuantizedDensity& density, const float3& uvw);
+
+	const Grid3D<float4>& GetTexels() const;
+
+protected:
+	Grid3D<float4> m_texels;	// Direction in xyz, magnitude in w
+};
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.h"
+#include "LightMap.h"
+
+using namespace std;
+
+LightMap::LightMap() :
+	m_gridSize(0, 0, 0),
+	m_slab(0)
+{
+}
+
+LightMap::~LightMap()
+{
+}
+
+void LightMap::Create(const uint3& gridSize, const uint3& divisor)
+{
+	m_gridSize = gridSize;
+
+	uint3 size;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto d = (max)(divisor[i], 1u);
+		size[i] = (gridSize[i] + d - 1) / d;
+	}
+	m_texels.Create(size);
+	m_slab = 0;
+}
+
+float3 LightMap::GetRayOrigin(const uint3& texel) const
+{
+	return (float3(texel) + 0.5f) / float3(m_texels.GetSize()) * 2.0f - 1.0f;
+}
+
+bool LightMap::HasDensity(const QuantizedDensity& density, const DensityPyramid& pyramid, const uint3& texel,
+	float threshold) const
+{
+	const auto& size = m_texels.GetSize();
+	const auto uvw = GetRayOrigin(texel) * 0.5f + 0.5f;
+	if (size == m_gridSize) return density.Sample(uvw) >= threshold;
+
+	// GetFootprintMax of CSRayMarchL.hlsl: the view rays read the texel anywhere within one
+	// texel of its center
+	const auto& maxima = pyramid.GetLevel(0);
+	const auto extent = GetBrickExtent(m_gridSize);
+	uint3 lo, hi;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto gridSize = static_cast<float>(m_gridSize[i]);
+		lo[i] = static_cast<uint32_t>((min)((max)((uvw[i] - 1.0f / size[i]) * gridSize, 0.0f), gridSize - 1.0f)) / extent[i];
+		hi[i] = static_cast<uint32_t>((min)((max)((uvw[i] + 1.0f / size[i]) * gridSize, 0.0f), gridSize - 1.0f)) / extent[i];
+	}
+
+	auto maxDensity = 0.0f;
+	for (auto z = lo.z; z <= hi.z; ++z)
+		for (auto y = lo.y; y <= hi.y; ++y)
+			for (auto x = lo.x; x <= hi.x; ++x)
+				maxDensity = (max)(maxima[uint3(x, y, z)], maxDensity);
+
+	return maxDensity >= threshold;
+}
+
+float LightMap::Sample(const float3& uvw) const
+{
+	return SampleLinear(m_texels, uvw, AddressMode::CLAMP);
+}
+
+void LightMap::ScheduleRefresh(uint32_t interval, bool isFull, uint32_t& begin, uint32_t& end)
+{
+	const auto numSlices = m_texels.GetSize().z;
+	const auto numSlabs = (numSlices + 3) / 4;
+	if (isFull)
+	{
+		m_slab = 0;
+		interval = 1;
+	}
+
+	const auto numSlabsPerFrame = (numSlabs + (max)(interval, 1u) - 1) / (max)(interval, 1u);
+	const auto slabBegin = m_slab < numSlabs ? m_slab : 0;
+	const auto slabEnd = (min)(slabBegin + numSlabsPerFrame, numSlabs);
+	m_slab = slabEnd < numSlabs ? slabEnd : 0;
+
+	begin = slabBegin * 4;
+	end = (min)(slabEnd * 4, numSlices);
+}
+
+const uint3& LightMap::GetSize() const
+{
+	return m_texels.GetSize();
+}
+
+Grid3D<float>& LightMap::GetTexels()
+{
+	return m_texels;
+}
+
+const Grid3D<float>& LightMap::GetTexels() const
+{
+	return m_texels;
+}
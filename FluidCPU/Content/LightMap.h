@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DensityPyramid.h"
+
+//--------------------------------------------------------------------------------------
+// Light map of CSRayMarchL.hlsl at a resolution divided from the grid per axis: the texels
+// span the same volume, lit at their centers, and GetLight of RayMarch.hlsli filters them
+// trilinearly; it holds the transmittance towards the light
+//--------------------------------------------------------------------------------------
+class LightMap
+{
+public:
+	LightMap();
+	virtual ~LightMap();
+
+	void Create(const uint3& gridSize, const uint3& divisor);
+
+	float3 GetRayOrigin(const uint3& texel) const;	// In the [-1, 1] volume space
+
+	// Whether the texel casts rays: the density at its center on the grid resolution, and the
+	// brick maxima under its filter footprint when coarser, exceed the threshold
+	bool HasDensity(const QuantizedDensity& density, const DensityPyramid& pyramid, const uint3& texel,
+		float threshold) const;
+
+	float Sample(const float3& uvw) const;	// GetLight of RayMarch.hlsli, with clamped addressing
+
+	// Slices to ray-march this frame, from begin to end, as ScheduleLightMapRefresh of Fluid.cpp:
+	// slabs of 4 slices round-robin, each refreshed within interval frames; isFull takes all
+	void ScheduleRefresh(uint32_t interval, bool isFull, uint32_t& begin, uint32_t& end);
+
+	const uint3& GetSize() const;
+	Grid3D<float>& GetTexels();
+	const Grid3D<float>& GetTexels() const;
+
+protected:
+	Grid3D<float>	m_texels;
+	uint3			m_gridSize;
+	uint32_t		m_slab;	// Next to refresh
+};
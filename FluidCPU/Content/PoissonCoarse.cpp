@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "PoissonMultigrid.h"
+#include "PoissonCoarse.h"
+
+using namespace std;
+
+PoissonCoarse::PoissonCoarse(unique_ptr<PoissonSolver>&& solver, uint8_t numLevels) :
+	m_solver(move(solver)),
+	m_numLevels(numLevels)
+{
+}
+
+PoissonCoarse::~PoissonCoarse()
+{
+}
+
+bool PoissonCoarse::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!PoissonSolver::Init(pThreadPool, gridSize)) return false;
+
+	// Halve every axis (rounding up), as the multigrid levels of Fluid::Init
+	m_coarseX.clear();
+	m_coarseB.clear();
+	auto levelSize = gridSize;
+	for (uint8_t i = 0; i < m_numLevels; ++i)
+	{
+		levelSize = uint3((levelSize.x + 1) / 2, (levelSize.y + 1) / 2, (levelSize.z + 1) / 2);
+		m_coarseX.emplace_back(levelSize, 0.0f);
+		m_coarseB.emplace_back(levelSize, 0.0f);
+	}
+
+	return m_solver->Init(pThreadPool, levelSize);
+}
+
+uint32_t PoissonCoarse::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	if (m_numLevels == 0) return m_solver->Solve(x, b);
+
+	// The divergence is only solvable without its mean (removed by CSRemoveMean.hlsl);
+	// coarser levels restrict a zero guess, so their residuals are the restricted ones.
+	const auto bMean = static_cast<float>(GetMean(m_pThreadPool, b));
+	for (uint8_t i = 0; i < m_numLevels; ++i)
+	{
+		const auto& xf = i > 0 ? m_coarseX[i - 1] : x;
+		const auto& bf = i > 0 ? m_coarseB[i - 1] : b;
+		PoissonMultigrid::RestrictResidual(m_pThreadPool, m_coarseX[i], m_coarseB[i], xf, bf, i > 0 ? 0.0f : bMean);
+	}
+
+	const auto numIterations = m_solver->Solve(m_coarseX.back(), m_coarseB.back());
+
+	// Zero-initialized intermediate levels take the interpolation as is
+	for (auto i = m_numLevels; i > 0; --i)
+		PoissonMultigrid::Prolong(m_pThreadPool, i > 1 ? m_coarseX[i - 2] : x, m_coarseX[i - 1]);
+
+	return numIterations;
+}
+
+float PoissonCoarse::GetRelativeResidual() const
+{
+	return m_solver->GetRelativeResidual();
+}
+
+PoissonSolver* PoissonCoarse::GetSolver() const
+{
+	return m_solver.get();
+}
+
+uint8_t PoissonCoarse::GetNumLevels() const
+{
+	return m_numLevels;
+}
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Coarse pressure solve of Fluid::Simulate: restricts the residual of the previous
+// pressure to a grid halved numLevels times, solves for the correction there with
+// another solver, and prolongs it back; the pressure keeps only smooth detail
+//--------------------------------------------------------------------------------------
+class PoissonCoarse :
+	public PoissonSolver
+{
+public:
+	PoissonCoarse(std::unique_ptr<PoissonSolver>&& solver, uint8_t numLevels);
+	virtual ~PoissonCoarse();
+
+	bool Init(ThreadPool* pThreadPool, const uint3& gridSize) override;
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+	float GetRelativeResidual() const override;
+
+	PoissonSolver* GetSolver() const;
+	uint8_t GetNumLevels() const;
+
+protected:
+	std::unique_ptr<PoissonSolver> m_solver;
+
+	// Levels 1 to numLevels; level 0 is the caller's grid
+	std::vector<Grid3D<float>> m_coarseX;
+	std::vector<Grid3D<float>> m_coarseB;
+
+	uint8_t m_numLevels;
+};
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "PoissonDCT.h"
+
+using namespace std;
+
+static const double		g_pi = 3.14159265358979323846;
+static const uint32_t	g_batchSize = 8;
+
+PoissonDCT::PoissonDCT()
+{
+}
+
+PoissonDCT::~PoissonDCT()
+{
+}
+
+bool PoissonDCT::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!PoissonSolver::Init(pThreadPool, gridSize)) return false;
+
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto n = gridSize[i];
+		if (!m_transforms[i].Init(n)) return false;
+
+		// Eigenvalues of the 1D clamped-neighbor stencil x[k - 1] - 2 * x[k] + x[k + 1]
+		m_eigenvalues[i].resize(n);
+		for (auto k = 0u; k < n; ++k)
+			m_eigenvalues[i][k] = static_cast<float>(2.0 * cos(g_pi * k / n) - 2.0);
+	}
+
+	return true;
+}
+
+uint32_t PoissonDCT::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	// Transform b in the storage of x
+	m_pThreadPool->Dispatch(static_cast<uint32_t>(x.GetStorageSize()), [&](uint32_t begin, uint32_t end)
+	{
+		copy(b.GetData() + begin, b.GetData() + end, x.GetData() + begin);
+	});
+
+	for (uint8_t i = 0; i < 3; ++i) if (m_gridSize[i] > 1) transform(x, i, false);
+
+	// Divide by the eigenvalues; the constant mode (the mean of b) has none and is dropped
+	ForEachCell(m_pThreadPool, m_gridSize, [&](const uint3& k)
+	{
+		const auto lambda = m_eigenvalues[0][k.x] + m_eigenvalues[1][k.y] + m_eigenvalues[2][k.z];
+		x[k] = lambda < 0.0f ? x[k] / lambda : 0.0f;
+	});
+
+	for (uint8_t i = 3; i-- > 0;) if (m_gridSize[i] > 1) transform(x, i, true);
+
+	return 1;
+}
+
+void PoissonDCT::transform(Grid3D<float>& grid, uint8_t axis, bool isInverse)
+{
+	const auto& dct = m_transforms[axis];
+	const auto n = m_gridSize[axis];
+	const auto numLines = static_cast<uint32_t>(grid.GetNumCells() / n);
+	const auto stride = axis > 0 ? (axis > 1 ? static_cast<size_t>(m_gridSize.x) * m_gridSize.y : m_gridSize.x) : 1;
+
+	// Lines along y and z are gathered in batches of neighbors in x, so each strided
+	// access reads a run of contiguous cells
+	const auto batchSize = axis > 0 ? (min)(g_batchSize, m_gridSize.x) : 1;
+
+	m_pThreadPool->Dispatch(numLines, [&](uint32_t begin, uint32_t end)
+	{
+		vector<double> lines(static_cast<size_t>(n) * batchSize);
+		vector<complex<double>> work(dct.GetWorkSize());
+
+		for (auto i = begin; i < end;)
+		{
+			// First cell of the batch; lines along y are enumerated by (x, z)
+			const auto x = axis > 0 ? i % m_gridSize.x : 0;
+			const auto first = axis == 1 ? grid.Index(x, 0, i / m_gridSize.x) :
+				(axis > 1 ? i : static_cast<size_t>(i) * n);
+			const auto numBatchLines = (min)((min)(batchSize, end - i), axis > 0 ? m_gridSize.x - x : 1);
+			const auto pData = grid.GetData() + first;
+
+			for (auto j = 0u; j < n; ++j)
+				for (auto k = 0u; k < numBatchLines; ++k)
+					lines[k * n + j] = pData[j * stride + k];
+
+			for (auto k = 0u; k < numBatchLines; ++k)
+			{
+				if (isInverse) dct.Inverse(&lines[k * n], work.data());
+				else dct.Forward(&lines[k * n], work.data());
+			}
+
+			for (auto j = 0u; j < n; ++j)
+				for (auto k = 0u; k < numBatchLines; ++k)
+					pData[j * stride + k] = static_cast<float>(lines[k * n + j]);
+
+			i += numBatchLines;
+		}
+	});
+}
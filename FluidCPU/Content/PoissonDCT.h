@@ -0,0 +1,29 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "CosineTransform.h"
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Direct solve of CSCosineTransform.hlsl and CSSpectralSolve.hlsl; the clamped-neighbor
+// stencil on a box is diagonal in the DCT-II basis, so no iteration is needed
+//--------------------------------------------------------------------------------------
+class PoissonDCT :
+	public PoissonSolver
+{
+public:
+	PoissonDCT();
+	virtual ~PoissonDCT();
+
+	bool Init(ThreadPool* pThreadPool, const uint3& gridSize) override;
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+
+protected:
+	void transform(Grid3D<float>& grid, uint8_t axis, bool isInverse);
+
+	CosineTransform		m_transforms[3];
+	std::vector<float>	m_eigenvalues[3];
+};
@@ -0,0 +1,345 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "PoissonJacobi.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Jacobi update of cell i of a row; neighbors are summed in the order of GetNeighbors,
+// so every blocking produces the same bits. Returns the bits of the update's magnitude.
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+static inline uint32_t relaxCell(float* x1, const float* x0, const float* up, const float* down,
+	const float* front, const float* back, const float* b, uint32_t i, uint32_t l, uint32_t r)
+{
+	auto q = -b[i];
+	q += x0[l];
+	q += x0[r];
+	q += up[i];
+	q += down[i];
+	if (IS_3D)
+	{
+		q += front[i];
+		q += back[i];
+	}
+	q /= IS_3D ? 6.0f : 4.0f;
+
+	x1[i] = q;
+
+	const auto error = fabsf(q - x0[i]);
+	uint32_t bits;
+	memcpy(&bits, &error, sizeof(bits));
+
+	return bits;
+}
+
+//--------------------------------------------------------------------------------------
+// Relaxes a row given its clamped neighbor rows; returns the largest update. Non-negative
+// floats order like their bit patterns, so the maximum is reduced on integers, which
+// vectorizes without relaxing floating-point semantics.
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+static float relaxRow(float* x1, const float* x0, const float* up, const float* down,
+	const float* front, const float* back, const float* b, uint32_t width)
+{
+	const auto last = width - 1;
+	auto bits = relaxCell<IS_3D>(x1, x0, up, down, front, back, b, 0, 0, last > 0 ? 1 : 0);
+	if (last > 0)
+	{
+		// The boundary cells are peeled off, so the interior loop is free of clamps
+		for (auto i = 1u; i < last; ++i)
+			bits = (max)(relaxCell<IS_3D>(x1, x0, up, down, front, back, b, i, i - 1, i + 1), bits);
+		bits = (max)(relaxCell<IS_3D>(x1, x0, up, down, front, back, b, last, last - 1, last), bits);
+	}
+
+	float error;
+	memcpy(&error, &bits, sizeof(error));
+
+	return error;
+}
+
+static inline float relaxRow(float* x1, const float* x0, const float* up, const float* down,
+	const float* front, const float* back, const float* b, uint32_t width, bool is3D)
+{
+	return is3D ? relaxRow<true>(x1, x0, up, down, front, back, b, width) :
+		relaxRow<false>(x1, x0, up, down, front, back, b, width);
+}
+
+PoissonJacobi::PoissonJacobi() :
+	m_maxIterations(64),	// ITER
+	m_tolerance(0.001f),
+	m_tileSize(16),
+	m_timeBlock(1),
+	m_isAutotuned(true)
+{
+}
+
+PoissonJacobi::~PoissonJacobi()
+{
+}
+
+bool PoissonJacobi::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!PoissonSolver::Init(pThreadPool, gridSize)) return false;
+
+	m_x1.Create(gridSize, 0.0f);
+	m_sliceErrors.assign(gridSize.z > 1 ? gridSize.z : gridSize.y, 0.0f);
+	if (m_isAutotuned) autotune();
+
+	return true;
+}
+
+uint32_t PoissonJacobi::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	// The GPU relaxes in place with racy neighbor reads; the CPU reference uses
+	// double-buffered Jacobi sweeps, which are deterministic for any thread count.
+	auto k = 0u;
+	while (k < m_maxIterations)
+	{
+		const auto numSweeps = (min)(m_timeBlock, m_maxIterations - k);
+		relax(m_x1, x, b, numSweeps);
+
+		// Global counterpart of the per-cell early-out in CSPoisson.hlsli; a block that
+		// converges midway is redone from its input up to that sweep, so the result does
+		// not depend on the blocking.
+		const auto it = find_if(m_sweepErrors.cbegin(), m_sweepErrors.cend(),
+			[this](float error) { return error < m_tolerance; });
+		const auto isConverged = it != m_sweepErrors.cend();
+		const auto numApplied = isConverged ? static_cast<uint32_t>(it - m_sweepErrors.cbegin()) + 1 : numSweeps;
+		if (numApplied < numSweeps) relax(m_x1, x, b, numApplied);
+
+		x.Swap(m_x1);
+		k += numApplied;
+
+		if (isConverged) break;
+	}
+
+	return k;
+}
+
+void PoissonJacobi::SetMaxIterations(uint32_t maxIterations)
+{
+	m_maxIterations = maxIterations;
+}
+
+void PoissonJacobi::SetTolerance(float tolerance)
+{
+	m_tolerance = tolerance;
+}
+
+void PoissonJacobi::SetBlocking(uint32_t tileSize, uint32_t timeBlock)
+{
+	m_tileSize = (max)(tileSize, 1u);
+	m_timeBlock = timeBlock;
+	m_isAutotuned = timeBlock == 0;
+	if (m_isAutotuned)
+	{
+		m_timeBlock = 1;
+		if (m_pThreadPool) autotune();
+	}
+}
+
+uint32_t PoissonJacobi::GetTileSize() const
+{
+	return m_tileSize;
+}
+
+uint32_t PoissonJacobi::GetTimeBlock() const
+{
+	return m_timeBlock;
+}
+
+//--------------------------------------------------------------------------------------
+// Applies numSweeps sweeps from x0 to x1, leaving the largest update of each sweep in
+// m_sweepErrors; x0 is left intact
+//--------------------------------------------------------------------------------------
+void PoissonJacobi::relax(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b, uint32_t numSweeps)
+{
+	m_sweepErrors.resize(numSweeps);
+
+	if (numSweeps > 1) sweepTiles(x1, x0, b, numSweeps);
+	else sweep(x1, x0, b);
+}
+
+//--------------------------------------------------------------------------------------
+// Streams the whole grid once per sweep
+//--------------------------------------------------------------------------------------
+void PoissonJacobi::sweep(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b)
+{
+	const auto& gridSize = m_gridSize;
+	const auto is3D = gridSize.z > 1;
+
+	ForEachSlab(m_pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		for (auto z = begin.z; z < end.z; ++z)
+		{
+			for (auto y = begin.y; y < end.y; ++y)
+			{
+				const auto error = relaxRow(&x1(0, y, z), &x0(0, y, z),
+					&x0(0, y > 0 ? y - 1 : y, z), &x0(0, y + 1 < gridSize.y ? y + 1 : y, z),
+					&x0(0, y, z > 0 ? z - 1 : z), &x0(0, y, z + 1 < gridSize.z ? z + 1 : z),
+					&b(0, y, z), gridSize.x, is3D);
+
+				auto& sliceError = m_sliceErrors[is3D ? z : y];
+				sliceError = is3D && y > begin.y ? (max)(sliceError, error) : error;
+			}
+		}
+	});
+
+	m_sweepErrors[0] = *max_element(m_sliceErrors.cbegin(), m_sliceErrors.cend());
+}
+
+//--------------------------------------------------------------------------------------
+// Temporal blocking: each tile of whole rows is relaxed numSweeps times in a private
+// buffer with a halo of numSweeps cells, the valid region shrinking by one cell per sweep
+// (except at the grid boundary), and only the tile itself is written back. Halo cells
+// are computed redundantly by the neighboring tiles.
+//--------------------------------------------------------------------------------------
+void PoissonJacobi::sweepTiles(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b, uint32_t numSweeps)
+{
+	const auto& gridSize = m_gridSize;
+	const auto is3D = gridSize.z > 1;
+	const auto tileSize = m_tileSize;
+	const auto numTilesY = (gridSize.y + tileSize - 1) / tileSize;
+	const auto numTilesZ = is3D ? (gridSize.z + tileSize - 1) / tileSize : 1;
+	const auto numTiles = numTilesY * numTilesZ;
+	const auto haloZ = is3D ? numSweeps : 0;
+
+	m_tileErrors.resize(static_cast<size_t>(numTiles) * numSweeps);
+	m_pThreadPool->Dispatch(numTiles, [&](uint32_t begin, uint32_t end)
+	{
+		vector<float> buffers[2];
+		for (auto t = begin; t < end; ++t)
+		{
+			// Cells owned by the tile, and the loaded region with its halo
+			const uint3 tileBegin(0, (t % numTilesY) * tileSize, is3D ? (t / numTilesY) * tileSize : 0);
+			const uint3 tileEnd(gridSize.x, (min)(tileBegin.y + tileSize, gridSize.y),
+				is3D ? (min)(tileBegin.z + tileSize, gridSize.z) : 1);
+			const uint3 loadBegin(0, (max)(tileBegin.y, numSweeps) - numSweeps, (max)(tileBegin.z, haloZ) - haloZ);
+			const uint3 loadEnd(gridSize.x, (min)(tileEnd.y + numSweeps, gridSize.y), (min)(tileEnd.z + haloZ, gridSize.z));
+
+			const auto slicePitch = static_cast<size_t>(loadEnd.y - loadBegin.y) * gridSize.x;
+			const auto numCells = slicePitch * (loadEnd.z - loadBegin.z);
+			for (auto& buffer : buffers) buffer.resize(numCells);
+
+			for (auto z = loadBegin.z; z < loadEnd.z; ++z)
+				copy_n(&x0(0, loadBegin.y, z), slicePitch, &buffers[0][(z - loadBegin.z) * slicePitch]);
+
+			const auto errors = &m_tileErrors[static_cast<size_t>(t) * numSweeps];
+			for (auto s = 1u; s <= numSweeps; ++s)
+			{
+				const auto src = buffers[(s - 1) & 1].data();
+				const auto dst = buffers[s & 1].data();
+				const auto getRow = [&](float* buffer, uint32_t y, uint32_t z)
+				{
+					return buffer + (z - loadBegin.z) * slicePitch + static_cast<size_t>(y - loadBegin.y) * gridSize.x;
+				};
+
+				// The last sweep only updates the tile, directly into x1
+				const auto isLast = s == numSweeps;
+				const uint3 validBegin(0, loadBegin.y > 0 ? loadBegin.y + s : 0, loadBegin.z > 0 ? loadBegin.z + s : 0);
+				const uint3 validEnd(gridSize.x, loadEnd.y < gridSize.y ? loadEnd.y - s : gridSize.y,
+					loadEnd.z < gridSize.z ? loadEnd.z - s : gridSize.z);
+				const auto& updateBegin = isLast ? tileBegin : validBegin;
+				const auto& updateEnd = isLast ? tileEnd : validEnd;
+
+				auto error = 0.0f;
+				for (auto z = updateBegin.z; z < updateEnd.z; ++z)
+				{
+					for (auto y = updateBegin.y; y < updateEnd.y; ++y)
+					{
+						const auto rowError = relaxRow(isLast ? &x1(0, y, z) : getRow(dst, y, z), getRow(src, y, z),
+							getRow(src, y > 0 ? y - 1 : y, z), getRow(src, y + 1 < gridSize.y ? y + 1 : y, z),
+							getRow(src, y, z > 0 ? z - 1 : z), getRow(src, y, z + 1 < gridSize.z ? z + 1 : z),
+							&b(0, y, z), gridSize.x, is3D);
+
+						// Only the tile's own cells count, so every cell is measured exactly once
+						const auto isOwned = y >= tileBegin.y && y < tileEnd.y && z >= tileBegin.z && z < tileEnd.z;
+						error = isOwned ? (max)(rowError, error) : error;
+					}
+				}
+				errors[s - 1] = error;
+			}
+		}
+	});
+
+	// Largest update per sweep over all tiles
+	for (auto s = 0u; s < numSweeps; ++s)
+	{
+		auto& sweepError = m_sweepErrors[s];
+		sweepError = 0.0f;
+		for (auto t = 0u; t < numTiles; ++t)
+			sweepError = (max)(m_tileErrors[static_cast<size_t>(t) * numSweeps + s], sweepError);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Times a few sweeps of each blocking on zero grids (free of denormals) and keeps the
+// fastest per sweep; whole-grid sweeps are a candidate, so blocking never loses where
+// the sweep is compute-bound (small grids, or a last-level cache holding the grid)
+//--------------------------------------------------------------------------------------
+void PoissonJacobi::autotune()
+{
+	// Rows (and slices) per tile and sweeps per block; tiles of 8 drown in halo overhead
+	static const uint32_t blockings[][2] =
+	{
+		{ 1, 1 },
+		{ 16, 2 }, { 32, 2 },
+		{ 16, 4 }, { 32, 4 }, { 64, 4 },
+		{ 32, 8 }, { 64, 8 }
+	};
+	static const uint32_t minTrialSweeps = 4;
+	static const uint8_t numTrials = 2;
+
+	const auto is3D = m_gridSize.z > 1;
+	const auto extent = is3D ? (max)(m_gridSize.y, m_gridSize.z) : m_gridSize.y;
+	Grid3D<float> x(m_gridSize, 0.0f);
+	const Grid3D<float> b(m_gridSize, 0.0f);
+
+	// Warm-up sweep, so the first candidate does not pay for cold caches
+	relax(m_x1, x, b, 1);
+
+	auto bestTileSize = m_tileSize;
+	auto bestTimeBlock = 1u;
+	auto bestTime = 0.0;
+	for (const auto& blocking : blockings)
+	{
+		// A tile as large as the grid leaves no tiles to block
+		const auto tileSize = blocking[0];
+		const auto timeBlock = blocking[1];
+		if (timeBlock > 1 && tileSize >= extent) continue;
+
+		m_tileSize = tileSize;
+		m_timeBlock = timeBlock;
+		// Best of a few trials, as a single one is at the mercy of the scheduler
+		const auto numSweeps = (max)(timeBlock, minTrialSweeps);
+		auto time = 0.0;
+		for (uint8_t i = 0; i < numTrials; ++i)
+		{
+			const auto start = chrono::steady_clock::now();
+			for (auto k = 0u; k < numSweeps; k += timeBlock)
+			{
+				relax(m_x1, x, b, timeBlock);
+				x.Swap(m_x1);
+			}
+			const chrono::duration<double> duration = chrono::steady_clock::now() - start;
+			time = i > 0 ? (min)(duration.count() / numSweeps, time) : duration.count() / numSweeps;
+		}
+
+		if (timeBlock == 1 || time < bestTime)
+		{
+			bestTime = time;
+			bestTileSize = tileSize;
+			bestTimeBlock = timeBlock;
+		}
+	}
+
+	m_tileSize = bestTileSize;
+	m_timeBlock = bestTimeBlock;
+}
@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Jacobi relaxation of CSPoisson.hlsli (ITER sweeps with an early-out on the update),
+// temporally blocked: each tile is loaded with a halo of one cell per sweep and relaxed
+// several times in cache before its interior is written back
+//--------------------------------------------------------------------------------------
+class PoissonJacobi :
+	public PoissonSolver
+{
+public:
+	PoissonJacobi();
+	virtual ~PoissonJacobi();
+
+	bool Init(ThreadPool* pThreadPool, const uint3& gridSize) override;
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+
+	void SetMaxIterations(uint32_t maxIterations);
+	void SetTolerance(float tolerance);
+
+	// Tiles span whole rows and tileSize rows (and slices in 3D); timeBlock = 1 sweeps the
+	// whole grid at a time, and timeBlock = 0 autotunes both sizes at Init
+	void SetBlocking(uint32_t tileSize, uint32_t timeBlock);
+	uint32_t GetTileSize() const;
+	uint32_t GetTimeBlock() const;
+
+protected:
+	void relax(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b, uint32_t numSweeps);
+	void sweep(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b);
+	void sweepTiles(Grid3D<float>& x1, const Grid3D<float>& x0, const Grid3D<float>& b, uint32_t numSweeps);
+	void autotune();
+
+	Grid3D<float>		m_x1;
+	std::vector<float>	m_sliceErrors;
+	std::vector<float>	m_tileErrors;
+	std::vector<float>	m_sweepErrors;
+
+	uint32_t			m_maxIterations;
+	float				m_tolerance;
+	uint32_t			m_tileSize;
+	uint32_t			m_timeBlock;
+	bool				m_isAutotuned;
+};
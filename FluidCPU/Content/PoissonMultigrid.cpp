@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "PoissonMultigrid.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Constants, mirrored from Fluid.cpp
+//--------------------------------------------------------------------------------------
+static const uint32_t	g_coarsestSize = 4;
+static const uint32_t	g_numCoarsestSweeps = 16;
+
+PoissonMultigrid::PoissonMultigrid() :
+	m_cycleType(V_CYCLE),
+	m_bMean(0.0f),
+	m_numCycles(1),
+	m_numPreSweeps(2),
+	m_numPostSweeps(2)
+{
+}
+
+PoissonMultigrid::~PoissonMultigrid()
+{
+}
+
+bool PoissonMultigrid::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!PoissonSolver::Init(pThreadPool, gridSize)) return false;
+
+	// Halve every axis (rounding up) until the coarsest level is small enough for plain relaxation
+	m_coarseX.clear();
+	m_coarseB.clear();
+	auto levelSize = gridSize;
+	while ((max)((max)(levelSize.x, levelSize.y), levelSize.z) > g_coarsestSize)
+	{
+		levelSize = uint3((levelSize.x + 1) / 2, (levelSize.y + 1) / 2, (levelSize.z + 1) / 2);
+		m_coarseX.emplace_back(levelSize, 0.0f);
+		m_coarseB.emplace_back(levelSize, 0.0f);
+	}
+
+	return true;
+}
+
+uint32_t PoissonMultigrid::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	// With pure Neumann boundaries, b is only solvable without its mean; Gauss-Seidel
+	// smoothing otherwise stalls at a residual of the size of the mean.
+	m_bMean = static_cast<float>(GetMean(m_pThreadPool, b));
+
+	for (auto i = 0u; i < m_numCycles; ++i) cycle(x, b, 0, m_cycleType == F_CYCLE);
+
+	return m_numCycles;
+}
+
+void PoissonMultigrid::SetCycleType(CycleType cycleType)
+{
+	m_cycleType = cycleType;
+}
+
+void PoissonMultigrid::SetNumCycles(uint32_t numCycles)
+{
+	m_numCycles = numCycles;
+}
+
+void PoissonMultigrid::SetNumSweeps(uint8_t numPreSweeps, uint8_t numPostSweeps)
+{
+	m_numPreSweeps = numPreSweeps;
+	m_numPostSweeps = numPostSweeps;
+}
+
+uint8_t PoissonMultigrid::GetNumLevels() const
+{
+	return static_cast<uint8_t>(m_coarseX.size() + 1);
+}
+
+void PoissonMultigrid::cycle(Grid3D<float>& x, const Grid3D<float>& b, uint8_t level, bool isFCycle)
+{
+	// Restricted residuals have zero mean already
+	const auto bMean = level > 0 ? 0.0f : m_bMean;
+
+	if (level >= m_coarseX.size())
+	{
+		smooth(x, b, bMean, g_numCoarsestSweeps);
+		return;
+	}
+
+	auto& xc = m_coarseX[level];
+	auto& bc = m_coarseB[level];
+
+	smooth(x, b, bMean, m_numPreSweeps);
+	RestrictResidual(m_pThreadPool, xc, bc, x, b, bMean);
+
+	// An F-cycle recurses with an F-cycle followed by a V-cycle
+	cycle(xc, bc, level + 1, isFCycle);
+	if (isFCycle) cycle(xc, bc, level + 1, false);
+
+	Prolong(m_pThreadPool, x, xc);
+	smooth(x, b, bMean, m_numPostSweeps);
+}
+
+void PoissonMultigrid::smooth(Grid3D<float>& x, const Grid3D<float>& b, float bMean, uint32_t numSweeps)
+{
+	const auto& gridSize = x.GetSize();
+	const auto numNeighbors = GetNumNeighbors(gridSize);
+
+	for (auto k = 0u; k < numSweeps; ++k)
+	{
+		// Red-black Gauss-Seidel: cells of one color only read cells of the other color
+		for (uint8_t color = 0; color < 2; ++color)
+		{
+			ForEachSlab(m_pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+			{
+				uint3 cell;
+				for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+				{
+					for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+					{
+						for (cell.x = (cell.y + cell.z + color) & 1; cell.x < end.x; cell.x += 2)
+						{
+							size_t cells[NUM_NEIGHBOR];
+							GetNeighbors(cells, cell, gridSize);
+
+							auto q = bMean - b[cell];
+							for (uint8_t i = 0; i < numNeighbors; ++i) q += x[cells[i]];
+							x[cell] = q / numNeighbors;
+						}
+					}
+				}
+			});
+		}
+	}
+}
+
+void PoissonMultigrid::RestrictResidual(ThreadPool* pThreadPool, Grid3D<float>& xc, Grid3D<float>& bc,
+	const Grid3D<float>& x, const Grid3D<float>& b, float bMean)
+{
+	const auto& gridSize = x.GetSize();
+	const auto numNeighbors = GetNumNeighbors(gridSize);
+
+	ForEachCell(pThreadPool, bc.GetSize(), [&](const uint3& cell)
+	{
+		const uint3 cellMin(cell.x * 2, cell.y * 2, cell.z * 2);
+		const uint3 cellMax((min)(cellMin.x + 1, gridSize.x - 1),
+			(min)(cellMin.y + 1, gridSize.y - 1), (min)(cellMin.z + 1, gridSize.z - 1));
+
+		// Average the residuals of the children
+		auto r = 0.0f;
+		uint3 child;
+		for (child.z = cellMin.z; child.z <= cellMax.z; ++child.z)
+		{
+			for (child.y = cellMin.y; child.y <= cellMax.y; ++child.y)
+			{
+				for (child.x = cellMin.x; child.x <= cellMax.x; ++child.x)
+				{
+					size_t cells[NUM_NEIGHBOR];
+					GetNeighbors(cells, child, gridSize);
+					r += GetResidual(x, b, cells, x.Index(child.x, child.y, child.z), numNeighbors) - bMean;
+				}
+			}
+		}
+
+		const auto numChildren = (cellMax.x - cellMin.x + 1) * (cellMax.y - cellMin.y + 1) * (cellMax.z - cellMin.z + 1);
+
+		// The coarse stencil spans twice the cell size, hence the h^2 factor of 4
+		bc[cell] = 4.0f * r / numChildren;
+		xc[cell] = 0.0f;
+	});
+}
+
+void PoissonMultigrid::Prolong(ThreadPool* pThreadPool, Grid3D<float>& x, const Grid3D<float>& xc)
+{
+	const auto& gridSize = x.GetSize();
+	const auto& coarseSize = xc.GetSize();
+
+	ForEachCell(pThreadPool, gridSize, [&](const uint3& cell)
+	{
+		// Trilinear interpolation of the coarse correction at the fine cell center
+		uint3 i0, i1;
+		float3 w;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto pos = gridSize[i] > 1 ? clamp((cell[i] + 0.5f) * 0.5f - 0.5f, 0.0f, coarseSize[i] - 1.0f) : 0.0f;
+			i0[i] = static_cast<uint32_t>(pos);
+			i1[i] = (min)(i0[i] + 1, coarseSize[i] - 1);
+			w[i] = pos - i0[i];
+		}
+
+		const auto e00 = lerp(xc(i0.x, i0.y, i0.z), xc(i1.x, i0.y, i0.z), w.x);
+		const auto e10 = lerp(xc(i0.x, i1.y, i0.z), xc(i1.x, i1.y, i0.z), w.x);
+		const auto e01 = lerp(xc(i0.x, i0.y, i1.z), xc(i1.x, i0.y, i1.z), w.x);
+		const auto e11 = lerp(xc(i0.x, i1.y, i1.z), xc(i1.x, i1.y, i1.z), w.x);
+		x[cell] += lerp(lerp(e00, e10, w.y), lerp(e01, e11, w.y), w.z);
+	});
+}
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Geometric multigrid of CSSmooth.hlsl, CSRestrict.hlsl and CSProlong.hlsl
+//--------------------------------------------------------------------------------------
+class PoissonMultigrid :
+	public PoissonSolver
+{
+public:
+	enum CycleType : uint8_t
+	{
+		V_CYCLE,
+		F_CYCLE
+	};
+
+	PoissonMultigrid();
+	virtual ~PoissonMultigrid();
+
+	bool Init(ThreadPool* pThreadPool, const uint3& gridSize) override;
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+
+	void SetCycleType(CycleType cycleType);
+	void SetNumCycles(uint32_t numCycles);
+	void SetNumSweeps(uint8_t numPreSweeps, uint8_t numPostSweeps);
+
+	uint8_t GetNumLevels() const;
+
+	// Transfers of CSRestrict.hlsl (also zeroing xc) and CSProlong.hlsl (adding to x)
+	static void RestrictResidual(ThreadPool* pThreadPool, Grid3D<float>& xc, Grid3D<float>& bc,
+		const Grid3D<float>& x, const Grid3D<float>& b, float bMean);
+	static void Prolong(ThreadPool* pThreadPool, Grid3D<float>& x, const Grid3D<float>& xc);
+
+protected:
+	void cycle(Grid3D<float>& x, const Grid3D<float>& b, uint8_t level, bool isFCycle);
+	void smooth(Grid3D<float>& x, const Grid3D<float>& b, float bMean, uint32_t numSweeps);
+
+	// Levels 1 to n - 1; level 0 is the caller's grid
+	std::vector<Grid3D<float>> m_coarseX;
+	std::vector<Grid3D<float>> m_coarseB;
+
+	CycleType	m_cycleType;
+	float		m_bMean;
+	uint32_t	m_numCycles;
+	uint8_t		m_numPreSweeps;
+	uint8_t		m_numPostSweeps;
+};
@@ -0,0 +1,417 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "PoissonPCG.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Row of cells along x, with the offsets of its neighbor rows; a clamped neighbor row
+// has an offset of 0, so the cell stands in for it as in GetNeighbors
+//--------------------------------------------------------------------------------------
+struct StencilRow
+{
+	ptrdiff_t Begin;
+	uint32_t Width;
+	ptrdiff_t Up, Down, Front, Back;
+};
+
+//--------------------------------------------------------------------------------------
+// Runs func(i, l, r) over every step-th cell of a row from first, with the indices of its
+// left and right neighbors; the clamped end cells are peeled off, so the interior loop is
+// free of clamps
+//--------------------------------------------------------------------------------------
+template<typename Func>
+static inline void ForEachRowCell(const StencilRow& row, uint32_t first, uint32_t step, const Func& func)
+{
+	const auto last = row.Width - 1;
+	const auto i0 = row.Begin;
+	auto x = first;
+	if (x == 0)
+	{
+		func(i0, i0, last > 0 ? i0 + 1 : i0);
+		x += step;
+	}
+
+	for (; x < last; x += step) func(i0 + x, i0 + x - 1, i0 + x + 1);
+	if (x == last && last > 0) func(i0 + last, i0 + last - 1, i0 + last);
+}
+
+//--------------------------------------------------------------------------------------
+// Sum of value(j) over the neighbors j of cell i, in the order of GetNeighbors; clamped
+// neighbors count as the cell itself, or are skipped when they are excluded
+//--------------------------------------------------------------------------------------
+template<bool IS_3D, bool IS_CLAMPED_INCLUDED, typename Value>
+static inline float SumNeighbors(const Value& value, const StencilRow& row, ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+{
+	// The cell stands in for its clamped neighbors, so the value can be loaded unconditionally
+	const auto get = [&](ptrdiff_t j)
+	{
+		const auto v = value(j);
+		return IS_CLAMPED_INCLUDED || j != i ? v : 0.0f;
+	};
+
+	auto sum = get(l);
+	sum += get(r);
+	sum += get(i + row.Up);
+	sum += get(i + row.Down);
+	if (IS_3D)
+	{
+		sum += get(i + row.Front);
+		sum += get(i + row.Back);
+	}
+
+	return sum;
+}
+
+//--------------------------------------------------------------------------------------
+// Dot product over every step-th cell of a row from first; the cells are summed in 8 float
+// lanes in a fixed order, which vectorizes without relaxing floating-point semantics
+//--------------------------------------------------------------------------------------
+static inline double RowDot(const float* a, const float* b, const StencilRow& row, uint32_t first, uint32_t step)
+{
+	const auto pA = a + row.Begin;
+	const auto pB = b + row.Begin;
+	float lanes[8] = {};
+	auto x = first;
+	for (; x + 7 * step < row.Width; x += 8 * step)
+		for (auto j = 0u; j < 8; ++j) lanes[j] += pA[x + j * step] * pB[x + j * step];
+
+	auto sum = 0.0;
+	for (const auto& lane : lanes) sum += lane;
+	for (; x < row.Width; x += step) sum += static_cast<double>(pA[x]) * pB[x];
+
+	return sum;
+}
+
+//--------------------------------------------------------------------------------------
+// Number of non-clamped neighbors, the diagonal of K = -A
+//--------------------------------------------------------------------------------------
+static inline uint8_t GetDiagonal(const size_t cells[NUM_NEIGHBOR], size_t i, uint8_t numNeighbors)
+{
+	uint8_t d = 0;
+	for (uint8_t n = 0; n < numNeighbors; ++n) d += cells[n] != i ? 1 : 0;
+
+	return d;
+}
+
+//--------------------------------------------------------------------------------------
+// Runs func(row, sums) over the rows of the grid, summing per slice and then over slices
+// in a fixed order, so results match for any thread count
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void PoissonPCG::reduce(double sums[2], const Func& func)
+{
+	const auto& gridSize = m_gridSize;
+	const auto is3D = gridSize.z > 1;
+	const auto stride = static_cast<ptrdiff_t>(gridSize.x) * gridSize.y;
+
+	ForEachSlab(m_pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		for (auto z = begin.z; z < end.z; ++z)
+		{
+			for (auto y = begin.y; y < end.y; ++y)
+			{
+				StencilRow row;
+				row.Begin = z * stride + static_cast<ptrdiff_t>(y) * gridSize.x;
+				row.Width = gridSize.x;
+				row.Up = y > 0 ? -static_cast<ptrdiff_t>(gridSize.x) : 0;
+				row.Down = y + 1 < gridSize.y ? gridSize.x : 0;
+				row.Front = z > 0 ? -static_cast<ptrdiff_t>(stride) : 0;
+				row.Back = z + 1 < gridSize.z ? stride : 0;
+
+				double rowSums[2] = {};
+				func(row, (y + z) & 1, rowSums);
+
+				auto& sliceSums = m_sliceSums[is3D ? z : y];
+				const auto isFirstRow = !is3D || y == begin.y;
+				sliceSums[0] = (isFirstRow ? 0.0 : sliceSums[0]) + rowSums[0];
+				sliceSums[1] = (isFirstRow ? 0.0 : sliceSums[1]) + rowSums[1];
+			}
+		}
+	});
+
+	sums[0] = sums[1] = 0.0;
+	for (const auto& sliceSums : m_sliceSums)
+	{
+		sums[0] += sliceSums[0];
+		sums[1] += sliceSums[1];
+	}
+}
+
+PoissonPCG::PoissonPCG() :
+	m_preconditioner(JACOBI),
+	m_maxIterations(128),	// Converges within it at 1e-2 on the 48^3 to 128^3 simulations
+	m_tolerance(1.0e-2f),
+	m_residual(0.0f)
+{
+}
+
+PoissonPCG::~PoissonPCG()
+{
+}
+
+bool PoissonPCG::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!PoissonSolver::Init(pThreadPool, gridSize)) return false;
+
+	m_r[0].Create(gridSize, 0.0f);
+	m_r[1].Create(gridSize, 0.0f);
+	m_z.Create(gridSize, 0.0f);
+	m_p[0].Create(gridSize, 0.0f);
+	m_p[1].Create(gridSize, 0.0f);
+	m_q.Create(gridSize, 0.0f);
+	m_invPivots.Create(gridSize, 0.0f);
+	m_sliceSums.assign(gridSize.z > 1 ? gridSize.z : gridSize.y, array<double, 2>());
+	initPreconditioner();
+
+	return true;
+}
+
+uint32_t PoissonPCG::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	return m_gridSize.z > 1 ? solve<true>(x, b) : solve<false>(x, b);
+}
+
+float PoissonPCG::GetRelativeResidual() const
+{
+	return m_residual;
+}
+
+void PoissonPCG::SetPreconditioner(Preconditioner preconditioner)
+{
+	m_preconditioner = preconditioner;
+	if (m_pThreadPool) initPreconditioner();
+}
+
+void PoissonPCG::SetMaxIterations(uint32_t maxIterations)
+{
+	m_maxIterations = maxIterations;
+}
+
+void PoissonPCG::SetTolerance(float tolerance)
+{
+	m_tolerance = tolerance;
+}
+
+template<bool IS_3D>
+uint32_t PoissonPCG::solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	// CG needs a positive (semi-)definite operator, so it solves K x = -(b - mean(b)) with
+	// K = -A; with pure Neumann boundaries, only the zero-mean part of b is solvable.
+	const auto numNeighbors = static_cast<float>(GetNumNeighbors(m_gridSize));
+	const auto bMean = static_cast<float>(GetMean(m_pThreadPool, b));
+	const auto pX = &x[0];
+	const auto pB = &b[0];
+	const auto pQ = &m_q[0];
+	const auto pInvPivots = &m_invPivots[0];
+
+	// Initial residual from the previous solution, and the norm of the right-hand side
+	double sums[2];
+	{
+		const auto pR = &m_r[0][0];
+		const auto loadX = [pX](ptrdiff_t j) { return pX[j]; };
+		reduce(sums, [&](const StencilRow& row, uint32_t, double partials[2])
+		{
+			ForEachRowCell(row, 0, 1, [=](ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+			{
+				const auto rhs = bMean - pB[i];
+				const auto res = rhs - numNeighbors * pX[i] + SumNeighbors<IS_3D, true>(loadX, row, i, l, r);
+				pR[i] = res;
+				partials[0] += static_cast<double>(res) * res;
+				partials[1] += static_cast<double>(rhs) * rhs;
+			});
+		});
+	}
+
+	auto rr = sums[0];
+	const auto bb = sums[1];
+	const auto rrMax = static_cast<double>(m_tolerance) * m_tolerance * bb;
+
+	auto k = 0u;
+	if (rr > rrMax)
+	{
+		auto rz = precondition<IS_3D>();
+		auto beta = 0.0f;
+		const auto isJacobi = m_preconditioner == JACOBI;
+
+		while (k < m_maxIterations)
+		{
+			// Search direction p = z + beta * p and q = K p; the neighbors' directions are
+			// formed on the fly, so both updates share one pass.
+			{
+				const auto pZ = &m_z[0];
+				const auto pP0 = &m_p[0][0];
+				const auto pP1 = &m_p[1][0];
+				const auto loadP = [=](ptrdiff_t j) { return pZ[j] + beta * pP0[j]; };
+				reduce(sums, [&](const StencilRow& row, uint32_t, double partials[2])
+				{
+					ForEachRowCell(row, 0, 1, [=](ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+					{
+						const auto p = loadP(i);
+						const auto q = numNeighbors * p - SumNeighbors<IS_3D, true>(loadP, row, i, l, r);
+						pP1[i] = p;
+						pQ[i] = q;
+					});
+					partials[0] += RowDot(pP1, pQ, row, 0, 1);
+				});
+				m_p[0].Swap(m_p[1]);
+			}
+
+			// The direction vanishes only when the residual does
+			const auto pq = sums[0];
+			if (pq <= 0.0) break;
+
+			// Step along p, with the preconditioner folded into the same pass: all of Jacobi,
+			// or the black half of IC(0) from the stepped residuals of its red neighbors
+			{
+				const auto alpha = static_cast<float>(rz / pq);
+				const auto pP = &m_p[0][0];
+				const auto pZ = &m_z[0];
+				const auto pR0 = &m_r[0][0];
+				const auto pR1 = &m_r[1][0];
+				const auto loadY = [=](ptrdiff_t j) { return (pR0[j] - alpha * pQ[j]) * pInvPivots[j]; };
+				reduce(sums, [&](const StencilRow& row, uint32_t parity, double partials[2])
+				{
+					ForEachRowCell(row, 0, 1, [=](ptrdiff_t i, ptrdiff_t, ptrdiff_t)
+					{
+						const auto r = pR0[i] - alpha * pQ[i];
+						pX[i] += alpha * pP[i];
+						pR1[i] = r;
+					});
+					partials[0] += RowDot(pR1, pR1, row, 0, 1);
+
+					if (isJacobi)
+					{
+						ForEachRowCell(row, 0, 1, [=](ptrdiff_t i, ptrdiff_t, ptrdiff_t) { pZ[i] = pR1[i] * pInvPivots[i]; });
+						partials[1] += RowDot(pR1, pZ, row, 0, 1);
+					}
+					else
+					{
+						ForEachRowCell(row, !parity, 2, [=](ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+						{
+							pZ[i] = (pR1[i] + SumNeighbors<IS_3D, false>(loadY, row, i, l, r)) * pInvPivots[i];
+						});
+						partials[1] += RowDot(pR1, pZ, row, !parity, 2);
+					}
+				});
+				m_r[0].Swap(m_r[1]);
+			}
+			++k;
+
+			rr = sums[0];
+			if (rr <= rrMax) break;
+
+			const auto rzNew = isJacobi ? sums[1] : sums[1] + preconditionRed<IS_3D>();
+			beta = static_cast<float>(rzNew / rz);
+			rz = rzNew;
+		}
+	}
+
+	m_residual = bb > 0.0 ? static_cast<float>(sqrt(rr / bb)) : 0.0f;
+
+	return k;
+}
+
+void PoissonPCG::initPreconditioner()
+{
+	const auto numNeighbors = GetNumNeighbors(m_gridSize);
+
+	// Inverse diagonal; red cells keep it for IC(0) as well, since they only couple to black cells
+	ForEachCell(m_pThreadPool, m_gridSize, [&](const uint3& cell)
+	{
+		size_t cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, cell, m_gridSize);
+
+		const auto i = m_invPivots.Index(cell.x, cell.y, cell.z);
+		const auto d = GetDiagonal(cells, i, numNeighbors);
+		m_invPivots[i] = d > 0 ? 1.0f / d : 0.0f;
+	});
+
+	if (m_preconditioner != INCOMPLETE_CHOLESKY) return;
+
+	// Black pivots: d - sum(1 / d[red neighbors]) without fill-in
+	ForEachCell(m_pThreadPool, m_gridSize, [&](const uint3& cell)
+	{
+		if (((cell.x + cell.y + cell.z) & 1) == 0) return;
+
+		size_t cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, cell, m_gridSize);
+
+		const auto i = m_invPivots.Index(cell.x, cell.y, cell.z);
+		auto pivot = static_cast<float>(GetDiagonal(cells, i, numNeighbors));
+		for (uint8_t n = 0; n < numNeighbors; ++n) if (cells[n] != i) pivot -= m_invPivots[cells[n]];
+
+		// Breaks down only on degenerate grids of a few cells
+		m_invPivots[i] = pivot > 0.0f ? 1.0f / pivot : m_invPivots[i];
+	});
+}
+
+//--------------------------------------------------------------------------------------
+// z = M^-1 r from the residual alone, for the first iteration; returns r . z
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+double PoissonPCG::precondition()
+{
+	const auto pR = &m_r[0][0];
+	const auto pZ = &m_z[0];
+	const auto pInvPivots = &m_invPivots[0];
+	double sums[2];
+
+	if (m_preconditioner == INCOMPLETE_CHOLESKY)
+	{
+		// Solve (D + L) D^-1 (D + L^T) z = r: the forward red half is r / d, folded into
+		// the black pass, and the backward black half is z itself.
+		const auto loadY = [=](ptrdiff_t j) { return pR[j] * pInvPivots[j]; };
+		reduce(sums, [&](const StencilRow& row, uint32_t parity, double partials[2])
+		{
+			ForEachRowCell(row, !parity, 2, [=](ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+			{
+				const auto z = (pR[i] + SumNeighbors<IS_3D, false>(loadY, row, i, l, r)) * pInvPivots[i];
+				pZ[i] = z;
+				partials[0] += static_cast<double>(pR[i]) * z;
+			});
+		});
+
+		return sums[0] + preconditionRed<IS_3D>();
+	}
+
+	reduce(sums, [&](const StencilRow& row, uint32_t, double partials[2])
+	{
+		ForEachRowCell(row, 0, 1, [=](ptrdiff_t i, ptrdiff_t, ptrdiff_t)
+		{
+			const auto z = pR[i] * pInvPivots[i];
+			pZ[i] = z;
+			partials[0] += static_cast<double>(pR[i]) * z;
+		});
+	});
+
+	return sums[0];
+}
+
+//--------------------------------------------------------------------------------------
+// Backward red half of IC(0) from the black cells of z; returns its part of r . z
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+double PoissonPCG::preconditionRed()
+{
+	const auto pR = &m_r[0][0];
+	const auto pZ = &m_z[0];
+	const auto pInvPivots = &m_invPivots[0];
+	const auto loadZ = [pZ](ptrdiff_t j) { return pZ[j]; };
+
+	double sums[2];
+	reduce(sums, [&](const StencilRow& row, uint32_t parity, double partials[2])
+	{
+		ForEachRowCell(row, parity, 2, [=](ptrdiff_t i, ptrdiff_t l, ptrdiff_t r)
+		{
+			const auto z = (pR[i] + SumNeighbors<IS_3D, false>(loadZ, row, i, l, r)) * pInvPivots[i];
+			pZ[i] = z;
+			partials[0] += static_cast<double>(pR[i]) * z;
+		});
+	});
+
+	return sums[0];
+}
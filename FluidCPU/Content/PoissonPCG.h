@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Preconditioned conjugate gradient of CSPCGResidual.hlsl, CSPCGApply.hlsl,
+// CSPCGUpdate.hlsl and CSPCGReduce.hlsl, stopping at a relative residual tolerance
+//--------------------------------------------------------------------------------------
+class PoissonPCG :
+	public PoissonSolver
+{
+public:
+	enum Preconditioner : uint8_t
+	{
+		JACOBI,
+		INCOMPLETE_CHOLESKY	// IC(0) in red-black order, applied in two parallel half sweeps
+	};
+
+	PoissonPCG();
+	virtual ~PoissonPCG();
+
+	bool Init(ThreadPool* pThreadPool, const uint3& gridSize) override;
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+	float GetRelativeResidual() const override;
+
+	void SetPreconditioner(Preconditioner preconditioner);
+	void SetMaxIterations(uint32_t maxIterations);
+	void SetTolerance(float tolerance);
+
+protected:
+	template<bool IS_3D>
+	uint32_t solve(Grid3D<float>& x, const Grid3D<float>& b);
+	void initPreconditioner();
+	template<bool IS_3D>
+	double precondition();
+	template<bool IS_3D>
+	double preconditionRed();
+
+	template<typename Func>
+	void reduce(double sums[2], const Func& func);
+
+	Grid3D<float>	m_r[2];
+	Grid3D<float>	m_z;
+	Grid3D<float>	m_p[2];
+	Grid3D<float>	m_q;
+	Grid3D<float>	m_invPivots;
+
+	std::vector<std::array<double, 2>> m_sliceSums;
+
+	Preconditioner	m_preconditioner;
+	uint32_t		m_maxIterations;
+	float			m_tolerance;
+	float			m_residual;
+};
@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "PoissonSOR.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Over-relaxes cell i of a row in place; neighbors are summed in the order of GetNeighbors
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+static inline void relaxCell(float* x, const float* up, const float* down, const float* front,
+	const float* back, const float* b, float bMean, float omega, uint32_t i, uint32_t l, uint32_t r)
+{
+	auto q = bMean - b[i];
+	q += x[l];
+	q += x[r];
+	q += up[i];
+	q += down[i];
+	if (IS_3D)
+	{
+		q += front[i];
+		q += back[i];
+	}
+	q /= IS_3D ? 6.0f : 4.0f;
+
+	const auto x0 = x[i];
+	x[i] = x0 + omega * (q - x0);
+}
+
+//--------------------------------------------------------------------------------------
+// Over-relaxes every other cell of a row from first, given its clamped neighbor rows;
+// the cells between are of the other color, so they are only read
+//--------------------------------------------------------------------------------------
+template<bool IS_3D>
+static void relaxRow(float* x, const float* up, const float* down, const float* front, const float* back,
+	const float* b, float bMean, float omega, uint32_t width, uint32_t first)
+{
+	const auto last = width - 1;
+	auto i = first;
+	if (i == 0)
+	{
+		relaxCell<IS_3D>(x, up, down, front, back, b, bMean, omega, 0, 0, last > 0 ? 1 : 0);
+		i += 2;
+	}
+
+	// The boundary cells are peeled off, so the interior loop is free of clamps
+	for (; i < last; i += 2) relaxCell<IS_3D>(x, up, down, front, back, b, bMean, omega, i, i - 1, i + 1);
+	if (i == last && last > 0) relaxCell<IS_3D>(x, up, down, front, back, b, bMean, omega, last, last - 1, last);
+}
+
+static inline void relaxRow(float* x, const float* up, const float* down, const float* front, const float* back,
+	const float* b, float bMean, float omega, uint32_t width, uint32_t first, bool is3D)
+{
+	if (is3D) relaxRow<true>(x, up, down, front, back, b, bMean, omega, width, first);
+	else relaxRow<false>(x, up, down, front, back, b, bMean, omega, width, first);
+}
+
+PoissonSOR::PoissonSOR() :
+	m_numSweeps(32),
+	m_omega(1.0f)
+{
+}
+
+PoissonSOR::~PoissonSOR()
+{
+}
+
+uint32_t PoissonSOR::Solve(Grid3D<float>& x, const Grid3D<float>& b)
+{
+	const auto& gridSize = m_gridSize;
+	const auto is3D = gridSize.z > 1;
+
+	// Over-relaxation amplifies the unsolvable mean of b into a drift of x, so it is
+	// removed as in CSRemoveMean.hlsl.
+	const auto bMean = static_cast<float>(GetMean(m_pThreadPool, b));
+
+	for (auto k = 0u; k < m_numSweeps; ++k)
+	{
+		for (uint8_t color = 0; color < 2; ++color)
+		{
+			ForEachSlab(m_pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+			{
+				for (auto z = begin.z; z < end.z; ++z)
+				{
+					for (auto y = begin.y; y < end.y; ++y)
+					{
+						relaxRow(&x(0, y, z), &x(0, y > 0 ? y - 1 : y, z), &x(0, y + 1 < gridSize.y ? y + 1 : y, z),
+							&x(0, y, z > 0 ? z - 1 : z), &x(0, y, z + 1 < gridSize.z ? z + 1 : z),
+							&b(0, y, z), bMean, m_omega, gridSize.x, (y + z + color) & 1, is3D);
+					}
+				}
+			});
+		}
+	}
+
+	return m_numSweeps;
+}
+
+void PoissonSOR::SetNumSweeps(uint32_t numSweeps)
+{
+	m_numSweeps = numSweeps;
+}
+
+void PoissonSOR::SetOmega(float omega)
+{
+	m_omega = omega;
+}
@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PoissonSolver.h"
+
+//--------------------------------------------------------------------------------------
+// Red-black successive over-relaxation of CSSmooth.hlsl; each half sweep only reads
+// cells of the other color, so results are bit-identical for any thread count
+//--------------------------------------------------------------------------------------
+class PoissonSOR :
+	public PoissonSolver
+{
+public:
+	PoissonSOR();
+	virtual ~PoissonSOR();
+
+	uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) override;
+
+	void SetNumSweeps(uint32_t numSweeps);
+	void SetOmega(float omega);	// 1 is Gauss-Seidel; (1, 2) over-relaxes
+
+protected:
+	uint32_t	m_numSweeps;
+	float		m_omega;
+};
@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "PoissonSolver.h"
+
+using namespace std;
+
+PoissonSolver::PoissonSolver() :
+	m_pThreadPool(nullptr),
+	m_gridSize(0, 0, 0)
+{
+}
+
+PoissonSolver::~PoissonSolver()
+{
+}
+
+bool PoissonSolver::Init(ThreadPool* pThreadPool, const uint3& gridSize)
+{
+	if (!pThreadPool || gridSize.x == 0 || gridSize.y == 0 || gridSize.z == 0) return false;
+
+	m_pThreadPool = pThreadPool;
+	m_gridSize = gridSize;
+
+	return true;
+}
+
+float PoissonSolver::GetRelativeResidual() const
+{
+	return -1.0f;
+}
+
+double PoissonSolver::GetMean(ThreadPool* pThreadPool, const Grid3D<float>& grid)
+{
+	const auto& gridSize = grid.GetSize();
+	const auto is3D = gridSize.z > 1;
+
+	// One partial sum per slice, accumulated in order afterwards
+	vector<double> sliceSums(is3D ? gridSize.z : gridSize.y, 0.0);
+	ForEachSlab(pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+		{
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+			{
+				auto sum = 0.0;
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x) sum += grid[cell];
+				sliceSums[is3D ? cell.z : cell.y] += sum;
+			}
+		}
+	});
+
+	auto sum = 0.0;
+	for (const auto& sliceSum : sliceSums) sum += sliceSum;
+
+	return sum / grid.GetNumCells();
+}
+
+double PoissonSolver::GetDeviation(ThreadPool* pThreadPool, const Grid3D<float>& grid)
+{
+	const auto& gridSize = grid.GetSize();
+	const auto mean = GetMean(pThreadPool, grid);
+	const auto is3D = gridSize.z > 1;
+
+	vector<double> sliceSqSums(is3D ? gridSize.z : gridSize.y, 0.0);
+	ForEachSlab(pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+		{
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+			{
+				auto sqSum = 0.0;
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x)
+				{
+					const auto d = grid[cell] - mean;
+					sqSum += d * d;
+				}
+				sliceSqSums[is3D ? cell.z : cell.y] += sqSum;
+			}
+		}
+	});
+
+	auto sqSum = 0.0;
+	for (const auto& sliceSqSum : sliceSqSums) sqSum += sliceSqSum;
+
+	return sqrt(sqSum / grid.GetNumCells());
+}
+
+double PoissonSolver::GetResidualNorm(ThreadPool* pThreadPool, const Grid3D<float>& x, const Grid3D<float>& b)
+{
+	const auto& gridSize = x.GetSize();
+	const auto numNeighbors = GetNumNeighbors(gridSize);
+	const auto is3D = gridSize.z > 1;
+
+	// One partial sum per slice, accumulated in order afterwards
+	const auto numSlices = is3D ? gridSize.z : gridSize.y;
+	vector<double> sliceSums(numSlices, 0.0);
+	vector<double> sliceSqSums(numSlices, 0.0);
+	ForEachSlab(pThreadPool, gridSize, [&](const uint3& begin, const uint3& end)
+	{
+		uint3 cell;
+		for (cell.z = begin.z; cell.z < end.z; ++cell.z)
+		{
+			for (cell.y = begin.y; cell.y < end.y; ++cell.y)
+			{
+				auto sum = 0.0;
+				auto sqSum = 0.0;
+				for (cell.x = begin.x; cell.x < end.x; ++cell.x)
+				{
+					size_t cells[NUM_NEIGHBOR];
+					GetNeighbors(cells, cell, gridSize);
+					const double r = GetResidual(x, b, cells, x.Index(cell.x, cell.y, cell.z), numNeighbors);
+					sum += r;
+					sqSum += r * r;
+				}
+
+				const auto slice = is3D ? cell.z : cell.y;
+				sliceSums[slice] += sum;
+				sliceSqSums[slice] += sqSum;
+			}
+		}
+	});
+
+	auto sum = 0.0;
+	auto sqSum = 0.0;
+	for (auto i = 0u; i < numSlices; ++i)
+	{
+		sum += sliceSums[i];
+		sqSum += sliceSqSums[i];
+	}
+
+	// The mean of the residual equals the mean of b for any x (pure Neumann boundaries), so it is excluded
+	const auto numCells = static_cast<double>(x.GetNumCells());
+	const auto mean = sum / numCells;
+
+	return sqrt((max)(sqSum / numCells - mean * mean, 0.0));
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Grid3D.h"
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------------------------------
+// Neighbor cells with clamped boundaries
+//--------------------------------------------------------------------------------------
+inline void GetNeighbors(size_t cells[NUM_NEIGHBOR], const uint3& cell, const uint3& gridSize)
+{
+	const auto stride = static_cast<size_t>(gridSize.x) * gridSize.y;
+	const auto i = (cell.z * stride) + static_cast<size_t>(cell.y) * gridSize.x + cell.x;
+	cells[NEIGHBOR_L] = cell.x > 0 ? i - 1 : i;
+	cells[NEIGHBOR_R] = cell.x + 1 < gridSize.x ? i + 1 : i;
+	cells[NEIGHBOR_U] = cell.y > 0 ? i - gridSize.x : i;
+	cells[NEIGHBOR_D] = cell.y + 1 < gridSize.y ? i + gridSize.x : i;
+	cells[NEIGHBOR_F] = cell.z > 0 ? i - stride : i;
+	cells[NEIGHBOR_B] = cell.z + 1 < gridSize.z ? i + stride : i;
+}
+
+//--------------------------------------------------------------------------------------
+// N in CSProject[2|3]D.hlsl
+//--------------------------------------------------------------------------------------
+inline uint8_t GetNumNeighbors(const uint3& gridSize)
+{
+	return gridSize.z > 1 ? 6 : 4;
+}
+
+//--------------------------------------------------------------------------------------
+// Residual b - (sum(x[neighbors]) - N * x) at cell i
+//--------------------------------------------------------------------------------------
+inline float GetResidual(const Grid3D<float>& x, const Grid3D<float>& b,
+	const size_t cells[NUM_NEIGHBOR], size_t i, uint8_t numNeighbors)
+{
+	auto r = b[i] + numNeighbors * x[i];
+	for (uint8_t n = 0; n < numNeighbors; ++n) r -= x[cells[n]];
+
+	return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Solves sum(x[neighbors]) - N * x = b over the clamped-neighbor stencil of CSPoisson.hlsli
+//--------------------------------------------------------------------------------------
+class PoissonSolver
+{
+public:
+	PoissonSolver();
+	virtual ~PoissonSolver();
+
+	virtual bool Init(ThreadPool* pThreadPool, const uint3& gridSize);
+
+	// Refines x in place; returns the number of iterations (or cycles) performed
+	virtual uint32_t Solve(Grid3D<float>& x, const Grid3D<float>& b) = 0;
+
+	// Residual norm of the last solve relative to that of b, or a negative value if untracked
+	virtual float GetRelativeResidual() const;
+
+	// Mean of a grid, reduced in a fixed order for any thread count
+	static double GetMean(ThreadPool* pThreadPool, const Grid3D<float>& grid);
+
+	// Root-mean-square deviation from the mean, reduced in a fixed order for any thread count
+	static double GetDeviation(ThreadPool* pThreadPool, const Grid3D<float>& grid);
+
+	// Root-mean-square residual without its constant (null-space) component,
+	// reduced in a fixed order for any thread count
+	static double GetResidualNorm(ThreadPool* pThreadPool, const Grid3D<float>& x, const Grid3D<float>& b);
+
+protected:
+	ThreadPool*	m_pThreadPool;
+	uint3		m_gridSize;
+};
@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "Brick.h"
+#include "QuantizedDensity.h"
+
+using namespace std;
+
+QuantizedDensity::QuantizedDensity()
+{
+}
+
+QuantizedDensity::~QuantizedDensity()
+{
+}
+
+void QuantizedDensity::Create(const uint3& gridSize)
+{
+	m_codes.Create(gridSize);
+	m_ranges.Create(GetBrickGridSize(gridSize));
+}
+
+void QuantizedDensity::Quantize(ThreadPool* pThreadPool, const Grid3D<float4>& color)
+{
+	const auto& gridSize = m_codes.GetSize();
+	const auto extent = GetBrickExtent(gridSize);
+	const auto brickGridSize = GetBrickGridSize(gridSize);
+	const auto numBricks = brickGridSize.x * brickGridSize.y * brickGridSize.z;
+
+	// One brick per thread group, as the GPU pass
+	pThreadPool->Dispatch(numBricks, [&](uint32_t begin, uint32_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			const uint3 brick(i % brickGridSize.x, i / brickGridSize.x % brickGridSize.y,
+				i / (brickGridSize.x * brickGridSize.y));
+			const uint3 brickBegin(brick.x * extent.x, brick.y * extent.y, brick.z * extent.z);
+			const uint3 brickEnd((min)(brickBegin.x + extent.x, gridSize.x),
+				(min)(brickBegin.y + extent.y, gridSize.y), (min)(brickBegin.z + extent.z, gridSize.z));
+
+			// Range of the brick
+			auto minDensity = f16tof32(f32tof16(color(brickBegin.x, brickBegin.y, brickBegin.z).w));
+			auto maxDensity = minDensity;
+			uint3 cell;
+			for (cell.z = brickBegin.z; cell.z < brickEnd.z; ++cell.z)
+				for (cell.y = brickBegin.y; cell.y < brickEnd.y; ++cell.y)
+					for (cell.x = brickBegin.x; cell.x < brickEnd.x; ++cell.x)
+					{
+						const auto density = f16tof32(f32tof16(color[cell].w));
+						minDensity = (min)(density, minDensity);
+						maxDensity = (max)(density, maxDensity);
+					}
+
+			// Rounded to its storage first, so that the codes are quantized against what is decoded
+			auto& range = m_ranges[brick];
+			range.Offset = f16tof32(f32tof16(minDensity));
+			range.Scale = f16tof32(f32tof16(maxDensity - range.Offset));
+
+			for (cell.z = brickBegin.z; cell.z < brickEnd.z; ++cell.z)
+				for (cell.y = brickBegin.y; cell.y < brickEnd.y; ++cell.y)
+					for (cell.x = brickBegin.x; cell.x < brickEnd.x; ++cell.x)
+					{
+						const auto density = f16tof32(f32tof16(color[cell].w));
+						const auto code = range.Scale > 0.0f ? saturate((density - range.Offset) / range.Scale) : 0.0f;
+						m_codes[cell] = static_cast<uint8_t>(floorf(code * 255.0f + 0.5f));
+					}
+		}
+	});
+}
+
+float QuantizedDensity::Load(uint32_t x, uint32_t y, uint32_t z) const
+{
+	const auto extent = GetBrickExtent(m_codes.GetSize());
+	const auto& range = m_ranges(x / extent.x, y / extent.y, z / extent.z);
+
+	return m_codes(x, y, z) / 255.0f * range.Scale + range.Offset;
+}
+
+float QuantizedDensity::Sample(const float3& uvw) const
+{
+	// Each texel decodes with the range of its own brick, so the footprint may straddle bricks
+	const auto f = GetLinearFootprint(m_codes.GetSize(), uvw, AddressMode::CLAMP);
+
+	float planes[2];
+	for (uint8_t k = 0; k < 2; ++k)
+	{
+		const auto row0 = lerp(Load(f.x[0], f.y[0], f.z[k]), Load(f.x[1], f.y[0], f.z[k]), f.wx);
+		const auto row1 = lerp(Load(f.x[0], f.y[1], f.z[k]), Load(f.x[1], f.y[1], f.z[k]), f.wx);
+		planes[k] = lerp(row0, row1, f.wy);
+	}
+
+	return lerp(planes[0], planes[1], f.wz);
+}
+
+const Grid3D<uint8_t>& QuantizedDensity::GetCodes() const
+{
+	return m_codes;
+}
+
+const Grid3D<QuantizedDensity::Range>& QuantizedDensity::GetRanges() const
+{
+	return m_ranges;
+}
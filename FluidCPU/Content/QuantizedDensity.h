@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Sampler.h"
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------------------------------
+// Density of CSQuantizeDensity.hlsl for the ray marchers: 8-bit codes with a scale and an
+// offset per brick, rounded to half as the R16G16_FLOAT ranges of the GPU; a code c
+// decodes to c / 255 * scale + offset
+//--------------------------------------------------------------------------------------
+class QuantizedDensity
+{
+public:
+	struct Range
+	{
+		float Scale;
+		float Offset;
+	};
+
+	QuantizedDensity();
+	virtual ~QuantizedDensity();
+
+	void Create(const uint3& gridSize);
+
+	// Quantizes the density (w) of the color, read as the R16_FLOAT volume of the GPU
+	void Quantize(ThreadPool* pThreadPool, const Grid3D<float4>& color);
+
+	float Load(uint32_t x, uint32_t y, uint32_t z) const;
+	float Sample(const float3& uvw) const;	// GetDensity of RayMarch.hlsli, with clamped addressing
+
+	const Grid3D<uint8_t>& GetCodes() const;
+	const Grid3D<Range>& GetRanges() const;
+
+protected:
+	Grid3D<uint8_t>	m_codes;
+	Grid3D<Range>	m_ranges;	// Of each brick
+};
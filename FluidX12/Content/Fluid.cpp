@@ -13,6 +13,7 @@ struct CBSimulation
 {
 	float TimeStep;
 	uint32_t BaseSeed;
+	uint32_t NumIterations;
 };
 
 struct CBPerFrame
@@ -32,6 +33,97 @@ struct CBPerObject
 	XMFLOAT3X4 World;
 };
 
+// Scalars of the conjugate gradient, mirrored in CSPCG.hlsli
+struct PCGState
+{
+	float RZ;
+	float Alpha;
+	float Beta;
+	float RR;
+	float BB;
+	uint32_t NumIterations;
+	uint32_t IsConverged;
+};
+
+// Multigrid constants, mirrored in FluidCPU/Content/PoissonMultigrid.cpp
+static const uint32_t	g_mgCoarsestSize = 4;
+static const uint32_t	g_mgNumCoarsestSweeps = 16;
+static const uint32_t	g_mgNumPreSweeps = 2;
+static const uint32_t	g_mgNumPostSweeps = 2;
+
+// Red-black SOR sweeps per frame, mirrored in FluidCPU/Content/PoissonSOR.cpp
+static const uint32_t	g_sorNumSweeps = 32;
+
+// Fixed Jacobi budget, formerly ITER in CSProject[2|3]D.hlsl
+static const uint32_t	g_numJacobiIterations = 64;
+
+// MacCormack sub-stepping, mirrored in FluidCPU/Content/FluidCPU.cpp: the correction of
+// CSAdvect.hlsl only acts on traces of up to a cell per step
+static const float		g_maxCorrectedCells = 1.0f;
+static const uint32_t	g_maxCorrectedSubsteps = 16;
+
+// Edge of the sparse bricks in cells, mirrored in Brick.hlsli; every sparse pass runs 64 threads per group
+static const uint32_t	g_brickSize = 8;
+
+//--------------------------------------------------------------------------------------
+// Adaptive Jacobi budget, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline uint32_t AdaptIterations(uint32_t numIterations, float residual,
+	float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	if (residual > targetResidual) numIterations += (max)(numIterations / 2, 1u);
+	else if (residual >= 0.0f && residual < 0.5f * targetResidual) numIterations -= (max)(numIterations / 8, 1u);
+
+	return (min)((max)(numIterations, minIterations), maxIterations);
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-steps of a frame, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline uint32_t ScheduleSubsteps(float& timeStep, float frameTime, float maxCellSpeed,
+	float cflNumber, uint32_t maxSubsteps)
+{
+	const auto stableStep = maxCellSpeed > 0.0f ? cflNumber / maxCellSpeed : frameTime;
+	const auto numSubsteps = (min)(static_cast<uint32_t>((max)(ceilf(frameTime / stableStep), 1.0f)), maxSubsteps);
+	timeStep = (min)(frameTime / numSubsteps, stableStep);
+
+	return numSubsteps;
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-stepping of MacCormack advection, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline void LimitCorrectedSubstepping(float& cflNumber, uint32_t& maxSubsteps)
+{
+	if (cflNumber <= 0.0f) maxSubsteps = (max)(maxSubsteps, g_maxCorrectedSubsteps);
+	cflNumber = cflNumber > 0.0f ? (min)(cflNumber, g_maxCorrectedCells) : g_maxCorrectedCells;
+}
+
+//--------------------------------------------------------------------------------------
+// Bricks of 8x8x8 cells (8x8x1 in 2D), mirrored in Brick.hlsli
+//--------------------------------------------------------------------------------------
+static inline XMUINT3 GetBrickGridSize(const XMUINT3& gridSize)
+{
+	return XMUINT3(XUSG_DIV_UP(gridSize.x, g_brickSize), XUSG_DIV_UP(gridSize.y, g_brickSize),
+		gridSize.z > 1 ? XUSG_DIV_UP(gridSize.z, g_brickSize) : 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Slices of the light map to refresh this frame, in slabs of 4 (the depth of the light-pass
+// groups) taken round-robin, so every slab is refreshed within interval frames; mirrored in
+// FluidCPU/Content/LightMap.cpp
+//--------------------------------------------------------------------------------------
+static inline XMUINT2 ScheduleLightMapRefresh(uint32_t& slab, uint32_t numSlices, uint32_t interval)
+{
+	const auto numSlabs = XUSG_DIV_UP(numSlices, 4);
+	const auto numSlabsPerFrame = XUSG_DIV_UP(numSlabs, (max)(interval, 1u));
+	const auto begin = slab < numSlabs ? slab : 0;
+	const auto end = (min)(begin + numSlabsPerFrame, numSlabs);
+	slab = end < numSlabs ? end : 0;
+
+	return XMUINT2(begin * 4, (min)(end * 4, numSlices));
+}
+
 #ifdef _CPU_CUBE_FACE_CULL_
 static_assert(_CPU_CUBE_FACE_CULL_ == 0 || _CPU_CUBE_FACE_CULL_ == 1 || _CPU_CUBE_FACE_CULL_ == 2, "_CPU_CUBE_FACE_CULL_ can only be 0, 1, or 2");
 #endif
@@ -45,7 +137,7 @@ static inline bool IsCubeFaceVisible(uint8_t face, CXMVECTOR localSpaceEyePt)
 }
 #endif
 
-#if _CPU_CUBE_FACE_CULL_ == 1
+#if _CPU_CUBE_FACE_CULL_
 static inline uint32_t GenVisibilityMask(CXMMATRIX worldI, const XMFLOAT3& eyePt)
 {
 	const auto localSpaceEyePt = XMVector3Transform(XMLoadFloat3(&eyePt), worldI);
@@ -59,9 +151,13 @@ static inline uint32_t GenVisibilityMask(CXMMATRIX worldI, const XMFLOAT3& eyePt
 
 	return mask;
 }
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#endif
+
+#if _CPU_CUBE_FACE_CULL_ == 2
 struct CBCubeFaceList
 {
+	uint32_t LODs;	// 4 bits per face
+	XMUINT3 Padding;
 	XMUINT4 Faces[5];
 };
 
@@ -138,7 +234,42 @@ static inline float EstimateCubeEdgePixelSize(const XMVECTOR v[8])
 	return s;
 }
 
-static inline uint8_t EstimateCubeMapLOD(uint32_t& raySampleCount, uint8_t numMips, float cubeMapSize,
+static inline float EstimateCubeFacePixelSize(const XMVECTOR v[8], uint8_t face)
+{
+	// Corners of each face of the cube map, +X, -X, +Y, -Y, +Z and -Z, in order around it
+	static const uint8_t fi[][4] =
+	{
+		{ 0, 2, 7, 5 },
+		{ 1, 4, 6, 3 },
+		{ 0, 5, 4, 1 },
+		{ 2, 3, 6, 7 },
+		{ 0, 1, 3, 2 },
+		{ 5, 7, 6, 4 }
+	};
+
+	// Edge of the square of the same projected area
+	auto a = 0.0f;
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		const auto& p = v[fi[face][i]];
+		const auto& q = v[fi[face][(i + 1) % 4]];
+		a += XMVectorGetX(p) * XMVectorGetY(q) - XMVectorGetX(q) * XMVectorGetY(p);
+	}
+
+	return sqrtf(fabsf(a) * 0.5f);
+}
+
+static inline uint8_t GetFinestCubeMapLOD(uint32_t lods, uint32_t faceMask, uint8_t numMips)
+{
+	auto lod = static_cast<uint8_t>(numMips - 1);
+	for (uint8_t i = 0; i < 6; ++i)
+		if (faceMask & (1 << i)) lod = (min)(static_cast<uint8_t>(lods >> (i * 4) & 0xf), lod);
+
+	return lod;
+}
+
+// Returns the LOD of each face of the cube map, packed in 4 bits per face
+static inline uint32_t EstimateCubeMapLODs(uint32_t& raySampleCount, uint8_t numMips, float cubeMapSize,
 	CXMMATRIX worldViewProj, CXMVECTOR viewport, float upscale = 2.0f, float raySampleCountScale = 2.0f)
 {
 	XMVECTOR v[8];
@@ -158,24 +289,74 @@ static inline uint8_t EstimateCubeMapLOD(uint32_t& raySampleCount, uint8_t numMi
 	raySampleAmt = (min)(raySampleAmt, static_cast<float>(raySampleCount));
 	s = raySampleAmt / raySampleCountScale * sqrtf(3.0f);
 
-	// Use the more detailed integer level for conservation
-	//const auto level = static_cast<uint8_t>(floorf((max)(log2f(cubeMapSize / s), 0.0f)));
-	const auto level = static_cast<uint8_t>((max)(log2f(cubeMapSize / s), 0.0f));
+	// Each face from its own projected area, no finer than the whole cube; a face seen at a
+	// grazing angle covers few pixels
+	auto lods = 0u;
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		const auto sFace = (min)(EstimateCubeFacePixelSize(v, i) / upscale, s);
+
+		// Use the more detailed integer level for conservation
+		//const auto level = static_cast<uint8_t>(floorf((max)(log2f(cubeMapSize / sFace), 0.0f)));
+		const auto level = (min)((max)(log2f(cubeMapSize / sFace), 0.0f), static_cast<float>(numMips - 1));
+		lods |= static_cast<uint32_t>(level) << (i * 4);
+	}
 
-	return min<uint8_t>(level, numMips - 1);
+	return lods;
 }
 
 Fluid::Fluid() :
 	m_lightPt(75.0f, 75.0f, -75.0f),
 	m_lightColor(1.0f, 0.7f, 0.3f, XM_PI * 3.0f),
 	m_cubeFaceCount(6),
+	m_cubeMapLODs(0),
 	m_cubeMapLOD(0),
+	m_cubeMapInterleave(1),
+	m_cubeMapParity(0),
+	m_cubeMapFrame(0),
+	m_checkerboard(),
+	m_localEyePt(0.0f, 0.0f, 0.0f),
+	m_isCubeMapStale(true),
 	m_ambient(1.0f, 1.0f, 1.0f, XM_PI * 1.5f),
+	m_gridSize(0, 0, 0),
+	m_lightMapDivisor(1, 1, 1),
+	m_ambientDivisor(2, 2, 2),
 	m_maxRaySamples(192),
 	m_maxLightSamples(64),
+	m_lightFootprint(0.0f),
+	m_lightSpread(0.0f),
+	m_lightPass(LIGHT_RAY_MARCH),
+	m_sweepAxis(1),
+	m_isSweepFromMax(true),
+	m_lightMapInterval(1),
+	m_lightMapSlab(0),
+	m_lightMapSlices(0, 0),
+	m_ambientSlab(0),
+	m_ambientSlices(0, 0),
+	m_lightMapInputs(),
+	m_isLightMapStale(true),
 	m_frameParity(0),
-	m_coeffSH(nullptr),
-	m_timeInterval(0.0f)
+	m_projectionMode(PROJECT_JACOBI),
+	m_projectionStats(),
+	m_pcgMaxIterations(128),
+	m_pcgTolerance(1.0e-2f),
+	m_sorOmega(1.8f),
+	m_targetResidual(0.1f),
+	m_numIterations(g_numJacobiIterations),
+	m_minIterations(4),
+	m_maxAdaptiveIterations(g_numJacobiIterations),
+	m_pendingResiduals(0),
+	m_pressureLevel(0),
+	m_velocityLayout(VELOCITY_COLLOCATED),
+	m_advectionScheme(ADVECT_SEMI_LAGRANGIAN),
+	m_isSparse(false),
+	m_isGradientCached(false),
+	m_stepStats(),
+	m_maxCellSpeed(0.0f),
+	m_cflNumber(0.0f),
+	m_maxSubsteps(1),
+	m_pendingSpeeds(0),
+	m_coeffSH(nullptr)
 {
 	m_shaderLib = ShaderLib::MakeUnique();
 
@@ -200,6 +381,10 @@ bool Fluid::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 	m_gridSize = gridSize;
 	assert(m_gridSize.x == m_gridSize.y);
 
+	// The DCT projection transforms each line of the grid within a thread group
+	if (m_projectionMode == PROJECT_DCT && (max)((max)(gridSize.x, gridSize.y), gridSize.z) > MAX_COSINE_TRANSFORM_SIZE)
+		return false;
+
 	// Create resources
 	for (uint8_t i = 0; i < 2; ++i)
 	{
@@ -209,10 +394,32 @@ bool Fluid::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 				ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS), 1, MemoryFlag::NONE,
 				(L"Velocity" + to_wstring(i)).c_str()), false);
 
+		// Density apart from the color, so that the light rays fetch it alone
 		m_colors[i] = Texture3D::MakeUnique();
-		XUSG_N_RETURN(m_colors[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16G16B16A16_FLOAT,
+		XUSG_N_RETURN(m_colors[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R10G10B10A2_UNORM,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
 			(L"Color" + to_wstring(i)).c_str()), false);
+
+		m_densities[i] = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_densities[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"Density" + to_wstring(i)).c_str()), false);
+	}
+
+	// Forward predictions of the MacCormack corrector
+	if (m_advectionScheme == ADVECT_MACCORMACK)
+	{
+		m_predictedVelocity = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedVelocity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16G16B16A16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedVelocity"), false);
+
+		m_predictedColor = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedColor->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R10G10B10A2_UNORM,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedColor"), false);
+
+		m_predictedDensity = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedDensity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedDensity"), false);
 	}
 
 	m_incompress = Texture3D::MakeUnique();
@@ -220,16 +427,205 @@ bool Fluid::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
 		L"Incompressibility"), false);
 
-	m_lightMapSize = gridSize;
+	m_divergence = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_divergence->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"Divergence"), false);
+
+	// Ping-pong partner of the divergence for the DCT passes, which handle lines of up to 1024 cells
+	assert((max)((max)(gridSize.x, gridSize.y), gridSize.z) <= 1024);
+	m_spectrum = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_spectrum->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"Spectrum"), false);
+
+	// Multigrid levels: halve every axis (rounding up) until the coarsest level is small enough
+	m_coarseIncompress.clear();
+	m_coarseDivergence.clear();
+	auto levelSize = gridSize;
+	while ((max)((max)(levelSize.x, levelSize.y), levelSize.z) > g_mgCoarsestSize)
+	{
+		levelSize = XMUINT3((levelSize.x + 1) / 2, (levelSize.y + 1) / 2, (levelSize.z + 1) / 2);
+		const auto level = to_wstring(m_coarseIncompress.size() + 1);
+
+		auto incompress = Texture3D::MakeUnique();
+		XUSG_N_RETURN(incompress->Create(pDevice, levelSize.x, levelSize.y, levelSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"Incompressibility" + level).c_str()), false);
+		m_coarseIncompress.emplace_back(move(incompress));
+
+		auto divergence = Texture3D::MakeUnique();
+		XUSG_N_RETURN(divergence->Create(pDevice, levelSize.x, levelSize.y, levelSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"Divergence" + level).c_str()), false);
+		m_coarseDivergence.emplace_back(move(divergence));
+	}
+
+	// One partial mean of the divergence per thread group
+	const auto numGroups = XUSG_DIV_UP(gridSize.x, 8) * XUSG_DIV_UP(gridSize.y, 8) * gridSize.z;
+	m_partialMeans = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_partialMeans->Create(pDevice, numGroups, sizeof(float), Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"DivergencePartialMeans"), false);
+
+	m_divergenceMean = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_divergenceMean->Create(pDevice, 1, sizeof(float), Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"DivergenceMean"), false);
+
+	// Conjugate gradient vectors, and its dot products reduced from one partial per thread group
+	m_pcgResidual = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_pcgResidual->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PCGResidual"), false);
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		m_pcgDirections[i] = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_pcgDirections[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, (L"PCGDirection" + to_wstring(i)).c_str()), false);
+	}
+
+	m_pcgKDirection = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_pcgKDirection->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PCGKDirection"), false);
+
+	m_partialSums = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_partialSums->Create(pDevice, numGroups, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"PartialSums"), false);
+
+	m_pcgState = StructuredBuffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgState->Create(pDevice, 1, sizeof(PCGState), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"PCGState"), false);
+
+	// Arguments of the indirect PCG passes, written by each reduction
+	m_pcgDispatchArgs = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgDispatchArgs->Create(pDevice, 3, sizeof(uint32_t), Format::R32_UINT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 0, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"PCGDispatchArgs"), false);
+
+	m_pcgReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgReadback->Create(pDevice, sizeof(PCGState[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"PCGStateReadback"), false);
+
+	// Sums of the residual after the adaptive Jacobi projection, reduced from the same partials
+	m_residualSums = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_residualSums->Create(pDevice, 1, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"ResidualSums"), false);
+
+	m_residualReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_residualReadback->Create(pDevice, sizeof(XMFLOAT4[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"ResidualReadback"), false);
+
+	// Largest speeds per axis for the sub-step scheduler, reduced from the same partials
+	m_maxSpeed = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_maxSpeed->Create(pDevice, 1, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"MaxSpeed"), false);
+
+	m_speedReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_speedReadback->Create(pDevice, sizeof(XMFLOAT4[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"SpeedReadback"), false);
+
+	// Active bricks of the sparse simulation, listed with the arguments of their indirect dispatches
+	if (m_isSparse)
+	{
+		const auto brickGridSize = GetBrickGridSize(gridSize);
+		const auto numBricks = brickGridSize.x * brickGridSize.y * brickGridSize.z;
+		for (uint8_t i = 0; i < 2; ++i)
+		{
+			m_brickMasks[i] = StructuredBuffer::MakeUnique();
+			XUSG_N_RETURN(m_brickMasks[i]->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+				MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, (L"BrickMask" + to_wstring(i)).c_str()), false);
+
+			m_activeBricks[i] = StructuredBuffer::MakeUnique();
+			XUSG_N_RETURN(m_activeBricks[i]->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+				MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, (L"ActiveBricks" + to_wstring(i)).c_str()), false);
+
+			m_dispatchArgs[i] = TypedBuffer::MakeUnique();
+			XUSG_N_RETURN(m_dispatchArgs[i]->Create(pDevice, 3, sizeof(uint32_t), Format::R32_UINT,
+				ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 0, nullptr, 1, nullptr,
+				MemoryFlag::NONE, (L"BrickDispatchArgs" + to_wstring(i)).c_str()), false);
+		}
+
+		m_idleSteps = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_idleSteps->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+			MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"BrickIdleSteps"), false);
+	}
+
+	// Indirect dispatches of PCG and of the sparse simulation
+	{
+		IndirectArgument arg;
+		arg.Type = IndirectArgumentType::DISPATCH;
+		m_commandLayout = CommandLayout::MakeUnique();
+		XUSG_N_RETURN(m_commandLayout->Create(pDevice, sizeof(uint32_t[3]), 1, &arg), false);
+	}
+
+	// The light map is low frequency, so it may be coarser than the grid; its texels span
+	// the same volume, and the view rays filter them trilinearly
+	m_lightMapSize.x = XUSG_DIV_UP(gridSize.x, (max)(m_lightMapDivisor.x, 1u));
+	m_lightMapSize.y = XUSG_DIV_UP(gridSize.y, (max)(m_lightMapDivisor.y, 1u));
+	m_lightMapSize.z = XUSG_DIV_UP(gridSize.z, (max)(m_lightMapDivisor.z, 1u));
 	m_lightMap = Texture3D::MakeUnique();
 	XUSG_N_RETURN(m_lightMap->Create(pDevice, m_lightMapSize.x, m_lightMapSize.y, m_lightMapSize.z,
 		Format::R11G11B10_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
 		1, MemoryFlag::NONE, L"LightMap"), false);
 
-	const uint8_t numMips = 5;
-	m_cubeMap = Texture2D::MakeUnique();
-	XUSG_N_RETURN(m_cubeMap->Create(pDevice, gridSize.x, gridSize.y, Format::R8G8B8A8_UNORM, 6,
-		ResourceFlag::ALLOW_UNORDERED_ACCESS, numMips, 1, true, MemoryFlag::NONE, L"CubeMap"), false);
+	// The ambient of the light probe varies slower still, so it is decimated by default
+	m_ambientSize.x = XUSG_DIV_UP(gridSize.x, (max)(m_ambientDivisor.x, 1u));
+	m_ambientSize.y = XUSG_DIV_UP(gridSize.y, (max)(m_ambientDivisor.y, 1u));
+	m_ambientSize.z = XUSG_DIV_UP(gridSize.z, (max)(m_ambientDivisor.z, 1u));
+	m_ambientVolume = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_ambientVolume->Create(pDevice, m_ambientSize.x, m_ambientSize.y, m_ambientSize.z,
+		Format::R11G11B10_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"AmbientVolume"), false);
+
+	// Transmittance of the light sweep, ping-ponged between the slices across any axis
+	const auto sliceSize = (max)((max)(m_lightMapSize.x, m_lightMapSize.y), m_lightMapSize.z);
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		m_sweepSlices[i] = Texture2D::MakeUnique();
+		XUSG_N_RETURN(m_sweepSlices[i]->Create(pDevice, sliceSize, sliceSize, Format::R16_FLOAT, 1,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE,
+			(L"SweepSlice" + to_wstring(i)).c_str()), false);
+	}
+
+	// Density of the ray marchers, quantized against the range of each brick
+	const auto brickGridSize = GetBrickGridSize(gridSize);
+	m_quantizedDensity = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_quantizedDensity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R8_UNORM,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"QuantizedDensity"), false);
+
+	m_densityRanges = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityRanges->Create(pDevice, brickGridSize.x, brickGridSize.y, brickGridSize.z,
+		Format::R16G16_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"DensityRanges"), false);
+
+	// Max-density pyramid of the bricks for empty-space skipping, down to a single cell
+	m_densityPyramid = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityPyramid->Create(pDevice, brickGridSize.x, brickGridSize.y, brickGridSize.z,
+		Format::R32_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 0, MemoryFlag::NONE, L"DensityPyramid"), false);
+
+	// Density mips of the cone-traced light rays, from half resolution down to a single cell
+	m_densityMips = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityMips->Create(pDevice, (max)(gridSize.x >> 1, 1u), (max)(gridSize.y >> 1, 1u),
+		(max)(gridSize.z >> 1, 1u), Format::R16_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 0,
+		MemoryFlag::NONE, L"DensityMips"), false);
+
+	// Density gradient of the ambient pass, packed as a unit direction and a magnitude
+	if (m_isGradientCached)
+	{
+		m_densityGradient = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_densityGradient->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R8G8B8A8_SNORM,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"DensityGradient"), false);
+	}
+
+	// The checkerboard marching rebuilds from the cube map of the last frame, ping-ponged
+	const uint8_t numMips = NUM_CUBE_MAP_MIPS;
+	for (uint8_t i = 0; i < (m_cubeMapInterleave > 1 ? 2 : 1); ++i)
+	{
+		m_cubeMaps[i] = Texture2D::MakeUnique();
+		XUSG_N_RETURN(m_cubeMaps[i]->Create(pDevice, gridSize.x, gridSize.y, Format::R8G8B8A8_UNORM, 6,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, numMips, 1, true, MemoryFlag::NONE,
+			(L"CubeMap" + to_wstring(i)).c_str()), false);
+	}
 
 	//m_cubeDepth = Texture2D::MakeUnique();
 	//XUSG_N_RETURN(m_cubeDepth->Create(pDevice, gridSize.x, gridSize.y,  Format::R32_FLOAT, 6,
@@ -257,9 +653,15 @@ bool Fluid::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBCubeFaceList"), false);
 #endif
 
-	ResourceBarrier barrier;
-	const auto numBarriers = m_incompress->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
-	pCommandList->Barrier(numBarriers, &barrier);
+	// The zero-initialized lists and arguments dispatch nothing until the first build
+	ResourceBarrier barriers[5];
+	auto numBarriers = m_incompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	for (uint8_t i = 0; m_isSparse && i < 2; ++i)
+	{
+		numBarriers = m_activeBricks[i]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+		numBarriers = m_dispatchArgs[i]->SetBarrier(barriers, ResourceState::INDIRECT_ARGUMENT, numBarriers);
+	}
+	pCommandList->Barrier(numBarriers, barriers);
 
 	// Create pipelines
 	XUSG_N_RETURN(createPipelineLayouts(), false);
@@ -269,15 +671,105 @@ bool Fluid::Init(CommandList* pCommandList, uint32_t width, uint32_t height,
 	return true;
 }
 
+void Fluid::SetVelocityLayout(VelocityLayout layout)
+{
+	m_velocityLayout = layout;
+}
+
+void Fluid::SetAdvectionScheme(AdvectionScheme scheme)
+{
+	m_advectionScheme = scheme;
+}
+
+void Fluid::SetSparseBricks(bool isSparse)
+{
+	m_isSparse = isSparse;
+}
+
+void Fluid::SetLightMapDivisor(const XMUINT3& divisor)
+{
+	m_lightMapDivisor = divisor;
+}
+
+void Fluid::SetAmbientDivisor(const XMUINT3& divisor)
+{
+	m_ambientDivisor = divisor;
+}
+
+void Fluid::SetGradientCache(bool isCached)
+{
+	m_isGradientCached = isCached;
+}
+
+void Fluid::SetCheckerboard(uint8_t interleave)
+{
+	m_cubeMapInterleave = interleave >= 4 ? 4 : (interleave >= 2 ? 2 : 1);
+}
+
 void Fluid::SetMaxSamples(uint32_t maxRaySamples, uint32_t maxLightSamples)
 {
 	m_maxRaySamples = maxRaySamples;
 	m_maxLightSamples = maxLightSamples;
 }
 
+void Fluid::SetLightFootprint(float footprint, float spread)
+{
+	m_lightFootprint = footprint;
+	m_lightSpread = spread;
+	m_isLightMapStale = true;
+}
+
+void Fluid::SetLightPass(LightPass pass)
+{
+	m_lightPass = pass;
+}
+
+void Fluid::SetLightMapRefresh(uint32_t interval)
+{
+	m_lightMapInterval = (max)(interval, 1u);
+}
+
 void Fluid::SetSH(const StructuredBuffer::sptr& coeffSH)
 {
 	m_coeffSH = coeffSH;
+	m_isLightMapStale = true;
+}
+
+void Fluid::SetProjectionMode(ProjectionMode mode)
+{
+	// The DCT projection transforms each line of the grid within a thread group
+	if (mode == PROJECT_DCT && (max)((max)(m_gridSize.x, m_gridSize.y), m_gridSize.z) > MAX_COSINE_TRANSFORM_SIZE) return;
+	m_projectionMode = mode;
+}
+
+void Fluid::SetProjectionBudget(float tolerance, uint32_t maxIterations)
+{
+	m_pcgTolerance = tolerance;
+	m_pcgMaxIterations = maxIterations;
+}
+
+void Fluid::SetOverRelaxation(float omega)
+{
+	m_sorOmega = omega;
+}
+
+void Fluid::SetAdaptiveBudget(float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	m_targetResidual = targetResidual;
+	m_minIterations = minIterations;
+	m_maxAdaptiveIterations = maxIterations;
+	m_numIterations = (min)((max)(m_numIterations, minIterations), maxIterations);
+}
+
+void Fluid::SetPressureLevel(uint8_t level)
+{
+	m_pressureLevel = level;
+}
+
+void Fluid::SetSubstepping(float cflNumber, uint32_t maxSubsteps)
+{
+	m_cflNumber = cflNumber;
+	m_maxSubsteps = (max)(maxSubsteps, 1u);
 }
 
 void Fluid::UpdateFrame(float timeStep, uint8_t frameIndex,
@@ -320,92 +812,147 @@ void Fluid::UpdateFrame(float timeStep, uint8_t frameIndex,
 			XMStoreFloat3x4(&pCbData->WorldI, worldI);
 			XMStoreFloat3x4(&pCbData->World, world);
 
+			// The light sweep slices across the dominant axis of the light direction; the volume
+			// is centered at the origin, so a point light takes the same from its center
+			XMFLOAT3 lightDir;
+			XMStoreFloat3(&lightDir, XMVector3TransformNormal(XMLoadFloat3(&m_lightPt), worldI));
+			const float absDir[] = { fabsf(lightDir.x), fabsf(lightDir.y), fabsf(lightDir.z) };
+			m_sweepAxis = absDir[0] >= absDir[1] && absDir[0] >= absDir[2] ? 0 : (absDir[1] >= absDir[2] ? 1 : 2);
+			m_isSweepFromMax = (&lightDir.x)[m_sweepAxis] > 0.0f;
+
+			// The light map and the ambient volume refresh slabs of their slices round-robin, and
+			// all of them after a change of the light or the volume transform
+			const LightMapInputs lightMapInputs = { m_lightPt, m_lightColor, m_ambient, m_volumeWorld };
+			if (memcmp(&lightMapInputs, &m_lightMapInputs, sizeof(LightMapInputs)) != 0) m_isLightMapStale = true;
+			m_lightMapInputs = lightMapInputs;
+			if (m_isLightMapStale) m_lightMapSlab = 0;
+			m_lightMapSlices = ScheduleLightMapRefresh(m_lightMapSlab, m_lightMapSize.z,
+				m_isLightMapStale ? 1 : m_lightMapInterval);
+			if (m_isLightMapStale) m_ambientSlab = 0;
+			m_ambientSlices = ScheduleLightMapRefresh(m_ambientSlab, m_ambientSize.z,
+				m_isLightMapStale ? 1 : m_lightMapInterval);
+			m_isLightMapStale = false;
+
 			{
 				m_raySampleCount = m_maxRaySamples;
-				const auto numMips = m_cubeMap->GetNumMips();
-				const auto cubeMapSize = static_cast<float>(m_cubeMap->GetWidth());
+				const auto numMips = m_cubeMaps[0]->GetNumMips();
+				const auto cubeMapSize = static_cast<float>(m_cubeMaps[0]->GetWidth());
 				const auto witdh = static_cast<float>(m_viewport.x);
 				const auto height = static_cast<float>(m_viewport.y);
 				const auto viewport = XMVectorSet(witdh, height, 1.0f, 1.0f);
-				m_cubeMapLOD = EstimateCubeMapLOD(m_raySampleCount, numMips, cubeMapSize, worldViewProj, viewport);
+				m_cubeMapLODs = EstimateCubeMapLODs(m_raySampleCount, numMips, cubeMapSize, worldViewProj, viewport);
 
+#if _CPU_CUBE_FACE_CULL_
+				const auto visibilityMask = GenVisibilityMask(worldI, eyePt);
+#else
+				const auto visibilityMask = 0x3fu;
+#endif
 #if _CPU_CUBE_FACE_CULL_ == 1
-				m_visibilityMask = GenVisibilityMask(worldI, eyePt);
+				m_visibilityMask = visibilityMask;
 #elif _CPU_CUBE_FACE_CULL_ == 2
 				{
 					const auto pCbData = reinterpret_cast<CBCubeFaceList*>(m_cbCubeFaceList->Map(frameIndex));
+					pCbData->LODs = m_cubeMapLODs;
 					m_cubeFaceCount = GenVisibleCubeFaceList(*pCbData, worldI, eyePt);
 				}
 #endif
+				m_cubeMapLOD = GetFinestCubeMapLOD(m_cubeMapLODs, visibilityMask, numMips);
+			}
+
+			// The checkerboard marching cycles the phases over the frames, and marches all
+			// texels after a frame without the cube map, which leaves no history
+			{
+				XMFLOAT3 localEyePt;
+				XMStoreFloat3(&localEyePt, XMVector3Transform(XMLoadFloat3(&eyePt), worldI));
+				const auto interleave = m_isCubeMapStale ? 1u : m_cubeMapInterleave;
+				static const uint32_t phases[] = { 0, 3, 1, 2 };	// Diagonals of the 2x2 blocks first
+				m_checkerboard.PrevLODs = m_checkerboard.LODs;
+				m_checkerboard.PrevEyePt = m_localEyePt;
+				m_checkerboard.Interleave = interleave;
+				m_checkerboard.Phase = interleave == 4 ? phases[m_cubeMapFrame % 4] : m_cubeMapFrame % interleave;
+				m_checkerboard.LODs = m_cubeMapLODs;
+				if (m_cubeMapInterleave > 1) m_cubeMapParity = !m_cubeMapParity;
+				m_localEyePt = localEyePt;
+				m_isCubeMapStale = false;
+				++m_cubeMapFrame;
 			}
 		}
 	}
 
 	m_timeStep = timeStep;
-	if (timeStep > 0.0) m_frameParity = !m_frameParity;
 }
 
 void Fluid::Simulate(CommandList* pCommandList, uint8_t frameIndex)
 {
-	ResourceBarrier barriers[3];
-
-	auto timeStep = m_gridSize.z > 1 ? 1.0f / 60.0f : 1.0f / 800.0f;
-	m_timeInterval = m_timeInterval > timeStep ? 0.0f : m_timeInterval;
-	m_timeInterval += m_timeStep;
-	timeStep = m_timeInterval < timeStep ? 0.0f : timeStep;
-
-	// Advection
+	// The solve that last used this frame's readback slot has completed
+	if (m_projectionMode == PROJECT_PCG)
 	{
-		// Set barriers (promotions)
-		m_velocities[0]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
-		auto numBarriers = m_velocities[1]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
-		numBarriers = m_colors[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
-		pCommandList->Barrier(numBarriers, barriers);
-
-		// Set pipeline state
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[ADVECT]);
-		pCommandList->SetPipelineState(m_pipelines[ADVECT]);
-
-		// Set descriptor tables
-		pCommandList->SetComputeRootConstantBufferView(0, m_cbSimulation.get(), m_cbSimulation->GetCBVOffset(frameIndex));
-		pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_VECOLITY]);
-		pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_UAV_TABLE_COLOR + m_frameParity]);
-
-		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+		const auto pState = static_cast<const PCGState*>(m_pcgReadback->Map(nullptr)) + frameIndex;
+		m_projectionStats.NumIterations = pState->NumIterations;
+		m_projectionStats.Residual = pState->BB > 0.0f ? sqrtf(pState->RR / pState->BB) : 0.0f;
+		m_projectionStats.IsCapped = !pState->IsConverged;
 	}
 
-	// Projection
+	if (m_pendingResiduals >> frameIndex & 1)
 	{
-		// Set barriers
-		auto numBarriers = m_velocities[0]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
-		numBarriers = m_velocities[1]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
-		numBarriers = m_colors[m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
-			ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
-		pCommandList->Barrier(numBarriers, barriers);
-
-		// Set pipeline state
-		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PROJECT]);
-		pCommandList->SetPipelineState(m_pipelines[PROJECT]);
-
-		// Set descriptor tables
-		pCommandList->SetComputeRootConstantBufferView(0, m_cbSimulation.get(), m_cbSimulation->GetCBVOffset(frameIndex));
-		pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_VECOLITY1]);
-		
-		XMUINT3 numGroups;
-		if (m_gridSize.z > 1) // optimized for 3D
+		// Sums of (r, r^2, b, b^2), without the constant (null-space) components
+		const auto& sums = static_cast<const XMFLOAT4*>(m_residualReadback->Map(nullptr))[frameIndex];
+		const auto numCells = static_cast<float>(m_gridSize.x * m_gridSize.y * m_gridSize.z);
+		const auto rr = sums.y / numCells - (sums.x / numCells) * (sums.x / numCells);
+		const auto bb = sums.w / numCells - (sums.z / numCells) * (sums.z / numCells);
+		m_projectionStats.DivergenceError = bb > 0.0f ? sqrtf((max)(rr, 0.0f) / bb) : 0.0f;
+		m_pendingResiduals &= ~(1 << frameIndex);
+
+		if (m_projectionMode == PROJECT_JACOBI_ADAPTIVE)
 		{
-			numGroups.x = XUSG_DIV_UP(m_gridSize.x, 4);
-			numGroups.y = XUSG_DIV_UP(m_gridSize.y, 4);
-			numGroups.z = XUSG_DIV_UP(m_gridSize.z, 4);
+			m_projectionStats.Residual = m_projectionStats.DivergenceError;
+			m_numIterations = AdaptIterations(m_numIterations, m_projectionStats.Residual,
+				m_targetResidual, m_minIterations, m_maxAdaptiveIterations);
 		}
-		else
+	}
+
+	if (m_pendingSpeeds >> frameIndex & 1)
+	{
+		const auto& maxSpeed = static_cast<const XMFLOAT4*>(m_speedReadback->Map(nullptr))[frameIndex];
+		m_maxCellSpeed = (max)((max)(maxSpeed.x, maxSpeed.y), maxSpeed.z);
+		m_pendingSpeeds &= ~(1 << frameIndex);
+	}
+
+	// Iteration budget of the Jacobi projection
+	const auto isAdaptive = m_projectionMode == PROJECT_JACOBI_ADAPTIVE;
+	if (isAdaptive) m_projectionStats.NumIterations = m_numIterations;
+	const auto pCbData = reinterpret_cast<CBSimulation*>(m_cbSimulation->Map(frameIndex));
+	pCbData->NumIterations = isAdaptive ? m_numIterations : g_numJacobiIterations;
+
+	// Sub-steps of the frame, under the CFL number at the speed read back
+	auto cflNumber = m_cflNumber;
+	auto maxSubsteps = m_maxSubsteps;
+	if (m_advectionScheme == ADVECT_MACCORMACK) LimitCorrectedSubstepping(cflNumber, maxSubsteps);
+	m_stepStats.NumSubsteps = 1;
+	m_stepStats.TimeStep = m_timeStep;
+	if (cflNumber > 0.0f && m_timeStep > 0.0f) m_stepStats.NumSubsteps = ScheduleSubsteps(m_stepStats.TimeStep,
+		m_timeStep, m_maxCellSpeed, cflNumber, maxSubsteps);
+	m_stepStats.Courant = m_maxCellSpeed * m_stepStats.TimeStep;
+	m_stepStats.CFLNumber = cflNumber;
+	pCbData->TimeStep = m_stepStats.TimeStep;
+
+	for (auto i = 0u; i < m_stepStats.NumSubsteps; ++i)
+	{
+		if (m_timeStep > 0.0f)
 		{
-			numGroups.x = XUSG_DIV_UP(m_gridSize.x, 8);
-			numGroups.y = XUSG_DIV_UP(m_gridSize.y, 8);
-			numGroups.z = m_gridSize.z;
+			m_frameParity = !m_frameParity;
+			if (m_isSparse) buildBricks(pCommandList);
 		}
+		advect(pCommandList, frameIndex, i);
+		project(pCommandList, frameIndex);
+	}
 
-		pCommandList->Dispatch(numGroups.x, numGroups.y, numGroups.z);
+	// Residual on the full grid (also of the adaptive budget) and the largest speed after the
+	// last sub-step, read back FrameCount frames later
+	if (m_timeStep > 0.0f)
+	{
+		measureResidual(pCommandList, frameIndex);
+		if (cflNumber > 0.0f) measureSpeed(pCommandList, frameIndex);
 	}
 }
 
@@ -416,24 +963,36 @@ void Fluid::Render(CommandList* pCommandList, uint8_t frameIndex, uint8_t flags)
 
 	if (m_gridSize.z > 1)
 	{
+		quantizeDensity(pCommandList);
+		buildDensityPyramid(pCommandList);
+		if (m_lightFootprint > 1.0f || m_lightSpread > 0.0f) generateDensityMips(pCommandList);
+		if (m_coeffSH)
+		{
+			if (m_isGradientCached) computeDensityGradient(pCommandList);
+			computeAmbient(pCommandList, frameIndex);
+		}
 		if (cubemapRayMarch)
 		{
 			if (separateLightPass)
 			{
-				rayMarchL(pCommandList, frameIndex);
+				if (m_lightPass == LIGHT_SLICE_SWEEP) sweepLight(pCommandList, frameIndex);
+				else rayMarchL(pCommandList, frameIndex);
 				rayMarchV(pCommandList, frameIndex);
 			}
 			else
 			{
 				rayMarch(pCommandList, frameIndex);
 			}
+			if (m_checkerboard.Interleave > 1) reconstructCube(pCommandList, frameIndex);
 			renderCube(pCommandList, frameIndex);
 		}
 		else
 		{
+			m_isCubeMapStale = true;
 			if (separateLightPass)
 			{
-				rayMarchL(pCommandList, frameIndex);
+				if (m_lightPass == LIGHT_SLICE_SWEEP) sweepLight(pCommandList, frameIndex);
+				else rayMarchL(pCommandList, frameIndex);
 				rayCastVDirect(pCommandList, frameIndex);
 			}
 			else
@@ -445,6 +1004,24 @@ void Fluid::Render(CommandList* pCommandList, uint8_t frameIndex, uint8_t flags)
 	else visualizeColor(pCommandList);
 }
 
+const Fluid::ProjectionStats& Fluid::GetProjectionStats() const
+{
+	return m_projectionStats;
+}
+
+const Fluid::StepStats& Fluid::GetStepStats() const
+{
+	return m_stepStats;
+}
+
+uint8_t Fluid::GetPressureLevel() const
+{
+	// DCT and PCG always solve at full resolution
+	if (m_projectionMode == PROJECT_DCT || m_projectionMode == PROJECT_PCG) return 0;
+
+	return (min)(m_pressureLevel, static_cast<uint8_t>(m_coarseIncompress.size()));
+}
+
 bool Fluid::createPipelineLayouts()
 {
 	// Advection
@@ -455,13 +1032,38 @@ bool Fluid::createPipelineLayouts()
 		pipelineLayout->SetRootCBV(0, 0);
 		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
 		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
-		pipelineLayout->SetRange(2, DescriptorType::SRV, 1, 1);
-		pipelineLayout->SetRange(2, DescriptorType::UAV, 1, 1, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetRange(2, DescriptorType::SRV, 2, 1);
+		pipelineLayout->SetRange(2, DescriptorType::UAV, 2, 1, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		if (m_advectionScheme == ADVECT_MACCORMACK) pipelineLayout->SetRange(3, DescriptorType::SRV, 3, 3);
+		if (m_isSparse)
+		{
+			// Active bricks, and the marks of the bricks left busy
+			const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+			pipelineLayout->SetRootSRV(isMacCormack ? 4 : 3, isMacCormack ? 6 : 3);
+			pipelineLayout->SetRootUAV(isMacCormack ? 5 : 4, 3);
+		}
 		pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
 		XUSG_X_RETURN(m_pipelineLayouts[ADVECT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"AdvectionLayout"), false);
 	}
 
+	// Forward prediction of MacCormack advection
+	if (m_advectionScheme == ADVECT_MACCORMACK)
+	{
+		const auto sampler = m_descriptorTableLib->GetSampler(SamplerPreset::LINEAR_MIRROR);
+
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRootCBV(0, 0);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetRange(2, DescriptorType::SRV, 2, 1);
+		pipelineLayout->SetRange(2, DescriptorType::UAV, 2, 1, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		if (m_isSparse) pipelineLayout->SetRootSRV(3, 3);
+		pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+		XUSG_X_RETURN(m_pipelineLayouts[PREDICT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"PredictionLayout"), false);
+	}
+
 	// Projection
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
@@ -472,63 +1074,269 @@ bool Fluid::createPipelineLayouts()
 			PipelineLayoutFlag::NONE, L"ProjectionLayout"), false);
 	}
 
-	const auto sampler = m_descriptorTableLib->GetSampler(SamplerPreset::LINEAR_CLAMP);
+	// Divergence
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 2, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[DIVERGENCE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"DivergenceLayout"), false);
+	}
 
-	if (m_gridSize.z > 1)
+	// Mean reduction, mean removal, prolongation, and spectral solve
 	{
-		// Ray marching
-		{
-			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
-			pipelineLayout->SetRange(2, DescriptorType::SRV, 1, 0);
-			pipelineLayout->SetConstants(3, 3, 2);
-			pipelineLayout->SetRootSRV(4, 1);
-#if _CPU_CUBE_FACE_CULL_ == 1
-			pipelineLayout->SetConstants(5, 1, 3);
-#elif _CPU_CUBE_FACE_CULL_ == 2
-			pipelineLayout->SetRootCBV(5, 3);
-#endif
-			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
-			XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
-				PipelineLayoutFlag::NONE, L"RayMarchingLayout"), false);
-		}
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[REDUCE_MEAN], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"SrvUavLayout"), false);
+		m_pipelineLayouts[REMOVE_MEAN] = m_pipelineLayouts[REDUCE_MEAN];
+		m_pipelineLayouts[PROLONG] = m_pipelineLayouts[REDUCE_MEAN];
+		m_pipelineLayouts[SPECTRAL_SOLVE] = m_pipelineLayouts[REDUCE_MEAN];
+	}
 
-		// Light space ray marching
-		{
-			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
-			pipelineLayout->SetRange(2, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
-			pipelineLayout->SetConstants(3, 2, 2);
-			pipelineLayout->SetRootSRV(4, 1);
-			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
-			XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_L], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
-				PipelineLayoutFlag::NONE, L"LightSpaceRayMarchingLayout"), false);
-		}
+	// Smoothing
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetConstants(0, 2, 0);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[SMOOTH], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"SmoothingLayout"), false);
+	}
 
-		// View space ray marching
-		{
-			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
-			pipelineLayout->SetRange(2, DescriptorType::SRV, 2, 0);
-			pipelineLayout->SetConstants(3, 1, 2);
-#if _CPU_CUBE_FACE_CULL_ == 1
-			pipelineLayout->SetConstants(4, 1, 3);
-#elif _CPU_CUBE_FACE_CULL_ == 2
-			pipelineLayout->SetRootCBV(4, 3);
-#endif
+	// Restriction
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 2, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[RESTRICT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"RestrictionLayout"), false);
+	}
+
+	// Cosine transform
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetConstants(0, 2, 0);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[COSINE_TRANSFORM], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"CosineTransformLayout"), false);
+	}
+
+	// PCG residual
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 3, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[PCG_RESIDUAL], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"PCGResidualLayout"), false);
+	}
+
+	// PCG operator application and update
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 3, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 3, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[PCG_APPLY], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"PCGLayout"), false);
+
+		m_pipelineLayouts[PCG_UPDATE] = m_pipelineLayouts[PCG_APPLY];
+	}
+
+	// PCG reduction, with the group counts of the indirect passes and the stage and tolerance constants
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetConstants(0, 5, 0);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 2, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[PCG_REDUCE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"PCGReductionLayout"), false);
+	}
+
+	// Residual norm
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[RESIDUAL_NORM], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"ResidualNormLayout"), false);
+	}
+
+	// Sum reduction, max speed, and max reduction
+	m_pipelineLayouts[REDUCE_SUMS] = m_pipelineLayouts[REDUCE_MEAN];
+	m_pipelineLayouts[MAX_SPEED] = m_pipelineLayouts[REDUCE_MEAN];
+	m_pipelineLayouts[REDUCE_MAX] = m_pipelineLayouts[REDUCE_MEAN];
+
+	// Gradient subtraction
+	m_pipelineLayouts[SUBTRACT_GRADIENT] = m_pipelineLayouts[PROJECT];
+
+	// Active-brick list
+	if (m_isSparse)
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetConstants(0, 4, 0);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 2, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 6, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[BUILD_BRICKS], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"BrickBuildLayout"), false);
+	}
+
+	const auto sampler = m_descriptorTableLib->GetSampler(SamplerPreset::LINEAR_CLAMP);
+
+	if (m_gridSize.z > 1)
+	{
+		// Density quantization
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+			pipelineLayout->SetRange(0, DescriptorType::UAV, 2, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			XUSG_X_RETURN(m_pipelineLayouts[QUANTIZE_DENSITY], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"DensityQuantizationLayout"), false);
+		}
+
+		// Max-density pyramid
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+			pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			XUSG_X_RETURN(m_pipelineLayouts[DENSITY_PYRAMID], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"DensityPyramidLayout"), false);
+		}
+
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+			pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			XUSG_X_RETURN(m_pipelineLayouts[DENSITY_PYRAMID_MIP], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"DensityPyramidMipLayout"), false);
+		}
+
+		// Density mips
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+			pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			XUSG_X_RETURN(m_pipelineLayouts[DENSITY_MIP], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"DensityMipLayout"), false);
+		}
+
+		// Density gradient
+		if (m_isGradientCached)
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+			pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			XUSG_X_RETURN(m_pipelineLayouts[DENSITY_GRADIENT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"DensityGradientLayout"), false);
+		}
+
+		// Ambient volume
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 1, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 4, 0);
+			if (m_isGradientCached) pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 4, 0, DescriptorFlag::NONE, 7);
+			pipelineLayout->SetRange(2, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetConstants(3, 5, 1);
+			pipelineLayout->SetConstants(4, 2, 2);
+			pipelineLayout->SetRootSRV(5, m_isGradientCached ? 5 : 4);
+			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+			XUSG_X_RETURN(m_pipelineLayouts[AMBIENT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"AmbientLayout"), false);
+		}
+
+		// Ray marching
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::UAV, NUM_CUBE_MAP_MIPS, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetRange(2, DescriptorType::SRV, 5, 0);
+			pipelineLayout->SetRange(2, DescriptorType::SRV, 1, 5, 0, DescriptorFlag::NONE, 6);	// Ambient volume, past the light map
+			pipelineLayout->SetConstants(3, 5, 2);
+#if _CPU_CUBE_FACE_CULL_ == 1
+			pipelineLayout->SetConstants(4, 2, 3);	// Face LODs and visibility mask
+#elif _CPU_CUBE_FACE_CULL_ == 2
+			pipelineLayout->SetRootCBV(4, 3);
+#else
+			pipelineLayout->SetConstants(4, 1, 3);	// Face LODs
+#endif
+			pipelineLayout->SetConstants(5, 2, 4);	// Interleave and phase of the checkerboard marching
+			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+			XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"RayMarchingLayout"), false);
+		}
+
+		// Light space ray marching
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 4, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 4, 0, DescriptorFlag::NONE, 6);	// Ambient volume, past the color and the light map
+			pipelineLayout->SetRange(2, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetConstants(3, 5, 2);
+			pipelineLayout->SetConstants(4, 2, 3);
+			if (m_isSparse) pipelineLayout->SetRootSRV(5, 5);
+			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+			XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_L], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"LightSpaceRayMarchingLayout"), false);
+		}
+
+		// Light sweep
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 2, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 2, 0, DescriptorFlag::NONE, 6);	// Ambient volume
+			pipelineLayout->SetRange(2, DescriptorType::SRV, 1, 3);
+			pipelineLayout->SetRange(2, DescriptorType::UAV, 2, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetConstants(3, 5, 2);
+			pipelineLayout->SetConstants(4, 3, 3);
+			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+			XUSG_X_RETURN(m_pipelineLayouts[LIGHT_SWEEP], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"LightSweepLayout"), false);
+		}
+
+		// View space ray marching
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::UAV, NUM_CUBE_MAP_MIPS, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetRange(2, DescriptorType::SRV, 3, 0);
+			pipelineLayout->SetRange(2, DescriptorType::SRV, 2, 3, 0, DescriptorFlag::NONE, 4);	// Past the density mips, which the light map replaces
+			pipelineLayout->SetConstants(3, 1, 2);
+#if _CPU_CUBE_FACE_CULL_ == 1
+			pipelineLayout->SetConstants(4, 2, 3);	// Face LODs and visibility mask
+#elif _CPU_CUBE_FACE_CULL_ == 2
+			pipelineLayout->SetRootCBV(4, 3);
+#else
+			pipelineLayout->SetConstants(4, 1, 3);	// Face LODs
+#endif
+			pipelineLayout->SetConstants(5, 2, 4);	// Interleave and phase of the checkerboard marching
 			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
 			XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_V], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 				PipelineLayoutFlag::NONE, L"ViewSpaceRayMarchingLayout"), false);
 		}
 
+		// Cube-map reconstruction of the checkerboard marching
+		if (m_cubeMapInterleave > 1)
+		{
+			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
+			pipelineLayout->SetRange(1, DescriptorType::UAV, NUM_CUBE_MAP_MIPS, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+			pipelineLayout->SetRange(2, DescriptorType::SRV, NUM_CUBE_MAP_MIPS, 0);	// History
+			pipelineLayout->SetConstants(3, sizeof(CubeMapCheckerboard) / sizeof(uint32_t), 2);
+			pipelineLayout->SetStaticSamplers(&sampler, 1, 0);
+			XUSG_X_RETURN(m_pipelineLayouts[CUBE_RECONSTRUCT], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+				PipelineLayoutFlag::NONE, L"CubeReconstructionLayout"), false);
+		}
+
 		// Cube rendering
 		{
 			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
 			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::SRV, 3, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, NUM_CUBE_MAP_MIPS + 2, 0);
+			pipelineLayout->SetConstants(2, 1, 2, 0, Shader::Stage::PS);	// Face LODs
 			pipelineLayout->SetStaticSamplers(&sampler, 1, 0, 0, Shader::Stage::PS);
 			pipelineLayout->SetShaderStage(1, Shader::Stage::PS);
 			XUSG_X_RETURN(m_pipelineLayouts[RENDER_CUBE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
@@ -539,9 +1347,9 @@ bool Fluid::createPipelineLayouts()
 		{
 			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
 			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 0);
-			pipelineLayout->SetConstants(2, 3, 2, 0, Shader::Stage::PS);
-			pipelineLayout->SetRootSRV(3, 1, 0, DescriptorFlag::NONE, Shader::Stage::PS);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 5, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 5, 0, DescriptorFlag::NONE, 6);	// Ambient volume, past the light map
+			pipelineLayout->SetConstants(2, 5, 2, 0, Shader::Stage::PS);
 			pipelineLayout->SetStaticSamplers(&sampler, 1, 0, 0, Shader::Stage::PS);
 			pipelineLayout->SetShaderStage(0, Shader::Stage::PS);
 			pipelineLayout->SetShaderStage(1, Shader::Stage::PS);
@@ -553,7 +1361,8 @@ bool Fluid::createPipelineLayouts()
 		{
 			const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
 			pipelineLayout->SetRange(0, DescriptorType::CBV, 2, 0, 0, DescriptorFlag::DATA_STATIC);
-			pipelineLayout->SetRange(1, DescriptorType::SRV, 2, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 3, 0);
+			pipelineLayout->SetRange(1, DescriptorType::SRV, 2, 3, 0, DescriptorFlag::NONE, 4);	// Past the density mips, which the light map replaces
 			pipelineLayout->SetConstants(2, 1, 2, 0, Shader::Stage::PS);
 			pipelineLayout->SetStaticSamplers(&sampler, 1, 0, 0, Shader::Stage::PS);
 			pipelineLayout->SetShaderStage(0, Shader::Stage::PS);
@@ -566,7 +1375,7 @@ bool Fluid::createPipelineLayouts()
 	{
 		// Visualization
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
-		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
 		pipelineLayout->SetStaticSamplers(&sampler, 1, 0, 0, Shader::Stage::PS);
 		pipelineLayout->SetShaderStage(0, Shader::PS);
 		XUSG_X_RETURN(m_pipelineLayouts[VISUALIZE], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
@@ -583,10 +1392,17 @@ bool Fluid::createPipelines(Format rtFormat, Format dsFormat)
 	auto dsIndex = 0u;
 	auto psIndex = 0u;
 	auto csIndex = 0u;
+	const auto isStaggered = m_velocityLayout == VELOCITY_STAGGERED;
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
 
-	// Advection
+	// Advection, or the MacCormack corrector
 	{
-		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSAdvect.cso"), false);
+		const wchar_t* fileNames[][2][2] =
+		{
+			{ { L"CSAdvect.cso", L"CSMacCormack.cso" }, { L"CSAdvectSparse.cso", L"CSMacCormackSparse.cso" } },
+			{ { L"CSAdvectMAC.cso", L"CSMacCormackMAC.cso" }, { L"CSAdvectMACSparse.cso", L"CSMacCormackMACSparse.cso" } }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_isSparse][isMacCormack]), false);
 
 		const auto state = Compute::State::MakeUnique();
 		state->SetPipelineLayout(m_pipelineLayouts[ADVECT]);
@@ -594,10 +1410,30 @@ bool Fluid::createPipelines(Format rtFormat, Format dsFormat)
 		XUSG_X_RETURN(m_pipelines[ADVECT], state->GetPipeline(m_computePipelineLib.get(), L"Advection"), false);
 	}
 
+	// Forward prediction of MacCormack advection
+	if (isMacCormack)
+	{
+		const wchar_t* fileNames[][2] =
+		{
+			{ L"CSAdvectPredict.cso", L"CSAdvectPredictSparse.cso" },
+			{ L"CSAdvectPredictMAC.cso", L"CSAdvectPredictMACSparse.cso" }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_isSparse]), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PREDICT]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PREDICT], state->GetPipeline(m_computePipelineLib.get(), L"Prediction"), false);
+	}
+
 	// Projection
 	{
-		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_gridSize.z > 1 ?
-			L"CSProject3D.cso" : L"CSProject2D.cso"), false);
+		const wchar_t* fileNames[][2] =
+		{
+			{ L"CSProject2D.cso", L"CSProject3D.cso" },
+			{ L"CSProjectMAC2D.cso", L"CSProjectMAC3D.cso" }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_gridSize.z > 1]), false);
 
 		const auto state = Compute::State::MakeUnique();
 		state->SetPipelineLayout(m_pipelineLayouts[PROJECT]);
@@ -605,207 +1441,1583 @@ bool Fluid::createPipelines(Format rtFormat, Format dsFormat)
 		XUSG_X_RETURN(m_pipelines[PROJECT], state->GetPipeline(m_computePipelineLib.get(), L"Projection"), false);
 	}
 
-	// Visualization
-	if (m_gridSize.z > 1)
-	{
-		// Ray marching
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarch.cso"), false);
+	// Divergence
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+			L"CSDivergenceMAC.cso" : L"CSDivergence.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[DIVERGENCE]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[DIVERGENCE], state->GetPipeline(m_computePipelineLib.get(), L"Divergence"), false);
+	}
+
+	// Mean reduction
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceMean.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[REDUCE_MEAN]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[REDUCE_MEAN], state->GetPipeline(m_computePipelineLib.get(), L"MeanReduction"), false);
+	}
+
+	// Mean removal
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRemoveMean.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[REMOVE_MEAN]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[REMOVE_MEAN], state->GetPipeline(m_computePipelineLib.get(), L"MeanRemoval"), false);
+	}
+
+	// Smoothing
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSSmooth.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[SMOOTH]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[SMOOTH], state->GetPipeline(m_computePipelineLib.get(), L"Smoothing"), false);
+	}
+
+	// Restriction
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRestrict.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[RESTRICT]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[RESTRICT], state->GetPipeline(m_computePipelineLib.get(), L"Restriction"), false);
+	}
+
+	// Prolongation
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSProlong.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PROLONG]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PROLONG], state->GetPipeline(m_computePipelineLib.get(), L"Prolongation"), false);
+	}
+
+	// Gradient subtraction
+	{
+		const wchar_t* fileNames[][2] =
+		{
+			{ L"CSSubtractGradient2D.cso", L"CSSubtractGradient3D.cso" },
+			{ L"CSSubtractGradientMAC2D.cso", L"CSSubtractGradientMAC3D.cso" }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_gridSize.z > 1]), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[SUBTRACT_GRADIENT]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[SUBTRACT_GRADIENT], state->GetPipeline(m_computePipelineLib.get(), L"GradientSubtraction"), false);
+	}
+
+	// Cosine transform
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSCosineTransform.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[COSINE_TRANSFORM]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[COSINE_TRANSFORM], state->GetPipeline(m_computePipelineLib.get(), L"CosineTransform"), false);
+	}
+
+	// Spectral solve
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSSpectralSolve.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[SPECTRAL_SOLVE]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[SPECTRAL_SOLVE], state->GetPipeline(m_computePipelineLib.get(), L"SpectralSolve"), false);
+	}
+
+	// PCG residual
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGResidual.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PCG_RESIDUAL]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PCG_RESIDUAL], state->GetPipeline(m_computePipelineLib.get(), L"PCGResidual"), false);
+	}
+
+	// PCG operator application
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGApply.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PCG_APPLY]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PCG_APPLY], state->GetPipeline(m_computePipelineLib.get(), L"PCGApply"), false);
+	}
+
+	// PCG update
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGUpdate.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PCG_UPDATE]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PCG_UPDATE], state->GetPipeline(m_computePipelineLib.get(), L"PCGUpdate"), false);
+	}
+
+	// PCG reduction
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGReduce.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[PCG_REDUCE]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[PCG_REDUCE], state->GetPipeline(m_computePipelineLib.get(), L"PCGReduce"), false);
+	}
+
+	// Residual norm
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+			L"CSResidualNormMAC.cso" : L"CSResidualNorm.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[RESIDUAL_NORM]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[RESIDUAL_NORM], state->GetPipeline(m_computePipelineLib.get(), L"ResidualNorm"), false);
+	}
+
+	// Sum reduction
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceSums.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[REDUCE_SUMS]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[REDUCE_SUMS], state->GetPipeline(m_computePipelineLib.get(), L"SumReduction"), false);
+	}
+
+	// Max speed
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSMaxSpeed.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[MAX_SPEED]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[MAX_SPEED], state->GetPipeline(m_computePipelineLib.get(), L"MaxSpeed"), false);
+	}
+
+	// Max reduction
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceMax.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[REDUCE_MAX]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[REDUCE_MAX], state->GetPipeline(m_computePipelineLib.get(), L"MaxReduction"), false);
+	}
+
+	// Active-brick list
+	if (m_isSparse)
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBuildBricks.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BUILD_BRICKS]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[BUILD_BRICKS], state->GetPipeline(m_computePipelineLib.get(), L"BrickBuild"), false);
+	}
+
+	// Visualization
+	if (m_gridSize.z > 1)
+	{
+		// Density quantization
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSQuantizeDensity.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[QUANTIZE_DENSITY]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[QUANTIZE_DENSITY], state->GetPipeline(m_computePipelineLib.get(), L"DensityQuantization"), false);
+		}
+
+		// Max-density pyramid
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityPyramid.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DENSITY_PYRAMID]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[DENSITY_PYRAMID], state->GetPipeline(m_computePipelineLib.get(), L"DensityPyramid"), false);
+		}
+
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityPyramidMip.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DENSITY_PYRAMID_MIP]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[DENSITY_PYRAMID_MIP], state->GetPipeline(m_computePipelineLib.get(), L"DensityPyramidMip"), false);
+		}
+
+		// Density mips
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityMip.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DENSITY_MIP]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[DENSITY_MIP], state->GetPipeline(m_computePipelineLib.get(), L"DensityMip"), false);
+		}
+
+		// Density gradient
+		if (m_isGradientCached)
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityGradient.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DENSITY_GRADIENT]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[DENSITY_GRADIENT], state->GetPipeline(m_computePipelineLib.get(), L"DensityGradient"), false);
+		}
+
+		// Ambient volume
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_isGradientCached ?
+				L"CSAmbientG.cso" : L"CSAmbient.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[AMBIENT]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[AMBIENT], state->GetPipeline(m_computePipelineLib.get(), L"Ambient"), false);
+		}
+
+		// Ray marching
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarch.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[RAY_MARCH], state->GetPipeline(m_computePipelineLib.get(), L"RayMarching"), false);
+		}
+
+		// Light space ray marching
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_isSparse ?
+				L"CSRayMarchLSparse.cso" : L"CSRayMarchL.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH_L]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[RAY_MARCH_L], state->GetPipeline(m_computePipelineLib.get(), L"LightSpaceRayMarching"), false);
+		}
+
+		// Light sweep
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSLightSweep.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[LIGHT_SWEEP]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[LIGHT_SWEEP], state->GetPipeline(m_computePipelineLib.get(), L"LightSweep"), false);
+		}
+
+		// View space ray marching
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchV.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH_V]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[RAY_MARCH_V], state->GetPipeline(m_computePipelineLib.get(), L"ViewSpaceRayMarching"), false);
+		}
+
+		// Cube-map reconstruction of the checkerboard marching
+		if (m_cubeMapInterleave > 1)
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSCubeReconstruct.cso"), false);
+
+			const auto state = Compute::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[CUBE_RECONSTRUCT]);
+			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+			XUSG_X_RETURN(m_pipelines[CUBE_RECONSTRUCT], state->GetPipeline(m_computePipelineLib.get(), L"CubeReconstruction"), false);
+		}
+
+		// Cube rendering
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSCube.cso"), false);
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSCube.cso"), false);
+
+			const auto state = Graphics::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[RENDER_CUBE]);
+			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
+			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
+			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
+			state->RSSetState(Graphics::CULL_FRONT, m_graphicsPipelineLib.get()); // Front-face culling for interior surfaces
+			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
+			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
+			state->OMSetRTVFormats(&rtFormat, 1);
+			XUSG_X_RETURN(m_pipelines[RENDER_CUBE], state->GetPipeline(m_graphicsPipelineLib.get(), L"RayCasting"), false);
+		}
+
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSScreenQuad.cso"), false);
+
+		// Direct ray casting
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSRayCast.cso"), false);
+
+			const auto state = Graphics::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DIRECT_RAY_CAST]);
+			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex));
+			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
+			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
+			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
+			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
+			state->OMSetRTVFormats(&rtFormat, 1);
+			XUSG_X_RETURN(m_pipelines[DIRECT_RAY_CAST], state->GetPipeline(m_graphicsPipelineLib.get(), L"DirectRayCasting"), false);
+		}
+
+		// View space direct Ray casting 
+		{
+			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSRayCastV.cso"), false);
+
+			const auto state = Graphics::State::MakeUnique();
+			state->SetPipelineLayout(m_pipelineLayouts[DIRECT_RAY_CAST_V]);
+			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
+			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
+			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
+			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
+			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
+			state->OMSetRTVFormats(&rtFormat, 1);
+			XUSG_X_RETURN(m_pipelines[DIRECT_RAY_CAST_V], state->GetPipeline(m_graphicsPipelineLib.get(), L"ViewSpaceDirectRayCasting"), false);
+		}
+	}
+	else
+	{
+		// Visualization
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSScreenQuad.cso"), false);
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSVisualizeColor.cso"), false);
+
+		const auto state = Graphics::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[VISUALIZE]);
+		state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
+		state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
+		state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
+		state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
+		state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
+		state->OMSetRTVFormats(&rtFormat, 1);
+		XUSG_X_RETURN(m_pipelines[VISUALIZE], state->GetPipeline(m_graphicsPipelineLib.get(), L"Visualization"), false);
+	}
+
+	return true;
+}
+
+bool Fluid::createDescriptorTables()
+{
+	// Create CBV tables
+	if (m_gridSize.z > 1)
+	{
+		for (uint8_t i = 0; i < FrameCount; ++i)
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			const Descriptor descriptors[] =
+			{
+				m_cbPerObject->GetCBV(i),
+				m_cbPerFrame->GetCBV(i)
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+			XUSG_X_RETURN(m_cbvTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
+	}
+
+	// Create SRV and UAV tables
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_velocities[i]->GetSRV(),
+			m_velocities[!i]->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_VECOLITY + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		// Create incompressibility UAV
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, &m_incompress->GetUAV());
+		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_INCOMPRESS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_colors[!i]->GetSRV(),
+			m_densities[!i]->GetSRV(),
+			m_colors[i]->GetUAV(),
+			m_densities[i]->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_COLOR + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Forward predictions of MacCormack advection, written by the prediction and read by the corrector
+	if (m_advectionScheme == ADVECT_MACCORMACK)
+	{
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			const Descriptor descriptors[] =
+			{
+				m_velocities[0]->GetSRV(),
+				m_predictedVelocity->GetUAV()
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+			XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PREDICT_VELOCITY], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
+
+		for (uint8_t i = 0; i < 2; ++i)
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			const Descriptor descriptors[] =
+			{
+				m_colors[!i]->GetSRV(),
+				m_densities[!i]->GetSRV(),
+				m_predictedColor->GetUAV(),
+				m_predictedDensity->GetUAV()
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+			XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PREDICT_COLOR + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
+
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			const Descriptor descriptors[] =
+			{
+				m_predictedVelocity->GetSRV(),
+				m_predictedColor->GetSRV(),
+				m_predictedDensity->GetSRV()
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+			XUSG_X_RETURN(m_srvUavTables[SRV_TABLE_PREDICTION], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
+	}
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_quantizedDensity->GetSRV(),
+			m_densityRanges->GetSRV(),
+			m_densityPyramid->GetSRV(),
+			m_densityMips->GetSRV(),
+			m_colors[!i]->GetSRV(),
+			m_lightMap->GetSRV(),
+			m_ambientVolume->GetSRV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		if (m_densityGradient) descriptorTable->SetDescriptors(7, 1, &m_densityGradient->GetSRV());
+		XUSG_X_RETURN(m_srvUavTables[SRV_TABLE_RAY_MARCH + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Density quantization of the rendered frame
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_densities[i]->GetSRV(),
+			m_quantizedDensity->GetUAV(),
+			m_densityRanges->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_QUANTIZE + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Max-density pyramid: level 0 of the quantized density, and each coarser level of the one below
+	const uint8_t numPyramidLevels = m_densityPyramid->GetNumMips();
+	m_densityPyramidTables.resize(numPyramidLevels);
+	for (uint8_t i = 0; i < numPyramidLevels; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		if (i > 0)
+		{
+			const Descriptor descriptors[] =
+			{
+				m_densityPyramid->GetSRV(i - 1, true),
+				m_densityPyramid->GetUAV(i)
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		}
+		else
+		{
+			const Descriptor descriptors[] =
+			{
+				m_quantizedDensity->GetSRV(),
+				m_densityRanges->GetSRV(),
+				m_densityPyramid->GetUAV()
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		}
+		XUSG_X_RETURN(m_densityPyramidTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Density mips: mip 1 of the density of the rendered frame, and each coarser mip of the one below
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_densities[i]->GetSRV(),
+			m_densityMips->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_DENSITY_MIP + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	const uint8_t numDensityMips = m_densityMips->GetNumMips();
+	m_densityMipTables.resize(numDensityMips - 1);
+	for (uint8_t i = 1; i < numDensityMips; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_densityMips->GetSRV(i - 1, true),
+			m_densityMips->GetUAV(i)
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_densityMipTables[i - 1], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create UAV and SRV tables of all the mips, each face indexing its own LOD
+	for (uint8_t i = 0; i < (m_cubeMapInterleave > 1 ? 2 : 1); ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		Descriptor descriptors[NUM_CUBE_MAP_MIPS];
+		for (uint8_t j = 0; j < NUM_CUBE_MAP_MIPS; ++j) descriptors[j] = m_cubeMaps[i]->GetUAV(j);
+		//m_cubeDepth->GetUAV()
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_CUBE_MAP + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	for (uint8_t i = 0; i < (m_cubeMapInterleave > 1 ? 2 : 1); ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		Descriptor descriptors[NUM_CUBE_MAP_MIPS];
+		for (uint8_t j = 0; j < NUM_CUBE_MAP_MIPS; ++j) descriptors[j] = m_cubeMaps[i]->GetSRV(j);
+		//m_cubeDepth->GetSRV()
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_TABLE_CUBE_MAP + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create UAV table
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0,1, &m_lightMap->GetUAV());
+		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_LIGHT_MAP], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, &m_ambientVolume->GetUAV());
+		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_AMBIENT], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	if (m_densityGradient)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, &m_densityGradient->GetUAV());
+		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_DENSITY_GRADIENT], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Light sweep: the slice before, the light map and the slice swept, ping-ponged
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_sweepSlices[!i]->GetSRV(),
+			m_lightMap->GetUAV(),
+			m_sweepSlices[i]->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_LIGHT_SWEEP + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create divergence and mean tables
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_velocities[1]->GetSRV(),
+			m_divergence->GetUAV(),
+			m_partialMeans->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_DIVERGENCE], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_partialMeans->GetSRV(),
+			m_divergenceMean->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_REDUCE_MEAN], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_divergenceMean->GetSRV(),
+			m_divergence->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_REMOVE_MEAN], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create spectral tables, ping-ponging between the divergence and the spectrum
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			i ? m_spectrum->GetSRV() : m_divergence->GetSRV(),
+			i ? m_divergence->GetUAV() : m_spectrum->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_SPECTRUM + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_divergence->GetSRV(),
+			m_incompress->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_SPECTRAL_SOLUTION], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create PCG tables; the search directions ping-pong between iterations
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_divergence->GetSRV(),
+			m_incompress->GetSRV(),
+			m_pcgResidual->GetUAV(),
+			m_pcgDirections[0]->GetUAV(),
+			m_partialSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PCG_RESIDUAL], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_pcgResidual->GetSRV(),
+			m_pcgDirections[i]->GetSRV(),
+			m_pcgState->GetSRV(),
+			m_pcgDirections[!i]->GetUAV(),
+			m_pcgKDirection->GetUAV(),
+			m_partialSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PCG_APPLY + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_pcgDirections[!i]->GetSRV(),
+			m_pcgKDirection->GetSRV(),
+			m_pcgState->GetSRV(),
+			m_incompress->GetUAV(),
+			m_pcgResidual->GetUAV(),
+			m_partialSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PCG_UPDATE + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_partialSums->GetSRV(),
+			m_pcgState->GetUAV(),
+			m_pcgDispatchArgs->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_PCG_REDUCE], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_velocities[1]->GetSRV(),
+			m_incompress->GetSRV(),
+			m_partialSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_RESIDUAL_NORM], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_partialSums->GetSRV(),
+			m_residualSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_REDUCE_SUMS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_velocities[0]->GetSRV(),
+			m_partialSums->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_MAX_SPEED], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_partialSums->GetSRV(),
+			m_maxSpeed->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_REDUCE_MAX], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Active-brick lists: the build of each step reads the marks of the last advection, and
+	// resets the count of the next build; the bricks it drops take the projected velocity
+	for (uint8_t i = 0; m_isSparse && i < 2; ++i)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		const Descriptor descriptors[] =
+		{
+			m_brickMasks[!i]->GetSRV(),
+			m_velocities[0]->GetSRV(),
+			m_brickMasks[i]->GetUAV(),
+			m_idleSteps->GetUAV(),
+			m_activeBricks[i]->GetUAV(),
+			m_dispatchArgs[i]->GetUAV(),
+			m_dispatchArgs[!i]->GetUAV(),
+			m_velocities[1]->GetUAV()
+		};
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_BUILD_BRICKS + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
+	// Create multigrid tables per level
+	const auto numLevels = static_cast<uint8_t>(m_coarseIncompress.size() + 1);
+	m_smoothTables.resize(numLevels);
+	m_restrictTables.resize(numLevels - 1);
+	m_prolongTables.resize(numLevels - 1);
+	for (uint8_t i = 0; i < numLevels; ++i)
+	{
+		const auto pIncompress = i > 0 ? m_coarseIncompress[i - 1].get() : m_incompress.get();
+		const auto pDivergence = i > 0 ? m_coarseDivergence[i - 1].get() : m_divergence.get();
+
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			const Descriptor descriptors[] =
+			{
+				pDivergence->GetSRV(),
+				pIncompress->GetUAV()
+			};
+			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+			XUSG_X_RETURN(m_smoothTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
+
+		if (i + 1 < numLevels)
+		{
+			{
+				const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+				const Descriptor descriptors[] =
+				{
+					pIncompress->GetSRV(),
+					pDivergence->GetSRV(),
+					m_coarseDivergence[i]->GetUAV(),
+					m_coarseIncompress[i]->GetUAV()
+				};
+				descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+				XUSG_X_RETURN(m_restrictTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+			}
+
+			{
+				const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+				const Descriptor descriptors[] =
+				{
+					m_coarseIncompress[i]->GetSRV(),
+					pIncompress->GetUAV()
+				};
+				descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+				XUSG_X_RETURN(m_prolongTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+			}
+		}
+	}
+
+	return true;
+}
+
+void Fluid::advect(CommandList* pCommandList, uint8_t frameIndex, uint32_t substep)
+{
+	ResourceBarrier barriers[7];
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+
+	// Set barriers (promotions for the first sub-step; the later ones read the projection of the previous)
+	auto numBarriers = m_velocities[0]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = m_velocities[1]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, substep > 0 ? numBarriers : 0);
+	numBarriers = m_colors[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_densities[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	if (isMacCormack)
+	{
+		numBarriers = m_predictedVelocity->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		numBarriers = m_predictedColor->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		numBarriers = m_predictedDensity->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	}
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Forward semi-Lagrangian prediction, traced back by the corrector
+	if (isMacCormack)
+	{
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PREDICT]);
+		pCommandList->SetPipelineState(m_pipelines[PREDICT]);
+		pCommandList->SetComputeRootConstantBufferView(0, m_cbSimulation.get(), m_cbSimulation->GetCBVOffset(frameIndex));
+		pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_PREDICT_VELOCITY]);
+		pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_UAV_TABLE_PREDICT_COLOR + m_frameParity]);
+		if (m_isSparse)
+		{
+			pCommandList->SetComputeRootShaderResourceView(3, m_activeBricks[m_frameParity].get());
+			pCommandList->ExecuteIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+		}
+		else pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+
+		numBarriers = m_predictedVelocity->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_predictedColor->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+		numBarriers = m_predictedDensity->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+	}
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[ADVECT]);
+	pCommandList->SetPipelineState(m_pipelines[ADVECT]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeRootConstantBufferView(0, m_cbSimulation.get(), m_cbSimulation->GetCBVOffset(frameIndex));
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_VECOLITY]);
+	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_UAV_TABLE_COLOR + m_frameParity]);
+	if (isMacCormack) pCommandList->SetComputeDescriptorTable(3, m_srvUavTables[SRV_TABLE_PREDICTION]);
+
+	if (m_isSparse)
+	{
+		// Only the active bricks, marking those left busy for the next build
+		pCommandList->SetComputeRootShaderResourceView(isMacCormack ? 4 : 3, m_activeBricks[m_frameParity].get());
+		pCommandList->SetComputeRootUnorderedAccessView(isMacCormack ? 5 : 4, m_brickMasks[m_frameParity].get());
+		pCommandList->ExecuteIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+	}
+	else pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+}
+
+void Fluid::project(CommandList* pCommandList, uint8_t frameIndex)
+{
+	ResourceBarrier barriers[5];
+
+	// The Jacobi modes solve inside the projection shader, unless at a coarse pressure level
+	const auto isAdaptive = m_projectionMode == PROJECT_JACOBI_ADAPTIVE;
+	const auto isJacobi = m_projectionMode == PROJECT_JACOBI || isAdaptive;
+	const auto pressureLevel = GetPressureLevel();
+	const auto pipeline = isJacobi && pressureLevel == 0 ? PROJECT : SUBTRACT_GRADIENT;
+
+	// Set barriers
+	auto numBarriers = m_velocities[0]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	numBarriers = m_velocities[1]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_colors[m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_densities[m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
+	if (pipeline == PROJECT) numBarriers = m_incompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// External pressure solve
+	if (pipeline == SUBTRACT_GRADIENT && m_timeStep > 0.0f)
+	{
+		computeDivergence(pCommandList);
+
+		// A coarse level solves for the correction of the restricted residual, warm-started by the
+		// previous pressure, and adds its trilinear upsampling back; Jacobi relaxes red-black there
+		for (uint8_t i = 0; i < pressureLevel; ++i) restrictResidual(pCommandList, i);
+		if (m_projectionMode == PROJECT_DCT) solveSpectral(pCommandList);
+		else if (m_projectionMode == PROJECT_PCG) solvePCG(pCommandList, frameIndex);
+		else if (isJacobi) smooth(pCommandList, pressureLevel, isAdaptive ? m_numIterations : g_numJacobiIterations);
+		else if (m_projectionMode == PROJECT_SOR) smooth(pCommandList, pressureLevel, g_sorNumSweeps, true);
+		else multigrid(pCommandList, pressureLevel, m_projectionMode == PROJECT_MULTIGRID_F);
+		for (auto i = pressureLevel; i > 0; --i) prolong(pCommandList, i - 1);
+
+		numBarriers = m_incompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+		pCommandList->Barrier(numBarriers, barriers);
+	}
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[pipeline]);
+	pCommandList->SetPipelineState(m_pipelines[pipeline]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeRootConstantBufferView(0, m_cbSimulation.get(), m_cbSimulation->GetCBVOffset(frameIndex));
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_VECOLITY1]);
+
+	XMUINT3 numGroups;
+	if (m_gridSize.z > 1) // optimized for 3D
+	{
+		numGroups.x = XUSG_DIV_UP(m_gridSize.x, 4);
+		numGroups.y = XUSG_DIV_UP(m_gridSize.y, 4);
+		numGroups.z = XUSG_DIV_UP(m_gridSize.z, 4);
+	}
+	else
+	{
+		numGroups.x = XUSG_DIV_UP(m_gridSize.x, 8);
+		numGroups.y = XUSG_DIV_UP(m_gridSize.y, 8);
+		numGroups.z = m_gridSize.z;
+	}
+
+	pCommandList->Dispatch(numGroups.x, numGroups.y, numGroups.z);
+}
+
+void Fluid::computeDivergence(const CommandList* pCommandList)
+{
+	ResourceBarrier barriers[2];
+
+	// Divergence, with the partial means of the thread groups
+	{
+		// Set barriers
+		auto numBarriers = m_divergence->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+		numBarriers = m_partialMeans->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DIVERGENCE]);
+		pCommandList->SetPipelineState(m_pipelines[DIVERGENCE]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_DIVERGENCE]);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Mean reduction
+	{
+		// Set barriers
+		auto numBarriers = m_partialMeans->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_divergenceMean->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[REDUCE_MEAN]);
+		pCommandList->SetPipelineState(m_pipelines[REDUCE_MEAN]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_REDUCE_MEAN]);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Mean removal, since pure Neumann boundaries only admit a zero-mean divergence
+	{
+		// Set barriers
+		auto numBarriers = m_divergenceMean->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_divergence->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[REMOVE_MEAN]);
+		pCommandList->SetPipelineState(m_pipelines[REMOVE_MEAN]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_REMOVE_MEAN]);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+}
+
+void Fluid::multigrid(CommandList* pCommandList, uint8_t level, bool isFCycle)
+{
+	if (level >= m_coarseIncompress.size())
+	{
+		smooth(pCommandList, level, g_mgNumCoarsestSweeps);
+		return;
+	}
+
+	smooth(pCommandList, level, g_mgNumPreSweeps);
+	restrictResidual(pCommandList, level);
+
+	// An F-cycle recurses with an F-cycle followed by a V-cycle
+	multigrid(pCommandList, level + 1, isFCycle);
+	if (isFCycle) multigrid(pCommandList, level + 1, false);
+
+	prolong(pCommandList, level);
+	smooth(pCommandList, level, g_mgNumPostSweeps);
+}
+
+void Fluid::smooth(CommandList* pCommandList, uint8_t level, uint32_t numSweeps, bool overRelax)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+	const auto pDivergence = level > 0 ? m_coarseDivergence[level - 1].get() : m_divergence.get();
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[SMOOTH]);
+	pCommandList->SetPipelineState(m_pipelines[SMOOTH]);
+
+	// Set descriptor table
+	pCommandList->SetComputeDescriptorTable(1, m_smoothTables[level]);
+
+	// Red-black Gauss-Seidel (or SOR) sweeps
+	const auto omega = overRelax ? m_sorOmega : 1.0f;
+	ResourceBarrier barriers[2];
+	for (auto i = 0u; i < numSweeps; ++i)
+	{
+		for (uint8_t color = 0; color < 2; ++color)
+		{
+			auto numBarriers = pIncompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+			numBarriers = pDivergence->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+			pCommandList->Barrier(numBarriers, barriers);
+
+			const struct
+			{
+				uint32_t Color;
+				float Omega;
+			} constants = { color, omega };
+			pCommandList->SetCompute32BitConstants(0, 2, &constants);
+			pCommandList->Dispatch(XUSG_DIV_UP(pIncompress->GetWidth(), 8),
+				XUSG_DIV_UP(pIncompress->GetHeight(), 8), pIncompress->GetDepth());
+		}
+	}
+}
+
+void Fluid::restrictResidual(CommandList* pCommandList, uint8_t level)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+	const auto pDivergence = level > 0 ? m_coarseDivergence[level - 1].get() : m_divergence.get();
+	const auto pCoarseIncompress = m_coarseIncompress[level].get();
+
+	// Set barriers
+	ResourceBarrier barriers[4];
+	auto numBarriers = pIncompress->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = pDivergence->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_coarseDivergence[level]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = pCoarseIncompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[RESTRICT]);
+	pCommandList->SetPipelineState(m_pipelines[RESTRICT]);
+
+	// Set descriptor table
+	pCommandList->SetComputeDescriptorTable(0, m_restrictTables[level]);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(pCoarseIncompress->GetWidth(), 8),
+		XUSG_DIV_UP(pCoarseIncompress->GetHeight(), 8), pCoarseIncompress->GetDepth());
+}
+
+void Fluid::prolong(CommandList* pCommandList, uint8_t level)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+
+	// Set barriers
+	ResourceBarrier barriers[2];
+	auto numBarriers = m_coarseIncompress[level]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = pIncompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PROLONG]);
+	pCommandList->SetPipelineState(m_pipelines[PROLONG]);
+
+	// Set descriptor table
+	pCommandList->SetComputeDescriptorTable(0, m_prolongTables[level]);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(pIncompress->GetWidth(), 8),
+		XUSG_DIV_UP(pIncompress->GetHeight(), 8), pIncompress->GetDepth());
+}
+
+void Fluid::solveSpectral(CommandList* pCommandList)
+{
+	uint8_t axes[3];
+	uint8_t numAxes = 0;
+	for (uint8_t i = 0; i < 3; ++i) if ((&m_gridSize.x)[i] > 1) axes[numAxes++] = i;
+
+	// Forward transforms, the solve, and inverse transforms, alternating between the
+	// divergence and the spectrum; the odd pass count ends on the divergence
+	const uint8_t numPasses = numAxes * 2 + 1;
+	ResourceBarrier barriers[2];
+	for (uint8_t i = 0; i < numPasses; ++i)
+	{
+		const auto isLast = i + 1 >= numPasses;
+		const auto pSource = i & 1 ? m_spectrum.get() : m_divergence.get();
+		const auto pDest = isLast ? m_incompress.get() : (i & 1 ? m_divergence.get() : m_spectrum.get());
+		const auto table = isLast ? SRV_UAV_TABLE_SPECTRAL_SOLUTION : SRV_UAV_TABLE_SPECTRUM + (i & 1);
+
+		// Set barriers
+		auto numBarriers = pSource->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = pDest->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		if (i == numAxes)
+		{
+			// Set pipeline state
+			pCommandList->SetComputePipelineLayout(m_pipelineLayouts[SPECTRAL_SOLVE]);
+			pCommandList->SetPipelineState(m_pipelines[SPECTRAL_SOLVE]);
+
+			// Set descriptor table
+			pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[table]);
+
+			pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+		}
+		else
+		{
+			const auto isInverse = i > numAxes;
+			const auto axis = axes[isInverse ? numPasses - 1 - i : i];
+
+			// Set pipeline state
+			pCommandList->SetComputePipelineLayout(m_pipelineLayouts[COSINE_TRANSFORM]);
+			pCommandList->SetPipelineState(m_pipelines[COSINE_TRANSFORM]);
+
+			// Set descriptor table and constants
+			const uint32_t constants[] = { axis, isInverse ? 1u : 0u };
+			pCommandList->SetCompute32BitConstants(0, static_cast<uint32_t>(size(constants)), constants);
+			pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[table]);
+
+			// One thread group per line
+			const auto numLines = axis > 0 ? (axis > 1 ? XMUINT2(m_gridSize.x, m_gridSize.y) :
+				XMUINT2(m_gridSize.x, m_gridSize.z)) : XMUINT2(m_gridSize.y, m_gridSize.z);
+			pCommandList->Dispatch(numLines.x, numLines.y, 1);
+		}
+	}
+}
+
+void Fluid::solvePCG(CommandList* pCommandList, uint8_t frameIndex)
+{
+	ResourceBarrier barriers[7];
+
+	// Initial residual from the previous pressure
+	{
+		// Set barriers
+		auto numBarriers = m_divergence->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_incompress->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+		numBarriers = m_pcgResidual->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		numBarriers = m_pcgDirections[0]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PCG_RESIDUAL]);
+		pCommandList->SetPipelineState(m_pipelines[PCG_RESIDUAL]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_PCG_RESIDUAL]);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	reducePCG(pCommandList, 0);
+
+	// The whole budget is recorded; the passes after convergence are dispatched indirectly
+	// with no thread groups, leaving the barriers and the single-group reductions
+	for (auto i = 0u; i < m_pcgMaxIterations; ++i)
+	{
+		const uint8_t parity = i & 1;
+
+		// Search direction and q = K p
+		{
+			// Set barriers
+			auto numBarriers = m_pcgResidual->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+			numBarriers = m_pcgDirections[parity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+			numBarriers = m_pcgState->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+			numBarriers = m_pcgDirections[!parity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_pcgKDirection->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_pcgDispatchArgs->SetBarrier(barriers, ResourceState::INDIRECT_ARGUMENT, numBarriers);
+			pCommandList->Barrier(numBarriers, barriers);
+
+			// Set pipeline state
+			pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PCG_APPLY]);
+			pCommandList->SetPipelineState(m_pipelines[PCG_APPLY]);
+
+			// Set descriptor table
+			pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_PCG_APPLY + parity]);
+
+			pCommandList->ExecuteIndirect(m_commandLayout.get(), 1, m_pcgDispatchArgs.get());
+		}
+
+		reducePCG(pCommandList, 1);
+
+		// Step along the search direction
+		{
+			// Set barriers
+			auto numBarriers = m_pcgDirections[!parity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+			numBarriers = m_pcgKDirection->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+			numBarriers = m_pcgState->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+			numBarriers = m_incompress->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_pcgResidual->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			numBarriers = m_pcgDispatchArgs->SetBarrier(barriers, ResourceState::INDIRECT_ARGUMENT, numBarriers);
+			pCommandList->Barrier(numBarriers, barriers);
+
+			// Set pipeline state
+			pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PCG_UPDATE]);
+			pCommandList->SetPipelineState(m_pipelines[PCG_UPDATE]);
+
+			// Set descriptor table
+			pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_PCG_UPDATE + parity]);
+
+			pCommandList->ExecuteIndirect(m_commandLayout.get(), 1, m_pcgDispatchArgs.get());
+		}
+
+		reducePCG(pCommandList, 2);
+	}
+
+	// Copy the scalars to this frame's readback slot
+	const auto numBarriers = m_pcgState->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+	pCommandList->CopyBufferRegion(m_pcgReadback.get(), sizeof(PCGState) * frameIndex,
+		m_pcgState.get(), 0, sizeof(PCGState));
+}
+
+void Fluid::reducePCG(const CommandList* pCommandList, uint8_t stage)
+{
+	// Set barriers
+	ResourceBarrier barriers[3];
+	auto numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = m_pcgState->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_pcgDispatchArgs->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[PCG_REDUCE]);
+	pCommandList->SetPipelineState(m_pipelines[PCG_REDUCE]);
+
+	// Set descriptor table and constants
+	const struct
+	{
+		XMUINT3 NumGroups;
+		uint32_t Stage;
+		float Tolerance;
+	} constants =
+	{
+		XMUINT3(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z),
+		stage, m_pcgTolerance
+	};
+	pCommandList->SetCompute32BitConstants(0, 5, &constants);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_PCG_REDUCE]);
+
+	pCommandList->Dispatch(1, 1, 1);
+}
+
+void Fluid::measureResidual(CommandList* pCommandList, uint8_t frameIndex)
+{
+	ResourceBarrier barriers[2];
+
+	// Partial sums of the residual per thread group
+	{
+		// Set barriers
+		auto numBarriers = m_incompress->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[RESIDUAL_NORM]);
+		pCommandList->SetPipelineState(m_pipelines[RESIDUAL_NORM]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_RESIDUAL_NORM]);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Sum reduction
+	{
+		// Set barriers
+		auto numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_residualSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[REDUCE_SUMS]);
+		pCommandList->SetPipelineState(m_pipelines[REDUCE_SUMS]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_REDUCE_SUMS]);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Copy the sums to this frame's readback slot, without waiting for them
+	const auto numBarriers = m_residualSums->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+	pCommandList->CopyBufferRegion(m_residualReadback.get(), sizeof(XMFLOAT4) * frameIndex,
+		m_residualSums.get(), 0, sizeof(XMFLOAT4));
+	m_pendingResiduals |= 1 << frameIndex;
+}
+
+void Fluid::measureSpeed(CommandList* pCommandList, uint8_t frameIndex)
+{
+	ResourceBarrier barriers[2];
+
+	// Partial maxima of the projected velocity per thread group
+	{
+		// Set barriers
+		auto numBarriers = m_velocities[0]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[MAX_SPEED]);
+		pCommandList->SetPipelineState(m_pipelines[MAX_SPEED]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_MAX_SPEED]);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Max reduction
+	{
+		// Set barriers
+		auto numBarriers = m_partialSums->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		numBarriers = m_maxSpeed->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[REDUCE_MAX]);
+		pCommandList->SetPipelineState(m_pipelines[REDUCE_MAX]);
+
+		// Set descriptor table
+		pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_REDUCE_MAX]);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Copy the maxima to this frame's readback slot, without waiting for them
+	const auto numBarriers = m_maxSpeed->SetBarrier(barriers, ResourceState::COPY_SOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+	pCommandList->CopyBufferRegion(m_speedReadback.get(), sizeof(XMFLOAT4) * frameIndex,
+		m_maxSpeed.get(), 0, sizeof(XMFLOAT4));
+	m_pendingSpeeds |= 1 << frameIndex;
+}
 
-			const auto state = Compute::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH]);
-			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
-			XUSG_X_RETURN(m_pipelines[RAY_MARCH], state->GetPipeline(m_computePipelineLib.get(), L"RayMarching"), false);
-		}
+void Fluid::buildBricks(const CommandList* pCommandList)
+{
+	// Set barriers
+	ResourceBarrier barriers[8];
+	auto numBarriers = m_brickMasks[!m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = m_velocities[0]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_velocities[1]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_brickMasks[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_idleSteps->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_activeBricks[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	for (uint8_t i = 0; i < 2; ++i)
+		numBarriers = m_dispatchArgs[i]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
 
-		// Light space ray marching
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchL.cso"), false);
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[BUILD_BRICKS]);
+	pCommandList->SetPipelineState(m_pipelines[BUILD_BRICKS]);
+
+	// Set the brick grid, with the thread groups of each brick, and the descriptor table
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	const auto numBricks = brickGridSize.x * brickGridSize.y * brickGridSize.z;
+	const uint32_t numBrickGroups = g_brickSize * g_brickSize * (m_gridSize.z > 1 ? g_brickSize : 1) / 64;
+	pCommandList->SetCompute32BitConstants(0, 3, &brickGridSize);
+	pCommandList->SetCompute32BitConstant(0, numBrickGroups, 3);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_UAV_TABLE_BUILD_BRICKS + m_frameParity]);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(numBricks, 64), 1, 1);
+
+	// The list and its arguments drive the sparse passes of this step, after the marks are cleared
+	numBarriers = m_activeBricks[m_frameParity]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	numBarriers = m_dispatchArgs[m_frameParity]->SetBarrier(barriers, ResourceState::INDIRECT_ARGUMENT, numBarriers);
+	numBarriers = m_brickMasks[m_frameParity]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+}
 
-			const auto state = Compute::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH_L]);
-			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
-			XUSG_X_RETURN(m_pipelines[RAY_MARCH_L], state->GetPipeline(m_computePipelineLib.get(), L"LightSpaceRayMarching"), false);
-		}
+void Fluid::quantizeDensity(CommandList* pCommandList)
+{
+	// Set barriers
+	ResourceBarrier barriers[2];
+	auto numBarriers = m_quantizedDensity->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	numBarriers = m_densityRanges->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
 
-		// View space ray marching
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchV.cso"), false);
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[QUANTIZE_DENSITY]);
+	pCommandList->SetPipelineState(m_pipelines[QUANTIZE_DENSITY]);
 
-			const auto state = Compute::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[RAY_MARCH_V]);
-			state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
-			XUSG_X_RETURN(m_pipelines[RAY_MARCH_V], state->GetPipeline(m_computePipelineLib.get(), L"ViewSpaceRayMarching"), false);
-		}
+	// Set descriptor table
+	pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_UAV_TABLE_QUANTIZE + m_frameParity]);
 
-		// Cube rendering
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSCube.cso"), false);
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSCube.cso"), false);
+	// One thread group per brick
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	pCommandList->Dispatch(brickGridSize.x, brickGridSize.y, brickGridSize.z);
 
-			const auto state = Graphics::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[RENDER_CUBE]);
-			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
-			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
-			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
-			state->RSSetState(Graphics::CULL_FRONT, m_graphicsPipelineLib.get()); // Front-face culling for interior surfaces
-			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
-			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
-			state->OMSetRTVFormats(&rtFormat, 1);
-			XUSG_X_RETURN(m_pipelines[RENDER_CUBE], state->GetPipeline(m_graphicsPipelineLib.get(), L"RayCasting"), false);
-		}
+	numBarriers = m_quantizedDensity->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE);
+	numBarriers = m_densityRanges->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+}
 
-		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSScreenQuad.cso"), false);
+void Fluid::buildDensityPyramid(CommandList* pCommandList)
+{
+	const uint8_t numLevels = m_densityPyramid->GetNumMips();
 
-		// Direct ray casting
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSRayCast.cso"), false);
+	// Set barrier
+	ResourceBarrier barriers[2];
+	auto numBarriers = m_densityPyramid->SetBarrier(barriers, 0, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, barriers);
 
-			const auto state = Graphics::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[DIRECT_RAY_CAST]);
-			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex));
-			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
-			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
-			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
-			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
-			state->OMSetRTVFormats(&rtFormat, 1);
-			XUSG_X_RETURN(m_pipelines[DIRECT_RAY_CAST], state->GetPipeline(m_graphicsPipelineLib.get(), L"DirectRayCasting"), false);
-		}
+	// Level 0, one thread group per brick
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DENSITY_PYRAMID]);
+	pCommandList->SetPipelineState(m_pipelines[DENSITY_PYRAMID]);
+	pCommandList->SetComputeDescriptorTable(0, m_densityPyramidTables[0]);
 
-		// View space direct Ray casting 
-		{
-			XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSRayCastV.cso"), false);
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	pCommandList->Dispatch(brickGridSize.x, brickGridSize.y, brickGridSize.z);
 
-			const auto state = Graphics::State::MakeUnique();
-			state->SetPipelineLayout(m_pipelineLayouts[DIRECT_RAY_CAST_V]);
-			state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
-			state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
-			state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
-			state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
-			state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
-			state->OMSetRTVFormats(&rtFormat, 1);
-			XUSG_X_RETURN(m_pipelines[DIRECT_RAY_CAST_V], state->GetPipeline(m_graphicsPipelineLib.get(), L"ViewSpaceDirectRayCasting"), false);
-		}
-	}
-	else
+	// Coarser levels, each of the one below; the levels done are left for the ray marchers
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DENSITY_PYRAMID_MIP]);
+	pCommandList->SetPipelineState(m_pipelines[DENSITY_PYRAMID_MIP]);
+	for (uint8_t i = 1; i < numLevels; ++i)
 	{
-		// Visualization
-		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSScreenQuad.cso"), false);
-		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::PS, psIndex, L"PSVisualizeColor.cso"), false);
+		numBarriers = m_densityPyramid->SetBarrier(barriers, i - 1, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+			ResourceState::PIXEL_SHADER_RESOURCE);
+		numBarriers = m_densityPyramid->SetBarrier(barriers, i, ResourceState::UNORDERED_ACCESS, numBarriers);
+		pCommandList->Barrier(numBarriers, barriers);
 
-		const auto state = Graphics::State::MakeUnique();
-		state->SetPipelineLayout(m_pipelineLayouts[VISUALIZE]);
-		state->SetShader(Shader::Stage::VS, m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++));
-		state->SetShader(Shader::Stage::PS, m_shaderLib->GetShader(Shader::Stage::PS, psIndex++));
-		state->IASetPrimitiveTopologyType(PrimitiveTopologyType::TRIANGLE);
-		state->OMSetBlendState(Graphics::PREMULTIPLITED, m_graphicsPipelineLib.get());
-		state->DSSetState(Graphics::DEPTH_STENCIL_NONE, m_graphicsPipelineLib.get());
-		state->OMSetRTVFormats(&rtFormat, 1);
-		XUSG_X_RETURN(m_pipelines[VISUALIZE], state->GetPipeline(m_graphicsPipelineLib.get(), L"Visualization"), false);
+		pCommandList->SetComputeDescriptorTable(0, m_densityPyramidTables[i]);
+
+		const auto width = (max)(brickGridSize.x >> i, 1u);
+		const auto height = (max)(brickGridSize.y >> i, 1u);
+		const auto depth = (max)(brickGridSize.z >> i, 1u);
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 4), XUSG_DIV_UP(height, 4), XUSG_DIV_UP(depth, 4));
 	}
 
-	return true;
+	numBarriers = m_densityPyramid->SetBarrier(barriers, numLevels - 1, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
 }
 
-bool Fluid::createDescriptorTables()
+void Fluid::generateDensityMips(CommandList* pCommandList)
 {
-	// Create CBV tables
-	if (m_gridSize.z > 1)
+	const uint8_t numLevels = m_densityMips->GetNumMips();
+
+	// Set barrier
+	ResourceBarrier barriers[2];
+	auto numBarriers = m_densityMips->SetBarrier(barriers, 0, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DENSITY_MIP]);
+	pCommandList->SetPipelineState(m_pipelines[DENSITY_MIP]);
+
+	// Each level of the one below, the first of the density; the levels done are left for the ray marchers
+	for (uint8_t i = 0; i < numLevels; ++i)
 	{
-		for (uint8_t i = 0; i < FrameCount; ++i)
+		if (i > 0)
 		{
-			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-			const Descriptor descriptors[] =
-			{
-				m_cbPerObject->GetCBV(i),
-				m_cbPerFrame->GetCBV(i)
-			};
-			descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-			XUSG_X_RETURN(m_cbvTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+			numBarriers = m_densityMips->SetBarrier(barriers, i - 1, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+				ResourceState::PIXEL_SHADER_RESOURCE);
+			numBarriers = m_densityMips->SetBarrier(barriers, i, ResourceState::UNORDERED_ACCESS, numBarriers);
+			pCommandList->Barrier(numBarriers, barriers);
 		}
-	}
 
-	// Create SRV and UAV tables
-	for (uint8_t i = 0; i < 2; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_velocities[i]->GetSRV(),
-			m_velocities[!i]->GetUAV()
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_VECOLITY + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+		pCommandList->SetComputeDescriptorTable(0, i > 0 ? m_densityMipTables[i - 1] :
+			m_srvUavTables[SRV_UAV_TABLE_DENSITY_MIP + m_frameParity]);
 
-	{
-		// Create incompressibility UAV
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_incompress->GetUAV());
-		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_INCOMPRESS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		const auto width = (max)(m_gridSize.x >> (i + 1), 1u);
+		const auto height = (max)(m_gridSize.y >> (i + 1), 1u);
+		const auto depth = (max)(m_gridSize.z >> (i + 1), 1u);
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 4), XUSG_DIV_UP(height, 4), XUSG_DIV_UP(depth, 4));
 	}
 
-	for (uint8_t i = 0; i < 2; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_colors[!i]->GetSRV(),
-			m_colors[i]->GetUAV()
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_srvUavTables[SRV_UAV_TABLE_COLOR + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+	numBarriers = m_densityMips->SetBarrier(barriers, numLevels - 1, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+}
 
-	for (uint8_t i = 0; i < 2; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_colors[!i]->GetSRV(),
-			m_lightMap->GetSRV()
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_srvUavTables[SRV_TABLE_RAY_MARCH + i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+void Fluid::computeDensityGradient(CommandList* pCommandList)
+{
+	// Set barrier
+	ResourceBarrier barrier;
+	auto numBarriers = m_densityGradient->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, &barrier);
 
-	// Create UAV and SRV table
-	const uint8_t numMips = m_cubeMap->GetNumMips();
-	m_uavMipTables.resize(numMips);
-	for (uint8_t i = 0; i < numMips; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_cubeMap->GetUAV(i),
-			//m_cubeDepth->GetUAV()
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_uavMipTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DENSITY_GRADIENT]);
+	pCommandList->SetPipelineState(m_pipelines[DENSITY_GRADIENT]);
 
-	// Create SRV tables
-	m_srvMipTables.resize(numMips);
-	for (uint8_t i = 0; i < numMips; ++i)
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		const Descriptor descriptors[] =
-		{
-			m_cubeMap->GetSRV(i),
-			//m_cubeDepth->GetSRV()
-		};
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
-		XUSG_X_RETURN(m_srvMipTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+	// Set descriptor tables
+	pCommandList->SetComputeDescriptorTable(0, m_srvUavTables[SRV_TABLE_RAY_MARCH + !m_frameParity]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[UAV_TABLE_DENSITY_GRADIENT]);
 
-	// Create UAV table
-	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0,1, &m_lightMap->GetUAV());
-		XUSG_X_RETURN(m_srvUavTables[UAV_TABLE_LIGHT_MAP], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
-	}
+	pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 4), XUSG_DIV_UP(m_gridSize.y, 4), XUSG_DIV_UP(m_gridSize.z, 4));
 
-	return true;
+	numBarriers = m_densityGradient->SetBarrier(&barrier, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, &barrier);
+}
+
+void Fluid::computeAmbient(CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set barrier
+	ResourceBarrier barrier;
+	auto numBarriers = m_ambientVolume->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[AMBIENT]);
+	pCommandList->SetPipelineState(m_pipelines[AMBIENT]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeDescriptorTable(0, m_cbvTables[frameIndex]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_TABLE_RAY_MARCH + !m_frameParity]);
+	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[UAV_TABLE_AMBIENT]);
+	pCommandList->SetCompute32BitConstant(3, m_maxLightSamples);
+	pCommandList->SetCompute32BitConstant(3, 1, 1);
+	pCommandList->SetCompute32BitConstant(3, m_maxLightSamples, 2);
+	const float footprint[] = { m_lightFootprint, m_lightSpread };
+	pCommandList->SetCompute32BitConstants(3, static_cast<uint32_t>(size(footprint)), footprint, 3);
+	pCommandList->SetCompute32BitConstants(4, 2, &m_ambientSlices);
+	pCommandList->SetComputeRootShaderResourceView(5, m_coeffSH.get());
+
+	// Dispatch the slices refreshed this frame
+	pCommandList->Dispatch(XUSG_DIV_UP(m_ambientSize.x, 4), XUSG_DIV_UP(m_ambientSize.y, 4),
+		XUSG_DIV_UP(m_ambientSlices.y - m_ambientSlices.x, 4));
+
+	numBarriers = m_ambientVolume->SetBarrier(&barrier, ResourceState::NON_PIXEL_SHADER_RESOURCE |
+		ResourceState::PIXEL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, &barrier);
 }
 
 void Fluid::visualizeColor(const CommandList* pCommandList)
@@ -828,7 +3040,8 @@ void Fluid::rayMarch(CommandList* pCommandList, uint8_t frameIndex)
 	ResourceBarrier barriers[6];
 	auto numBarriers = 0u;
 	for (uint8_t i = 0; i < 6; ++i)
-		numBarriers = m_cubeMap->SetBarrier(barriers, m_cubeMapLOD, ResourceState::UNORDERED_ACCESS, numBarriers, i);
+		numBarriers = m_cubeMaps[m_cubeMapParity]->SetBarrier(barriers, static_cast<uint8_t>(m_cubeMapLODs >> (i * 4) & 0xf),
+			ResourceState::UNORDERED_ACCESS, numBarriers, i);
 	pCommandList->Barrier(numBarriers, barriers);
 
 	// Set pipeline state
@@ -837,24 +3050,31 @@ void Fluid::rayMarch(CommandList* pCommandList, uint8_t frameIndex)
 
 	// Set descriptor tables
 	pCommandList->SetComputeDescriptorTable(0, m_cbvTables[frameIndex]);
-	pCommandList->SetComputeDescriptorTable(1, m_uavMipTables[m_cubeMapLOD]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[UAV_TABLE_CUBE_MAP + m_cubeMapParity]);
 	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_TABLE_RAY_MARCH + !m_frameParity]);
 	pCommandList->SetCompute32BitConstant(3, m_raySampleCount);
 	pCommandList->SetCompute32BitConstant(3, m_coeffSH ? 1 : 0, 1);
 	pCommandList->SetCompute32BitConstant(3, m_maxLightSamples, 2);
-	if (m_coeffSH) pCommandList->SetComputeRootShaderResourceView(4, m_coeffSH.get());
+	const float footprint[] = { m_lightFootprint, m_lightSpread };
+	pCommandList->SetCompute32BitConstants(3, static_cast<uint32_t>(size(footprint)), footprint, 3);
+#if _CPU_CUBE_FACE_CULL_ == 2
+	pCommandList->SetComputeRootConstantBufferView(4, m_cbCubeFaceList.get(), m_cbCubeFaceList->GetCBVOffset(frameIndex));
+#else
+	pCommandList->SetCompute32BitConstant(4, m_cubeMapLODs);
 #if _CPU_CUBE_FACE_CULL_ == 1
-	pCommandList->SetCompute32BitConstant(5, m_visibilityMask);
-#elif _CPU_CUBE_FACE_CULL_ == 2
-	pCommandList->SetComputeRootConstantBufferView(5, m_cbCubeFaceList.get(), m_cbCubeFaceList->GetCBVOffset(frameIndex));
+	pCommandList->SetCompute32BitConstant(4, m_visibilityMask, 1);
 #endif
+#endif
+	pCommandList->SetCompute32BitConstants(5, 2, &m_checkerboard);
 
-	// Dispatch cube
+	// Dispatch cube, over the texels of this phase only
 	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
-	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), m_cubeFaceCount);
+	const auto interleave = m_checkerboard.Interleave;
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, interleave > 1 ? 16 : 8),
+		XUSG_DIV_UP(gridSize, interleave > 2 ? 16 : 8), m_cubeFaceCount);
 }
 
-void Fluid::rayMarchL(const CommandList* pCommandList, uint8_t frameIndex)
+void Fluid::rayMarchL(CommandList* pCommandList, uint8_t frameIndex)
 {
 	// Set barrier
 	ResourceBarrier barrier;
@@ -871,10 +3091,63 @@ void Fluid::rayMarchL(const CommandList* pCommandList, uint8_t frameIndex)
 	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[UAV_TABLE_LIGHT_MAP]);
 	pCommandList->SetCompute32BitConstant(3, m_maxLightSamples);
 	pCommandList->SetCompute32BitConstant(3, m_coeffSH ? 1 : 0, 1);
-	if (m_coeffSH) pCommandList->SetComputeRootShaderResourceView(4, m_coeffSH.get());
+	const float footprint[] = { m_lightFootprint, m_lightSpread };
+	pCommandList->SetCompute32BitConstants(3, static_cast<uint32_t>(size(footprint)), footprint, 3);
+	pCommandList->SetCompute32BitConstants(4, 2, &m_lightMapSlices);
+
+	// Dispatch the slices refreshed this frame, or the bricks of the last step only, since the
+	// others hold no density
+	if (m_isSparse)
+	{
+		pCommandList->SetComputeRootShaderResourceView(5, m_activeBricks[m_frameParity].get());
+		pCommandList->ExecuteIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+	}
+	else pCommandList->Dispatch(XUSG_DIV_UP(m_lightMapSize.x, 4), XUSG_DIV_UP(m_lightMapSize.y, 4),
+		XUSG_DIV_UP(m_lightMapSlices.y - m_lightMapSlices.x, 4));
+}
+
+void Fluid::sweepLight(CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set barriers
+	ResourceBarrier barriers[3];
+	auto numBarriers = m_lightMap->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS);
+	numBarriers = m_sweepSlices[0]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+	numBarriers = m_sweepSlices[1]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[LIGHT_SWEEP]);
+	pCommandList->SetPipelineState(m_pipelines[LIGHT_SWEEP]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeDescriptorTable(0, m_cbvTables[frameIndex]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[SRV_TABLE_RAY_MARCH + !m_frameParity]);
+	pCommandList->SetCompute32BitConstant(3, m_maxLightSamples);
+	pCommandList->SetCompute32BitConstant(3, m_coeffSH ? 1 : 0, 1);
+	const float footprint[] = { m_lightFootprint, m_lightSpread };
+	pCommandList->SetCompute32BitConstants(3, static_cast<uint32_t>(size(footprint)), footprint, 3);
+	pCommandList->SetCompute32BitConstant(4, m_sweepAxis, 1);
+	pCommandList->SetCompute32BitConstant(4, m_isSweepFromMax ? 1 : 0, 2);
+
+	// One dispatch per slice away from the light, each taking the transmittance of the one before
+	const uint32_t lightMapSize[] = { m_lightMapSize.x, m_lightMapSize.y, m_lightMapSize.z };
+	const auto numSlices = lightMapSize[m_sweepAxis];
+	const auto width = lightMapSize[(m_sweepAxis + 1) % 3];
+	const auto height = lightMapSize[(m_sweepAxis + 2) % 3];
+	for (auto i = 0u; i < numSlices; ++i)
+	{
+		const uint8_t slot = i & 1;
+		if (i > 0)
+		{
+			numBarriers = m_sweepSlices[!slot]->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+			numBarriers = m_sweepSlices[slot]->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
+			pCommandList->Barrier(numBarriers, barriers);
+		}
 
-	// Dispatch grid
-	pCommandList->Dispatch(XUSG_DIV_UP(m_lightMapSize.x, 4), XUSG_DIV_UP(m_lightMapSize.y, 4), XUSG_DIV_UP(m_lightMapSize.z, 4));
+		pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_UAV_TABLE_LIGHT_SWEEP + slot]);
+		pCommandList->SetCompute32BitConstant(4, i);
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 8), XUSG_DIV_UP(height, 8), 1);
+	}
 }
 
 void Fluid::rayMarchV(CommandList* pCommandList, uint8_t frameIndex)
@@ -883,7 +3156,8 @@ void Fluid::rayMarchV(CommandList* pCommandList, uint8_t frameIndex)
 	ResourceBarrier barriers[7];
 	auto numBarriers = m_lightMap->SetBarrier(barriers, ResourceState::NON_PIXEL_SHADER_RESOURCE);
 	for (uint8_t i = 0; i < 6; ++i)
-		numBarriers = m_cubeMap->SetBarrier(barriers, m_cubeMapLOD, ResourceState::UNORDERED_ACCESS, numBarriers, i);
+		numBarriers = m_cubeMaps[m_cubeMapParity]->SetBarrier(barriers, static_cast<uint8_t>(m_cubeMapLODs >> (i * 4) & 0xf),
+			ResourceState::UNORDERED_ACCESS, numBarriers, i);
 	pCommandList->Barrier(numBarriers, barriers);
 
 	// Set pipeline state
@@ -893,27 +3167,65 @@ void Fluid::rayMarchV(CommandList* pCommandList, uint8_t frameIndex)
 	// Set descriptor tables
 	pCommandList->SetComputeDescriptorTable(0, m_cbvTables[frameIndex]);
 	//pCommandList->SetComputeRootConstantBufferView(0, m_cbPerObject.get(), m_cbPerObject->GetCBVOffset(frameIndex));
-	pCommandList->SetComputeDescriptorTable(1, m_uavMipTables[m_cubeMapLOD]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[UAV_TABLE_CUBE_MAP + m_cubeMapParity]);
 	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_TABLE_RAY_MARCH + !m_frameParity]);
 	pCommandList->SetCompute32BitConstant(3, m_raySampleCount);
-#if _CPU_CUBE_FACE_CULL_ == 1
-	pCommandList->SetCompute32BitConstant(4, m_visibilityMask);
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#if _CPU_CUBE_FACE_CULL_ == 2
 	pCommandList->SetComputeRootConstantBufferView(4, m_cbCubeFaceList.get(), m_cbCubeFaceList->GetCBVOffset(frameIndex));
+#else
+	pCommandList->SetCompute32BitConstant(4, m_cubeMapLODs);
+#if _CPU_CUBE_FACE_CULL_ == 1
+	pCommandList->SetCompute32BitConstant(4, m_visibilityMask, 1);
 #endif
+#endif
+	pCommandList->SetCompute32BitConstants(5, 2, &m_checkerboard);
+
+	// Dispatch cube, over the texels of this phase only
+	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
+	const auto interleave = m_checkerboard.Interleave;
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, interleave > 1 ? 16 : 8),
+		XUSG_DIV_UP(gridSize, interleave > 2 ? 16 : 8), m_cubeFaceCount);
+}
+
+void Fluid::reconstructCube(CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set barriers, of all the mips of the history as the faces sample each at its LOD then
+	ResourceBarrier barriers[6 + 6 * NUM_CUBE_MAP_MIPS];
+	auto numBarriers = 0u;
+	const auto& cubeMap = m_cubeMaps[m_cubeMapParity];
+	const auto& history = m_cubeMaps[!m_cubeMapParity];
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		numBarriers = cubeMap->SetBarrier(barriers, static_cast<uint8_t>(m_cubeMapLODs >> (i * 4) & 0xf),
+			ResourceState::UNORDERED_ACCESS, numBarriers, i);
+		for (uint8_t j = 0; j < NUM_CUBE_MAP_MIPS; ++j)
+			numBarriers = history->SetBarrier(barriers, j, ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers, i);
+	}
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[CUBE_RECONSTRUCT]);
+	pCommandList->SetPipelineState(m_pipelines[CUBE_RECONSTRUCT]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeDescriptorTable(0, m_cbvTables[frameIndex]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvUavTables[UAV_TABLE_CUBE_MAP + m_cubeMapParity]);
+	pCommandList->SetComputeDescriptorTable(2, m_srvUavTables[SRV_TABLE_CUBE_MAP + !m_cubeMapParity]);
+	pCommandList->SetCompute32BitConstants(3, sizeof(CubeMapCheckerboard) / sizeof(uint32_t), &m_checkerboard);
 
-	// Dispatch cube
+	// Dispatch all faces, each skipping the texels marched this frame
 	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
-	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), m_cubeFaceCount);
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), 6);
 }
 
 void Fluid::renderCube(CommandList* pCommandList, uint8_t frameIndex)
 {
-	// Set barriers
-	ResourceBarrier barriers[6];
+	// Set barriers, of all the mips as the faces sample each at its own
+	ResourceBarrier barriers[6 * NUM_CUBE_MAP_MIPS];
 	auto numBarriers = 0u;
 	for (uint8_t i = 0; i < 6; ++i)
-		numBarriers = m_cubeMap->SetBarrier(barriers, m_cubeMapLOD, ResourceState::PIXEL_SHADER_RESOURCE, numBarriers, i);
+		for (uint8_t j = 0; j < NUM_CUBE_MAP_MIPS; ++j)
+			numBarriers = m_cubeMaps[m_cubeMapParity]->SetBarrier(barriers, j, ResourceState::PIXEL_SHADER_RESOURCE, numBarriers, i);
 	pCommandList->Barrier(numBarriers, barriers);
 
 	// Set pipeline state
@@ -923,7 +3235,8 @@ void Fluid::renderCube(CommandList* pCommandList, uint8_t frameIndex)
 	// Set descriptor tables
 	pCommandList->SetGraphicsDescriptorTable(0, m_cbvTables[frameIndex]);
 	//pCommandList->SetGraphicsRootConstantBufferView(0, m_cbPerObject.get(), m_cbPerObject->GetCBVOffset(frameIndex));
-	pCommandList->SetGraphicsDescriptorTable(1, m_srvMipTables[m_cubeMapLOD]);
+	pCommandList->SetGraphicsDescriptorTable(1, m_srvUavTables[SRV_TABLE_CUBE_MAP + m_cubeMapParity]);
+	pCommandList->SetGraphics32BitConstant(2, m_cubeMapLODs);
 
 	pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLESTRIP);
 	pCommandList->Draw(4, 6, 0, 0);
@@ -944,7 +3257,8 @@ void Fluid::rayCastDirect(const CommandList* pCommandList, uint8_t frameIndex)
 	pCommandList->SetGraphics32BitConstant(2, m_maxRaySamples);
 	pCommandList->SetGraphics32BitConstant(2, m_coeffSH ? 1 : 0, 1);
 	pCommandList->SetGraphics32BitConstant(2, m_maxLightSamples, 2);
-	if (m_coeffSH) pCommandList->SetGraphicsRootShaderResourceView(3, m_coeffSH.get());
+	const float footprint[] = { m_lightFootprint, m_lightSpread };
+	pCommandList->SetGraphics32BitConstants(2, static_cast<uint32_t>(size(footprint)), footprint, 3);
 
 	pCommandList->Draw(3, 1, 0, 0);
 }
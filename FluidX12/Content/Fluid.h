@@ -17,6 +17,59 @@ public:
 		OPTIMIZED = RAY_MARCH_CUBEMAP | SEPARATE_LIGHT_PASS
 	};
 
+	enum ProjectionMode : uint8_t
+	{
+		PROJECT_JACOBI,
+		PROJECT_MULTIGRID_V,
+		PROJECT_MULTIGRID_F,
+		PROJECT_DCT,
+		PROJECT_PCG,
+		PROJECT_SOR,
+		PROJECT_JACOBI_ADAPTIVE,
+
+		NUM_PROJECTION_MODE
+	};
+
+	enum VelocityLayout : uint8_t
+	{
+		VELOCITY_COLLOCATED,
+		VELOCITY_STAGGERED,	// MAC: component i on the face between cells (index - 1) and index along axis i
+
+		NUM_VELOCITY_LAYOUT
+	};
+
+	enum AdvectionScheme : uint8_t
+	{
+		ADVECT_SEMI_LAGRANGIAN,
+		ADVECT_MACCORMACK,	// Experimental second order, limited; always sub-steps at a CFL number of at most 1
+
+		NUM_ADVECTION_SCHEME
+	};
+
+	enum LightPass : uint8_t
+	{
+		LIGHT_RAY_MARCH,	// A light ray from every texel of the light map
+		LIGHT_SLICE_SWEEP,	// Slice by slice away from the light, each from the one before
+
+		NUM_LIGHT_PASS
+	};
+
+	struct ProjectionStats
+	{
+		uint32_t NumIterations;	// The budget of adaptive Jacobi
+		float Residual;		// Relative to the divergence
+		float DivergenceError;	// RMS residual of the pressure on the full grid, relative to the RMS divergence
+		bool IsCapped;		// PCG stopped at its iteration cap short of the tolerance
+	};
+
+	struct StepStats
+	{
+		uint32_t NumSubsteps;
+		float TimeStep;		// Of each sub-step
+		float Courant;		// Cells travelled per sub-step at the largest speed it was scheduled for
+		float CFLNumber;	// Scheduled under, capped for MacCormack; 0 takes the frame in one step
+	};
+
 	Fluid();
 	virtual ~Fluid();
 
@@ -25,23 +78,101 @@ public:
 		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::Format rtFormat, XUSG::Format dsFormat,
 		const DirectX::XMUINT3& gridSize);
 
+	void SetVelocityLayout(VelocityLayout layout);	// Before Init, which selects the shaders
+	void SetAdvectionScheme(AdvectionScheme scheme);	// Before Init, which selects the shaders
+	void SetSparseBricks(bool isSparse);	// Before Init, which selects the shaders; projects on the full grid
+	void SetLightMapDivisor(const DirectX::XMUINT3& divisor);	// Before Init, which sizes the light map; 1 matches the grid
+	// Before Init, which sizes the ambient volume of the light probe; 1 matches the grid
+	void SetAmbientDivisor(const DirectX::XMUINT3& divisor);
+	// Before Init, which selects the shaders; caches the density gradient of each frame in a
+	// volume that the ambient pass fetches once instead of taking 6 density samples
+	void SetGradientCache(bool isCached);
+	// Before Init, which creates the history; ray-marches 1 of interleave texels of the cube map per
+	// frame, 2 in a checkerboard and 4 in 2x2 blocks, and rebuilds the others from the last frame
+	void SetCheckerboard(uint8_t interleave);
 	void SetMaxSamples(uint32_t maxRaySamples, uint32_t maxLightSamples);
+	// Cone-traces the light and AO rays over density mips: their footprints span footprint texels
+	// at the origins and grow by spread per texel travelled; 0 and 0 march at full resolution
+	void SetLightFootprint(float footprint, float spread);
+	void SetLightPass(LightPass pass);	// Of the separate light pass
+	// Ray-marches 1/interval of the light map per frame, in slabs of 4 slices round-robin, so each
+	// texel is refreshed at least every interval frames; a change of the light or the volume transform
+	// refreshes all of it at once, and the slice sweep always does
+	void SetLightMapRefresh(uint32_t interval);
 	void SetSH(const XUSG::StructuredBuffer::sptr& coeffSH);
+	void SetProjectionMode(ProjectionMode mode);	// PROJECT_DCT takes up to MAX_COSINE_TRANSFORM_SIZE cells per axis, or Init fails
+	void SetProjectionBudget(float tolerance, uint32_t maxIterations);	// PCG only
+	void SetOverRelaxation(float omega);	// SOR only; 1 is Gauss-Seidel
+	void SetAdaptiveBudget(float targetResidual, uint32_t minIterations, uint32_t maxIterations);	// Adaptive Jacobi only
+	void SetPressureLevel(uint8_t level);	// 0 is full, 1 half and 2 quarter resolution; not for DCT and PCG
+	void SetSubstepping(float cflNumber, uint32_t maxSubsteps);	// cflNumber = 0 takes each frame in one step
+	// timeStep covers the frame, split into sub-steps under the CFL number
 	void UpdateFrame(float timeStep, uint8_t frameIndex, const DirectX::XMFLOAT4X4& view,
 		const DirectX::XMFLOAT4X4& proj, const DirectX::XMFLOAT3& eyePt);
 	void Simulate(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void Render(XUSG::CommandList* pCommandList, uint8_t frameIndex, uint8_t flags);
 
+	// Read back with a latency of FrameCount frames
+	const ProjectionStats& GetProjectionStats() const;
+	const StepStats& GetStepStats() const;
+	uint8_t GetPressureLevel() const;	// 0 for the projection modes without a coarse solve
+
 	static const uint8_t FrameCount = 3;
 
 protected:
+	// Inputs of the light map besides the density
+	struct LightMapInputs
+	{
+		DirectX::XMFLOAT3	LightPt;
+		DirectX::XMFLOAT4	LightColor;
+		DirectX::XMFLOAT4	Ambient;
+		DirectX::XMFLOAT3X4	World;
+	};
+
+	// Constants of the checkerboard marching; the ray marchers take the first two
+	struct CubeMapCheckerboard
+	{
+		uint32_t			Interleave;	// Texels per marched one; 1 marches all of them
+		uint32_t			Phase;		// Of the texels marched this frame
+		uint32_t			LODs;		// Of the faces, 4 bits each
+		uint32_t			PrevLODs;	// Of the history
+		DirectX::XMFLOAT3	PrevEyePt;	// Of the history, in local space
+	};
+
 	enum PipelineIndex : uint8_t
 	{
 		ADVECT,
+		PREDICT,
 		PROJECT,
+		DIVERGENCE,
+		REDUCE_MEAN,
+		REMOVE_MEAN,
+		SMOOTH,
+		RESTRICT,
+		PROLONG,
+		SUBTRACT_GRADIENT,
+		COSINE_TRANSFORM,
+		SPECTRAL_SOLVE,
+		PCG_RESIDUAL,
+		PCG_APPLY,
+		PCG_UPDATE,
+		PCG_REDUCE,
+		RESIDUAL_NORM,
+		REDUCE_SUMS,
+		MAX_SPEED,
+		REDUCE_MAX,
+		BUILD_BRICKS,
+		QUANTIZE_DENSITY,
+		DENSITY_PYRAMID,
+		DENSITY_PYRAMID_MIP,
+		DENSITY_MIP,
+		DENSITY_GRADIENT,
+		AMBIENT,
 		RAY_MARCH,
 		RAY_MARCH_L,
+		LIGHT_SWEEP,
 		RAY_MARCH_V,
+		CUBE_RECONSTRUCT,
 		RENDER_CUBE,
 		DIRECT_RAY_CAST,
 		DIRECT_RAY_CAST_V,
@@ -56,10 +187,44 @@ protected:
 		SRV_UAV_TABLE_VECOLITY1,
 		SRV_UAV_TABLE_COLOR,
 		SRV_UAV_TABLE_COLOR1,
+		SRV_UAV_TABLE_PREDICT_VELOCITY,
+		SRV_UAV_TABLE_PREDICT_COLOR,
+		SRV_UAV_TABLE_PREDICT_COLOR1,
+		SRV_TABLE_PREDICTION,
 		SRV_TABLE_RAY_MARCH,
 		SRV_TABLE_RAY_MARCH1,
 		UAV_TABLE_INCOMPRESS,
 		UAV_TABLE_LIGHT_MAP,
+		UAV_TABLE_AMBIENT,
+		UAV_TABLE_DENSITY_GRADIENT,
+		UAV_TABLE_CUBE_MAP,
+		UAV_TABLE_CUBE_MAP1,
+		SRV_TABLE_CUBE_MAP,
+		SRV_TABLE_CUBE_MAP1,
+		SRV_UAV_TABLE_DIVERGENCE,
+		SRV_UAV_TABLE_REDUCE_MEAN,
+		SRV_UAV_TABLE_REMOVE_MEAN,
+		SRV_UAV_TABLE_SPECTRUM,
+		SRV_UAV_TABLE_SPECTRUM1,
+		SRV_UAV_TABLE_SPECTRAL_SOLUTION,
+		SRV_UAV_TABLE_PCG_RESIDUAL,
+		SRV_UAV_TABLE_PCG_APPLY,
+		SRV_UAV_TABLE_PCG_APPLY1,
+		SRV_UAV_TABLE_PCG_UPDATE,
+		SRV_UAV_TABLE_PCG_UPDATE1,
+		SRV_UAV_TABLE_PCG_REDUCE,
+		SRV_UAV_TABLE_RESIDUAL_NORM,
+		SRV_UAV_TABLE_REDUCE_SUMS,
+		SRV_UAV_TABLE_MAX_SPEED,
+		SRV_UAV_TABLE_REDUCE_MAX,
+		SRV_UAV_TABLE_BUILD_BRICKS,
+		SRV_UAV_TABLE_BUILD_BRICKS1,
+		SRV_UAV_TABLE_QUANTIZE,
+		SRV_UAV_TABLE_QUANTIZE1,
+		SRV_UAV_TABLE_DENSITY_MIP,
+		SRV_UAV_TABLE_DENSITY_MIP1,
+		SRV_UAV_TABLE_LIGHT_SWEEP,
+		SRV_UAV_TABLE_LIGHT_SWEEP1,
 
 		NUM_SRV_UAV_TABLE
 	};
@@ -68,10 +233,30 @@ protected:
 	bool createPipelines(XUSG::Format rtFormat, XUSG::Format dsFormat);
 	bool createDescriptorTables();
 
+	void advect(XUSG::CommandList* pCommandList, uint8_t frameIndex, uint32_t substep);
+	void project(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void computeDivergence(const XUSG::CommandList* pCommandList);
+	void multigrid(XUSG::CommandList* pCommandList, uint8_t level, bool isFCycle);
+	void smooth(XUSG::CommandList* pCommandList, uint8_t level, uint32_t numSweeps, bool overRelax = false);
+	void restrictResidual(XUSG::CommandList* pCommandList, uint8_t level);
+	void prolong(XUSG::CommandList* pCommandList, uint8_t level);
+	void solveSpectral(XUSG::CommandList* pCommandList);
+	void solvePCG(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void reducePCG(const XUSG::CommandList* pCommandList, uint8_t stage);
+	void measureResidual(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void measureSpeed(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void buildBricks(const XUSG::CommandList* pCommandList);
+	void quantizeDensity(XUSG::CommandList* pCommandList);
+	void buildDensityPyramid(XUSG::CommandList* pCommandList);
+	void generateDensityMips(XUSG::CommandList* pCommandList);
+	void computeDensityGradient(XUSG::CommandList* pCommandList);
+	void computeAmbient(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void visualizeColor(const XUSG::CommandList* pCommandList);
 	void rayMarch(XUSG::CommandList* pCommandList, uint8_t frameIndex);
-	void rayMarchL(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void rayMarchL(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void sweepLight(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayMarchV(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void reconstructCube(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void renderCube(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayCastDirect(const XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayCastVDirect(XUSG::CommandList* pCommandList, uint8_t frameIndex);
@@ -85,16 +270,53 @@ protected:
 	XUSG::PipelineLayout	m_pipelineLayouts[NUM_PIPELINE];
 	XUSG::Pipeline			m_pipelines[NUM_PIPELINE];
 
-	std::vector<XUSG::DescriptorTable> m_uavMipTables;
-	std::vector<XUSG::DescriptorTable> m_srvMipTables;
+	std::vector<XUSG::DescriptorTable> m_smoothTables;
+	std::vector<XUSG::DescriptorTable> m_restrictTables;
+	std::vector<XUSG::DescriptorTable> m_prolongTables;
+	std::vector<XUSG::DescriptorTable> m_densityPyramidTables;
+	std::vector<XUSG::DescriptorTable> m_densityMipTables;
 	XUSG::DescriptorTable	m_srvUavTables[NUM_SRV_UAV_TABLE];
 	XUSG::DescriptorTable	m_cbvTables[FrameCount];
 
 	XUSG::Texture3D::uptr	m_incompress;
+	XUSG::Texture3D::uptr	m_divergence;
+	XUSG::Texture3D::uptr	m_spectrum;
+	XUSG::TypedBuffer::uptr	m_partialMeans;
+	XUSG::TypedBuffer::uptr	m_divergenceMean;
+	XUSG::Texture3D::uptr	m_pcgResidual;
+	XUSG::Texture3D::uptr	m_pcgDirections[2];
+	XUSG::Texture3D::uptr	m_pcgKDirection;
+	XUSG::TypedBuffer::uptr	m_partialSums;
+	XUSG::StructuredBuffer::uptr m_pcgState;
+	XUSG::TypedBuffer::uptr	m_pcgDispatchArgs;
+	XUSG::Buffer::uptr		m_pcgReadback;
+	XUSG::TypedBuffer::uptr	m_residualSums;
+	XUSG::Buffer::uptr		m_residualReadback;
+	XUSG::TypedBuffer::uptr	m_maxSpeed;
+	XUSG::Buffer::uptr		m_speedReadback;
+	std::vector<XUSG::Texture3D::uptr> m_coarseIncompress;
+	std::vector<XUSG::Texture3D::uptr> m_coarseDivergence;
 	XUSG::Texture3D::uptr	m_velocities[2];
-	XUSG::Texture3D::uptr	m_colors[2];
-	XUSG::Texture2D::uptr	m_cubeMap;
+	XUSG::Texture3D::uptr	m_colors[2];			// Albedo, unpremultiplied
+	XUSG::Texture3D::uptr	m_densities[2];
+	XUSG::Texture3D::uptr	m_predictedVelocity;	// MacCormack only
+	XUSG::Texture3D::uptr	m_predictedColor;
+	XUSG::Texture3D::uptr	m_predictedDensity;
+	XUSG::Texture2D::uptr	m_cubeMaps[2];			// The other is the history of the checkerboard marching
 	XUSG::Texture3D::uptr	m_lightMap;
+	XUSG::Texture3D::uptr	m_ambientVolume;	// AO-weighted irradiance of the light probe
+	XUSG::Texture2D::uptr	m_sweepSlices[2];	// Transmittance of the last two slices of the light sweep
+	XUSG::Texture3D::uptr	m_quantizedDensity;	// 8 bits per brick, for the ray marchers
+	XUSG::Texture3D::uptr	m_densityRanges;	// Scale and offset of each brick
+	XUSG::Texture3D::uptr	m_densityPyramid;	// Max density of each brick and its sample footprints, with a max mip chain
+	XUSG::Texture3D::uptr	m_densityMips;		// Mips 1 and coarser of the density, for cone-traced light rays
+	XUSG::Texture3D::uptr	m_densityGradient;	// Direction and magnitude, with the gradient cache only
+	XUSG::StructuredBuffer::uptr m_brickMasks[2];	// Sparse bricks only
+	XUSG::StructuredBuffer::uptr m_idleSteps;
+	XUSG::StructuredBuffer::uptr m_activeBricks[2];
+	XUSG::TypedBuffer::uptr	m_dispatchArgs[2];
+
+	XUSG::CommandLayout::uptr m_commandLayout;
 
 	XUSG::ConstantBuffer::uptr m_cbSimulation;
 	XUSG::ConstantBuffer::uptr m_cbPerObject;
@@ -110,19 +332,62 @@ protected:
 	DirectX::XMFLOAT4		m_ambient;
 	DirectX::XMUINT3		m_gridSize;
 	DirectX::XMUINT3		m_lightMapSize;
+	DirectX::XMUINT3		m_lightMapDivisor;
+	DirectX::XMUINT3		m_ambientSize;
+	DirectX::XMUINT3		m_ambientDivisor;
 	DirectX::XMUINT2		m_viewport;
 	DirectX::XMFLOAT3X4		m_volumeWorld;
 
 	uint32_t				m_raySampleCount;
 	uint32_t				m_maxRaySamples;
 	uint32_t				m_maxLightSamples;
+	float					m_lightFootprint;
+	float					m_lightSpread;
+	LightPass				m_lightPass;
+	uint8_t					m_sweepAxis;		// Dominant axis of the light direction
+	bool					m_isSweepFromMax;	// Whether the light is on the max side of the axis
+	uint32_t				m_lightMapInterval;	// Frames of a full round-robin refresh of the light map
+	uint32_t				m_lightMapSlab;		// Next slab of 4 slices to refresh
+	DirectX::XMUINT2		m_lightMapSlices;	// Refreshed this frame, from x to y
+	uint32_t				m_ambientSlab;		// As the light map, of the ambient volume
+	DirectX::XMUINT2		m_ambientSlices;
+	LightMapInputs			m_lightMapInputs;	// Of the last frame
+	bool					m_isLightMapStale;	// Refreshes all of the light map next frame
 #if _CPU_CUBE_FACE_CULL_ == 1
 	uint32_t				m_visibilityMask;
 #endif
 	uint8_t					m_cubeFaceCount;
-	uint8_t					m_cubeMapLOD;
+	uint32_t				m_cubeMapLODs;		// 4 bits per face
+	uint8_t					m_cubeMapLOD;		// The finest of the visible faces
+	uint8_t					m_cubeMapInterleave;	// Of the checkerboard marching; 1 marches all texels
+	uint8_t					m_cubeMapParity;	// Of the cube map of this frame
+	uint32_t				m_cubeMapFrame;		// Frames marched, cycling the phases
+	CubeMapCheckerboard		m_checkerboard;		// Of this frame
+	DirectX::XMFLOAT3		m_localEyePt;		// Of the last frame
+	bool					m_isCubeMapStale;	// Marches all of the cube map next frame
 	uint8_t					m_frameParity;
 
+	ProjectionMode			m_projectionMode;
+	ProjectionStats			m_projectionStats;
+	uint32_t				m_pcgMaxIterations;
+	float					m_pcgTolerance;
+	float					m_sorOmega;
+	float					m_targetResidual;
+	uint32_t				m_numIterations;
+	uint32_t				m_minIterations;
+	uint32_t				m_maxAdaptiveIterations;
+	uint8_t					m_pendingResiduals;	// Bit mask of readback slots holding a residual
+	uint8_t					m_pressureLevel;
+	VelocityLayout			m_velocityLayout;
+	AdvectionScheme			m_advectionScheme;
+	bool					m_isSparse;
+	bool					m_isGradientCached;
+
+	StepStats				m_stepStats;
+	float					m_maxCellSpeed;	// In cells per unit time, read back FrameCount frames later
+	float					m_cflNumber;
+	uint32_t				m_maxSubsteps;
+	uint8_t					m_pendingSpeeds;	// Bit mask of readback slots holding a speed
+
 	float					m_timeStep;
-	float					m_timeInterval;
 };
@@ -13,6 +13,7 @@ struct CBSimulation
 {
 	float TimeStep;
 	uint32_t BaseSeed;
+	uint32_t NumIterations;
 };
 
 struct CBPerFrame
@@ -32,11 +33,123 @@ struct CBPerObject
 	XMFLOAT3X4 World;
 };
 
+// Scalars of the conjugate gradient, mirrored in CSPCG.hlsli
+struct PCGState
+{
+	float RZ;
+	float Alpha;
+	float Beta;
+	float RR;
+	float BB;
+	uint32_t NumIterations;
+	uint32_t IsConverged;
+};
+
+struct CBSmooth
+{
+	uint32_t Color;
+	float Omega;
+};
+
+struct CBPCGReduce
+{
+	XMUINT3 NumGroups;
+	uint32_t Stage;
+	float Tolerance;
+};
+
+struct CBBricks
+{
+	XMUINT3 BrickGridSize;
+	uint32_t NumBrickGroups;
+};
+
+// Multigrid constants, mirrored in FluidCPU/Content/PoissonMultigrid.cpp
+static const uint32_t	g_mgCoarsestSize = 4;
+static const uint32_t	g_mgNumCoarsestSweeps = 16;
+static const uint32_t	g_mgNumPreSweeps = 2;
+static const uint32_t	g_mgNumPostSweeps = 2;
+
+// Red-black SOR sweeps per frame, mirrored in FluidCPU/Content/PoissonSOR.cpp
+static const uint32_t	g_sorNumSweeps = 32;
+
+// Fixed Jacobi budget, formerly ITER in CSProject[2|3]D.hlsl
+static const uint32_t	g_numJacobiIterations = 64;
+
+// MacCormack sub-stepping, mirrored in FluidCPU/Content/FluidCPU.cpp: the correction of
+// CSAdvect.hlsl only acts on traces of up to a cell per step
+static const float		g_maxCorrectedCells = 1.0f;
+static const uint32_t	g_maxCorrectedSubsteps = 16;
+
+// Edge of the sparse bricks in cells, mirrored in Brick.hlsli; every sparse pass runs 64 threads per group
+static const uint32_t	g_brickSize = 8;
+
+//--------------------------------------------------------------------------------------
+// Adaptive Jacobi budget, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline uint32_t AdaptIterations(uint32_t numIterations, float residual,
+	float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	if (residual > targetResidual) numIterations += (max)(numIterations / 2, 1u);
+	else if (residual >= 0.0f && residual < 0.5f * targetResidual) numIterations -= (max)(numIterations / 8, 1u);
+
+	return (min)((max)(numIterations, minIterations), maxIterations);
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-steps of a frame, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline uint32_t ScheduleSubsteps(float& timeStep, float frameTime, float maxCellSpeed,
+	float cflNumber, uint32_t maxSubsteps)
+{
+	const auto stableStep = maxCellSpeed > 0.0f ? cflNumber / maxCellSpeed : frameTime;
+	const auto numSubsteps = (min)(static_cast<uint32_t>((max)(ceilf(frameTime / stableStep), 1.0f)), maxSubsteps);
+	timeStep = (min)(frameTime / numSubsteps, stableStep);
+
+	return numSubsteps;
+}
+
+//--------------------------------------------------------------------------------------
+// Sub-stepping of MacCormack advection, mirrored in FluidCPU/Content/FluidCPU.cpp
+//--------------------------------------------------------------------------------------
+static inline void LimitCorrectedSubstepping(float& cflNumber, uint32_t& maxSubsteps)
+{
+	if (cflNumber <= 0.0f) maxSubsteps = (max)(maxSubsteps, g_maxCorrectedSubsteps);
+	cflNumber = cflNumber > 0.0f ? (min)(cflNumber, g_maxCorrectedCells) : g_maxCorrectedCells;
+}
+
+//--------------------------------------------------------------------------------------
+// Bricks of 8x8x8 cells (8x8x1 in 2D), mirrored in Brick.hlsli
+//--------------------------------------------------------------------------------------
+static inline XMUINT3 GetBrickGridSize(const XMUINT3& gridSize)
+{
+	return XMUINT3(XUSG_DIV_UP(gridSize.x, g_brickSize), XUSG_DIV_UP(gridSize.y, g_brickSize),
+		gridSize.z > 1 ? XUSG_DIV_UP(gridSize.z, g_brickSize) : 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Slices of the light map to refresh this frame, in slabs of 4 (the depth of the light-pass
+// groups) taken round-robin, so every slab is refreshed within interval frames; mirrored in
+// FluidCPU/Content/LightMap.cpp
+//--------------------------------------------------------------------------------------
+static inline XMUINT2 ScheduleLightMapRefresh(uint32_t& slab, uint32_t numSlices, uint32_t interval)
+{
+	const auto numSlabs = XUSG_DIV_UP(numSlices, 4);
+	const auto numSlabsPerFrame = XUSG_DIV_UP(numSlabs, (max)(interval, 1u));
+	const auto begin = slab < numSlabs ? slab : 0;
+	const auto end = (min)(begin + numSlabsPerFrame, numSlabs);
+	slab = end < numSlabs ? end : 0;
+
+	return XMUINT2(begin * 4, (min)(end * 4, numSlices));
+}
+
 struct CBSampleRes
 {
 	uint32_t NumSamples;
 	uint32_t HasLightProbes;
 	uint32_t NumLightSamples;
+	float LightFootprint;
+	float LightSpread;
 };
 
 #ifdef _CPU_CUBE_FACE_CULL_
@@ -52,7 +165,7 @@ static inline bool IsCubeFaceVisible(uint8_t face, CXMVECTOR localSpaceEyePt)
 }
 #endif
 
-#if _CPU_CUBE_FACE_CULL_ == 1
+#if _CPU_CUBE_FACE_CULL_
 static inline uint32_t GenVisibilityMask(CXMMATRIX worldI, const XMFLOAT3& eyePt)
 {
 	const auto localSpaceEyePt = XMVector3Transform(XMLoadFloat3(&eyePt), worldI);
@@ -66,9 +179,13 @@ static inline uint32_t GenVisibilityMask(CXMMATRIX worldI, const XMFLOAT3& eyePt
 
 	return mask;
 }
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#endif
+
+#if _CPU_CUBE_FACE_CULL_ == 2
 struct CBCubeFaceList
 {
+	uint32_t LODs;	// 4 bits per face
+	XMUINT3 Padding;
 	XMUINT4 Faces[5];
 };
 
@@ -88,6 +205,12 @@ static inline uint8_t GenVisibleCubeFaceList(CBCubeFaceList& faceList, CXMMATRIX
 
 	return count;
 }
+#else
+struct CBCubeFaceCull
+{
+	uint32_t LODs;	// 4 bits per face
+	uint32_t VisibilityMask;
+};
 #endif
 
 static inline XMVECTOR ProjectToViewport(uint32_t i, CXMMATRIX worldViewProj, CXMVECTOR viewport)
@@ -145,7 +268,42 @@ static inline float EstimateCubeEdgePixelSize(const XMVECTOR v[8])
 	return s;
 }
 
-static inline uint8_t EstimateCubeMapLOD(uint32_t& raySampleCount, uint8_t numMips, float cubeMapSize,
+static inline float EstimateCubeFacePixelSize(const XMVECTOR v[8], uint8_t face)
+{
+	// Corners of each face of the cube map, +X, -X, +Y, -Y, +Z and -Z, in order around it
+	static const uint8_t fi[][4] =
+	{
+		{ 0, 2, 7, 5 },
+		{ 1, 4, 6, 3 },
+		{ 0, 5, 4, 1 },
+		{ 2, 3, 6, 7 },
+		{ 0, 1, 3, 2 },
+		{ 5, 7, 6, 4 }
+	};
+
+	// Edge of the square of the same projected area
+	auto a = 0.0f;
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		const auto& p = v[fi[face][i]];
+		const auto& q = v[fi[face][(i + 1) % 4]];
+		a += XMVectorGetX(p) * XMVectorGetY(q) - XMVectorGetX(q) * XMVectorGetY(p);
+	}
+
+	return sqrtf(fabsf(a) * 0.5f);
+}
+
+static inline uint8_t GetFinestCubeMapLOD(uint32_t lods, uint32_t faceMask, uint8_t numMips)
+{
+	auto lod = static_cast<uint8_t>(numMips - 1);
+	for (uint8_t i = 0; i < 6; ++i)
+		if (faceMask & (1 << i)) lod = (min)(static_cast<uint8_t>(lods >> (i * 4) & 0xf), lod);
+
+	return lod;
+}
+
+// Returns the LOD of each face of the cube map, packed in 4 bits per face
+static inline uint32_t EstimateCubeMapLODs(uint32_t& raySampleCount, uint8_t numMips, float cubeMapSize,
 	CXMMATRIX worldViewProj, CXMVECTOR viewport, float upscale = 2.0f, float raySampleCountScale = 2.0f)
 {
 	XMVECTOR v[8];
@@ -165,11 +323,20 @@ static inline uint8_t EstimateCubeMapLOD(uint32_t& raySampleCount, uint8_t numMi
 	raySampleAmt = (min)(raySampleAmt, static_cast<float>(raySampleCount));
 	s = raySampleAmt / raySampleCountScale * sqrtf(3.0f);
 
-	// Use the more detailed integer level for conservation
-	//const auto level = static_cast<uint8_t>(floorf((max)(log2f(cubeMapSize / s), 0.0f)));
-	const auto level = static_cast<uint8_t>((max)(log2f(cubeMapSize / s), 0.0f));
+	// Each face from its own projected area, no finer than the whole cube; a face seen at a
+	// grazing angle covers few pixels
+	auto lods = 0u;
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		const auto sFace = (min)(EstimateCubeFacePixelSize(v, i) / upscale, s);
+
+		// Use the more detailed integer level for conservation
+		//const auto level = static_cast<uint8_t>(floorf((max)(log2f(cubeMapSize / sFace), 0.0f)));
+		const auto level = (min)((max)(log2f(cubeMapSize / sFace), 0.0f), static_cast<float>(numMips - 1));
+		lods |= static_cast<uint32_t>(level) << (i * 4);
+	}
 
-	return min<uint8_t>(level, numMips - 1);
+	return lods;
 }
 
 FluidEZ::FluidEZ() :
@@ -177,12 +344,52 @@ FluidEZ::FluidEZ() :
 	m_lightColor(1.0f, 0.7f, 0.3f, XM_PI * 3.0f),
 	m_cubeFaceCount(6),
 	m_cubeMapLOD(0),
+	m_cubeMapInterleave(1),
+	m_cubeMapParity(0),
+	m_cubeMapFrame(0),
+	m_checkerboard(),
+	m_localEyePt(0.0f, 0.0f, 0.0f),
+	m_isCubeMapStale(true),
 	m_ambient(1.0f, 1.0f, 1.0f, XM_PI * 1.5f),
+	m_gridSize(0, 0, 0),
+	m_lightMapDivisor(1, 1, 1),
+	m_ambientDivisor(2, 2, 2),
 	m_maxRaySamples(192),
 	m_maxLightSamples(64),
+	m_lightFootprint(0.0f),
+	m_lightSpread(0.0f),
+	m_lightPass(LIGHT_RAY_MARCH),
+	m_sweepAxis(1),
+	m_isSweepFromMax(true),
+	m_lightMapInterval(1),
+	m_lightMapSlab(0),
+	m_lightMapSlices(0, 0),
+	m_ambientSlab(0),
+	m_ambientSlices(0, 0),
+	m_lightMapInputs(),
+	m_isLightMapStale(true),
 	m_frameParity(0),
-	m_coeffSH(nullptr),
-	m_timeInterval(0.0f)
+	m_projectionMode(PROJECT_JACOBI),
+	m_projectionStats(),
+	m_pcgMaxIterations(128),
+	m_pcgTolerance(1.0e-2f),
+	m_sorOmega(1.8f),
+	m_targetResidual(0.1f),
+	m_numIterations(g_numJacobiIterations),
+	m_minIterations(4),
+	m_maxAdaptiveIterations(g_numJacobiIterations),
+	m_pendingResiduals(0),
+	m_pressureLevel(0),
+	m_velocityLayout(VELOCITY_COLLOCATED),
+	m_advectionScheme(ADVECT_SEMI_LAGRANGIAN),
+	m_isSparse(false),
+	m_isGradientCached(false),
+	m_stepStats(),
+	m_maxCellSpeed(0.0f),
+	m_cflNumber(0.0f),
+	m_maxSubsteps(1),
+	m_pendingSpeeds(0),
+	m_coeffSH(nullptr)
 {
 	m_shaderLib = ShaderLib::MakeUnique();
 
@@ -202,6 +409,10 @@ bool FluidEZ::Init(XUSG::CommandList* pCommandList, uint32_t width, uint32_t hei
 	m_gridSize = gridSize;
 	assert(m_gridSize.x == m_gridSize.y);
 
+	// The DCT projection transforms each line of the grid within a thread group
+	if (m_projectionMode == PROJECT_DCT && (max)((max)(gridSize.x, gridSize.y), gridSize.z) > MAX_COSINE_TRANSFORM_SIZE)
+		return false;
+
 	// Create resources
 	for (uint8_t i = 0; i < 2; ++i)
 	{
@@ -209,10 +420,32 @@ bool FluidEZ::Init(XUSG::CommandList* pCommandList, uint32_t width, uint32_t hei
 		XUSG_N_RETURN(m_velocities[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16G16B16A16_FLOAT,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, (L"VelocityEZ" + to_wstring(i)).c_str()), false);
 
+		// Density apart from the color, so that the light rays fetch it alone
 		m_colors[i] = Texture3D::MakeUnique();
-		XUSG_N_RETURN(m_colors[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16G16B16A16_FLOAT,
+		XUSG_N_RETURN(m_colors[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R10G10B10A2_UNORM,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
 			(L"ColorEZ" + to_wstring(i)).c_str()), false);
+
+		m_densities[i] = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_densities[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"DensityEZ" + to_wstring(i)).c_str()), false);
+	}
+
+	// Forward predictions of the MacCormack corrector
+	if (m_advectionScheme == ADVECT_MACCORMACK)
+	{
+		m_predictedVelocity = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedVelocity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16G16B16A16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedVelocityEZ"), false);
+
+		m_predictedColor = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedColor->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R10G10B10A2_UNORM,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedColorEZ"), false);
+
+		m_predictedDensity = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_predictedDensity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R16_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PredictedDensityEZ"), false);
 	}
 
 	m_incompress = Texture3D::MakeUnique();
@@ -220,25 +453,210 @@ bool FluidEZ::Init(XUSG::CommandList* pCommandList, uint32_t width, uint32_t hei
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
 		L"IncompressibilityEZ"), false);
 
-	m_lightMapSize = gridSize;
+	m_divergence = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_divergence->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"DivergenceEZ"), false);
+
+	// Ping-pong partner of the divergence for the DCT passes, which handle lines of up to 1024 cells
+	assert((max)((max)(gridSize.x, gridSize.y), gridSize.z) <= 1024);
+	m_spectrum = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_spectrum->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"SpectrumEZ"), false);
+
+	// Multigrid levels: halve every axis (rounding up) until the coarsest level is small enough
+	m_coarseIncompress.clear();
+	m_coarseDivergence.clear();
+	auto levelSize = gridSize;
+	while ((max)((max)(levelSize.x, levelSize.y), levelSize.z) > g_mgCoarsestSize)
+	{
+		levelSize = XMUINT3((levelSize.x + 1) / 2, (levelSize.y + 1) / 2, (levelSize.z + 1) / 2);
+		const auto level = to_wstring(m_coarseIncompress.size() + 1);
+
+		auto incompress = Texture3D::MakeUnique();
+		XUSG_N_RETURN(incompress->Create(pDevice, levelSize.x, levelSize.y, levelSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"IncompressibilityEZ" + level).c_str()), false);
+		m_coarseIncompress.emplace_back(move(incompress));
+
+		auto divergence = Texture3D::MakeUnique();
+		XUSG_N_RETURN(divergence->Create(pDevice, levelSize.x, levelSize.y, levelSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE,
+			(L"DivergenceEZ" + level).c_str()), false);
+		m_coarseDivergence.emplace_back(move(divergence));
+	}
+
+	// One partial mean of the divergence per thread group
+	const auto numGroups = XUSG_DIV_UP(gridSize.x, 8) * XUSG_DIV_UP(gridSize.y, 8) * gridSize.z;
+	m_partialMeans = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_partialMeans->Create(pDevice, numGroups, sizeof(float), Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"DivergencePartialMeansEZ"), false);
+
+	m_divergenceMean = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_divergenceMean->Create(pDevice, 1, sizeof(float), Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"DivergenceMeanEZ"), false);
+
+	// Conjugate gradient vectors, and its dot products reduced from one partial per thread group
+	m_pcgResidual = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_pcgResidual->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PCGResidualEZ"), false);
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		m_pcgDirections[i] = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_pcgDirections[i]->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, (L"PCGDirectionEZ" + to_wstring(i)).c_str()), false);
+	}
+
+	m_pcgKDirection = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_pcgKDirection->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"PCGKDirectionEZ"), false);
+
+	m_partialSums = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_partialSums->Create(pDevice, numGroups, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"PartialSumsEZ"), false);
+
+	m_pcgState = StructuredBuffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgState->Create(pDevice, 1, sizeof(PCGState), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"PCGStateEZ"), false);
+
+	// Arguments of the indirect PCG passes, written by each reduction
+	m_pcgDispatchArgs = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgDispatchArgs->Create(pDevice, 3, sizeof(uint32_t), Format::R32_UINT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 0, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"PCGDispatchArgsEZ"), false);
+
+	m_pcgReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_pcgReadback->Create(pDevice, sizeof(PCGState[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"PCGStateReadbackEZ"), false);
+
+	// Sums of the residual after the adaptive Jacobi projection, reduced from the same partials
+	m_residualSums = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_residualSums->Create(pDevice, 1, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"ResidualSumsEZ"), false);
+
+	m_residualReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_residualReadback->Create(pDevice, sizeof(XMFLOAT4[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"ResidualReadbackEZ"), false);
+
+	// Largest speeds per axis for the sub-step scheduler, reduced from the same partials
+	m_maxSpeed = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_maxSpeed->Create(pDevice, 1, sizeof(float[4]), Format::R32G32B32A32_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr, 1, nullptr,
+		MemoryFlag::NONE, L"MaxSpeedEZ"), false);
+
+	m_speedReadback = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_speedReadback->Create(pDevice, sizeof(XMFLOAT4[FrameCount]), ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"SpeedReadbackEZ"), false);
+
+	// Active bricks of the sparse simulation, listed with the arguments of their indirect dispatches
+	if (m_isSparse)
+	{
+		const auto brickGridSize = GetBrickGridSize(gridSize);
+		const auto numBricks = brickGridSize.x * brickGridSize.y * brickGridSize.z;
+		for (uint8_t i = 0; i < 2; ++i)
+		{
+			m_brickMasks[i] = StructuredBuffer::MakeUnique();
+			XUSG_N_RETURN(m_brickMasks[i]->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+				MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, (L"BrickMaskEZ" + to_wstring(i)).c_str()), false);
+
+			m_activeBricks[i] = StructuredBuffer::MakeUnique();
+			XUSG_N_RETURN(m_activeBricks[i]->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+				MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, (L"ActiveBricksEZ" + to_wstring(i)).c_str()), false);
+
+			m_dispatchArgs[i] = TypedBuffer::MakeUnique();
+			XUSG_N_RETURN(m_dispatchArgs[i]->Create(pDevice, 3, sizeof(uint32_t), Format::R32_UINT,
+				ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 0, nullptr, 1, nullptr,
+				MemoryFlag::NONE, (L"BrickDispatchArgsEZ" + to_wstring(i)).c_str()), false);
+		}
+
+		m_idleSteps = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_idleSteps->Create(pDevice, numBricks, sizeof(uint32_t), ResourceFlag::ALLOW_UNORDERED_ACCESS,
+			MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"BrickIdleStepsEZ"), false);
+	}
+
+	// Indirect dispatches of PCG and of the sparse simulation
+	{
+		IndirectArgument arg;
+		arg.Type = IndirectArgumentType::DISPATCH;
+		m_commandLayout = CommandLayout::MakeUnique();
+		XUSG_N_RETURN(m_commandLayout->Create(pDevice, sizeof(uint32_t[3]), 1, &arg), false);
+	}
+
+	// The light map is low frequency, so it may be coarser than the grid; its texels span
+	// the same volume, and the view rays filter them trilinearly
+	m_lightMapSize.x = XUSG_DIV_UP(gridSize.x, (max)(m_lightMapDivisor.x, 1u));
+	m_lightMapSize.y = XUSG_DIV_UP(gridSize.y, (max)(m_lightMapDivisor.y, 1u));
+	m_lightMapSize.z = XUSG_DIV_UP(gridSize.z, (max)(m_lightMapDivisor.z, 1u));
 	m_lightMap = Texture3D::MakeUnique();
 	XUSG_N_RETURN(m_lightMap->Create(pDevice, m_lightMapSize.x, m_lightMapSize.y, m_lightMapSize.z,
 		Format::R11G11B10_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS | ResourceFlag::ALLOW_SIMULTANEOUS_ACCESS,
 		1, MemoryFlag::NONE, L"LightMapEZ"), false);
 
-	const uint8_t numMips = 5;
-	m_cubeMap = Texture2D::MakeUnique();
-	XUSG_N_RETURN(m_cubeMap->Create(pDevice, gridSize.x, gridSize.y, Format::R8G8B8A8_UNORM, 6,
-		ResourceFlag::ALLOW_UNORDERED_ACCESS, numMips, 1, true, MemoryFlag::NONE, L"CubeMapEZ"), false);
+	// The ambient of the light probe varies slower still, so it is decimated by default
+	m_ambientSize.x = XUSG_DIV_UP(gridSize.x, (max)(m_ambientDivisor.x, 1u));
+	m_ambientSize.y = XUSG_DIV_UP(gridSize.y, (max)(m_ambientDivisor.y, 1u));
+	m_ambientSize.z = XUSG_DIV_UP(gridSize.z, (max)(m_ambientDivisor.z, 1u));
+	m_ambientVolume = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_ambientVolume->Create(pDevice, m_ambientSize.x, m_ambientSize.y, m_ambientSize.z,
+		Format::R11G11B10_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"AmbientVolumeEZ"), false);
+
+	// Transmittance of the light sweep, ping-ponged between the slices across any axis
+	const auto sliceSize = (max)((max)(m_lightMapSize.x, m_lightMapSize.y), m_lightMapSize.z);
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		m_sweepSlices[i] = Texture2D::MakeUnique();
+		XUSG_N_RETURN(m_sweepSlices[i]->Create(pDevice, sliceSize, sliceSize, Format::R16_FLOAT, 1,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE,
+			(L"SweepSliceEZ" + to_wstring(i)).c_str()), false);
+	}
+
+	// Density of the ray marchers, quantized against the range of each brick
+	const auto brickGridSize = GetBrickGridSize(gridSize);
+	m_quantizedDensity = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_quantizedDensity->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R8_UNORM,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"QuantizedDensityEZ"), false);
+
+	m_densityRanges = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityRanges->Create(pDevice, brickGridSize.x, brickGridSize.y, brickGridSize.z,
+		Format::R16G16_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"DensityRangesEZ"), false);
+
+	// Max-density pyramid of the bricks for empty-space skipping, down to a single cell
+	m_densityPyramid = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityPyramid->Create(pDevice, brickGridSize.x, brickGridSize.y, brickGridSize.z,
+		Format::R32_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 0, MemoryFlag::NONE, L"DensityPyramidEZ"), false);
+
+	// Density mips of the cone-traced light rays, from half resolution down to a single cell
+	m_densityMips = Texture3D::MakeUnique();
+	XUSG_N_RETURN(m_densityMips->Create(pDevice, (max)(gridSize.x >> 1, 1u), (max)(gridSize.y >> 1, 1u),
+		(max)(gridSize.z >> 1, 1u), Format::R16_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS, 0,
+		MemoryFlag::NONE, L"DensityMipsEZ"), false);
+
+	// Density gradient of the ambient pass, packed as a unit direction and a magnitude
+	if (m_isGradientCached)
+	{
+		m_densityGradient = Texture3D::MakeUnique();
+		XUSG_N_RETURN(m_densityGradient->Create(pDevice, gridSize.x, gridSize.y, gridSize.z, Format::R8G8B8A8_SNORM,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, L"DensityGradientEZ"), false);
+	}
+
+	// The checkerboard marching rebuilds from the cube map of the last frame, ping-ponged
+	const uint8_t numMips = NUM_CUBE_MAP_MIPS;
+	for (uint8_t i = 0; i < (m_cubeMapInterleave > 1 ? 2 : 1); ++i)
+	{
+		m_cubeMaps[i] = Texture2D::MakeUnique();
+		XUSG_N_RETURN(m_cubeMaps[i]->Create(pDevice, gridSize.x, gridSize.y, Format::R8G8B8A8_UNORM, 6,
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, numMips, 1, true, MemoryFlag::NONE,
+			(L"CubeMapEZ" + to_wstring(i)).c_str()), false);
+	}
 
 	//m_cubeDepth = Texture2D::MakeUnique();
 	//XUSG_N_RETURN(m_cubeDepth->Create(pDevice, gridSize.x, gridSize.y,  Format::R32_FLOAT, 6,
 	//	ResourceFlag::ALLOW_UNORDERED_ACCESS, numMips, 1, true, MemoryFlag::NONE, L"CubeDepthEZ"), false);
 
-	m_nullBuffer = Buffer::MakeUnique();
-	XUSG_N_RETURN(m_nullBuffer->Create(pDevice, 0, ResourceFlag::ALLOW_UNORDERED_ACCESS,
-		MemoryType::DEFAULT, 1, nullptr, 1, nullptr, MemoryFlag::NONE, L"NullBuffer"), false);
-
 	// Create constant buffers
 	m_cbSimulation = ConstantBuffer::MakeUnique();
 	XUSG_N_RETURN(m_cbSimulation->Create(pDevice, sizeof(CBSimulation[FrameCount]), FrameCount,
@@ -263,29 +681,192 @@ bool FluidEZ::Init(XUSG::CommandList* pCommandList, uint32_t width, uint32_t hei
 			MemoryType::UPLOAD, MemoryFlag::NONE, (L"FluidEZ.CBSampleRes" + to_wstring(i)).c_str()), false);
 	}
 
-#if _CPU_CUBE_FACE_CULL_ == 1
-	m_cbCubeFaceCull = ConstantBuffer::MakeUnique();
-	XUSG_N_RETURN(m_cbCubeFaceCull->Create(pDevice, sizeof(uint32_t[FrameCount]), FrameCount,
-		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBCubeFaceVisEZ"), false);
-#elif _CPU_CUBE_FACE_CULL_ == 2
+	// Red and black colors of the smoothing passes, for Gauss-Seidel (0, 1) and SOR (2, 3)
+	m_cbSmooth = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbSmooth->Create(pDevice, sizeof(CBSmooth[4]), 4, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBSmooth"), false);
+	for (uint8_t i = 0; i < 2; ++i) *static_cast<CBSmooth*>(m_cbSmooth->Map(i)) = { i, 1.0f };
+	SetOverRelaxation(m_sorOmega);
+
+	// Group counts, stages and tolerance of the PCG reductions, per frame since the tolerance is user-set
+	m_cbPCGReduce = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbPCGReduce->Create(pDevice, sizeof(CBPCGReduce[FrameCount * 3]), FrameCount * 3, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBPCGReduce"), false);
+
+	// Axes and directions of the cosine transform passes, indexed by isInverse * 3 + axis
+	struct CBCosineTransform
+	{
+		uint32_t Axis;
+		uint32_t IsInverse;
+	};
+	m_cbCosineTransform = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbCosineTransform->Create(pDevice, sizeof(CBCosineTransform[6]), 6, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBCosineTransform"), false);
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		const auto pCbData = reinterpret_cast<CBCosineTransform*>(m_cbCosineTransform->Map(i));
+		pCbData->Axis = i % 3;
+		pCbData->IsInverse = i / 3;
+	}
+
+	// Brick grid of the active-brick build, with the thread groups of each brick
+	if (m_isSparse)
+	{
+		m_cbBricks = ConstantBuffer::MakeUnique();
+		XUSG_N_RETURN(m_cbBricks->Create(pDevice, sizeof(CBBricks), 1, nullptr,
+			MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBBricks"), false);
+		const auto pCbData = reinterpret_cast<CBBricks*>(m_cbBricks->Map());
+		pCbData->BrickGridSize = GetBrickGridSize(gridSize);
+		pCbData->NumBrickGroups = g_brickSize * g_brickSize * (gridSize.z > 1 ? g_brickSize : 1) / 64;
+	}
+
+	// Slices of the light map and the ambient volume refreshed per frame
+	m_cbLightMapRefresh = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbLightMapRefresh->Create(pDevice, sizeof(XMUINT2[FrameCount]), FrameCount, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBLightMapRefresh"), false);
+
+	m_cbAmbientRefresh = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbAmbientRefresh->Create(pDevice, sizeof(XMUINT2[FrameCount]), FrameCount, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBAmbientRefresh"), false);
+
+	m_cbCheckerboard = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbCheckerboard->Create(pDevice, sizeof(CubeMapCheckerboard[FrameCount]), FrameCount, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBCheckerboard"), false);
+
+	// Slices of the light sweep, indexed by (axis * 2 + isFromMax) * sliceSize + slice
+	struct CBLightSweep
+	{
+		uint32_t Slice;
+		uint32_t Axis;
+		uint32_t IsFromMax;
+	};
+	const auto numSweepSlices = 6 * sliceSize;
+	m_cbLightSweep = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbLightSweep->Create(pDevice, sizeof(CBLightSweep) * numSweepSlices, numSweepSlices, nullptr,
+		MemoryType::UPLOAD, MemoryFlag::NONE, L"FluidEZ.CBLightSweep"), false);
+	for (auto i = 0u; i < numSweepSlices; ++i)
+	{
+		const auto pCbData = reinterpret_cast<CBLightSweep*>(m_cbLightSweep->Map(i));
+		pCbData->Slice = i % sliceSize;
+		pCbData->Axis = i / sliceSize / 2;
+		pCbData->IsFromMax = i / sliceSize % 2;
+	}
+
+#if _CPU_CUBE_FACE_CULL_ == 2
 	m_cbCubeFaceList = ConstantBuffer::MakeUnique();
 	XUSG_N_RETURN(m_cbCubeFaceList->Create(m_device.get(), sizeof(CBCubeFaceList[FrameCount]), FrameCount,
 		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBCubeFaceListEZ"), false);
+#else
+	m_cbCubeFaceCull = ConstantBuffer::MakeUnique();
+	XUSG_N_RETURN(m_cbCubeFaceCull->Create(pDevice, sizeof(CBCubeFaceCull[FrameCount]), FrameCount,
+		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"CBCubeFaceVisEZ"), false);
 #endif
 
 	// Create shaders
 	return createShaders();
 }
 
+void FluidEZ::SetVelocityLayout(VelocityLayout layout)
+{
+	m_velocityLayout = layout;
+}
+
+void FluidEZ::SetAdvectionScheme(AdvectionScheme scheme)
+{
+	m_advectionScheme = scheme;
+}
+
+void FluidEZ::SetSparseBricks(bool isSparse)
+{
+	m_isSparse = isSparse;
+}
+
+void FluidEZ::SetLightMapDivisor(const XMUINT3& divisor)
+{
+	m_lightMapDivisor = divisor;
+}
+
+void FluidEZ::SetAmbientDivisor(const XMUINT3& divisor)
+{
+	m_ambientDivisor = divisor;
+}
+
+void FluidEZ::SetGradientCache(bool isCached)
+{
+	m_isGradientCached = isCached;
+}
+
+void FluidEZ::SetCheckerboard(uint8_t interleave)
+{
+	m_cubeMapInterleave = interleave >= 4 ? 4 : (interleave >= 2 ? 2 : 1);
+}
+
 void FluidEZ::SetMaxSamples(uint32_t maxRaySamples, uint32_t maxLightSamples)
 {
 	m_maxRaySamples = maxRaySamples;
 	m_maxLightSamples = maxLightSamples;
 }
 
+void FluidEZ::SetLightFootprint(float footprint, float spread)
+{
+	m_lightFootprint = footprint;
+	m_lightSpread = spread;
+	m_isLightMapStale = true;
+}
+
+void FluidEZ::SetLightPass(LightPass pass)
+{
+	m_lightPass = pass;
+}
+
+void FluidEZ::SetLightMapRefresh(uint32_t interval)
+{
+	m_lightMapInterval = (max)(interval, 1u);
+}
+
 void FluidEZ::SetSH(const StructuredBuffer::sptr& coeffSH)
 {
 	m_coeffSH = coeffSH;
+	m_isLightMapStale = true;
+}
+
+void FluidEZ::SetProjectionMode(ProjectionMode mode)
+{
+	// The DCT projection transforms each line of the grid within a thread group
+	if (mode == PROJECT_DCT && (max)((max)(m_gridSize.x, m_gridSize.y), m_gridSize.z) > MAX_COSINE_TRANSFORM_SIZE) return;
+	m_projectionMode = mode;
+}
+
+void FluidEZ::SetProjectionBudget(float tolerance, uint32_t maxIterations)
+{
+	m_pcgTolerance = tolerance;
+	m_pcgMaxIterations = maxIterations;
+}
+
+void FluidEZ::SetOverRelaxation(float omega)
+{
+	m_sorOmega = omega;
+	if (m_cbSmooth)
+		for (uint8_t i = 0; i < 2; ++i) *static_cast<CBSmooth*>(m_cbSmooth->Map(i + 2)) = { i, omega };
+}
+
+void FluidEZ::SetAdaptiveBudget(float targetResidual, uint32_t minIterations, uint32_t maxIterations)
+{
+	m_targetResidual = targetResidual;
+	m_minIterations = minIterations;
+	m_maxAdaptiveIterations = maxIterations;
+	m_numIterations = (min)((max)(m_numIterations, minIterations), maxIterations);
+}
+
+void FluidEZ::SetPressureLevel(uint8_t level)
+{
+	m_pressureLevel = level;
+}
+
+void FluidEZ::SetSubstepping(float cflNumber, uint32_t maxSubsteps)
+{
+	m_cflNumber = cflNumber;
+	m_maxSubsteps = (max)(maxSubsteps, 1u);
 }
 
 void FluidEZ::UpdateFrame(float timeStep, uint8_t frameIndex,
@@ -328,20 +909,45 @@ void FluidEZ::UpdateFrame(float timeStep, uint8_t frameIndex,
 			XMStoreFloat3x4(&pCbData->WorldI, worldI);
 			XMStoreFloat3x4(&pCbData->World, world);
 
+			// The light sweep slices across the dominant axis of the light direction; the volume
+			// is centered at the origin, so a point light takes the same from its center
+			XMFLOAT3 lightDir;
+			XMStoreFloat3(&lightDir, XMVector3TransformNormal(XMLoadFloat3(&m_lightPt), worldI));
+			const float absDir[] = { fabsf(lightDir.x), fabsf(lightDir.y), fabsf(lightDir.z) };
+			m_sweepAxis = absDir[0] >= absDir[1] && absDir[0] >= absDir[2] ? 0 : (absDir[1] >= absDir[2] ? 1 : 2);
+			m_isSweepFromMax = (&lightDir.x)[m_sweepAxis] > 0.0f;
+
+			// The light map and the ambient volume refresh slabs of their slices round-robin, and
+			// all of them after a change of the light or the volume transform
+			const LightMapInputs lightMapInputs = { m_lightPt, m_lightColor, m_ambient, m_volumeWorld };
+			if (memcmp(&lightMapInputs, &m_lightMapInputs, sizeof(LightMapInputs)) != 0) m_isLightMapStale = true;
+			m_lightMapInputs = lightMapInputs;
+			if (m_isLightMapStale) m_lightMapSlab = 0;
+			m_lightMapSlices = ScheduleLightMapRefresh(m_lightMapSlab, m_lightMapSize.z,
+				m_isLightMapStale ? 1 : m_lightMapInterval);
+			if (m_isLightMapStale) m_ambientSlab = 0;
+			m_ambientSlices = ScheduleLightMapRefresh(m_ambientSlab, m_ambientSize.z,
+				m_isLightMapStale ? 1 : m_lightMapInterval);
+			m_isLightMapStale = false;
+			*reinterpret_cast<XMUINT2*>(m_cbLightMapRefresh->Map(frameIndex)) = m_lightMapSlices;
+			*reinterpret_cast<XMUINT2*>(m_cbAmbientRefresh->Map(frameIndex)) = m_ambientSlices;
+
 			{
 				m_raySampleCount = m_maxRaySamples;
-				const auto numMips = m_cubeMap->GetNumMips();
-				const auto cubeMapSize = static_cast<float>(m_cubeMap->GetWidth());
+				const auto numMips = m_cubeMaps[0]->GetNumMips();
+				const auto cubeMapSize = static_cast<float>(m_cubeMaps[0]->GetWidth());
 				const auto witdh = static_cast<float>(m_viewport.x);
 				const auto height = static_cast<float>(m_viewport.y);
 				const auto viewport = XMVectorSet(witdh, height, 1.0f, 1.0f);
-				m_cubeMapLOD = EstimateCubeMapLOD(m_raySampleCount, numMips, cubeMapSize, worldViewProj, viewport);
+				const auto lods = EstimateCubeMapLODs(m_raySampleCount, numMips, cubeMapSize, worldViewProj, viewport);
 
 				{
 					const auto pCbData = static_cast<CBSampleRes*>(m_cbSampleRes[CB_SAMPLE_RES]->Map(frameIndex));
 					pCbData->NumSamples = m_raySampleCount;
 					pCbData->HasLightProbes = m_coeffSH ? 1 : 0;
 					pCbData->NumLightSamples = m_maxLightSamples;
+					pCbData->LightFootprint = m_lightFootprint;
+					pCbData->LightSpread = m_lightSpread;
 				}
 
 				{
@@ -349,102 +955,124 @@ void FluidEZ::UpdateFrame(float timeStep, uint8_t frameIndex,
 					pCbData->NumSamples = m_maxLightSamples;
 					pCbData->HasLightProbes = m_coeffSH ? 1 : 0;
 					pCbData->NumLightSamples = m_maxLightSamples;
+					pCbData->LightFootprint = m_lightFootprint;
+					pCbData->LightSpread = m_lightSpread;
 				}
 
-#if _CPU_CUBE_FACE_CULL_ == 1
-				{
-					const auto pCbData = static_cast<uint32_t*>(m_cbCubeFaceCull->Map(frameIndex));
-					*pCbData = GenVisibilityMask(worldI, eyePt);
-				}
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#if _CPU_CUBE_FACE_CULL_
+				const auto visibilityMask = GenVisibilityMask(worldI, eyePt);
+#else
+				const auto visibilityMask = 0x3fu;
+#endif
+#if _CPU_CUBE_FACE_CULL_ == 2
 				{
 					const auto pCbData = reinterpret_cast<CBCubeFaceList*>(m_cbCubeFaceList->Map(frameIndex));
+					pCbData->LODs = lods;
 					m_cubeFaceCount = GenVisibleCubeFaceList(*pCbData, worldI, eyePt);
 				}
+#else
+				{
+					const auto pCbData = reinterpret_cast<CBCubeFaceCull*>(m_cbCubeFaceCull->Map(frameIndex));
+					pCbData->LODs = lods;
+					pCbData->VisibilityMask = visibilityMask;
+				}
 #endif
+				m_cubeMapLOD = GetFinestCubeMapLOD(lods, visibilityMask, numMips);
+
+				// The checkerboard marching cycles the phases over the frames, and marches all
+				// texels after a frame without the cube map, which leaves no history
+				XMFLOAT3 localEyePt;
+				XMStoreFloat3(&localEyePt, XMVector3Transform(XMLoadFloat3(&eyePt), worldI));
+				const auto interleave = m_isCubeMapStale ? 1u : m_cubeMapInterleave;
+				static const uint32_t phases[] = { 0, 3, 1, 2 };	// Diagonals of the 2x2 blocks first
+				m_checkerboard.PrevLODs = m_checkerboard.LODs;
+				m_checkerboard.PrevEyePt = m_localEyePt;
+				m_checkerboard.Interleave = interleave;
+				m_checkerboard.Phase = interleave == 4 ? phases[m_cubeMapFrame % 4] : m_cubeMapFrame % interleave;
+				m_checkerboard.LODs = lods;
+				*reinterpret_cast<CubeMapCheckerboard*>(m_cbCheckerboard->Map(frameIndex)) = m_checkerboard;
+				if (m_cubeMapInterleave > 1) m_cubeMapParity = !m_cubeMapParity;
+				m_localEyePt = localEyePt;
+				m_isCubeMapStale = false;
+				++m_cubeMapFrame;
 			}
 		}
 	}
 
 	m_timeStep = timeStep;
-	if (timeStep > 0.0) m_frameParity = !m_frameParity;
 }
 
 void FluidEZ::Simulate(EZ::CommandList* pCommandList, uint8_t frameIndex)
 {
-	auto timeStep = m_gridSize.z > 1 ? 1.0f / 60.0f : 1.0f / 800.0f;
-	m_timeInterval = m_timeInterval > timeStep ? 0.0f : m_timeInterval;
-	m_timeInterval += m_timeStep;
-	timeStep = m_timeInterval < timeStep ? 0.0f : timeStep;
-
-	// Advection
+	// The solve that last used this frame's readback slot has completed
+	if (m_projectionMode == PROJECT_PCG)
 	{
-		// Set pipeline state
-		pCommandList->SetComputeShader(m_shaders[CS_ADVECT]);
-
-		// Set UAVs
-		const EZ::ResourceView uavs[] =
-		{
-			EZ::GetUAV(m_velocities[1].get()),
-			EZ::GetUAV(m_colors[m_frameParity].get())
-		};
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
-
-		// Set CBV
-		const auto cbv = EZ::GetCBV(m_cbSimulation.get(), frameIndex);
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
-
-		// Set SRVs
-		const EZ::ResourceView srvs[] =
-		{
-			EZ::GetSRV(m_velocities[0].get()),
-			EZ::GetSRV(m_colors[!m_frameParity].get())
-		};
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
-
-		// Set sampler
-		const auto sampler = SamplerPreset::LINEAR_CLAMP;
-		pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
-
-		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+		const auto pState = static_cast<const PCGState*>(m_pcgReadback->Map(nullptr)) + frameIndex;
+		m_projectionStats.NumIterations = pState->NumIterations;
+		m_projectionStats.Residual = pState->BB > 0.0f ? sqrtf(pState->RR / pState->BB) : 0.0f;
+		m_projectionStats.IsCapped = !pState->IsConverged;
 	}
 
-	// Projection
+	if (m_pendingResiduals >> frameIndex & 1)
 	{
-		// Set pipeline state
-		pCommandList->SetComputeShader(m_shaders[m_gridSize.z > 1 ? CS_PROJECT_3D : CS_PROJECT_2D]);
-
-		// Set UAVs
-		const EZ::ResourceView uavs[] =
+		// Sums of (r, r^2, b, b^2), without the constant (null-space) components
+		const auto& sums = static_cast<const XMFLOAT4*>(m_residualReadback->Map(nullptr))[frameIndex];
+		const auto numCells = static_cast<float>(m_gridSize.x * m_gridSize.y * m_gridSize.z);
+		const auto rr = sums.y / numCells - (sums.x / numCells) * (sums.x / numCells);
+		const auto bb = sums.w / numCells - (sums.z / numCells) * (sums.z / numCells);
+		m_projectionStats.DivergenceError = bb > 0.0f ? sqrtf((max)(rr, 0.0f) / bb) : 0.0f;
+		m_pendingResiduals &= ~(1 << frameIndex);
+
+		if (m_projectionMode == PROJECT_JACOBI_ADAPTIVE)
 		{
-			EZ::GetUAV(m_velocities[0].get()),
-			EZ::GetUAV(m_incompress.get())
-		};
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
-
-		// Set CBV
-		const auto cbv = EZ::GetCBV(m_cbSimulation.get(), frameIndex);
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+			m_projectionStats.Residual = m_projectionStats.DivergenceError;
+			m_numIterations = AdaptIterations(m_numIterations, m_projectionStats.Residual,
+				m_targetResidual, m_minIterations, m_maxAdaptiveIterations);
+		}
+	}
 
-		// Set SRV
-		const auto srv = EZ::GetSRV(m_velocities[1].get());
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+	if (m_pendingSpeeds >> frameIndex & 1)
+	{
+		const auto& maxSpeed = static_cast<const XMFLOAT4*>(m_speedReadback->Map(nullptr))[frameIndex];
+		m_maxCellSpeed = (max)((max)(maxSpeed.x, maxSpeed.y), maxSpeed.z);
+		m_pendingSpeeds &= ~(1 << frameIndex);
+	}
 
-		XMUINT3 numGroups;
-		if (m_gridSize.z > 1) // optimized for 3D
-		{
-			numGroups.x = XUSG_DIV_UP(m_gridSize.x, 4);
-			numGroups.y = XUSG_DIV_UP(m_gridSize.y, 4);
-			numGroups.z = XUSG_DIV_UP(m_gridSize.z, 4);
-		}
-		else
+	// Iteration budget of the Jacobi projection
+	const auto isAdaptive = m_projectionMode == PROJECT_JACOBI_ADAPTIVE;
+	if (isAdaptive) m_projectionStats.NumIterations = m_numIterations;
+	const auto pCbData = reinterpret_cast<CBSimulation*>(m_cbSimulation->Map(frameIndex));
+	pCbData->NumIterations = isAdaptive ? m_numIterations : g_numJacobiIterations;
+
+	// Sub-steps of the frame, under the CFL number at the speed read back
+	auto cflNumber = m_cflNumber;
+	auto maxSubsteps = m_maxSubsteps;
+	if (m_advectionScheme == ADVECT_MACCORMACK) LimitCorrectedSubstepping(cflNumber, maxSubsteps);
+	m_stepStats.NumSubsteps = 1;
+	m_stepStats.TimeStep = m_timeStep;
+	if (cflNumber > 0.0f && m_timeStep > 0.0f) m_stepStats.NumSubsteps = ScheduleSubsteps(m_stepStats.TimeStep,
+		m_timeStep, m_maxCellSpeed, cflNumber, maxSubsteps);
+	m_stepStats.Courant = m_maxCellSpeed * m_stepStats.TimeStep;
+	m_stepStats.CFLNumber = cflNumber;
+	pCbData->TimeStep = m_stepStats.TimeStep;
+
+	for (auto i = 0u; i < m_stepStats.NumSubsteps; ++i)
+	{
+		if (m_timeStep > 0.0f)
 		{
-			numGroups.x = XUSG_DIV_UP(m_gridSize.x, 8);
-			numGroups.y = XUSG_DIV_UP(m_gridSize.y, 8);
-			numGroups.z = m_gridSize.z;
+			m_frameParity = !m_frameParity;
+			if (m_isSparse) buildBricks(pCommandList);
 		}
+		advect(pCommandList, frameIndex);
+		project(pCommandList, frameIndex);
+	}
 
-		pCommandList->Dispatch(numGroups.x, numGroups.y, numGroups.z);
+	// Residual on the full grid (also of the adaptive budget) and the largest speed after the
+	// last sub-step, read back FrameCount frames later
+	if (m_timeStep > 0.0f)
+	{
+		measureResidual(pCommandList, frameIndex);
+		if (cflNumber > 0.0f) measureSpeed(pCommandList, frameIndex);
 	}
 }
 
@@ -455,24 +1083,36 @@ void FluidEZ::Render(EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t
 
 	if (m_gridSize.z > 1)
 	{
+		quantizeDensity(pCommandList);
+		buildDensityPyramid(pCommandList);
+		if (m_lightFootprint > 1.0f || m_lightSpread > 0.0f) generateDensityMips(pCommandList);
+		if (m_coeffSH)
+		{
+			if (m_isGradientCached) computeDensityGradient(pCommandList);
+			computeAmbient(pCommandList, frameIndex);
+		}
 		if (cubemapRayMarch)
 		{
 			if (separateLightPass)
 			{
-				rayMarchL(pCommandList, frameIndex);
+				if (m_lightPass == LIGHT_SLICE_SWEEP) sweepLight(pCommandList, frameIndex);
+				else rayMarchL(pCommandList, frameIndex);
 				rayMarchV(pCommandList, frameIndex);
 			}
 			else
 			{
 				rayMarch(pCommandList, frameIndex);
 			}
+			if (m_checkerboard.Interleave > 1) reconstructCube(pCommandList, frameIndex);
 			renderCube(pCommandList, frameIndex);
 		}
 		else
 		{
+			m_isCubeMapStale = true;
 			if (separateLightPass)
 			{
-				rayMarchL(pCommandList, frameIndex);
+				if (m_lightPass == LIGHT_SLICE_SWEEP) sweepLight(pCommandList, frameIndex);
+				else rayMarchL(pCommandList, frameIndex);
 				rayCastVDirect(pCommandList, frameIndex);
 			}
 			else
@@ -484,29 +1124,165 @@ void FluidEZ::Render(EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t
 	else visualizeColor(pCommandList);
 }
 
+const FluidEZ::ProjectionStats& FluidEZ::GetProjectionStats() const
+{
+	return m_projectionStats;
+}
+
+const FluidEZ::StepStats& FluidEZ::GetStepStats() const
+{
+	return m_stepStats;
+}
+
+uint8_t FluidEZ::GetPressureLevel() const
+{
+	// DCT and PCG always solve at full resolution
+	if (m_projectionMode == PROJECT_DCT || m_projectionMode == PROJECT_PCG) return 0;
+
+	return (min)(m_pressureLevel, static_cast<uint8_t>(m_coarseIncompress.size()));
+}
+
 bool FluidEZ::createShaders()
 {
 	auto vsIndex = 0u;
 	auto psIndex = 0u;
 	auto csIndex = 0u;
+	const auto isStaggered = m_velocityLayout == VELOCITY_STAGGERED;
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+
+	{
+		const wchar_t* fileNames[][2][2] =
+		{
+			{ { L"CSAdvect.cso", L"CSMacCormack.cso" }, { L"CSAdvectSparse.cso", L"CSMacCormackSparse.cso" } },
+			{ { L"CSAdvectMAC.cso", L"CSMacCormackMAC.cso" }, { L"CSAdvectMACSparse.cso", L"CSMacCormackMACSparse.cso" } }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_isSparse][isMacCormack]), false);
+		m_shaders[CS_ADVECT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	}
 
-	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSAdvect.cso"), false);
-	m_shaders[CS_ADVECT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	if (isMacCormack)
+	{
+		const wchar_t* fileNames[][2] =
+		{
+			{ L"CSAdvectPredict.cso", L"CSAdvectPredictSparse.cso" },
+			{ L"CSAdvectPredictMAC.cso", L"CSAdvectPredictMACSparse.cso" }
+		};
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, fileNames[isStaggered][m_isSparse]), false);
+		m_shaders[CS_PREDICT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	}
 
-	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSProject3D.cso"), false);
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSProjectMAC3D.cso" : L"CSProject3D.cso"), false);
 	m_shaders[CS_PROJECT_3D] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 	
-	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSProject2D.cso"), false);
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSProjectMAC2D.cso" : L"CSProject2D.cso"), false);
 	m_shaders[CS_PROJECT_2D] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 	
-	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarch.cso"), false);
-	m_shaders[CS_RAY_MARCH] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSDivergenceMAC.cso" : L"CSDivergence.cso"), false);
+	m_shaders[CS_DIVERGENCE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceMean.cso"), false);
+	m_shaders[CS_REDUCE_MEAN] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRemoveMean.cso"), false);
+	m_shaders[CS_REMOVE_MEAN] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSSmooth.cso"), false);
+	m_shaders[CS_SMOOTH] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRestrict.cso"), false);
+	m_shaders[CS_RESTRICT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSProlong.cso"), false);
+	m_shaders[CS_PROLONG] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSCosineTransform.cso"), false);
+	m_shaders[CS_COSINE_TRANSFORM] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSSpectralSolve.cso"), false);
+	m_shaders[CS_SPECTRAL_SOLVE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGResidual.cso"), false);
+	m_shaders[CS_PCG_RESIDUAL] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGApply.cso"), false);
+	m_shaders[CS_PCG_APPLY] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGUpdate.cso"), false);
+	m_shaders[CS_PCG_UPDATE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSPCGReduce.cso"), false);
+	m_shaders[CS_PCG_REDUCE] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSResidualNormMAC.cso" : L"CSResidualNorm.cso"), false);
+	m_shaders[CS_RESIDUAL_NORM] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceSums.cso"), false);
+	m_shaders[CS_REDUCE_SUMS] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSMaxSpeed.cso"), false);
+	m_shaders[CS_MAX_SPEED] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSReduceMax.cso"), false);
+	m_shaders[CS_REDUCE_MAX] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	if (m_isSparse)
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBuildBricks.cso"), false);
+		m_shaders[CS_BUILD_BRICKS] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	}
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSSubtractGradientMAC3D.cso" : L"CSSubtractGradient3D.cso"), false);
+	m_shaders[CS_SUBTRACT_GRADIENT_3D] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, isStaggered ?
+		L"CSSubtractGradientMAC2D.cso" : L"CSSubtractGradient2D.cso"), false);
+	m_shaders[CS_SUBTRACT_GRADIENT_2D] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSQuantizeDensity.cso"), false);
+	m_shaders[CS_QUANTIZE_DENSITY] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityPyramid.cso"), false);
+	m_shaders[CS_DENSITY_PYRAMID] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityPyramidMip.cso"), false);
+	m_shaders[CS_DENSITY_PYRAMID_MIP] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityMip.cso"), false);
+	m_shaders[CS_DENSITY_MIP] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	if (m_isGradientCached)
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDensityGradient.cso"), false);
+		m_shaders[CS_DENSITY_GRADIENT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	}
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_isGradientCached ?
+		L"CSAmbientG.cso" : L"CSAmbient.cso"), false);
+	m_shaders[CS_AMBIENT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarch.cso"), false);
+	m_shaders[CS_RAY_MARCH] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 	
-	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchL.cso"), false);
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, m_isSparse ?
+		L"CSRayMarchLSparse.cso" : L"CSRayMarchL.cso"), false);
 	m_shaders[CS_RAY_MARCH_L] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSLightSweep.cso"), false);
+	m_shaders[CS_LIGHT_SWEEP] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
 	
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchV.cso"), false);
 	m_shaders[CS_RAY_MARCH_V] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+
+	if (m_cubeMapInterleave > 1)
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSCubeReconstruct.cso"), false);
+		m_shaders[CS_CUBE_RECONSTRUCT] = m_shaderLib->GetShader(Shader::Stage::CS, csIndex++);
+	}
 	
 	XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::VS, vsIndex, L"VSCube.cso"), false);
 	m_shaders[VS_CUBE] = m_shaderLib->GetShader(Shader::Stage::VS, vsIndex++);
@@ -529,6 +1305,744 @@ bool FluidEZ::createShaders()
 	return true;
 }
 
+void FluidEZ::advect(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	const auto isMacCormack = m_advectionScheme == ADVECT_MACCORMACK;
+
+	// Forward semi-Lagrangian prediction, traced back by the corrector
+	if (isMacCormack)
+	{
+		pCommandList->SetComputeShader(m_shaders[CS_PREDICT]);
+
+		const EZ::ResourceView uavs[] =
+		{
+			EZ::GetUAV(m_predictedVelocity.get()),
+			EZ::GetUAV(m_predictedColor.get()),
+			EZ::GetUAV(m_predictedDensity.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+		const auto cbv = EZ::GetCBV(m_cbSimulation.get(), frameIndex);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_velocities[0].get()),
+			EZ::GetSRV(m_colors[!m_frameParity].get()),
+			EZ::GetSRV(m_densities[!m_frameParity].get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+		const auto sampler = SamplerPreset::LINEAR_CLAMP;
+		pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
+
+		if (m_isSparse)
+		{
+			const auto brickSrv = EZ::GetSRV(m_activeBricks[m_frameParity].get());
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 3, 1, &brickSrv);
+			pCommandList->DispatchIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+		}
+		else pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_ADVECT]);
+
+	// Set UAVs
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_velocities[1].get()),
+		EZ::GetUAV(m_colors[m_frameParity].get()),
+		EZ::GetUAV(m_densities[m_frameParity].get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set CBV
+	const auto cbv = EZ::GetCBV(m_cbSimulation.get(), frameIndex);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+	// Set SRVs
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(m_velocities[0].get()),
+		EZ::GetSRV(m_colors[!m_frameParity].get()),
+		EZ::GetSRV(m_densities[!m_frameParity].get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+	if (isMacCormack)
+	{
+		const EZ::ResourceView predictionSrvs[] =
+		{
+			EZ::GetSRV(m_predictedVelocity.get()),
+			EZ::GetSRV(m_predictedColor.get()),
+			EZ::GetSRV(m_predictedDensity.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 3,
+			static_cast<uint32_t>(size(predictionSrvs)), predictionSrvs);
+	}
+
+	// Set sampler
+	const auto sampler = SamplerPreset::LINEAR_CLAMP;
+	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
+
+	if (m_isSparse)
+	{
+		// Only the active bricks, marking those left busy for the next build
+		const auto brickSrv = EZ::GetSRV(m_activeBricks[m_frameParity].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, isMacCormack ? 6 : 3, 1, &brickSrv);
+		const auto brickUav = EZ::GetUAV(m_brickMasks[m_frameParity].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 3, 1, &brickUav);
+		pCommandList->DispatchIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+	}
+	else pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+}
+
+void FluidEZ::project(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// External pressure solve; the Jacobi modes solve inside the projection shader, unless at a
+	// coarse pressure level
+	const auto isAdaptive = m_projectionMode == PROJECT_JACOBI_ADAPTIVE;
+	const auto isJacobi = m_projectionMode == PROJECT_JACOBI || isAdaptive;
+	const auto pressureLevel = GetPressureLevel();
+	const auto isProject = isJacobi && pressureLevel == 0;
+	if (!isProject && m_timeStep > 0.0f)
+	{
+		computeDivergence(pCommandList);
+
+		// A coarse level solves for the correction of the restricted residual, warm-started by the
+		// previous pressure, and adds its trilinear upsampling back; Jacobi relaxes red-black there
+		for (uint8_t i = 0; i < pressureLevel; ++i) restrictResidual(pCommandList, i);
+		if (m_projectionMode == PROJECT_DCT) solveSpectral(pCommandList);
+		else if (m_projectionMode == PROJECT_PCG) solvePCG(pCommandList, frameIndex);
+		else if (isJacobi) smooth(pCommandList, pressureLevel, isAdaptive ? m_numIterations : g_numJacobiIterations);
+		else if (m_projectionMode == PROJECT_SOR) smooth(pCommandList, pressureLevel, g_sorNumSweeps, true);
+		else multigrid(pCommandList, pressureLevel, m_projectionMode == PROJECT_MULTIGRID_F);
+		for (auto i = pressureLevel; i > 0; --i) prolong(pCommandList, i - 1);
+	}
+
+	// Set pipeline state
+	if (isProject) pCommandList->SetComputeShader(m_shaders[m_gridSize.z > 1 ? CS_PROJECT_3D : CS_PROJECT_2D]);
+	else pCommandList->SetComputeShader(m_shaders[m_gridSize.z > 1 ? CS_SUBTRACT_GRADIENT_3D : CS_SUBTRACT_GRADIENT_2D]);
+
+	// Set UAVs
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_velocities[0].get()),
+		EZ::GetUAV(m_incompress.get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set CBV
+	const auto cbv = EZ::GetCBV(m_cbSimulation.get(), frameIndex);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+	// Set SRV
+	const auto srv = EZ::GetSRV(m_velocities[1].get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+	XMUINT3 numGroups;
+	if (m_gridSize.z > 1) // optimized for 3D
+	{
+		numGroups.x = XUSG_DIV_UP(m_gridSize.x, 4);
+		numGroups.y = XUSG_DIV_UP(m_gridSize.y, 4);
+		numGroups.z = XUSG_DIV_UP(m_gridSize.z, 4);
+	}
+	else
+	{
+		numGroups.x = XUSG_DIV_UP(m_gridSize.x, 8);
+		numGroups.y = XUSG_DIV_UP(m_gridSize.y, 8);
+		numGroups.z = m_gridSize.z;
+	}
+
+	pCommandList->Dispatch(numGroups.x, numGroups.y, numGroups.z);
+}
+
+void FluidEZ::computeDivergence(EZ::CommandList* pCommandList)
+{
+	// Divergence, with the partial means of the thread groups
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_DIVERGENCE]);
+
+		// Set UAVs
+		const EZ::ResourceView uavs[] =
+		{
+			EZ::GetUAV(m_divergence.get()),
+			EZ::GetUAV(m_partialMeans.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_velocities[1].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Mean reduction
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_REDUCE_MEAN]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_divergenceMean.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_partialMeans.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Mean removal, since pure Neumann boundaries only admit a zero-mean divergence
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_REMOVE_MEAN]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_divergence.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_divergenceMean.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+}
+
+void FluidEZ::multigrid(EZ::CommandList* pCommandList, uint8_t level, bool isFCycle)
+{
+	if (level >= m_coarseIncompress.size())
+	{
+		smooth(pCommandList, level, g_mgNumCoarsestSweeps);
+		return;
+	}
+
+	smooth(pCommandList, level, g_mgNumPreSweeps);
+	restrictResidual(pCommandList, level);
+
+	// An F-cycle recurses with an F-cycle followed by a V-cycle
+	multigrid(pCommandList, level + 1, isFCycle);
+	if (isFCycle) multigrid(pCommandList, level + 1, false);
+
+	prolong(pCommandList, level);
+	smooth(pCommandList, level, g_mgNumPostSweeps);
+}
+
+void FluidEZ::smooth(EZ::CommandList* pCommandList, uint8_t level, uint32_t numSweeps, bool overRelax)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+	const auto pDivergence = level > 0 ? m_coarseDivergence[level - 1].get() : m_divergence.get();
+
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_SMOOTH]);
+
+	// Set UAV
+	const auto uav = EZ::GetUAV(pIncompress);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+	// Set SRV
+	const auto srv = EZ::GetSRV(pDivergence);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+	// Red-black Gauss-Seidel (or SOR) sweeps
+	for (auto i = 0u; i < numSweeps; ++i)
+	{
+		for (uint8_t color = 0; color < 2; ++color)
+		{
+			// Set CBV
+			const auto cbv = EZ::GetCBV(m_cbSmooth.get(), overRelax ? color + 2 : color);
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+			pCommandList->Dispatch(XUSG_DIV_UP(pIncompress->GetWidth(), 8),
+				XUSG_DIV_UP(pIncompress->GetHeight(), 8), pIncompress->GetDepth());
+		}
+	}
+}
+
+void FluidEZ::restrictResidual(EZ::CommandList* pCommandList, uint8_t level)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+	const auto pDivergence = level > 0 ? m_coarseDivergence[level - 1].get() : m_divergence.get();
+	const auto pCoarseIncompress = m_coarseIncompress[level].get();
+
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_RESTRICT]);
+
+	// Set UAVs
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_coarseDivergence[level].get()),
+		EZ::GetUAV(pCoarseIncompress)
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set SRVs
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(pIncompress),
+		EZ::GetSRV(pDivergence)
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(pCoarseIncompress->GetWidth(), 8),
+		XUSG_DIV_UP(pCoarseIncompress->GetHeight(), 8), pCoarseIncompress->GetDepth());
+}
+
+void FluidEZ::prolong(EZ::CommandList* pCommandList, uint8_t level)
+{
+	const auto pIncompress = level > 0 ? m_coarseIncompress[level - 1].get() : m_incompress.get();
+
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_PROLONG]);
+
+	// Set UAV
+	const auto uav = EZ::GetUAV(pIncompress);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+	// Set SRV
+	const auto srv = EZ::GetSRV(m_coarseIncompress[level].get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(pIncompress->GetWidth(), 8),
+		XUSG_DIV_UP(pIncompress->GetHeight(), 8), pIncompress->GetDepth());
+}
+
+void FluidEZ::solveSpectral(EZ::CommandList* pCommandList)
+{
+	uint8_t axes[3];
+	uint8_t numAxes = 0;
+	for (uint8_t i = 0; i < 3; ++i) if ((&m_gridSize.x)[i] > 1) axes[numAxes++] = i;
+
+	// Forward transforms, the solve, and inverse transforms, alternating between the
+	// divergence and the spectrum; the odd pass count ends on the divergence
+	const uint8_t numPasses = numAxes * 2 + 1;
+	for (uint8_t i = 0; i < numPasses; ++i)
+	{
+		const auto isLast = i + 1 >= numPasses;
+		const auto pSource = i & 1 ? m_spectrum.get() : m_divergence.get();
+		const auto pDest = isLast ? m_incompress.get() : (i & 1 ? m_divergence.get() : m_spectrum.get());
+
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[i == numAxes ? CS_SPECTRAL_SOLVE : CS_COSINE_TRANSFORM]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(pDest);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(pSource);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		if (i == numAxes) pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+		else
+		{
+			const auto isInverse = i > numAxes;
+			const auto axis = axes[isInverse ? numPasses - 1 - i : i];
+
+			// Set CBV
+			const auto cbv = EZ::GetCBV(m_cbCosineTransform.get(), (isInverse ? 3 : 0) + axis);
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+			// One thread group per line
+			const auto numLines = axis > 0 ? (axis > 1 ? XMUINT2(m_gridSize.x, m_gridSize.y) :
+				XMUINT2(m_gridSize.x, m_gridSize.z)) : XMUINT2(m_gridSize.y, m_gridSize.z);
+			pCommandList->Dispatch(numLines.x, numLines.y, 1);
+		}
+	}
+}
+
+void FluidEZ::solvePCG(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto pCbData = static_cast<CBPCGReduce*>(m_cbPCGReduce->Map(frameIndex * 3 + i));
+		pCbData->NumGroups = XMUINT3(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+		pCbData->Stage = i;
+		pCbData->Tolerance = m_pcgTolerance;
+	}
+
+	// Initial residual from the previous pressure
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_PCG_RESIDUAL]);
+
+		// Set UAVs
+		const EZ::ResourceView uavs[] =
+		{
+			EZ::GetUAV(m_pcgResidual.get()),
+			EZ::GetUAV(m_pcgDirections[0].get()),
+			EZ::GetUAV(m_partialSums.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+		// Set SRVs
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_divergence.get()),
+			EZ::GetSRV(m_incompress.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	reducePCG(pCommandList, frameIndex, 0);
+
+	// The whole budget is recorded; the passes after convergence are dispatched indirectly
+	// with no thread groups, leaving the single-group reductions
+	for (auto i = 0u; i < m_pcgMaxIterations; ++i)
+	{
+		const uint8_t parity = i & 1;
+
+		// Search direction and q = K p
+		{
+			// Set pipeline state
+			pCommandList->SetComputeShader(m_shaders[CS_PCG_APPLY]);
+
+			// Set UAVs
+			const EZ::ResourceView uavs[] =
+			{
+				EZ::GetUAV(m_pcgDirections[!parity].get()),
+				EZ::GetUAV(m_pcgKDirection.get()),
+				EZ::GetUAV(m_partialSums.get())
+			};
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+			// Set SRVs
+			const EZ::ResourceView srvs[] =
+			{
+				EZ::GetSRV(m_pcgResidual.get()),
+				EZ::GetSRV(m_pcgDirections[parity].get()),
+				EZ::GetSRV(m_pcgState.get())
+			};
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+			pCommandList->DispatchIndirect(m_commandLayout.get(), 1, m_pcgDispatchArgs.get());
+		}
+
+		reducePCG(pCommandList, frameIndex, 1);
+
+		// Step along the search direction
+		{
+			// Set pipeline state
+			pCommandList->SetComputeShader(m_shaders[CS_PCG_UPDATE]);
+
+			// Set UAVs
+			const EZ::ResourceView uavs[] =
+			{
+				EZ::GetUAV(m_incompress.get()),
+				EZ::GetUAV(m_pcgResidual.get()),
+				EZ::GetUAV(m_partialSums.get())
+			};
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+			// Set SRVs
+			const EZ::ResourceView srvs[] =
+			{
+				EZ::GetSRV(m_pcgDirections[!parity].get()),
+				EZ::GetSRV(m_pcgKDirection.get()),
+				EZ::GetSRV(m_pcgState.get())
+			};
+			pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+			pCommandList->DispatchIndirect(m_commandLayout.get(), 1, m_pcgDispatchArgs.get());
+		}
+
+		reducePCG(pCommandList, frameIndex, 2);
+	}
+
+	// Copy the scalars to this frame's readback slot
+	pCommandList->CopyBufferRegion(m_pcgReadback.get(), sizeof(PCGState) * frameIndex,
+		m_pcgState.get(), 0, sizeof(PCGState));
+}
+
+void FluidEZ::reducePCG(EZ::CommandList* pCommandList, uint8_t frameIndex, uint8_t stage)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_PCG_REDUCE]);
+
+	// Set CBV
+	const auto cbv = EZ::GetCBV(m_cbPCGReduce.get(), frameIndex * 3 + stage);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+	// Set UAVs
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_pcgState.get()),
+		EZ::GetUAV(m_pcgDispatchArgs.get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set SRV
+	const auto srv = EZ::GetSRV(m_partialSums.get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+	pCommandList->Dispatch(1, 1, 1);
+}
+
+void FluidEZ::measureResidual(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Partial sums of the residual per thread group
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_RESIDUAL_NORM]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_partialSums.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRVs
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_velocities[1].get()),
+			EZ::GetSRV(m_incompress.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Sum reduction
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_REDUCE_SUMS]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_residualSums.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_partialSums.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Copy the sums to this frame's readback slot, without waiting for them
+	pCommandList->CopyBufferRegion(m_residualReadback.get(), sizeof(XMFLOAT4) * frameIndex,
+		m_residualSums.get(), 0, sizeof(XMFLOAT4));
+	m_pendingResiduals |= 1 << frameIndex;
+}
+
+void FluidEZ::measureSpeed(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Partial maxima of the projected velocity per thread group
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_MAX_SPEED]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_partialSums.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_velocities[0].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 8), XUSG_DIV_UP(m_gridSize.y, 8), m_gridSize.z);
+	}
+
+	// Max reduction
+	{
+		// Set pipeline state
+		pCommandList->SetComputeShader(m_shaders[CS_REDUCE_MAX]);
+
+		// Set UAV
+		const auto uav = EZ::GetUAV(m_maxSpeed.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		// Set SRV
+		const auto srv = EZ::GetSRV(m_partialSums.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		pCommandList->Dispatch(1, 1, 1);
+	}
+
+	// Copy the maxima to this frame's readback slot, without waiting for them
+	pCommandList->CopyBufferRegion(m_speedReadback.get(), sizeof(XMFLOAT4) * frameIndex,
+		m_maxSpeed.get(), 0, sizeof(XMFLOAT4));
+	m_pendingSpeeds |= 1 << frameIndex;
+}
+
+void FluidEZ::buildBricks(EZ::CommandList* pCommandList)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_BUILD_BRICKS]);
+
+	// Set UAVs; the build resets the count of the next one, and the bricks it drops take the
+	// projected velocity
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_brickMasks[m_frameParity].get()),
+		EZ::GetUAV(m_idleSteps.get()),
+		EZ::GetUAV(m_activeBricks[m_frameParity].get()),
+		EZ::GetUAV(m_dispatchArgs[m_frameParity].get()),
+		EZ::GetUAV(m_dispatchArgs[!m_frameParity].get()),
+		EZ::GetUAV(m_velocities[1].get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set CBV
+	const auto cbv = EZ::GetCBV(m_cbBricks.get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, 1, &cbv);
+
+	// Set SRVs of the marks of the last advection and the projected velocity
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(m_brickMasks[!m_frameParity].get()),
+		EZ::GetSRV(m_velocities[0].get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	pCommandList->Dispatch(XUSG_DIV_UP(brickGridSize.x * brickGridSize.y * brickGridSize.z, 64), 1, 1);
+}
+
+void FluidEZ::quantizeDensity(EZ::CommandList* pCommandList)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_QUANTIZE_DENSITY]);
+
+	// Set UAVs
+	const EZ::ResourceView uavs[] =
+	{
+		EZ::GetUAV(m_quantizedDensity.get()),
+		EZ::GetUAV(m_densityRanges.get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set SRV of the rendered frame
+	const auto srv = EZ::GetSRV(m_densities[m_frameParity].get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+	// One thread group per brick
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	pCommandList->Dispatch(brickGridSize.x, brickGridSize.y, brickGridSize.z);
+}
+
+void FluidEZ::buildDensityPyramid(EZ::CommandList* pCommandList)
+{
+	const uint8_t numLevels = m_densityPyramid->GetNumMips();
+
+	// Level 0, one thread group per brick
+	pCommandList->SetComputeShader(m_shaders[CS_DENSITY_PYRAMID]);
+	{
+		const auto uav = EZ::GetUAV(m_densityPyramid.get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_quantizedDensity.get()),
+			EZ::GetSRV(m_densityRanges.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+	}
+
+	const auto brickGridSize = GetBrickGridSize(m_gridSize);
+	pCommandList->Dispatch(brickGridSize.x, brickGridSize.y, brickGridSize.z);
+
+	// Coarser levels, each of the one below
+	pCommandList->SetComputeShader(m_shaders[CS_DENSITY_PYRAMID_MIP]);
+	for (uint8_t i = 1; i < numLevels; ++i)
+	{
+		const auto uav = EZ::GetUAV(m_densityPyramid.get(), i);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		const auto srv = EZ::GetSRV(m_densityPyramid.get(), i - 1, true);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		const auto width = (max)(brickGridSize.x >> i, 1u);
+		const auto height = (max)(brickGridSize.y >> i, 1u);
+		const auto depth = (max)(brickGridSize.z >> i, 1u);
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 4), XUSG_DIV_UP(height, 4), XUSG_DIV_UP(depth, 4));
+	}
+}
+
+void FluidEZ::generateDensityMips(EZ::CommandList* pCommandList)
+{
+	const uint8_t numLevels = m_densityMips->GetNumMips();
+
+	// Each level of the one below, the first of the density of the rendered frame
+	pCommandList->SetComputeShader(m_shaders[CS_DENSITY_MIP]);
+	for (uint8_t i = 0; i < numLevels; ++i)
+	{
+		const auto uav = EZ::GetUAV(m_densityMips.get(), i);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+		const auto srv = i > 0 ? EZ::GetSRV(m_densityMips.get(), i - 1, true) : EZ::GetSRV(m_densities[m_frameParity].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
+
+		const auto width = (max)(m_gridSize.x >> (i + 1), 1u);
+		const auto height = (max)(m_gridSize.y >> (i + 1), 1u);
+		const auto depth = (max)(m_gridSize.z >> (i + 1), 1u);
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 4), XUSG_DIV_UP(height, 4), XUSG_DIV_UP(depth, 4));
+	}
+}
+
+void FluidEZ::computeDensityGradient(EZ::CommandList* pCommandList)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_DENSITY_GRADIENT]);
+
+	// Set UAV
+	const auto uav = EZ::GetUAV(m_densityGradient.get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+	// Set SRVs
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(m_quantizedDensity.get()),
+		EZ::GetSRV(m_densityRanges.get())
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+	pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize.x, 4), XUSG_DIV_UP(m_gridSize.y, 4), XUSG_DIV_UP(m_gridSize.z, 4));
+}
+
+void FluidEZ::computeAmbient(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_AMBIENT]);
+
+	// Set UAV
+	const auto uav = EZ::GetUAV(m_ambientVolume.get());
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+
+	// Set CBVs
+	const EZ::ResourceView cbvs[] =
+	{
+		EZ::GetCBV(m_cbPerObject.get(), frameIndex),
+		EZ::GetCBV(m_cbSampleRes[CB_SAMPLE_RES_L].get(), frameIndex),
+		EZ::GetCBV(m_cbAmbientRefresh.get(), frameIndex)
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
+
+	// Set SRVs
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(m_quantizedDensity.get()),
+		EZ::GetSRV(m_densityRanges.get()),
+		EZ::GetSRV(m_densityPyramid.get()),
+		EZ::GetSRV(m_densityMips.get()),
+		m_densityGradient ? EZ::GetSRV(m_densityGradient.get()) : EZ::GetSRV(m_coeffSH.get()),
+		EZ::GetSRV(m_coeffSH.get())
+	};
+	// The gradient cache, if any, comes before the SH coefficients
+	const uint32_t numSRVs = m_densityGradient ? 6 : 5;
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, numSRVs, srvs);
+
+	// Set sampler
+	const auto sampler = SamplerPreset::LINEAR_CLAMP;
+	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
+
+	// Dispatch the slices refreshed this frame
+	pCommandList->Dispatch(XUSG_DIV_UP(m_ambientSize.x, 4), XUSG_DIV_UP(m_ambientSize.y, 4),
+		XUSG_DIV_UP(m_ambientSlices.y - m_ambientSlices.x, 4));
+}
+
 void FluidEZ::visualizeColor(EZ::CommandList* pCommandList)
 {
 	// Set pipeline state
@@ -538,9 +2052,13 @@ void FluidEZ::visualizeColor(EZ::CommandList* pCommandList)
 	pCommandList->OMSetBlendState(Graphics::PREMULTIPLITED);
 	pCommandList->DSSetState(Graphics::DEPTH_STENCIL_NONE);
 
-	// Set SRV
-	const auto srv = EZ::GetSRV(m_colors[m_frameParity].get());
-	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 0, 1, &srv);
+	// Set SRVs
+	const EZ::ResourceView srvs[] =
+	{
+		EZ::GetSRV(m_colors[m_frameParity].get()),
+		EZ::GetSRV(m_densities[m_frameParity].get())
+	};
+	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 
 	// Set sampler
 	const auto sampler = SamplerPreset::LINEAR_CLAMP;
@@ -554,9 +2072,10 @@ void FluidEZ::rayMarch(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	// Set pipeline state
 	pCommandList->SetComputeShader(m_shaders[CS_RAY_MARCH]);
 
-	// Set UAV
-	const auto uav = EZ::GetUAV(m_cubeMap.get(), m_cubeMapLOD);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+	// Set UAVs of all the mips, each face writing its own LOD
+	EZ::ResourceView uavs[NUM_CUBE_MAP_MIPS];
+	for (uint8_t i = 0; i < NUM_CUBE_MAP_MIPS; ++i) uavs[i] = EZ::GetUAV(m_cubeMaps[m_cubeMapParity].get(), i);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
 
 	// Set CBVs
 	const EZ::ResourceView cbvs[] =
@@ -567,33 +2086,40 @@ void FluidEZ::rayMarch(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	};
 	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
 
-#if _CPU_CUBE_FACE_CULL_ == 1
-	const auto cbv = EZ::GetCBV(m_cbCubeFaceCull.get(), frameIndex);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#if _CPU_CUBE_FACE_CULL_ == 2
 	const auto cbv = EZ::GetCBV(m_cbCubeFaceList.get(), frameIndex);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
+#else
+	const auto cbv = EZ::GetCBV(m_cbCubeFaceCull.get(), frameIndex);
 #endif
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
 
-	// Set SRVs
-	{
-		const auto srv = EZ::GetSRV(m_colors[m_frameParity].get());
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, 1, &srv);
-	}
+	const auto cbvCheckerboard = EZ::GetCBV(m_cbCheckerboard.get(), frameIndex);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)) + 1, 1,
+		&cbvCheckerboard);
 
-	if (m_coeffSH)
+	// Set SRVs
 	{
-		const auto srv = EZ::GetSRV(m_coeffSH.get());
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 1, 1, &srv);
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_quantizedDensity.get()),
+			EZ::GetSRV(m_densityRanges.get()),
+			EZ::GetSRV(m_densityPyramid.get()),
+			EZ::GetSRV(m_densityMips.get()),
+			EZ::GetSRV(m_colors[m_frameParity].get()),
+			EZ::GetSRV(m_ambientVolume.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 	}
 
 	// Set sampler
 	const auto sampler = SamplerPreset::LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
 
-	// Dispatch cube
+	// Dispatch cube, over the texels of this phase only
 	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
-	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), m_cubeFaceCount);
+	const auto interleave = m_checkerboard.Interleave;
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, interleave > 1 ? 16 : 8),
+		XUSG_DIV_UP(gridSize, interleave > 2 ? 16 : 8), m_cubeFaceCount);
 }
 
 void FluidEZ::rayMarchL(EZ::CommandList* pCommandList, uint8_t frameIndex)
@@ -610,7 +2136,8 @@ void FluidEZ::rayMarchL(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	{
 		EZ::GetCBV(m_cbPerObject.get(), frameIndex),
 		EZ::GetCBV(m_cbPerFrame.get(), frameIndex),
-		EZ::GetCBV(m_cbSampleRes[CB_SAMPLE_RES_L].get(), frameIndex)
+		EZ::GetCBV(m_cbSampleRes[CB_SAMPLE_RES_L].get(), frameIndex),
+		EZ::GetCBV(m_cbLightMapRefresh.get(), frameIndex)
 	};
 	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
 
@@ -618,24 +2145,85 @@ void FluidEZ::rayMarchL(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	{
 		const EZ::ResourceView srvs[] =
 		{
-			EZ::GetSRV(m_colors[m_frameParity].get()),
-			EZ::GetSRV(m_nullBuffer.get()) // Workaround for Tier 2 GPUs
+			EZ::GetSRV(m_quantizedDensity.get()),
+			EZ::GetSRV(m_densityRanges.get()),
+			EZ::GetSRV(m_densityPyramid.get()),
+			EZ::GetSRV(m_densityMips.get()),
+			EZ::GetSRV(m_ambientVolume.get())
 		};
 		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 	}
 
-	if (m_coeffSH)
+	// Set sampler
+	const auto sampler = SamplerPreset::LINEAR_CLAMP;
+	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
+
+	// Dispatch the slices refreshed this frame, or the bricks of the last step only, since the
+	// others hold no density
+	if (m_isSparse)
+	{
+		const auto brickSrv = EZ::GetSRV(m_activeBricks[m_frameParity].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 5, 1, &brickSrv);
+		pCommandList->DispatchIndirect(m_commandLayout.get(), 1, m_dispatchArgs[m_frameParity].get());
+	}
+	else pCommandList->Dispatch(XUSG_DIV_UP(m_lightMapSize.x, 4), XUSG_DIV_UP(m_lightMapSize.y, 4),
+		XUSG_DIV_UP(m_lightMapSlices.y - m_lightMapSlices.x, 4));
+}
+
+void FluidEZ::sweepLight(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_LIGHT_SWEEP]);
+
+	// Set CBVs
+	const EZ::ResourceView cbvs[] =
+	{
+		EZ::GetCBV(m_cbPerObject.get(), frameIndex),
+		EZ::GetCBV(m_cbPerFrame.get(), frameIndex),
+		EZ::GetCBV(m_cbSampleRes[CB_SAMPLE_RES_L].get(), frameIndex)
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
+
+	// Set SRVs
 	{
-		const auto srv = EZ::GetSRV(m_coeffSH.get());
-		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 1, 1, &srv);
+		const EZ::ResourceView srvs[] =
+		{
+			EZ::GetSRV(m_quantizedDensity.get()),
+			EZ::GetSRV(m_densityRanges.get()),
+			EZ::GetSRV(m_ambientVolume.get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 	}
 
 	// Set sampler
 	const auto sampler = SamplerPreset::LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
 
-	// Dispatch grid
-	pCommandList->Dispatch(XUSG_DIV_UP(m_lightMapSize.x, 4), XUSG_DIV_UP(m_lightMapSize.y, 4), XUSG_DIV_UP(m_lightMapSize.z, 4));
+	// One dispatch per slice away from the light, each taking the transmittance of the one before
+	const uint32_t lightMapSize[] = { m_lightMapSize.x, m_lightMapSize.y, m_lightMapSize.z };
+	const auto numSlices = lightMapSize[m_sweepAxis];
+	const auto width = lightMapSize[(m_sweepAxis + 1) % 3];
+	const auto height = lightMapSize[(m_sweepAxis + 2) % 3];
+	const auto sliceSize = static_cast<uint32_t>(m_sweepSlices[0]->GetWidth());
+	const auto cbBase = (m_sweepAxis * 2u + (m_isSweepFromMax ? 1 : 0)) * sliceSize;
+	for (auto i = 0u; i < numSlices; ++i)
+	{
+		const uint8_t slot = i & 1;
+		const auto cbv = EZ::GetCBV(m_cbLightSweep.get(), cbBase + i);
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 3, 1, &cbv);
+
+		const auto srv = EZ::GetSRV(m_sweepSlices[!slot].get());
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 3, 1, &srv);
+
+		const EZ::ResourceView uavs[] =
+		{
+			EZ::GetUAV(m_lightMap.get()),
+			EZ::GetUAV(m_sweepSlices[slot].get())
+		};
+		pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+		pCommandList->Dispatch(XUSG_DIV_UP(width, 8), XUSG_DIV_UP(height, 8), 1);
+	}
 }
 
 void FluidEZ::rayMarchV(EZ::CommandList* pCommandList, uint8_t frameIndex)
@@ -643,9 +2231,10 @@ void FluidEZ::rayMarchV(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	// Set pipeline state
 	pCommandList->SetComputeShader(m_shaders[CS_RAY_MARCH_V]);
 
-	// Set UAV
-	const auto uav = EZ::GetUAV(m_cubeMap.get(), m_cubeMapLOD);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, 1, &uav);
+	// Set UAVs of all the mips, each face writing its own LOD
+	EZ::ResourceView uavs[NUM_CUBE_MAP_MIPS];
+	for (uint8_t i = 0; i < NUM_CUBE_MAP_MIPS; ++i) uavs[i] = EZ::GetUAV(m_cubeMaps[m_cubeMapParity].get(), i);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
 
 	// Set CBVs
 	const EZ::ResourceView cbvs[] =
@@ -656,17 +2245,23 @@ void FluidEZ::rayMarchV(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	};
 	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
 
-#if _CPU_CUBE_FACE_CULL_ == 1
-	const auto cbv = EZ::GetCBV(m_cbCubeFaceCull.get(), frameIndex);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
-#elif _CPU_CUBE_FACE_CULL_ == 2
+#if _CPU_CUBE_FACE_CULL_ == 2
 	const auto cbv = EZ::GetCBV(m_cbCubeFaceList.get(), frameIndex);
-	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
+#else
+	const auto cbv = EZ::GetCBV(m_cbCubeFaceCull.get(), frameIndex);
 #endif
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)), 1, &cbv);
+
+	const auto cbvCheckerboard = EZ::GetCBV(m_cbCheckerboard.get(), frameIndex);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, static_cast<uint32_t>(size(cbvs)) + 1, 1,
+		&cbvCheckerboard);
 
 	// Set SRVs
 	const EZ::ResourceView srvs[] =
 	{
+		EZ::GetSRV(m_quantizedDensity.get()),
+		EZ::GetSRV(m_densityRanges.get()),
+		EZ::GetSRV(m_densityPyramid.get()),
 		EZ::GetSRV(m_colors[m_frameParity].get()),
 		EZ::GetSRV(m_lightMap.get())
 	};
@@ -676,9 +2271,44 @@ void FluidEZ::rayMarchV(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	const auto sampler = SamplerPreset::LINEAR_CLAMP;
 	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
 
-	// Dispatch cube
+	// Dispatch cube, over the texels of this phase only
+	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
+	const auto interleave = m_checkerboard.Interleave;
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, interleave > 1 ? 16 : 8),
+		XUSG_DIV_UP(gridSize, interleave > 2 ? 16 : 8), m_cubeFaceCount);
+}
+
+void FluidEZ::reconstructCube(EZ::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set pipeline state
+	pCommandList->SetComputeShader(m_shaders[CS_CUBE_RECONSTRUCT]);
+
+	// Set UAVs of all the mips, each face writing its own LOD
+	EZ::ResourceView uavs[NUM_CUBE_MAP_MIPS];
+	for (uint8_t i = 0; i < NUM_CUBE_MAP_MIPS; ++i) uavs[i] = EZ::GetUAV(m_cubeMaps[m_cubeMapParity].get(), i);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::UAV, 0, static_cast<uint32_t>(size(uavs)), uavs);
+
+	// Set CBVs
+	const EZ::ResourceView cbvs[] =
+	{
+		EZ::GetCBV(m_cbPerObject.get(), frameIndex),
+		EZ::GetCBV(m_cbPerFrame.get(), frameIndex),
+		EZ::GetCBV(m_cbCheckerboard.get(), frameIndex)
+	};
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
+
+	// Set SRVs of all the mips of the history, each face sampling its LOD then
+	EZ::ResourceView srvs[NUM_CUBE_MAP_MIPS];
+	for (uint8_t i = 0; i < NUM_CUBE_MAP_MIPS; ++i) srvs[i] = EZ::GetSRV(m_cubeMaps[!m_cubeMapParity].get(), i);
+	pCommandList->SetResources(Shader::Stage::CS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
+
+	// Set sampler
+	const auto sampler = SamplerPreset::LINEAR_CLAMP;
+	pCommandList->SetSamplerStates(Shader::Stage::CS, 0, 1, &sampler);
+
+	// Dispatch all faces, each skipping the texels marched this frame
 	const auto gridSize = m_gridSize.x >> m_cubeMapLOD;
-	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), m_cubeFaceCount);
+	pCommandList->Dispatch(XUSG_DIV_UP(gridSize, 8), XUSG_DIV_UP(gridSize, 8), 6);
 }
 
 void FluidEZ::renderCube(EZ::CommandList* pCommandList, uint8_t frameIndex)
@@ -691,21 +2321,23 @@ void FluidEZ::renderCube(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	pCommandList->DSSetState(Graphics::DEPTH_STENCIL_NONE);
 	pCommandList->OMSetBlendState(Graphics::PREMULTIPLITED);
 
-	// Set CBVs
+	// Set CBVs, the face LODs leading the face-culling constants
 	const EZ::ResourceView cbvs[] =
 	{
 		EZ::GetCBV(m_cbPerObject.get(), frameIndex),
 		EZ::GetCBV(m_cbPerFrame.get(), frameIndex),
-		EZ::GetCBV(m_cbSampleRes[CB_SAMPLE_RES].get(), frameIndex)
+#if _CPU_CUBE_FACE_CULL_ == 2
+		EZ::GetCBV(m_cbCubeFaceList.get(), frameIndex)
+#else
+		EZ::GetCBV(m_cbCubeFaceCull.get(), frameIndex)
+#endif
 	};
 	pCommandList->SetResources(Shader::Stage::VS, DescriptorType::CBV, 0, 1, cbvs);
 	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
 
-	// Set SRVs
-	const EZ::ResourceView srvs[] =
-	{
-		EZ::GetSRV(m_cubeMap.get(), m_cubeMapLOD)
-	};
+	// Set SRVs of all the mips, each face sampling its own LOD
+	EZ::ResourceView srvs[NUM_CUBE_MAP_MIPS];
+	for (uint8_t i = 0; i < NUM_CUBE_MAP_MIPS; ++i) srvs[i] = EZ::GetSRV(m_cubeMaps[m_cubeMapParity].get(), i);
 	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 
 	// Set sampler
@@ -736,14 +2368,16 @@ void FluidEZ::rayCastDirect(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::CBV, 0, static_cast<uint32_t>(size(cbvs)), cbvs);
 
 	// Set SRVs
-	const auto srv = EZ::GetSRV(m_colors[m_frameParity].get());
-	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 0, 1, &srv);
-
-	if (m_coeffSH)
+	const EZ::ResourceView srvs[] =
 	{
-		const auto srv = EZ::GetSRV(m_coeffSH.get());
-		pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 1, 1, &srv);
-	}
+		EZ::GetSRV(m_quantizedDensity.get()),
+		EZ::GetSRV(m_densityRanges.get()),
+		EZ::GetSRV(m_densityPyramid.get()),
+		EZ::GetSRV(m_densityMips.get()),
+		EZ::GetSRV(m_colors[m_frameParity].get()),
+		EZ::GetSRV(m_ambientVolume.get())
+	};
+	pCommandList->SetResources(Shader::Stage::PS, DescriptorType::SRV, 0, static_cast<uint32_t>(size(srvs)), srvs);
 
 	// Set sampler
 	const auto sampler = SamplerPreset::LINEAR_CLAMP;
@@ -773,6 +2407,9 @@ void FluidEZ::rayCastVDirect(EZ::CommandList* pCommandList, uint8_t frameIndex)
 	// Set SRVs
 	const EZ::ResourceView srvs[] =
 	{
+		EZ::GetSRV(m_quantizedDensity.get()),
+		EZ::GetSRV(m_densityRanges.get()),
+		EZ::GetSRV(m_densityPyramid.get()),
 		EZ::GetSRV(m_colors[m_frameParity].get()),
 		EZ::GetSRV(m_lightMap.get())
 	};
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+static const uint	g_brickSize = 8;
+static const float	g_activeDensity = 1.0 / 256.0;	// Mirrored in FluidCPU
+static const float	g_activeSpeed = 1.0e-2;
+static const uint	g_maxIdleSteps = 2;			// Quiet steps before a brick is skipped
+
+//--------------------------------------------------------------------------------------
+// Bricks of 8x8x8 cells (8x8x1 in 2D), indexed linearly x first
+//--------------------------------------------------------------------------------------
+uint3 GetBrickExtent(uint3 gridSize)
+{
+	return uint3(g_brickSize, g_brickSize, gridSize.z > 1 ? g_brickSize : 1);
+}
+
+uint3 GetBrickGridSize(uint3 gridSize)
+{
+	const uint3 extent = GetBrickExtent(gridSize);
+
+	return (gridSize + extent - 1) / extent;
+}
+
+uint GetBrickIndex(uint3 cell, uint3 gridSize)
+{
+	const uint3 brick = cell / GetBrickExtent(gridSize);
+	const uint3 brickGridSize = GetBrickGridSize(gridSize);
+
+	return brick.x + brickGridSize.x * (brick.y + brickGridSize.y * brick.z);
+}
+
+//--------------------------------------------------------------------------------------
+// Cell of a thread in an indirect dispatch over the active bricks: the group Y is the
+// slot in the brick list, and the group X the sub-group within the brick
+//--------------------------------------------------------------------------------------
+uint3 GetBrickCell(uint brickIndex, uint subGroup, uint3 GTid, uint3 groupSize, uint3 gridSize)
+{
+	const uint3 extent = GetBrickExtent(gridSize);
+	const uint3 brickGridSize = GetBrickGridSize(gridSize);
+	const uint3 brick = uint3(brickIndex % brickGridSize.x, brickIndex / brickGridSize.x % brickGridSize.y,
+		brickIndex / (brickGridSize.x * brickGridSize.y));
+
+	const uint3 n = max(extent / groupSize, 1);
+	const uint3 group = uint3(subGroup % n.x, subGroup / n.x % n.y, subGroup / (n.x * n.y));
+
+	return brick * extent + group * groupSize + GTid;
+}
@@ -4,6 +4,9 @@
 
 #include "Simulation.hlsli"
 #include "Impulse.hlsli"
+#ifdef _SPARSE_
+#include "Brick.hlsli"
+#endif
 
 //--------------------------------------------------------------------------------------
 // Constants
@@ -17,10 +20,27 @@ static const float	g_dissipation = 0.2;
 // Textures
 //--------------------------------------------------------------------------------------
 RWTexture3D<float3> g_rwVelocity;
-RWTexture3D<float4>	g_rwColor;
+RWTexture3D<float3>	g_rwColor;		// Albedo, unpremultiplied
+RWTexture3D<float>	g_rwDensity;
 
 Texture3D<float3>	g_txVelocity;
-Texture3D			g_txColor;
+Texture3D<float3>	g_txColor;
+Texture3D<float>	g_txDensity;
+#ifdef _MACCORMACK_
+Texture3D<float3>	g_txVelocityP;	// Predicted by the forward semi-Lagrangian pass
+Texture3D<float3>	g_txColorP;
+Texture3D<float>	g_txDensityP;
+#endif
+
+#ifdef _SPARSE_
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+StructuredBuffer<uint>		g_roActiveBricks;
+#ifndef _PREDICTOR_
+RWStructuredBuffer<uint>	g_rwBrickMask;	// Bricks left busy, for the next build
+#endif
+#endif
 
 //--------------------------------------------------------------------------------------
 // Sampler
@@ -35,45 +55,256 @@ float Gaussian(float3 disp, float r)
 	return exp(-4.0 * dot(disp, disp) / (r * r));
 }
 
+//--------------------------------------------------------------------------------------
+// External force of the impulse
+//--------------------------------------------------------------------------------------
+float3 GetImpulseForce(float3 disp, float basis, float3 gridSize)
+{
+	const float3 vortForce = float3(-disp.z, 0.0, disp.x) * g_vortScl;
+	const float3 extForce = g_extForce * basis;
+
+	return gridSize.z > 1.0 ? extForce * g_forceScl3D + vortForce : extForce;
+}
+
+#ifdef _STAGGERED_
+//--------------------------------------------------------------------------------------
+// Sample a component of the staggered velocity, stored half a cell before the center
+//--------------------------------------------------------------------------------------
+float SampleFace(Texture3D<float3> txVelocity, float3 pos, float3 gridSize, uint axis)
+{
+	pos[axis] += 0.5 / gridSize[axis];
+
+	return txVelocity.SampleLevel(g_smpLinear, SimulationToTextureSpace(pos, gridSize), 0.0)[axis];
+}
+
+//--------------------------------------------------------------------------------------
+// Sample the full staggered velocity at a position
+//--------------------------------------------------------------------------------------
+float3 SampleStaggered(float3 pos, float3 gridSize)
+{
+	return float3(SampleFace(g_txVelocity, pos, gridSize, 0), SampleFace(g_txVelocity, pos, gridSize, 1),
+		SampleFace(g_txVelocity, pos, gridSize, 2));
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Texels interpolated by a linear sample at a position in texture space, mirrored at any
+// distance out of the grid as the sampler (and AddressTexel of the CPU reference) does
+//--------------------------------------------------------------------------------------
+uint3 GetFootprintTexel(float3 tex, float3 gridSize, uint i)
+{
+	const int3 period = int3(gridSize) * 2;
+	int3 t = int3(floor(tex * gridSize - 0.5)) + int3(i & 1, (i >> 1) & 1, i >> 2);
+	t %= period;
+	t = t < 0 ? t + period : t;
+
+	return uint3(t < period / 2 ? t : period - 1 - t);
+}
+
+//--------------------------------------------------------------------------------------
+// Color premultiplied by the density, from the albedo and density volumes
+//--------------------------------------------------------------------------------------
+float4 LoadColor(Texture3D<float3> txColor, Texture3D<float> txDensity, uint3 texel)
+{
+	const float density = txDensity[texel];
+
+	return float4(txColor[texel] * density, density);
+}
+
+//--------------------------------------------------------------------------------------
+// Linear sample of the premultiplied color; the texels are premultiplied before they are
+// filtered, so that the albedo of empty texels does not bleed into the smoke
+//--------------------------------------------------------------------------------------
+float4 SampleColor(Texture3D<float3> txColor, Texture3D<float> txDensity, float3 tex, float3 gridSize)
+{
+	const float3 w = frac(tex * gridSize - 0.5);
+
+	float4 color = 0.0;
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		const float3 weights = lerp(1.0 - w, w, float3(i & 1, (i >> 1) & 1, i >> 2));
+		color += LoadColor(txColor, txDensity, GetFootprintTexel(tex, gridSize, i)) * (weights.x * weights.y * weights.z);
+	}
+
+	return color;
+}
+
+#ifdef _MACCORMACK_
+// Beyond a cell per step the back-trace no longer inverts the forward trace
+static const float g_maxCorrectedCells = 1.0;
+
+//--------------------------------------------------------------------------------------
+// Whether a displacement in simulation space is short enough for the correction
+//--------------------------------------------------------------------------------------
+bool IsCorrectable(float3 disp, float3 gridSize)
+{
+	return all(abs(disp) * gridSize <= g_maxCorrectedCells);
+}
+
+//--------------------------------------------------------------------------------------
+// Limiters: a corrected value out of the range of the texels that the forward
+// semi-Lagrangian sample interpolated reverts to that sample (the prediction), so the
+// scheme creates no new extrema; clamping would pin it to the extremes instead
+//--------------------------------------------------------------------------------------
+float LimitFace(float u, float predicted, float3 tex, float3 gridSize, uint axis)
+{
+	float minU = g_txVelocity[GetFootprintTexel(tex, gridSize, 0)][axis], maxU = minU;
+	[unroll]
+	for (uint i = 1; i < 8; ++i)
+	{
+		const float texel = g_txVelocity[GetFootprintTexel(tex, gridSize, i)][axis];
+		minU = min(texel, minU);
+		maxU = max(texel, maxU);
+	}
+
+	return u < minU || u > maxU ? predicted : u;
+}
+
+float4 LimitColor(float4 color, float4 predicted, float3 tex, float3 gridSize)
+{
+	float4 minColor = LoadColor(g_txColor, g_txDensity, GetFootprintTexel(tex, gridSize, 0)), maxColor = minColor;
+	[unroll]
+	for (uint i = 1; i < 8; ++i)
+	{
+		const float4 texel = LoadColor(g_txColor, g_txDensity, GetFootprintTexel(tex, gridSize, i));
+		minColor = min(texel, minColor);
+		maxColor = max(texel, maxColor);
+	}
+
+	return color < minColor || color > maxColor ? predicted : color;
+}
+#endif
+
 //--------------------------------------------------------------------------------------
 // Compute shader of advection
 //--------------------------------------------------------------------------------------
 [numthreads(8, 8, 1)]
+#ifdef _SPARSE_
+void main(uint3 GTid : SV_GroupThreadID, uint3 Gid : SV_GroupID)
+#else
 void main(uint3 DTid : SV_DispatchThreadID)
+#endif
 {
 	// Fetch velocity field
 	float3 gridSize;
 	g_txVelocity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
-	float3 u = g_txVelocity[DTid];
 
-	// Advections
+#ifdef _SPARSE_
+	// Cell in the active brick of this group
+	const uint3 DTid = GetBrickCell(g_roActiveBricks[Gid.y], Gid.x, GTid, uint3(8, 8, 1), gridSize);
+	if (any(DTid >= gridSize)) return;
+#endif
+
 	const float timeStep = g_timeStep;
 	const float3 pos = GridToSimulationSpace(DTid, gridSize);
+	const float impulseR = gridSize.z > 1.0 ? g_impulseR : g_impulseR * 0.5;
+
+#ifdef _STAGGERED_
+	// Advect each component from its own face, with the impulse there
+	float3 u = 0.0;
+	const uint numAxes = gridSize.z > 1.0 ? 3 : 2;
+	for (uint i = 0; i < numAxes; ++i)
+	{
+		float3 facePos = pos;
+		facePos[i] -= 0.5 / gridSize[i];
+		const float3 v = SampleStaggered(facePos, gridSize);
+		float3 adv = facePos - v * timeStep;
+#ifdef _MACCORMACK_
+		// Trace the prediction back, and compensate half of its error within the forward footprint
+		const float predicted = g_txVelocityP[DTid][i];
+		u[i] = predicted;
+		if (IsCorrectable(v * timeStep, gridSize))
+		{
+			u[i] += 0.5 * (g_txVelocity[DTid][i] - SampleFace(g_txVelocityP, facePos + v * timeStep, gridSize, i));
+			adv[i] += 0.5 / gridSize[i];
+			u[i] = LimitFace(u[i], predicted, SimulationToTextureSpace(adv, gridSize), gridSize, i);
+		}
+#else
+		u[i] = SampleFace(g_txVelocity, adv, gridSize, i);
+#endif
+
+#ifndef _PREDICTOR_
+		const float3 disp = facePos - g_impulsePos;
+		const float basis = Gaussian(disp, impulseR);
+		if (basis >= exp(-4.0)) u[i] += GetImpulseForce(disp, basis, gridSize)[i] * timeStep;
+#endif
+	}
+
+	// Advect the color at the cell center
+	const float3 v = SampleStaggered(pos, gridSize);
+	const float3 adv = SimulationToTextureSpace(pos - v * timeStep, gridSize);
+#ifdef _MACCORMACK_
+	const float4 predicted = LoadColor(g_txColorP, g_txDensityP, DTid);
+	float4 color = predicted;
+	if (IsCorrectable(v * timeStep, gridSize))
+	{
+		color += 0.5 * (LoadColor(g_txColor, g_txDensity, DTid) -
+			SampleColor(g_txColorP, g_txDensityP, SimulationToTextureSpace(pos + v * timeStep, gridSize), gridSize));
+		color = LimitColor(color, predicted, adv, gridSize);
+	}
+#else
+	float4 color = SampleColor(g_txColor, g_txDensity, adv, gridSize);
+#endif
+
+#ifndef _PREDICTOR_
+	// Impulse
+	const float3 disp = pos - g_impulsePos;
+	const float basis = Gaussian(disp, impulseR);
+	if (basis >= exp(-4.0)) color = saturate(color + g_impulse * timeStep * basis);
+#endif
+#else
+	float3 u = g_txVelocity[DTid];
+
+	// Advections
 	const float3 adv = SimulationToTextureSpace(pos - u * timeStep, gridSize);
+#ifdef _MACCORMACK_
+	// Trace the predicted color back, and compensate half of its error within the forward
+	// footprint; the velocity keeps the prediction, as the collocated projection does not see
+	// the checkerboard modes that an undamped velocity grows into
+	const float4 predicted = LoadColor(g_txColorP, g_txDensityP, DTid);
+	float4 color = predicted;
+	if (IsCorrectable(u * timeStep, gridSize))
+	{
+		const float3 back = SimulationToTextureSpace(pos + u * timeStep, gridSize);
+		color = LimitColor(color + 0.5 * (LoadColor(g_txColor, g_txDensity, DTid) -
+			SampleColor(g_txColorP, g_txDensityP, back, gridSize)), predicted, adv, gridSize);
+	}
+	u = g_txVelocityP[DTid];
+#else
 	u = g_txVelocity.SampleLevel(g_smpLinear, adv, 0.0);
-	float4 color = g_txColor.SampleLevel(g_smpLinear, adv, 0.0);
+	float4 color = SampleColor(g_txColor, g_txDensity, adv, gridSize);
+#endif
 
+#ifndef _PREDICTOR_
 	// Impulse
 	const float3 disp = pos - g_impulsePos;
-	const float impulseR = gridSize.z > 1.0 ? g_impulseR : g_impulseR * 0.5;
 	float basis = Gaussian(disp, impulseR);
 	if (basis >= exp(-4.0))
 	{
 		//basis = sqrt(basis) * 0.4;
-		const float3 vortForce = float3(-disp.z, 0.0, disp.x) * g_vortScl;
-		float3 extForce = g_extForce * basis;
-		extForce = gridSize.z > 1 ? extForce * g_forceScl3D + vortForce : extForce;
-		u += extForce * timeStep;
+		u += GetImpulseForce(disp, basis, gridSize) * timeStep;
 		color = saturate(color + g_impulse * timeStep * basis);
 	}
-
-#ifndef _PRE_MULTIPLIED_
-	color.xyz = color.w > 0.0 ? color.xyz / color.w : color.xyz;
+#endif
 #endif
 
+#ifdef _PREDICTOR_
+	// Forward prediction for the MacCormack corrector, without forces and dissipation
+	const float atten = 1.0;
+#else
 	const float atten = max(1.0 - g_dissipation * timeStep, 0.0);
+#endif
+
+	// Output; the albedo is stored unpremultiplied, so only the density dissipates
+	u *= atten;
+	g_rwVelocity[DTid] = u;
+	g_rwColor[DTid] = color.w > 0.0 ? color.xyz / color.w : 0.0;
+	color.w *= atten;
+	g_rwDensity[DTid] = color.w;
 
-	// Output
-	g_rwVelocity[DTid] = u * atten;
-	g_rwColor[DTid] = color * atten;
+#if defined(_SPARSE_) && !defined(_PREDICTOR_)
+	if (color.w > g_activeDensity || any(abs(u) > g_activeSpeed))
+		g_rwBrickMask[GetBrickIndex(DTid, gridSize)] = 1;
+#endif
 }
@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _STAGGERED_
+#define _SPARSE_
+
+#include "CSAdvect.hlsl"
@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _STAGGERED_
+#define _PREDICTOR_
+
+#include "CSAdvect.hlsl"
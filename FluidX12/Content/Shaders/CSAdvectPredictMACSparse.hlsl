@@ -0,0 +1,9 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _STAGGERED_
+#define _PREDICTOR_
+#define _SPARSE_
+
+#include "CSAdvect.hlsl"
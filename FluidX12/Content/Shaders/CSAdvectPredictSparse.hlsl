@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _PREDICTOR_
+#define _SPARSE_
+
+#include "CSAdvect.hlsl"
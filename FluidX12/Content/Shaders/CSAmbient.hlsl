@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "RayMarch.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbRefresh
+{
+	uint g_sliceBegin;	// Of the ambient volume, refreshed this frame
+	uint g_sliceEnd;
+};
+
+//--------------------------------------------------------------------------------------
+// Unordered access texture
+//--------------------------------------------------------------------------------------
+RWTexture3D<float3> g_rwAmbient;
+
+//--------------------------------------------------------------------------------------
+// Buffer
+//--------------------------------------------------------------------------------------
+StructuredBuffer<float3> g_roSHCoeffs;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the ambient volume, the AO-weighted irradiance of the light probe that
+// the ray marchers filter in place of an AO ray per sample: each texel takes the irradiance
+// against the density gradient at its center, occluded by an AO ray along it where the
+// density under its filter footprint is not empty
+//--------------------------------------------------------------------------------------
+[numthreads(4, 4, 4)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 size, gridSize;
+	g_rwAmbient.GetDimensions(size.x, size.y, size.z);
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// Only the slices refreshed this frame; the others keep theirs from earlier frames
+	DTid.z += g_sliceBegin;
+	if (any(DTid >= size) || DTid.z >= g_sliceEnd) return;
+
+	const float3 pos = (DTid + 0.5) / float3(size) * 2.0 - 1.0;
+	const float3 uvw = LocalToTex3DSpace(pos);
+
+	float3 shCoeffs[SH_NUM_COEFF];
+	LoadSH(shCoeffs, g_roSHCoeffs);
+	float3 rayDir = -GetDensityGradient(uvw);
+	rayDir = any(abs(rayDir) > 0.0) ? rayDir : pos; // Avoid 0-gradient caused by uniform density field
+	const float3 irradiance = GetIrradiance(shCoeffs, normalize(mul(rayDir, (float3x3)g_world)));
+
+	min16float density;
+	if (any(size != gridSize)) density = GetFootprintMax(uvw, size, gridSize);
+	else density = GetDensity(uvw);
+
+	min16float ao = 1.0;
+	if (density >= ZERO_THRESHOLD)
+		CastLightRay(ao, pos, normalize(rayDir), g_step, g_numSamples, float2(g_lightFootprint, g_lightSpread));
+
+	g_rwAmbient[DTid] = ao * irradiance;
+}
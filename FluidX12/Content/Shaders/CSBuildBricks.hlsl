@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+cbuffer cbBricks
+{
+	uint3	g_brickGridSize;
+	uint	g_numBrickGroups;	// Thread groups of each brick in the sparse dispatches
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers and textures
+//--------------------------------------------------------------------------------------
+StructuredBuffer<uint>		g_roBrickMask;	// Marked by the last advection
+Texture3D<float3>			g_txVelocity;	// Projected by the last step
+
+RWStructuredBuffer<uint>	g_rwBrickMask;	// Cleared for the coming advection
+RWStructuredBuffer<uint>	g_rwIdleSteps;
+RWStructuredBuffer<uint>	g_rwActiveBricks;
+RWBuffer<uint>				g_rwDispatchArgs;
+RWBuffer<uint>				g_rwNextDispatchArgs;	// Reset for the build of the next step
+RWTexture3D<float3>			g_rwVelocity;	// Advected, read by the projection
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the active-brick list: a brick is kept while any brick in its 3x3x3
+// neighborhood has been busy within g_maxIdleSteps steps, so that both color buffers
+// are quiet once it is skipped. A skipped brick hands the projection its last projected
+// velocity in place of a stale advection
+//--------------------------------------------------------------------------------------
+[numthreads(64, 1, 1)]
+void main(uint DTid : SV_DispatchThreadID)
+{
+	if (DTid == 0)
+	{
+		g_rwDispatchArgs[0] = g_numBrickGroups;
+		g_rwDispatchArgs[2] = 1;
+		g_rwNextDispatchArgs[1] = 0;
+	}
+
+	const uint numBricks = g_brickGridSize.x * g_brickGridSize.y * g_brickGridSize.z;
+	if (DTid >= numBricks) return;
+
+	const uint3 brick = uint3(DTid % g_brickGridSize.x, DTid / g_brickGridSize.x % g_brickGridSize.y,
+		DTid / (g_brickGridSize.x * g_brickGridSize.y));
+	const uint3 begin = max(brick, 1) - 1;
+	const uint3 end = min(brick + 2, g_brickGridSize);
+
+	bool isBusy = false;
+	for (uint z = begin.z; z < end.z; ++z)
+		for (uint y = begin.y; y < end.y; ++y)
+			for (uint x = begin.x; x < end.x; ++x)
+				isBusy = isBusy || g_roBrickMask[x + g_brickGridSize.x * (y + g_brickGridSize.y * z)] != 0;
+
+	const uint lastIdleSteps = g_rwIdleSteps[DTid];
+	const uint idleSteps = isBusy ? 0 : min(lastIdleSteps + 1, g_maxIdleSteps);
+	g_rwIdleSteps[DTid] = idleSteps;
+	g_rwBrickMask[DTid] = 0;
+
+	// Rare, so a single thread copies the brick
+	if (idleSteps >= g_maxIdleSteps && lastIdleSteps < g_maxIdleSteps)
+	{
+		uint3 gridSize;
+		g_rwVelocity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+		const uint3 extent = GetBrickExtent(gridSize);
+		const uint3 cellBegin = brick * extent;
+		const uint3 cellEnd = min(cellBegin + extent, gridSize);
+		for (uint k = cellBegin.z; k < cellEnd.z; ++k)
+			for (uint j = cellBegin.y; j < cellEnd.y; ++j)
+				for (uint i = cellBegin.x; i < cellEnd.x; ++i)
+					g_rwVelocity[uint3(i, j, k)] = g_txVelocity[uint3(i, j, k)];
+	}
+
+	if (idleSteps < g_maxIdleSteps)
+	{
+		uint slot;
+		InterlockedAdd(g_rwDispatchArgs[1], 1, slot);
+		g_rwActiveBricks[slot] = DTid;
+	}
+}
@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+
+#define GROUP_SIZE 64
+#define PI 3.141592654
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+cbuffer cbPerPass
+{
+	uint g_axis;
+	uint g_isInverse;
+};
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txSource;
+RWTexture3D<float>	g_rwDest;
+
+// Complex line ping-ponged between the stages of the FFT
+groupshared float2 g_lines[2][MAX_COSINE_TRANSFORM_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Cell i of a line along the current axis
+//--------------------------------------------------------------------------------------
+uint3 GetCell(uint2 lineIdx, uint i)
+{
+	return g_axis > 0 ? (g_axis > 1 ? uint3(lineIdx, i) : uint3(lineIdx.x, i, lineIdx.y)) : uint3(i, lineIdx);
+}
+
+//--------------------------------------------------------------------------------------
+// Position of sample i in the line of Makhoul's reordering: the even samples in order,
+// then the odd samples reversed
+//--------------------------------------------------------------------------------------
+uint GetReorderedIndex(uint i, uint n)
+{
+	return i & 1 ? n - 1 - (i >> 1) : i >> 1;
+}
+
+//--------------------------------------------------------------------------------------
+// exp(-2 * pi * i * j / n)
+//--------------------------------------------------------------------------------------
+float2 Twiddle(uint j, uint n)
+{
+	float s, c;
+	sincos(-2.0 * PI * j / n, s, c);
+
+	return float2(c, s);
+}
+
+float2 Mul(float2 a, float2 b)
+{
+	return float2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+//--------------------------------------------------------------------------------------
+// Radices 2, 3, 5 first, then any remaining primes, as CosineTransform::Init
+//--------------------------------------------------------------------------------------
+uint GetSmallestFactor(uint m)
+{
+	for (uint p = 2; p * p <= m; ++p) if (m % p == 0) return p;
+
+	return m;
+}
+
+//--------------------------------------------------------------------------------------
+// Mixed-radix Stockham FFT of the line in g_lines[0], in natural order without a bit
+// reversal; a stage of radix p takes p-point DFT butterflies over the sub-transforms of
+// length ns already done, and a prime p without a dedicated butterfly takes a plain DFT as
+// CosineTransform::fft. Returns the buffer holding the spectrum
+//--------------------------------------------------------------------------------------
+uint FFT(uint GTidx, uint n)
+{
+	uint src = 0;
+	uint ns = 1;
+	for (uint m = n; m > 1;)
+	{
+		const uint p = GetSmallestFactor(m);
+		const uint np = n / p;
+		for (uint j = GTidx; j < np; j += GROUP_SIZE)
+		{
+			const uint k = j % ns;
+			const uint dest = (j - k) * p + k;
+			for (uint q = 0; q < p; ++q)
+			{
+				// Twiddle of the sub-transform and the DFT kernel in one: exp(-2 pi i r (k + q ns) / (ns p))
+				const uint kq = k + q * ns;
+				float2 sum = g_lines[src][j];
+				for (uint r = 1; r < p; ++r)
+					sum += Mul(g_lines[src][j + r * np], Twiddle(r * kq % (ns * p), ns * p));
+				g_lines[1 - src][dest + q * ns] = sum;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		src = 1 - src;
+		ns *= p;
+		m /= p;
+	}
+
+	return src;
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader of a DCT-II (or its inverse, DCT-III) along one axis, through a complex
+// FFT of the same length as CosineTransform (Makhoul's reordering); each thread group
+// transforms one line held in groupshared memory
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_rwDest.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	const uint n = gridSize[g_axis];
+
+	uint i;
+	if (g_isInverse)
+	{
+		// Half-sample-shifted spectrum: V[k] = exp(-pi i k / 2n) * (X[k] + i X[n - k])
+		for (i = GTidx; i < n; i += GROUP_SIZE)
+		{
+			const float re = g_txSource[GetCell(Gid.xy, i)];
+			const float im = i > 0 ? g_txSource[GetCell(Gid.xy, n - i)] : 0.0;
+			g_lines[0][i] = Mul(Twiddle(i, 4 * n), float2(re, im));
+		}
+	}
+	else for (i = GTidx; i < n; i += GROUP_SIZE)
+		g_lines[0][GetReorderedIndex(i, n)] = float2(g_txSource[GetCell(Gid.xy, i)], 0.0);
+	GroupMemoryBarrierWithGroupSync();
+
+	const uint src = FFT(GTidx, n);
+
+	for (i = GTidx; i < n; i += GROUP_SIZE)
+	{
+		// Forward: X[k] = Re(F[k] * exp(-pi i k / 2n)); inverse: undo the reordering
+		const float y = g_isInverse ? g_lines[src][GetReorderedIndex(i, n)].x / n :
+			Mul(g_lines[src][i], Twiddle(i, 4 * n)).x;
+		g_rwDest[GetCell(Gid.xy, i)] = y;
+	}
+}
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "SharedConsts.h"
+#include "RayMarch.hlsli"
+#include "CubeMap.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbCheckerboard
+{
+	uint g_interleave;		// Texels per marched one
+	uint g_phase;			// Of the texels marched this frame
+	uint g_cubeMapLODs;		// 4 bits per face
+	uint g_prevCubeMapLODs;	// Of the history
+	float3 g_prevEyePt;		// Of the history, in local space
+};
+
+//--------------------------------------------------------------------------------------
+// Constant
+//--------------------------------------------------------------------------------------
+static const float g_historyTolerance = 0.05;	// Beyond the range of the marched neighbors
+
+//--------------------------------------------------------------------------------------
+// Unordered access textures
+//--------------------------------------------------------------------------------------
+RWTexture2DArray<float4> g_rwCubeMaps[NUM_CUBE_MAP_MIPS];	// Each at its mip
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+TextureCube<float4> g_txHistories[NUM_CUBE_MAP_MIPS];	// Cube map of the last frame, each from its mip on
+
+//--------------------------------------------------------------------------------------
+// Where the history saw the ray of a texel: the ray is represented by its midpoint within
+// the volume, and the ray of the last eye through that point leaves the cube on a face that
+// the history holds
+//--------------------------------------------------------------------------------------
+float3 Reproject(float3 target, float3 eyePt)
+{
+	float3 rayOrigin = eyePt;
+	if (!ComputeRayOrigin(rayOrigin, normalize(target - eyePt))) rayOrigin = target;
+	const float3 pos = (rayOrigin + target) * 0.5;
+
+	// The exit of the ray through pos, which is inside the cube on every axis
+	const float3 rayDir = pos - g_prevEyePt;
+	const float3 u = ((rayDir >= 0.0 ? 1.0 : -1.0) - g_prevEyePt) / rayDir;
+
+	return g_prevEyePt + rayDir * min(min(u.x, u.y), u.z);
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the checkerboard marching, rebuilding the texels that the ray marchers
+// left this frame on the visible faces: each takes the history reprojected from the last
+// eye, clamped to the range of the marched neighbors, unless the opacity of the history
+// falls out of it, as after a large change of the density along the ray, where it takes
+// their mean instead; mirrored in FluidCPU as CubeMap
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	const float3 eyePt = mul(float4(g_eyePt, 1.0), g_worldI);
+	if (!IsVisible(DTid.z, eyePt) || IsMarched(DTid.xy, g_interleave, g_phase)) return;
+
+	// The dispatch covers the finest LOD of the visible faces; a coarser face takes fewer texels
+	const uint lod = (g_cubeMapLODs >> (DTid.z * 4)) & 0xf;
+	uint3 cubeMapSize;
+	g_rwCubeMaps[lod].GetDimensions(cubeMapSize.x, cubeMapSize.y, cubeMapSize.z);
+	if (any(DTid.xy >= cubeMapSize.xy)) return;
+
+	// Range and mean of the 3x3 neighbors marched this frame, 1 to 4 of them
+	float4 minColor = 1.0, maxColor = 0.0, sum = 0.0;
+	float n = 0.0;
+	[unroll]
+	for (int j = -1; j <= 1; ++j)
+	{
+		[unroll]
+		for (int i = -1; i <= 1; ++i)
+		{
+			const int2 texel = int2(DTid.xy) + int2(i, j);
+			if (any(texel < 0 || texel >= int2(cubeMapSize.xy))) continue;
+			if (!IsMarched(texel, g_interleave, g_phase)) continue;
+
+			const float4 color = g_rwCubeMaps[lod][uint3(texel, DTid.z)];
+			minColor = min(color, minColor);
+			maxColor = max(color, maxColor);
+			sum += color;
+			++n;
+		}
+	}
+
+	// The history at the face where the last eye saw the ray, at the LOD of the face then
+	const float3 pos = Reproject(GetLocalPos(DTid.xy, DTid.z, g_rwCubeMaps[lod]), eyePt);
+	const float3 absPos = abs(pos);
+	const uint axis = absPos.x >= absPos.y && absPos.x >= absPos.z ? 0 : (absPos.y >= absPos.z ? 1 : 2);
+	const uint face = axis * 2 + (pos[axis] < 0.0 ? 1 : 0);
+	const uint prevLOD = (g_prevCubeMapLODs >> (face * 4)) & 0xf;
+	const float4 history = g_txHistories[NonUniformResourceIndex(prevLOD)].SampleLevel(g_smpLinear, pos, 0.0);
+
+	minColor -= g_historyTolerance;
+	maxColor += g_historyTolerance;
+	const bool isRejected = history.w < minColor.w || history.w > maxColor.w;
+	g_rwCubeMaps[lod][DTid] = isRejected ? sum / max(n, 1.0) : clamp(history, minColor, maxColor);
+}
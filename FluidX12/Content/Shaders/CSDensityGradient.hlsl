@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.hlsli"
+
+#define GROUP_SIZE 64
+
+static const uint g_tileSize = 4 + 2;
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txDensity;		// Quantized to 8 bits per brick
+Texture3D<float2>	g_txDensityRanges;	// Scale and offset of each brick
+
+RWTexture3D<float4>	g_rwGradient;		// Direction in xyz, magnitude in w
+
+groupshared float g_densities[g_tileSize * g_tileSize * g_tileSize];
+
+//--------------------------------------------------------------------------------------
+// Compute shader caching GetDensityGradient of RayMarch.hlsli at the texel centers, where
+// its offset samples are the neighboring texels: a 4x4x4 group decodes its 6x6x6 texels
+// once, and each thread packs the central differences of its own as a unit direction and a
+// magnitude clamped to 1, and kept off 0 by a step of SNORM so as not to lose the direction
+// of a small gradient; mirrored in FluidCPU as GradientVolume
+//--------------------------------------------------------------------------------------
+[numthreads(4, 4, 4)]
+void main(uint GTidx : SV_GroupIndex, uint3 GTid : SV_GroupThreadID, uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// 6x6x6 texels, clamped to the grid as the sampler, 4 per thread at most
+	const int3 first = int3(DTid - GTid) - 1;
+	for (uint i = GTidx; i < g_tileSize * g_tileSize * g_tileSize; i += GROUP_SIZE)
+	{
+		const int3 offset = int3(i % g_tileSize, i / g_tileSize % g_tileSize, i / (g_tileSize * g_tileSize));
+		const uint3 texel = clamp(first + offset, 0, int3(gridSize) - 1);
+		const float2 range = g_txDensityRanges[texel / g_brickSize];
+		g_densities[i] = g_txDensity[texel] * range.x + range.y;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (any(DTid >= gridSize)) return;
+
+	const uint3 t = GTid + 1;
+	const uint idx = t.x + g_tileSize * (t.y + g_tileSize * t.z);
+	float3 gradient;
+	gradient.x = g_densities[idx + 1] - g_densities[idx - 1];
+	gradient.y = g_densities[idx + g_tileSize] - g_densities[idx - g_tileSize];
+	gradient.z = g_densities[idx + g_tileSize * g_tileSize] - g_densities[idx - g_tileSize * g_tileSize];
+#ifdef _TEXCOORD_INVERT_Y_
+	gradient.y = -gradient.y;
+#endif
+
+	const float magnitude = length(gradient);
+	g_rwGradient[DTid] = magnitude > 0.0 ? float4(gradient / magnitude, clamp(magnitude, 1.0 / 127.0, 1.0)) : 0.0;
+}
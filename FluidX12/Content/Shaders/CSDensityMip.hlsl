@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txSource;			// The density, or the level below
+RWTexture3D<float>	g_rwDensityMip;
+
+//--------------------------------------------------------------------------------------
+// Compute shader averaging the 2x2x2 cells of the level below for each cell of the density
+// mips of the cone-traced light rays; the children clamp to the level below, as past a
+// single cell along an axis
+//--------------------------------------------------------------------------------------
+[numthreads(4, 4, 4)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 size, srcSize;
+	g_rwDensityMip.GetDimensions(size.x, size.y, size.z);
+	if (any(DTid >= size)) return;
+
+	g_txSource.GetDimensions(srcSize.x, srcSize.y, srcSize.z);
+
+	float density = 0.0;
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		const uint3 child = min(DTid * 2 + uint3(i & 1, i >> 1 & 1, i >> 2), srcSize - 1);
+		density += g_txSource[child];
+	}
+
+	g_rwDensityMip[DTid] = density / 8.0;
+}
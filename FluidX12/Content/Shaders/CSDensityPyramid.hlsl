@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.hlsli"
+
+#define GROUP_SIZE 512
+
+static const uint g_apronSize = g_brickSize + 2;
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txDensity;		// Quantized to 8 bits per brick
+Texture3D<float2>	g_txDensityRanges;	// Scale and offset of each brick
+
+RWTexture3D<float>	g_rwDensityMaxima;	// Level 0 of the pyramid
+
+groupshared float g_maxima[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader taking the max of the decoded density over each 8x8x8 brick and the
+// texels that the trilinear footprints of its samples reach, one past it on each side,
+// for empty-space skipping; mirrored in FluidCPU as DensityPyramid
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 8)]
+void main(uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// 10x10x10 texels, clamped to the grid as the sampler, 2 per thread at most
+	const int3 first = int3(Gid * g_brickSize) - 1;
+	float maxDensity = 0.0;
+	for (uint i = GTidx; i < g_apronSize * g_apronSize * g_apronSize; i += GROUP_SIZE)
+	{
+		const int3 offset = int3(i % g_apronSize, i / g_apronSize % g_apronSize, i / (g_apronSize * g_apronSize));
+		const uint3 texel = clamp(first + offset, 0, int3(gridSize) - 1);
+		const float2 range = g_txDensityRanges[texel / g_brickSize];
+		maxDensity = max(g_txDensity[texel] * range.x + range.y, maxDensity);
+	}
+
+	// Parallel reduction in the thread group
+	g_maxima[GTidx] = maxDensity;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_maxima[GTidx] = max(g_maxima[GTidx], g_maxima[GTidx + s]);
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0) g_rwDensityMaxima[Gid] = g_maxima[0];
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txSource;			// The level below
+RWTexture3D<float>	g_rwDensityMaxima;
+
+//--------------------------------------------------------------------------------------
+// Compute shader taking the max of the 2x2x2 cells of the level below for each cell of
+// the max-density pyramid; the children clamp to the level below, as past a single cell
+// along an axis
+//--------------------------------------------------------------------------------------
+[numthreads(4, 4, 4)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 size, srcSize;
+	g_rwDensityMaxima.GetDimensions(size.x, size.y, size.z);
+	if (any(DTid >= size)) return;
+
+	g_txSource.GetDimensions(srcSize.x, srcSize.y, srcSize.z);
+
+	float maxDensity = 0.0;
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		const uint3 child = min(DTid * 2 + uint3(i & 1, i >> 1 & 1, i >> 2), srcSize - 1);
+		maxDensity = max(g_txSource[child], maxDensity);
+	}
+
+	g_rwDensityMaxima[DTid] = maxDensity;
+}
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSMultigrid.hlsli"
+
+#define GROUP_SIZE 64
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float3>	g_txVelocity;
+
+RWTexture3D<float>	g_rwDivergence;
+RWBuffer<float>		g_rwPartialMeans;
+
+groupshared float g_sums[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader of divergence, with the partial mean of each thread group
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txVelocity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	float b = 0.0;
+	if (all(DTid < gridSize))
+	{
+		uint3 cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, DTid, gridSize);
+
+#ifdef _STAGGERED_
+		b = GetStaggeredDivergence(g_txVelocity, DTid, cells);
+#else
+		// Compute the divergence using central differences
+		const float fL = g_txVelocity[cells[0]].x;
+		const float fR = g_txVelocity[cells[1]].x;
+		const float fU = g_txVelocity[cells[2]].y;
+		const float fD = g_txVelocity[cells[3]].y;
+		const float fF = g_txVelocity[cells[4]].z;
+		const float fB = g_txVelocity[cells[5]].z;
+		b = 0.5 * ((fR - fL) + (fD - fU) + (fB - fF));
+#endif
+
+		g_rwDivergence[DTid] = b;
+	}
+
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = b;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] += g_sums[GTidx + s];
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0)
+	{
+		const uint2 numGroups = (gridSize.xy + 7) / 8;
+		const float numCells = gridSize.x * gridSize.y * gridSize.z;
+		g_rwPartialMeans[(Gid.z * numGroups.y + Gid.y) * numGroups.x + Gid.x] = g_sums[0] / numCells;
+	}
+}
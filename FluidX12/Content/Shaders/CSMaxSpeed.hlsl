@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define GROUP_SIZE 64
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float3>	g_txVelocity;
+
+RWBuffer<float4>	g_rwPartialMaxima;
+
+groupshared float3 g_maxima[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the largest speeds per axis in cells per unit time, with the partial
+// maxima of each thread group
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txVelocity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// Parallel reduction in the thread group
+	g_maxima[GTidx] = all(DTid < gridSize) ? abs(g_txVelocity[DTid]) * gridSize : 0.0;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_maxima[GTidx] = max(g_maxima[GTidx], g_maxima[GTidx + s]);
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0)
+	{
+		const uint2 numGroups = (gridSize.xy + 7) / 8;
+		g_rwPartialMaxima[(Gid.z * numGroups.y + Gid.y) * numGroups.x + Gid.x] = float4(g_maxima[0], 0.0);
+	}
+}
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define NUM_NEIGHBOR 6
+
+//--------------------------------------------------------------------------------------
+// Neighbor cells (left, right, up, down, front, back) with clamped boundaries
+//--------------------------------------------------------------------------------------
+void GetNeighbors(out uint3 cells[NUM_NEIGHBOR], uint3 cell, uint3 gridSize)
+{
+	const uint3 cellMin = max(cell, 1) - 1;
+	const uint3 cellMax = min(cell + 1, gridSize - 1);
+	cells[0] = uint3(cellMin.x, cell.yz);
+	cells[1] = uint3(cellMax.x, cell.yz);
+	cells[2] = uint3(cell.x, cellMin.y, cell.z);
+	cells[3] = uint3(cell.x, cellMax.y, cell.z);
+	cells[4] = uint3(cell.xy, cellMin.z);
+	cells[5] = uint3(cell.xy, cellMax.z);
+}
+
+//--------------------------------------------------------------------------------------
+// N in CSProject[2|3]D.hlsl
+//--------------------------------------------------------------------------------------
+uint GetNumNeighbors(uint3 gridSize)
+{
+	return gridSize.z > 1 ? 6 : 4;
+}
+
+//--------------------------------------------------------------------------------------
+// Divergence of the staggered velocity using compact differences, as in
+// CSProject[2|3]D.hlsl; the faces on the domain boundary are solid walls
+//--------------------------------------------------------------------------------------
+float GetStaggeredDivergence(Texture3D<float3> txU, uint3 cell, uint3 cells[NUM_NEIGHBOR])
+{
+	const float fL = any(cells[0] != cell) ? txU[cell].x : 0.0;
+	const float fR = any(cells[1] != cell) ? txU[cells[1]].x : 0.0;
+	const float fU = any(cells[2] != cell) ? txU[cell].y : 0.0;
+	const float fD = any(cells[3] != cell) ? txU[cells[3]].y : 0.0;
+	const float fF = any(cells[4] != cell) ? txU[cell].z : 0.0;
+	const float fB = any(cells[5] != cell) ? txU[cells[5]].z : 0.0;
+
+	return (fR - fL) + (fD - fU) + (fB - fF);
+}
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSMultigrid.hlsli"
+
+#ifndef GROUP_SIZE
+#define GROUP_SIZE 64
+#endif
+
+//--------------------------------------------------------------------------------------
+// Scalars of the conjugate gradient, mirrored in Fluid.cpp
+//--------------------------------------------------------------------------------------
+struct PCGState
+{
+	float RZ;		// r . z
+	float Alpha;
+	float Beta;
+	float RR;		// r . r
+	float BB;		// b . b, the reference of the relative tolerance
+	uint NumIterations;
+	uint IsConverged;
+};
+
+groupshared float3 g_sums[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Inverse of the number of non-clamped neighbors, the diagonal of K = -A; the
+// Jacobi preconditioner z = r / d is applied on the fly from it
+//--------------------------------------------------------------------------------------
+float GetInvDiagonal(uint3 cell, uint3 gridSize)
+{
+	const uint3 numNeighbors = min(cell, 1) + min(gridSize - 1 - cell, 1);
+	const uint d = numNeighbors.x + numNeighbors.y + (gridSize.z > 1 ? numNeighbors.z : 0);
+
+	return d > 0 ? 1.0 / d : 0.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Sums of the thread group, written to a partial per group for CSPCGReduce.hlsl
+//--------------------------------------------------------------------------------------
+void WritePartialSums(RWBuffer<float4> rwPartialSums, float3 sums,
+	uint GTidx, uint3 Gid, uint3 gridSize)
+{
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = sums;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] += g_sums[GTidx + s];
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0)
+	{
+		const uint2 numGroups = (gridSize.xy + 7) / 8;
+		rwPartialSums[(Gid.z * numGroups.y + Gid.y) * numGroups.x + Gid.x] = float4(g_sums[0], 0.0);
+	}
+}
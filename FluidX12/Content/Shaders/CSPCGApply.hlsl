@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSPCG.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float>			g_txResidual;
+Texture3D<float>			g_txDirection;
+StructuredBuffer<PCGState>	g_roState;
+
+RWTexture3D<float>	g_rwDirection;
+RWTexture3D<float>	g_rwKDirection;
+RWBuffer<float4>	g_rwPartialSums;
+
+//--------------------------------------------------------------------------------------
+// New search direction p = z + beta * p at a cell
+//--------------------------------------------------------------------------------------
+float GetDirection(uint3 cell, uint3 gridSize, float beta)
+{
+	return g_txResidual[cell] * GetInvDiagonal(cell, gridSize) + beta * g_txDirection[cell];
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the search direction and q = K p, with the partial sums of p . q
+// The neighbors' directions are formed on the fly, so both updates share one pass.
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	const PCGState state = g_roState[0];
+
+	uint3 gridSize;
+	g_txResidual.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	float3 sums = 0.0;
+	if (all(DTid < gridSize))
+	{
+		uint3 cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, DTid, gridSize);
+		const uint n = GetNumNeighbors(gridSize);
+
+		const float p = GetDirection(DTid, gridSize, state.Beta);
+		float q = n * p;
+		for (uint i = 0; i < n; ++i) q -= GetDirection(cells[i], gridSize, state.Beta);
+
+		g_rwDirection[DTid] = p;
+		g_rwKDirection[DTid] = q;
+		sums.x = p * q;
+	}
+
+	WritePartialSums(g_rwPartialSums, sums, GTidx, Gid, gridSize);
+}
@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define GROUP_SIZE 256
+
+#include "CSPCG.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+cbuffer cbPerPass
+{
+	uint3 g_numGroups;	// Of the apply and update passes
+	uint g_stage;		// 0: residual, 1: apply, 2: update
+	float g_tolerance;	// Relative to the norm of b
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Buffer<float4>				g_roPartialSums;
+RWStructuredBuffer<PCGState> g_rwState;
+RWBuffer<uint>				g_rwDispatchArgs;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the dot-product reductions and the scalar updates of the conjugate
+// gradient, dispatched with a single thread group; it also writes the arguments of the
+// next indirect pass, which launches no thread groups once the solve has converged, so
+// the arguments stay empty through the rest of the recorded budget
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTidx : SV_GroupIndex)
+{
+	PCGState state = g_rwState[0];
+	if (g_stage > 0 && state.IsConverged) return;
+
+	uint numPartials;
+	g_roPartialSums.GetDimensions(numPartials);
+
+	float3 sum = 0.0;
+	for (uint i = GTidx; i < numPartials; i += GROUP_SIZE) sum += g_roPartialSums[i].xyz;
+
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = sum;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] += g_sums[GTidx + s];
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx > 0) return;
+
+	sum = g_sums[0];
+	switch (g_stage)
+	{
+	case 0:
+		state.RR = sum.x;
+		state.RZ = sum.y;
+		state.BB = sum.z;
+		state.Beta = 0.0;
+		state.NumIterations = 0;
+		state.IsConverged = sum.x <= g_tolerance * g_tolerance * sum.z;
+		break;
+	case 1:
+		// The direction vanishes only when the residual does
+		state.Alpha = sum.x > 0.0 ? state.RZ / sum.x : 0.0;
+		state.IsConverged = sum.x <= 0.0;
+		break;
+	default:
+		++state.NumIterations;
+		state.RR = sum.x;
+		state.Beta = sum.y / state.RZ;
+		state.RZ = sum.y;
+		state.IsConverged = sum.x <= g_tolerance * g_tolerance * state.BB;
+	}
+
+	g_rwState[0] = state;
+
+	const uint3 numGroups = state.IsConverged ? 0 : g_numGroups;
+	g_rwDispatchArgs[0] = numGroups.x;
+	g_rwDispatchArgs[1] = numGroups.y;
+	g_rwDispatchArgs[2] = numGroups.z;
+}
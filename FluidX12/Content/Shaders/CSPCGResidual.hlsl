@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSPCG.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txDivergence;
+Texture3D<float>	g_txIncompress;
+
+RWTexture3D<float>	g_rwResidual;
+RWTexture3D<float>	g_rwDirection;
+RWBuffer<float4>	g_rwPartialSums;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the initial residual r = -b - K x from the previous pressure, with
+// the partial sums of r . r, r . z and b . b of each thread group
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txIncompress.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	float3 sums = 0.0;
+	if (all(DTid < gridSize))
+	{
+		uint3 cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, DTid, gridSize);
+		const uint n = GetNumNeighbors(gridSize);
+
+		// The divergence has zero mean already (CSRemoveMean.hlsl)
+		const float b = g_txDivergence[DTid];
+		float r = -b - n * g_txIncompress[DTid];
+		for (uint i = 0; i < n; ++i) r += g_txIncompress[cells[i]];
+
+		g_rwResidual[DTid] = r;
+		g_rwDirection[DTid] = 0.0;
+		sums = float3(r * r, r * r * GetInvDiagonal(DTid, gridSize), b * b);
+	}
+
+	WritePartialSums(g_rwPartialSums, sums, GTidx, Gid, gridSize);
+}
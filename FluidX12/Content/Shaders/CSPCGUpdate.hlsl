@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSPCG.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float>			g_txDirection;
+Texture3D<float>			g_txKDirection;
+StructuredBuffer<PCGState>	g_roState;
+
+RWTexture3D<float>	g_rwIncompress;
+RWTexture3D<float>	g_rwResidual;
+RWBuffer<float4>	g_rwPartialSums;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the step x += alpha * p and r -= alpha * q, with the partial sums
+// of r . r and r . z
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	const PCGState state = g_roState[0];
+
+	uint3 gridSize;
+	g_rwResidual.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	float3 sums = 0.0;
+	if (all(DTid < gridSize))
+	{
+		const float r = g_rwResidual[DTid] - state.Alpha * g_txKDirection[DTid];
+		g_rwIncompress[DTid] += state.Alpha * g_txDirection[DTid];
+		g_rwResidual[DTid] = r;
+		sums.xy = float2(r * r, r * r * GetInvDiagonal(DTid, gridSize));
+	}
+
+	WritePartialSums(g_rwPartialSums, sums, GTidx, Gid, gridSize);
+}
@@ -5,10 +5,10 @@
 //--------------------------------------------------------------------------------------
 // Poisson solver
 //--------------------------------------------------------------------------------------
-void Poisson(RWTexture3D<float> rwX, float b, uint3 cell, uint3 cells[N])
+void Poisson(RWTexture3D<float> rwX, float b, uint3 cell, uint3 cells[N], uint numIterations)
 {
 	// Jacobi/Gauss-Seidel iterations
-	for (uint k = 0; k < ITER; ++k)
+	for (uint k = 0; k < numIterations; ++k)
 	{
 		float q[N];
 		[unroll] for (uint i = 0; i < N; ++i) q[i] = rwX[cells[i]];
@@ -8,8 +8,6 @@
 #define D 3
 #define N 4
 
-#define ITER 64
-
 #include "Simulation.hlsli"
 #include "CSPoisson.hlsli"
 
@@ -19,6 +17,8 @@
 cbuffer cbPerFrame
 {
 	float g_timeStep;
+	uint g_baseSeed;
+	uint g_numIterations;	// Jacobi budget, adapted per frame in the adaptive mode
 };
 
 static const float g_density = 1.0;
@@ -34,8 +34,18 @@ globallycoherent RWTexture3D<float> g_rwIncompress;
 //--------------------------------------------------------------------------------------
 // Compute divergence
 //--------------------------------------------------------------------------------------
-float GetDivergence(Texture3D<float3> txU, uint3 cells[N])
+float GetDivergence(Texture3D<float3> txU, uint3 cell, uint3 cells[N])
 {
+#ifdef _STAGGERED_
+	// The faces on the domain boundary are solid walls
+	const float fL = any(cells[L] != cell) ? txU[cell].x : 0.0;
+	const float fR = any(cells[R] != cell) ? txU[cells[R]].x : 0.0;
+	const float fU = any(cells[U] != cell) ? txU[cell].y : 0.0;
+	const float fD = any(cells[D] != cell) ? txU[cells[D]].y : 0.0;
+
+	// Compute the divergence using compact differences
+	return (fR - fL) + (fD - fU);
+#else
 	const float fL = txU[cells[L]].x;
 	const float fR = txU[cells[R]].x;
 	const float fU = txU[cells[U]].y;
@@ -43,19 +53,28 @@ float GetDivergence(Texture3D<float3> txU, uint3 cells[N])
 
 	// Compute the divergence using central differences
 	return 0.5 * ((fR - fL) + (fD - fU));
+#endif
 }
 
 //--------------------------------------------------------------------------------------
 // Projection
 //--------------------------------------------------------------------------------------
-void Project(RWTexture3D<float> rwQ, inout float3 u, uint3 cells[N])
+void Project(RWTexture3D<float> rwQ, inout float3 u, uint3 cell, uint3 cells[N])
 {
 	float q[N];
 	[unroll] for (uint i = 0; i < N; ++i) q[i] = rwQ[cells[i]];
 
+#ifdef _STAGGERED_
+	// Subtract the compact gradient on the faces, which is the exact adjoint of the
+	// divergence, so no density scaling is needed; the faces on the boundary are walls
+	const float qC = rwQ[cell];
+	u.x = any(cells[L] != cell) ? u.x - (qC - q[L]) : 0.0;
+	u.y = any(cells[U] != cell) ? u.y - (qC - q[U]) : 0.0;
+#else
 	// Project the velocity onto its divergence-free component
 	// Compute the gradient using central differences
 	u.xy -= 0.5 * float2(q[R] - q[L], q[D] - q[U]) / g_density;
+#endif
 }
 
 //--------------------------------------------------------------------------------------
@@ -81,8 +100,10 @@ void main(uint3 DTid : SV_DispatchThreadID)
 
 	if (g_timeStep > 0.0)
 	{
+#ifndef _EXTERNAL_POISSON_SOLVER_
 		// Compute divergence
-		const float b = GetDivergence(g_txVelocity, cells);
+		const float b = GetDivergence(g_txVelocity, DTid, cells);
+#endif
 
 		// Boundary process
 #if 0
@@ -90,16 +111,20 @@ void main(uint3 DTid : SV_DispatchThreadID)
 		if (any(offset.xy)) u = -g_txVelocity[DTid + int3(offset, 0)];
 #endif
 
+#ifndef _EXTERNAL_POISSON_SOLVER_
 		// Poisson solver
-		Poisson(g_rwIncompress, b, DTid, cells);
+		Poisson(g_rwIncompress, b, DTid, cells, g_numIterations);
+#endif
 
 		// Projection
-		Project(g_rwIncompress, u, cells);
+		Project(g_rwIncompress, u, DTid, cells);
 
+#ifndef _STAGGERED_
 		// Boundary process
 		float3 pos = GridToSimulationSpace(DTid, gridSize);
 		pos.xy = pos.xy * 2.0 - 1.0;
 		u *= u * pos > 0.0 ? clamp((0.97 - abs(pos)) / 0.03, -1.0, 1.0) : 1.0;
+#endif
 	}
 
 	g_rwVelocity[DTid] = u;
@@ -10,8 +10,6 @@
 #define B 5
 #define N 6
 
-#define ITER 64
-
 #include "Simulation.hlsli"
 #include "CSPoisson.hlsli"
 
@@ -21,6 +19,8 @@
 cbuffer cbPerFrame
 {
 	float g_timeStep;
+	uint g_baseSeed;
+	uint g_numIterations;	// Jacobi budget, adapted per frame in the adaptive mode
 };
 
 static const float g_density = 0.48;
@@ -36,8 +36,20 @@ globallycoherent RWTexture3D<float> g_rwIncompress;
 //--------------------------------------------------------------------------------------
 // Compute divergence
 //--------------------------------------------------------------------------------------
-float GetDivergence(Texture3D<float3> txU, uint3 cells[N])
+float GetDivergence(Texture3D<float3> txU, uint3 cell, uint3 cells[N])
 {
+#ifdef _STAGGERED_
+	// The faces on the domain boundary are solid walls
+	const float fL = any(cells[L] != cell) ? txU[cell].x : 0.0;
+	const float fR = any(cells[R] != cell) ? txU[cells[R]].x : 0.0;
+	const float fU = any(cells[U] != cell) ? txU[cell].y : 0.0;
+	const float fD = any(cells[D] != cell) ? txU[cells[D]].y : 0.0;
+	const float fF = any(cells[F] != cell) ? txU[cell].z : 0.0;
+	const float fB = any(cells[B] != cell) ? txU[cells[B]].z : 0.0;
+
+	// Compute the divergence using compact differences
+	return (fR - fL) + (fD - fU) + (fB - fF);
+#else
 	const float fL = txU[cells[L]].x;
 	const float fR = txU[cells[R]].x;
 	const float fU = txU[cells[U]].y;
@@ -47,19 +59,29 @@ float GetDivergence(Texture3D<float3> txU, uint3 cells[N])
 
 	// Compute the divergence using central differences
 	return 0.5 * ((fR - fL) + (fD - fU) + (fB - fF));
+#endif
 }
 
 //--------------------------------------------------------------------------------------
 // Projection
 //--------------------------------------------------------------------------------------
-void Project(RWTexture3D<float> rwQ, inout float3 u, uint3 cells[N])
+void Project(RWTexture3D<float> rwQ, inout float3 u, uint3 cell, uint3 cells[N])
 {
 	float q[N];
 	[unroll] for (uint i = 0; i < N; ++i) q[i] = rwQ[cells[i]];
 
+#ifdef _STAGGERED_
+	// Subtract the compact gradient on the faces, which is the exact adjoint of the
+	// divergence, so no density scaling is needed; the faces on the boundary are walls
+	const float qC = rwQ[cell];
+	u.x = any(cells[L] != cell) ? u.x - (qC - q[L]) : 0.0;
+	u.y = any(cells[U] != cell) ? u.y - (qC - q[U]) : 0.0;
+	u.z = any(cells[F] != cell) ? u.z - (qC - q[F]) : 0.0;
+#else
 	// Project the velocity onto its divergence-free component
 	// Compute the gradient using central differences
 	u -= 0.5 * float3(q[R] - q[L], q[D] - q[U], q[B] - q[F]) / g_density;
+#endif
 }
 
 //--------------------------------------------------------------------------------------
@@ -87,8 +109,10 @@ void main(uint3 DTid : SV_DispatchThreadID)
 
 	if (g_timeStep > 0.0)
 	{
+#ifndef _EXTERNAL_POISSON_SOLVER_
 		// Compute divergence
-		const float b = GetDivergence(g_txVelocity, cells);
+		const float b = GetDivergence(g_txVelocity, DTid, cells);
+#endif
 
 #if 0
 		// Boundary process
@@ -96,17 +120,21 @@ void main(uint3 DTid : SV_DispatchThreadID)
 		if (any(offset)) u = -g_txVelocity[DTid + offset];
 #endif
 
+#ifndef _EXTERNAL_POISSON_SOLVER_
 		// Poisson solver
-		Poisson(g_rwIncompress, b, DTid, cells);
+		Poisson(g_rwIncompress, b, DTid, cells, g_numIterations);
+#endif
 
 		// Projection
-		Project(g_rwIncompress, u, cells);
+		Project(g_rwIncompress, u, DTid, cells);
 
+#ifndef _STAGGERED_
 		// Boundary process
 		float3 pos = GridToSimulationSpace(DTid, gridSize);
 		pos = pos * 2.0 - 1.0;
 		u *= u * pos > 0.0 ? clamp((0.97 - abs(pos)) / 0.03, -1.0, 1.0) : 1.0;
 		//u = u * pos > 0.0 && abs(pos) > 0.95 ? -u : u;
+#endif
 	}
 
 	g_rwVelocity[DTid] = u;
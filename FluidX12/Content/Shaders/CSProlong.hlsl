@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txIncompress;		// Coarse level
+RWTexture3D<float>	g_rwIncompress;		// Fine level
+
+//--------------------------------------------------------------------------------------
+// Compute shader of correction prolongation
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 gridSize, coarseSize;
+	g_rwIncompress.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	g_txIncompress.GetDimensions(coarseSize.x, coarseSize.y, coarseSize.z);
+	if (any(DTid >= gridSize)) return;
+
+	// Trilinear interpolation of the coarse correction at the fine cell center
+	float3 pos = gridSize > 1 ? (DTid + 0.5) * 0.5 - 0.5 : 0.0;
+	pos = clamp(pos, 0.0, coarseSize - 1.0);
+	const uint3 i0 = pos;
+	const uint3 i1 = min(i0 + 1, coarseSize - 1);
+	const float3 w = pos - i0;
+
+	const float e00 = lerp(g_txIncompress[i0], g_txIncompress[uint3(i1.x, i0.yz)], w.x);
+	const float e10 = lerp(g_txIncompress[uint3(i0.x, i1.y, i0.z)], g_txIncompress[uint3(i1.xy, i0.z)], w.x);
+	const float e01 = lerp(g_txIncompress[uint3(i0.xy, i1.z)], g_txIncompress[uint3(i1.x, i0.y, i1.z)], w.x);
+	const float e11 = lerp(g_txIncompress[uint3(i0.x, i1.yz)], g_txIncompress[i1], w.x);
+
+	g_rwIncompress[DTid] += lerp(lerp(e00, e10, w.y), lerp(e01, e11, w.y), w.z);
+}
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "Brick.hlsli"
+
+#define GROUP_SIZE 512
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>			g_txDensity;
+
+RWTexture3D<unorm float>	g_rwDensity;		// Quantized to 8 bits
+RWTexture3D<float2>			g_rwDensityRanges;	// Scale and offset of each brick
+
+groupshared float2 g_ranges[GROUP_SIZE];	// Min and max
+
+//--------------------------------------------------------------------------------------
+// Compute shader quantizing the density of each 8x8x8 brick against its own range, for
+// the ray marchers; mirrored in FluidCPU as QuantizedDensity
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 8)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// Parallel reduction in the thread group; the cells past the grid repeat its last ones
+	const float density = g_txDensity[min(DTid, gridSize - 1)];
+	g_ranges[GTidx] = density;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s)
+		{
+			const float2 range = g_ranges[GTidx + s];
+			g_ranges[GTidx] = float2(min(g_ranges[GTidx].x, range.x), max(g_ranges[GTidx].y, range.y));
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	// Rounded to its storage first, so that the codes are quantized against what is decoded
+	const float2 minMax = g_ranges[0];
+	const float offset = f16tof32(f32tof16(minMax.x));
+	const float scale = f16tof32(f32tof16(minMax.y - offset));
+	if (GTidx == 0) g_rwDensityRanges[Gid] = float2(scale, offset);
+
+	if (all(DTid < gridSize)) g_rwDensity[DTid] = scale > 0.0 ? saturate((density - offset) / scale) : 0.0;
+}
@@ -4,26 +4,31 @@
 
 #include "SharedConsts.h"
 #include "RayMarch.hlsli"
+#include "CubeMap.hlsli"
 
 //--------------------------------------------------------------------------------------
 // Constant buffer
 //--------------------------------------------------------------------------------------
-#if _CPU_CUBE_FACE_CULL_ == 1
 cbuffer cb
 {
+	uint g_cubeMapLODs;	// 4 bits per face
+#if _CPU_CUBE_FACE_CULL_ == 1
 	uint g_visibilityMask;
-};
 #elif _CPU_CUBE_FACE_CULL_ == 2
-cbuffer cb
-{
 	uint g_faces[5];
-};
 #endif
+};
+
+cbuffer cbCheckerboard
+{
+	uint g_interleave;	// Texels per marched one; 1 marches all of them
+	uint g_phase;		// Of the texels marched this frame
+};
 
 //--------------------------------------------------------------------------------------
 // Unordered access textures
 //--------------------------------------------------------------------------------------
-RWTexture2DArray<float4> g_rwCubeMap;
+RWTexture2DArray<float4> g_rwCubeMaps[NUM_CUBE_MAP_MIPS];	// Each at its mip
 #ifdef _HAS_DEPTH_MAP_
 RWTexture2DArray<float> g_rwCubeDepth;
 #endif
@@ -33,46 +38,6 @@ RWTexture2DArray<float> g_rwCubeDepth;
 //--------------------------------------------------------------------------------------
 SamplerState g_smpPoint;
 
-//--------------------------------------------------------------------------------------
-// Get the local-space position of the grid surface
-//--------------------------------------------------------------------------------------
-float3 GetLocalPos(float2 pos, uint face, RWTexture2DArray<float4> rwCubeMap)
-{
-	float3 gridSize;
-	rwCubeMap.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
-	
-	pos = (pos + 0.5) / gridSize.xy * 2.0 - 1.0;
-	pos.y = -pos.y;
-
-	switch (face)
-	{
-	case 0: // +X
-		return float3(1.0, pos.y, -pos.x);
-	case 1: // -X
-		return float3(-1.0, pos.y, pos.x);
-	case 2: // +Y
-		return float3(pos.x, 1.0, -pos.y);
-	case 3: // -Y
-		return float3(pos.x, -1.0, pos.y);
-	case 4: // +Z
-		return float3(pos.x, pos.y, 1.0);
-	case 5: // -Z
-		return float3(-pos.x, pos.y, -1.0);
-	default:
-		return 0.0;
-	}
-}
-
-//--------------------------------------------------------------------------------------
-// Check the visibility of the cube face
-//--------------------------------------------------------------------------------------
-bool IsVisible(uint face, float3 localSpaceEyePt)
-{
-	const float viewComp = localSpaceEyePt[face >> 1];
-
-	return (face & 0x1) ? viewComp > -1.0 : viewComp < 1.0;
-}
-
 //--------------------------------------------------------------------------------------
 // Get clip-space position
 //--------------------------------------------------------------------------------------
@@ -104,6 +69,16 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	DTid.z = g_faces[DTid.z];
 #endif
 
+	// Only the texels of this phase, which the dispatch is sized for; CSCubeReconstruct.hlsl
+	// rebuilds the others from the last frame
+	DTid.xy = GetMarchedTexel(DTid.xy, g_interleave, g_phase);
+
+	// The dispatch covers the finest LOD of the visible faces; a coarser face takes fewer texels
+	const uint lod = (g_cubeMapLODs >> (DTid.z * 4)) & 0xf;
+	uint3 cubeMapSize;
+	g_rwCubeMaps[lod].GetDimensions(cubeMapSize.x, cubeMapSize.y, cubeMapSize.z);
+	if (any(DTid.xy >= cubeMapSize.xy)) return;
+
 	float3 rayOrigin = mul(float4(g_eyePt, 1.0), g_worldI);
 	//if (rayOrigin[DTid.z >> 1] == 0.0) return;
 
@@ -111,7 +86,7 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	if (!IsVisible(DTid.z, rayOrigin)) return;
 #endif
 
-	const float3 target = GetLocalPos(DTid.xy, DTid.z, g_rwCubeMap);
+	const float3 target = GetLocalPos(DTid.xy, DTid.z, g_rwCubeMaps[lod]);
 	const float3 rayDir = normalize(target - rayOrigin);
 	if (!ComputeRayOrigin(rayOrigin, rayDir)) return;
 
@@ -125,11 +100,6 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	tMax = GetTMax(pos, rayOrigin, rayDir, tMax);
 #endif
 
-	float3 shCoeffs[SH_NUM_COEFF];
-#if defined(_HAS_LIGHT_PROBE_) && !defined(_LIGHT_PASS_)
-	if (g_hasLightProbes) LoadSH(shCoeffs, g_roSHCoeffs);
-#endif
-	
 #ifdef _POINT_LIGHT_
 	const float3 localSpaceLightPt = mul(float4(g_lightPt, 1.0), g_worldI);
 #else
@@ -143,10 +113,24 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	float t = 0.0;
 	min16float step = stepScale;
 	float prevDensity = 0.0;
+	bool isEmpty = true;
 	for (uint i = 0; i < g_numSamples; ++i)
 	{
 		const float3 pos = rayOrigin + rayDir * t;
 		if (any(abs(pos) > 1.0)) break;
+
+		// After an empty sample, leap over the empty cells of the max-density pyramid in the
+		// fixed steps of empty space, which leaves the samples beyond where they were
+		const uint numEmptySteps = isEmpty ? GetEmptySteps(pos, rayDir, stepScale, ZERO_THRESHOLD) : 0;
+		if (numEmptySteps > 0)
+		{
+			i += numEmptySteps - 1;
+			step = stepScale;
+			t += float(step) * numEmptySteps;
+			if (t > tMax) break;
+			continue;
+		}
+
 		const float3 uvw = LocalToTex3DSpace(pos);
 
 		// Get a sample
@@ -154,17 +138,19 @@ void main(uint3 DTid : SV_DispatchThreadID)
 		//const float mip1 = WaveReadLaneAt(mip, couple);
 		//mip = min(mip, mip1);
 		//min16float4 color = GetSample(uvw, mip);
-		min16float4 color = GetSample(uvw);
+		const min16float density = GetDensity(uvw);
 		min16float newStep = stepScale;
+		isEmpty = density <= ZERO_THRESHOLD;
 
-		// Skip empty space
-		if (color.w > ZERO_THRESHOLD)
+		// Skip empty space, where the color is not fetched
+		if (!isEmpty)
 		{
+			min16float4 color = GetColor(uvw, density);
 #ifdef _POINT_LIGHT_
 			// Point light direction in texture space
 			const float3 lightDir = normalize(localSpaceLightPt - pos);
 #endif
-			const float3 light = GetLight(pos, lightDir, shCoeffs); // Sample light
+			const float3 light = GetLight(pos, lightDir); // Sample light
 
 			// Update step
 			const min16float transm = 1.0 - scatter.w;
@@ -192,5 +178,5 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	scatter.xyz /= 2.0 * PI;
 
 	//scatter.xyz = eyeIdx ? min16float3(0.5 * scatter.x, scatter.yz) : min16float3(scatter.x, 0.5 * scatter.yz);
-	g_rwCubeMap[DTid] = scatter;
+	g_rwCubeMaps[lod][DTid] = scatter;
 }
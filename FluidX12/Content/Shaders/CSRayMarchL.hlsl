@@ -4,22 +4,131 @@
 
 #include "RayMarch.hlsli"
 
+#ifdef _SWEEP_
 //--------------------------------------------------------------------------------------
-// Unordered access texture
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbSweep
+{
+	uint g_slice;		// Counted from the one nearest the light
+	uint g_sweepAxis;	// Of the slices, the dominant one of the light direction
+	uint g_isFromMax;	// Whether the light is on the max side of the axis
+};
+#else
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbRefresh
+{
+	uint g_sliceBegin;	// Of the light map, refreshed this frame
+	uint g_sliceEnd;
+};
+#endif
+
+//--------------------------------------------------------------------------------------
+// Unordered access textures
 //--------------------------------------------------------------------------------------
 RWTexture3D<float3> g_rwLightMap;
+#ifdef _SWEEP_
+RWTexture2D<float> g_rwTransm;		// Of this slice
+#endif
+
+#ifdef _SPARSE_
+//--------------------------------------------------------------------------------------
+// Buffer
+//--------------------------------------------------------------------------------------
+StructuredBuffer<uint> g_roActiveBricks;	// Of the simulation grid
+#endif
+
+#ifdef _SWEEP_
+//--------------------------------------------------------------------------------------
+// Texture
+//--------------------------------------------------------------------------------------
+Texture2D<float> g_txTransm;		// Of the previous slice, nearer the light
+
+//--------------------------------------------------------------------------------------
+// Transmittance of a texel from the previous slice: the ray towards the light crosses its
+// plane, where the transmittance is filtered from the slice and attenuated by the density
+// there over the segment, as CastLightRay does by g_step; rays entering through the sides
+// of the volume, and those of a point light between the slices, start unoccluded
+//--------------------------------------------------------------------------------------
+min16float SweepTransmittance(float3 rayOrigin, float3 rayDir, uint3 lightMapSize)
+{
+	const uint axis = g_sweepAxis;
+	const uint2 plane = uint2((axis + 1) % 3, (axis + 2) % 3);
+	const float dirAxis = g_isFromMax ? rayDir[axis] : -rayDir[axis];
+	if (g_slice == 0 || dirAxis <= 0.0) return 1.0;
+
+	const float t = 2.0 / lightMapSize[axis] / dirAxis;
+	const float3 pos = rayOrigin + rayDir * t;
+	const float2 pos2D = float2(pos[plane.x], pos[plane.y]);
+	if (any(abs(pos2D) > 1.0)) return 1.0;
+
+	// Filtered within the texels of the slice, which the texture may exceed
+	const float2 sliceSize = float2(lightMapSize[plane.x], lightMapSize[plane.y]);
+	float2 texSize;
+	g_txTransm.GetDimensions(texSize.x, texSize.y);
+	const float2 xy = clamp((pos2D * 0.5 + 0.5) * sliceSize, 0.5, sliceSize - 0.5);
+	const float transm = g_txTransm.SampleLevel(g_smpLinear, xy / texSize, 0.0);
+
+	const float density = GetDensity(LocalToTex3DSpace(pos));
+
+	return min16float(transm * pow(max(1.0 - density * ABSORPTION, 0.0), t / g_step));
+}
+#endif
 
 //--------------------------------------------------------------------------------------
 // Compute Shader
 //--------------------------------------------------------------------------------------
+#ifdef _SWEEP_
+[numthreads(8, 8, 1)]
+void main(uint2 DTid2D : SV_DispatchThreadID)
+#else
 [numthreads(4, 4, 4)]
+#ifdef _SPARSE_
+void main(uint3 GTid : SV_GroupThreadID, uint3 Gid : SV_GroupID)
+#else
 void main(uint3 DTid : SV_DispatchThreadID)
+#endif
+#endif
 {
-	float3 gridSize;
-	g_rwLightMap.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	uint3 lightMapSize, gridSize;
+	g_rwLightMap.GetDimensions(lightMapSize.x, lightMapSize.y, lightMapSize.z);
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+#ifdef _SWEEP_
+	// Texel of the slice, swept away from the light
+	const uint axis = g_sweepAxis;
+	const uint2 plane = uint2((axis + 1) % 3, (axis + 2) % 3);
+	if (DTid2D.x >= lightMapSize[plane.x] || DTid2D.y >= lightMapSize[plane.y]) return;
+
+	uint3 DTid;
+	DTid[axis] = g_isFromMax ? lightMapSize[axis] - 1 - g_slice : g_slice;
+	DTid[plane.x] = DTid2D.x;
+	DTid[plane.y] = DTid2D.y;
+#endif
+
+#ifdef _SPARSE_
+	// Cell in the active brick of this group; the idle bricks hold no density to light
+	const uint3 cell = GetBrickCell(g_roActiveBricks[Gid.y], Gid.x, GTid, uint3(4, 4, 4), gridSize);
+	if (any(cell >= gridSize)) return;
+
+	// The texel whose center falls in the cell, if any; a coarse light map has at most one
+	// per cell, and the same as the cell otherwise
+	const uint3 DTid = ((cell * 2 + 1) * lightMapSize) / (gridSize * 2);
+	if (any(((DTid * 2 + 1) * gridSize) / (lightMapSize * 2) != cell)) return;
+#endif
+
+#ifndef _SWEEP_
+	// Only the slices refreshed this frame; the others keep their light from earlier frames
+#ifndef _SPARSE_
+	DTid.z += g_sliceBegin;
+#endif
+	if (DTid.z < g_sliceBegin || DTid.z >= g_sliceEnd) return;
+#endif
 
 	float4 rayOrigin;
-	rayOrigin.xyz = (DTid + 0.5) / gridSize * 2.0 - 1.0;
+	rayOrigin.xyz = (DTid + 0.5) / float3(lightMapSize) * 2.0 - 1.0;
 	rayOrigin.w = 1.0;
 
 	//rayOrigin.xyz = mul(rayOrigin, g_world);	// Light-map space to world space
@@ -34,46 +143,36 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	// Light-map space same to volume space (coupled)
 	//rayOrigin.xyz = mul(rayOrigin, g_worldI);	// World space to volume space
 	const float3 uvw = LocalToTex3DSpace(rayOrigin.xyz);
-	const min16float density = GetSample(uvw).w;
 
-#ifdef _HAS_LIGHT_PROBE_
-	min16float ao = 1.0;
-	float3 irradiance = 0.0;
-#endif
-
-	if (density >= ZERO_THRESHOLD)
-	{
-		if (shadow >= ZERO_THRESHOLD)
-		{
 #ifdef _POINT_LIGHT_
-			const float3 localSpaceLightPt = mul(float4(g_lightPt, 1.0), g_worldI);
-			const float3 rayDir = normalize(localSpaceLightPt - rayOrigin.xyz);
+	const float3 localSpaceLightPt = mul(float4(g_lightPt, 1.0), g_worldI);
+	const float3 lightDir = normalize(localSpaceLightPt - rayOrigin.xyz);
 #else
-			const float3 localSpaceLightPt = mul(g_lightPt, (float3x3)g_worldI);
-			const float3 rayDir = normalize(localSpaceLightPt);
+	const float3 localSpaceLightPt = mul(g_lightPt, (float3x3)g_worldI);
+	const float3 lightDir = normalize(localSpaceLightPt);
 #endif
-			CastLightRay(shadow, rayOrigin.xyz, rayDir, g_step, g_numSamples);
-		}
 
-#ifdef _HAS_LIGHT_PROBE_
-		if (g_hasLightProbes) // An approximation to GI effect with light probe
-		{
-			float3 shCoeffs[SH_NUM_COEFF];
-			LoadSH(shCoeffs, g_roSHCoeffs);
-			float3 rayDir = -GetDensityGradient(uvw);
-			rayDir = any(abs(rayDir) > 0.0) ? rayDir : rayOrigin.xyz; // Avoid 0-gradient caused by uniform density field
-			irradiance = GetIrradiance(shCoeffs, normalize(mul(rayDir, (float3x3)g_world)));
-			rayDir = normalize(rayDir);
-			CastLightRay(ao, rayOrigin.xyz, rayDir, g_step, g_numSamples);
-		}
+#ifdef _SWEEP_
+	// Every texel carries the transmittance on to the next slice, with or without density,
+	// apart from the shadow map, which the slices do not propagate
+	const min16float transm = SweepTransmittance(rayOrigin.xyz, lightDir, lightMapSize);
+	g_rwTransm[DTid2D] = transm;
+	shadow *= transm;
+#else
+	min16float density;
+	if (any(lightMapSize != gridSize)) density = GetFootprintMax(uvw, lightMapSize, gridSize);
+	else density = GetDensity(uvw);
+
+	if (density >= ZERO_THRESHOLD && shadow >= ZERO_THRESHOLD)
+		CastLightRay(shadow, rayOrigin.xyz, lightDir, g_step, g_numSamples, float2(g_lightFootprint, g_lightSpread));
 #endif
-	}
 
 	const min16float3 lightColor = min16float3(g_lightColor.xyz * g_lightColor.w);
 	min16float3 ambient = min16float3(g_ambient.xyz * g_ambient.w);
 
 #ifdef _HAS_LIGHT_PROBE_
-	ambient = g_hasLightProbes ? ao * min16float3(irradiance) : ambient;
+	// An approximation to GI effect with light probe, occluded along the density gradient
+	if (g_hasLightProbes) ambient = min16float3(g_txAmbient.SampleLevel(g_smpLinear, rayOrigin.xyz * 0.5 + 0.5, 0.0));
 #endif
 
 	g_rwLightMap[DTid] = shadow * lightColor + ambient;
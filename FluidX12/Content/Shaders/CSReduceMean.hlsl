@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define GROUP_SIZE 256
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Buffer<float>	g_roPartialMeans;
+RWBuffer<float>	g_rwMean;
+
+groupshared float g_sums[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the mean reduction, dispatched with a single thread group
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTidx : SV_GroupIndex)
+{
+	uint numPartials;
+	g_roPartialMeans.GetDimensions(numPartials);
+
+	float sum = 0.0;
+	for (uint i = GTidx; i < numPartials; i += GROUP_SIZE) sum += g_roPartialMeans[i];
+
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = sum;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] += g_sums[GTidx + s];
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0) g_rwMean[0] = g_sums[0];
+}
@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define GROUP_SIZE 256
+
+#ifdef _MAX_
+#define REDUCE(a, b) max(a, b)
+#else
+#define REDUCE(a, b) ((a) + (b))
+#endif
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+Buffer<float4>		g_roPartialSums;
+RWBuffer<float4>	g_rwSums;
+
+groupshared float4 g_sums[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the sum (or max) reduction, dispatched with a single thread group
+//--------------------------------------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint GTidx : SV_GroupIndex)
+{
+	uint numPartials;
+	g_roPartialSums.GetDimensions(numPartials);
+
+	float4 sum = 0.0;
+	for (uint i = GTidx; i < numPartials; i += GROUP_SIZE) sum = REDUCE(sum, g_roPartialSums[i]);
+
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = sum;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] = REDUCE(g_sums[GTidx], g_sums[GTidx + s]);
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0) g_rwSums[0] = g_sums[0];
+}
@@ -0,0 +1,24 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Buffers and textures
+//--------------------------------------------------------------------------------------
+Buffer<float>		g_roMean;
+RWTexture3D<float>	g_rwDivergence;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of mean removal
+// With pure Neumann boundaries, the Poisson equation is only solvable for a zero-mean
+// right-hand side; Gauss-Seidel smoothing otherwise stalls at a residual of the mean.
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 gridSize;
+	g_rwDivergence.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	if (any(DTid >= gridSize)) return;
+
+	g_rwDivergence[DTid] -= g_roMean[0];
+}
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSMultigrid.hlsli"
+
+#define GROUP_SIZE 64
+
+//--------------------------------------------------------------------------------------
+// Textures and buffers
+//--------------------------------------------------------------------------------------
+Texture3D<float3>	g_txVelocity;
+Texture3D<float>	g_txIncompress;
+
+RWBuffer<float4>	g_rwPartialSums;
+
+groupshared float4 g_sums[GROUP_SIZE];
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the pressure residual b - (sum(x[neighbors]) - N * x) after the
+// projection, with the partial sums (r, r^2, b, b^2) of each thread group
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GTidx : SV_GroupIndex, uint3 Gid : SV_GroupID)
+{
+	uint3 gridSize;
+	g_txVelocity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	float4 sums = 0.0;
+	if (all(DTid < gridSize))
+	{
+		uint3 cells[NUM_NEIGHBOR];
+		GetNeighbors(cells, DTid, gridSize);
+		const uint n = GetNumNeighbors(gridSize);
+
+		// Divergence of the advected velocity, as in CSProject[2|3]D.hlsl
+#ifdef _STAGGERED_
+		const float b = GetStaggeredDivergence(g_txVelocity, DTid, cells);
+#else
+		const float fL = g_txVelocity[cells[0]].x;
+		const float fR = g_txVelocity[cells[1]].x;
+		const float fU = g_txVelocity[cells[2]].y;
+		const float fD = g_txVelocity[cells[3]].y;
+		const float fF = g_txVelocity[cells[4]].z;
+		const float fB = g_txVelocity[cells[5]].z;
+		const float b = 0.5 * ((fR - fL) + (fD - fU) + (fB - fF));
+#endif
+
+		float r = b + n * g_txIncompress[DTid];
+		for (uint i = 0; i < n; ++i) r -= g_txIncompress[cells[i]];
+
+		sums = float4(r, r * r, b, b * b);
+	}
+
+	// Parallel reduction in the thread group
+	g_sums[GTidx] = sums;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint s = GROUP_SIZE >> 1; s > 0; s >>= 1)
+	{
+		if (GTidx < s) g_sums[GTidx] += g_sums[GTidx + s];
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (GTidx == 0)
+	{
+		const uint2 numGroups = (gridSize.xy + 7) / 8;
+		g_rwPartialSums[(Gid.z * numGroups.y + Gid.y) * numGroups.x + Gid.x] = g_sums[0];
+	}
+}
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSMultigrid.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txIncompress;		// Fine level
+Texture3D<float>	g_txDivergence;		// Fine level
+
+RWTexture3D<float>	g_rwDivergence;		// Coarse level
+RWTexture3D<float>	g_rwIncompress;		// Coarse level
+
+//--------------------------------------------------------------------------------------
+// Residual b - (sum(x[neighbors]) - N * x)
+//--------------------------------------------------------------------------------------
+float GetResidual(uint3 cell, uint3 gridSize, uint n)
+{
+	uint3 cells[NUM_NEIGHBOR];
+	GetNeighbors(cells, cell, gridSize);
+
+	float r = g_txDivergence[cell] + n * g_txIncompress[cell];
+	for (uint i = 0; i < n; ++i) r -= g_txIncompress[cells[i]];
+
+	return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Compute shader of residual restriction
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 coarseSize, gridSize;
+	g_rwDivergence.GetDimensions(coarseSize.x, coarseSize.y, coarseSize.z);
+	g_txIncompress.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	if (any(DTid >= coarseSize)) return;
+
+	const uint3 cellMin = DTid * 2;
+	const uint3 cellMax = min(cellMin + 1, gridSize - 1);
+	const uint n = GetNumNeighbors(gridSize);
+
+	// Average the residuals of the children
+	float r = 0.0;
+	uint3 child;
+	for (child.z = cellMin.z; child.z <= cellMax.z; ++child.z)
+		for (child.y = cellMin.y; child.y <= cellMax.y; ++child.y)
+			for (child.x = cellMin.x; child.x <= cellMax.x; ++child.x)
+				r += GetResidual(child, gridSize, n);
+
+	const uint3 numChildren = cellMax - cellMin + 1;
+
+	// The coarse stencil spans twice the cell size, hence the h^2 factor of 4
+	g_rwDivergence[DTid] = 4.0 * r / (numChildren.x * numChildren.y * numChildren.z);
+	g_rwIncompress[DTid] = 0.0;
+}
@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "CSMultigrid.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constants
+//--------------------------------------------------------------------------------------
+cbuffer cbPerPass
+{
+	uint g_color;
+	float g_omega;	// 1 for Gauss-Seidel
+};
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txDivergence;
+RWTexture3D<float>	g_rwIncompress;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of red-black Gauss-Seidel smoothing, over-relaxed by g_omega
+// Cells of one color only read cells of the other color, so each pass is race free
+// and deterministic.
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 gridSize;
+	g_rwIncompress.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	if (((DTid.x + DTid.y + DTid.z) & 1) != g_color || any(DTid >= gridSize)) return;
+
+	uint3 cells[NUM_NEIGHBOR];
+	GetNeighbors(cells, DTid, gridSize);
+	const uint n = GetNumNeighbors(gridSize);
+
+	float x = -g_txDivergence[DTid];
+	for (uint i = 0; i < n; ++i) x += g_rwIncompress[cells[i]];
+	x /= n;
+
+	const float x0 = g_rwIncompress[DTid];
+	g_rwIncompress[DTid] = x0 + g_omega * (x - x0);
+}
@@ -0,0 +1,29 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define PI 3.141592654
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture3D<float>	g_txSource;
+RWTexture3D<float>	g_rwDest;
+
+//--------------------------------------------------------------------------------------
+// Compute shader of the Poisson solve in the DCT-II basis, where the clamped-neighbor
+// stencil is diagonal
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	uint3 gridSize;
+	g_rwDest.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	if (any(DTid >= gridSize)) return;
+
+	// Sum of the eigenvalues 2 * cos(pi * k / n) - 2 per axis; the constant mode has none
+	const float3 lambda = 2.0 * cos(PI * DTid / gridSize) - 2.0;
+	const float l = lambda.x + lambda.y + lambda.z;
+
+	g_rwDest[DTid] = l < 0.0 ? g_txSource[DTid] / l : 0.0;
+}
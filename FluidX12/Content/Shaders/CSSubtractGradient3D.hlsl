@@ -0,0 +1,7 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _EXTERNAL_POISSON_SOLVER_
+
+#include "CSProject3D.hlsl"
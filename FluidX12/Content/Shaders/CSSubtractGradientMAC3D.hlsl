@@ -0,0 +1,8 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define _EXTERNAL_POISSON_SOLVER_
+#define _STAGGERED_
+
+#include "CSProject3D.hlsl"
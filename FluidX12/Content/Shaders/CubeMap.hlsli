@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen & ZENG, Wei. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Get the local-space position of the grid surface
+//--------------------------------------------------------------------------------------
+float3 GetLocalPos(float2 pos, uint face, RWTexture2DArray<float4> rwCubeMap)
+{
+	float3 gridSize;
+	rwCubeMap.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	pos = (pos + 0.5) / gridSize.xy * 2.0 - 1.0;
+	pos.y = -pos.y;
+
+	switch (face)
+	{
+	case 0: // +X
+		return float3(1.0, pos.y, -pos.x);
+	case 1: // -X
+		return float3(-1.0, pos.y, pos.x);
+	case 2: // +Y
+		return float3(pos.x, 1.0, -pos.y);
+	case 3: // -Y
+		return float3(pos.x, -1.0, pos.y);
+	case 4: // +Z
+		return float3(pos.x, pos.y, 1.0);
+	case 5: // -Z
+		return float3(-pos.x, pos.y, -1.0);
+	default:
+		return 0.0;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Check the visibility of the cube face
+//--------------------------------------------------------------------------------------
+bool IsVisible(uint face, float3 localSpaceEyePt)
+{
+	const float viewComp = localSpaceEyePt[face >> 1];
+
+	return (face & 0x1) ? viewComp > -1.0 : viewComp < 1.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Checkerboard marching: 1 of interleave texels per frame, a checkerboard for 2 and a
+// corner of each 2x2 block for 4, at the offset of phase; mirrored in FluidCPU as CubeMap
+//--------------------------------------------------------------------------------------
+uint2 GetMarchedTexel(uint2 idx, uint interleave, uint phase)
+{
+	switch (interleave)
+	{
+	case 2:
+		return uint2(idx.x * 2 + ((idx.y + phase) & 1), idx.y);
+	case 4:
+		return idx * 2 + uint2(phase & 1, phase >> 1);
+	default:
+		return idx;
+	}
+}
+
+bool IsMarched(uint2 texel, uint interleave, uint phase)
+{
+	switch (interleave)
+	{
+	case 2:
+		return ((texel.x + texel.y + phase) & 1) == 0;
+	case 4:
+		return all((texel & 1) == uint2(phase & 1, phase >> 1));
+	default:
+		return true;
+	}
+}
@@ -5,13 +5,21 @@
 #include "SharedConsts.h"
 #include "Common.hlsli"
 
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbCubeMap
+{
+	uint g_cubeMapLODs;	// 4 bits per face, each ray-marched at its own
+};
+
 //--------------------------------------------------------------------------------------
 // Texture
 //--------------------------------------------------------------------------------------
 #if _USE_PURE_ARRAY_
-Texture2DArray<float4> g_txCubeMap;
+Texture2DArray<float4> g_txCubeMaps[NUM_CUBE_MAP_MIPS];	// Each from its mip on
 #else
-TextureCube<float4> g_txCubeMap;
+TextureCube<float4> g_txCubeMaps[NUM_CUBE_MAP_MIPS];
 #endif
 
 #ifdef _HAS_DEPTH_MAP_
@@ -35,10 +43,18 @@ float UnprojectZ(float depth)
 	return unproj.z / (depth * unproj.x + unproj.y);
 }
 
+//--------------------------------------------------------------------------------------
+// Get the LOD of a cube-map face
+//--------------------------------------------------------------------------------------
+uint GetCubeMapLOD(uint face)
+{
+	return (g_cubeMapLODs >> (face * 4)) & 0xf;
+}
+
 //--------------------------------------------------------------------------------------
 // Get domain location
 //--------------------------------------------------------------------------------------
-min16float2 GetDomain(float2 uv, float3 pos, float3 rayDir, float2 gridSize)
+min16float2 GetDomain(float2 uv, float3 pos, float3 rayDir, float2 gridSize, uint lod)
 {
 	uv *= gridSize;
 	float2 domain = frac(uv + 0.5);
@@ -46,7 +62,13 @@ min16float2 GetDomain(float2 uv, float3 pos, float3 rayDir, float2 gridSize)
 #if !_USE_PURE_ARRAY_
 	const float bound = gridSize.x - 1.0;
 	const float3 axes = pos * gridSize.x;
-	if (any(abs(axes) > bound && axes * rayDir < 0.0))
+
+	// The neighboring face across an edge holds no texels at this LOD unless it shares it
+	bool3 isAcross = axes * rayDir < 0.0;
+	[unroll]
+	for (uint i = 0; i < 3; ++i) isAcross[i] = isAcross[i] || GetCubeMapLOD(i * 2 + (pos[i] < 0.0 ? 1 : 0)) != lod;
+
+	if (any(abs(axes) > bound && isAcross))
 	{
 		// Need to clamp the exterior edge
 		uv = min(uv, gridSize - 0.5);
@@ -62,21 +84,31 @@ min16float2 GetDomain(float2 uv, float3 pos, float3 rayDir, float2 gridSize)
 //--------------------------------------------------------------------------------------
 min16float4 CubeCast(uint2 idx, float3 uvw, float3 pos, float3 rayDir)
 {
+	// Each face at its own LOD, of the dominant axis of the position on the cube
+#if _USE_PURE_ARRAY_
+	const uint face = uvw.z;
+#else
+	const float3 absPos = abs(pos);
+	const uint axis = absPos.x >= absPos.y && absPos.x >= absPos.z ? 0 : (absPos.y >= absPos.z ? 1 : 2);
+	const uint face = axis * 2 + (pos[axis] < 0.0 ? 1 : 0);
+#endif
+	const uint lod = GetCubeMapLOD(face);
+
 	float2 gridSize;
-	g_txCubeMap.GetDimensions(gridSize.x, gridSize.y);
+	g_txCubeMaps[NonUniformResourceIndex(lod)].GetDimensions(gridSize.x, gridSize.y);
 	float2 uv = uvw.xy;
 
 #if !_USE_PURE_ARRAY_
 	uvw = pos;
 #endif
 
-	const float4 color = g_txCubeMap.SampleLevel(g_smpLinear, uvw, 0.0);
+	const float4 color = g_txCubeMaps[NonUniformResourceIndex(lod)].SampleLevel(g_smpLinear, uvw, 0.0);
 	const float4x4 gathers =
 	{
-		g_txCubeMap.GatherRed(g_smpLinear, uvw),
-		g_txCubeMap.GatherGreen(g_smpLinear, uvw),
-		g_txCubeMap.GatherBlue(g_smpLinear, uvw),
-		g_txCubeMap.GatherAlpha(g_smpLinear, uvw)
+		g_txCubeMaps[NonUniformResourceIndex(lod)].GatherRed(g_smpLinear, uvw),
+		g_txCubeMaps[NonUniformResourceIndex(lod)].GatherGreen(g_smpLinear, uvw),
+		g_txCubeMaps[NonUniformResourceIndex(lod)].GatherBlue(g_smpLinear, uvw),
+		g_txCubeMaps[NonUniformResourceIndex(lod)].GatherAlpha(g_smpLinear, uvw)
 	};
 
 #ifdef _HAS_DEPTH_MAP_
@@ -84,7 +116,7 @@ min16float4 CubeCast(uint2 idx, float3 uvw, float3 pos, float3 rayDir)
 	float depth = g_txDepth[idx];
 #endif
 
-	const min16float2 domain = GetDomain(uv, pos, rayDir, gridSize);
+	const min16float2 domain = GetDomain(uv, pos, rayDir, gridSize, lod);
 	const min16float2 domainInv = 1.0 - domain;
 	const min16float4 wb =
 	{
@@ -55,11 +55,6 @@ min16float4 main(PSIn input) : SV_TARGET
 	const float tMax = GetTMax(pos, rayOrigin, rayDir);
 #endif
 
-	float3 shCoeffs[SH_NUM_COEFF];
-#if defined(_HAS_LIGHT_PROBE_) && !defined(_LIGHT_PASS_)
-	if (g_hasLightProbes) LoadSH(shCoeffs, g_roSHCoeffs);
-#endif
-
 #ifdef _POINT_LIGHT_
 	const float3 localSpaceLightPt = mul(float4(g_lightPt, 1.0), g_worldI);
 #else
@@ -73,10 +68,26 @@ min16float4 main(PSIn input) : SV_TARGET
 	float t = 0.0;
 	min16float step = g_step;
 	float prevDensity = 0.0;
+	bool isEmpty = true;
 	for (uint i = 0; i < g_numSamples; ++i)
 	{
 		const float3 pos = rayOrigin + rayDir * t;
 		if (any(abs(pos) > 1.0)) break;
+
+		// After an empty sample, leap over the empty cells of the max-density pyramid in the
+		// fixed steps of empty space, which leaves the samples beyond where they were
+		const uint numEmptySteps = isEmpty ? GetEmptySteps(pos, rayDir, g_step, ZERO_THRESHOLD) : 0;
+		if (numEmptySteps > 0)
+		{
+			i += numEmptySteps - 1;
+			step = g_step;
+			t += float(step) * numEmptySteps;
+#ifdef _HAS_DEPTH_MAP_
+			if (t > tMax) break;
+#endif
+			continue;
+		}
+
 		const float3 uvw = LocalToTex3DSpace(pos);
 
 		// Get a sample
@@ -84,17 +95,19 @@ min16float4 main(PSIn input) : SV_TARGET
 		//const float mip1 = WaveReadLaneAt(mip, couple);
 		//mip = min(mip, mip1);
 		//min16float4 color = GetSample(uvw, mip);
-		min16float4 color = GetSample(uvw);
+		const min16float density = GetDensity(uvw);
 		min16float newStep = g_step;
+		isEmpty = density <= ZERO_THRESHOLD;
 
-		// Skip empty space
-		if (color.w > ZERO_THRESHOLD)
+		// Skip empty space, where the color is not fetched
+		if (!isEmpty)
 		{
+			min16float4 color = GetColor(uvw, density);
 #ifdef _POINT_LIGHT_
 			// Point light direction in texture space
 			const float3 lightDir = normalize(localSpaceLightPt - pos);
 #endif
-			const float3 light = GetLight(pos, lightDir, shCoeffs); // Sample light
+			const float3 light = GetLight(pos, lightDir); // Sample light
 
 			// Update step
 			const min16float transm = 1.0 - scatter.w;
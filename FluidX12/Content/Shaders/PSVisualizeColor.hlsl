@@ -12,9 +12,10 @@ struct PSIn
 };
 
 //--------------------------------------------------------------------------------------
-// Texture
+// Textures
 //--------------------------------------------------------------------------------------
-Texture3D		g_txSrc;
+Texture3D<float3>	g_txColor;	// Albedo, unpremultiplied
+Texture3D<float>	g_txDensity;
 
 //--------------------------------------------------------------------------------------
 // Texture sampler
@@ -26,7 +27,8 @@ min16float4 main(PSIn input) : SV_TARGET
 	float3 uvw = float3(input.Tex, 0.5);
 	uvw.y = 1.0 - uvw.y;
 
-	min16float4 color = min16float4(g_txSrc.SampleLevel(g_smpLinear, uvw, 0.0));
+	const float density = g_txDensity.SampleLevel(g_smpLinear, uvw, 0.0);
+	min16float4 color = min16float4(g_txColor.SampleLevel(g_smpLinear, uvw, 0.0) * density, density);
 	color.xyz /= color.xyz + 0.5;
 	
 	return color;
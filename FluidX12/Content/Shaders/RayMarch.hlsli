@@ -3,6 +3,7 @@
 //--------------------------------------------------------------------------------------
 
 #include "Common.hlsli"
+#include "Brick.hlsli"
 #ifdef _HAS_LIGHT_PROBE_
 #define SH_ORDER 3
 #include "SHIrradiance.hlsli"
@@ -21,6 +22,8 @@ cbuffer cbSampleRes
 	uint g_hasLightProbes;
 #endif
 	uint g_numLightSamples; // Only for non-light-separate paths, which need both view and light ray samples
+	float g_lightFootprint;	// Footprint schedule of the light and AO rays: texels at the origin
+	float g_lightSpread;	// and their growth per texel travelled, for cone tracing
 };
 
 //--------------------------------------------------------------------------------------
@@ -33,7 +36,11 @@ static const min16float g_lightStep = g_maxDist / min16float(g_numLightSamples);
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
-Texture3D g_txGrid;
+Texture3D<float> g_txDensity;		// Quantized to 8 bits per brick
+Texture3D<float2> g_txDensityRanges;	// Scale and offset of each brick
+Texture3D<float> g_txDensityMaxima;	// Max-density pyramid of the bricks, for empty-space skipping
+Texture3D<float> g_txDensityMips;	// Level l is mip l + 1 of the density, for cone tracing
+Texture3D<float3> g_txColor;		// Albedo, unpremultiplied
 
 #ifdef _LIGHT_PASS_
 Texture3D<float3> g_txLightMap;
@@ -48,7 +55,11 @@ Texture2D<float> g_txShadow;
 #endif
 
 #if defined(_HAS_LIGHT_PROBE_) && !defined(_LIGHT_PASS_)
-StructuredBuffer<float3> g_roSHCoeffs;
+Texture3D<float3> g_txAmbient;		// AO-weighted irradiance of the light probe, of CSAmbient.hlsl
+#endif
+
+#ifdef _GRADIENT_VOLUME_
+Texture3D<float4> g_txGradient;		// Packed density gradient, of CSDensityGradient.hlsl
 #endif
 
 
@@ -56,15 +67,103 @@ StructuredBuffer<float3> g_roSHCoeffs;
 SamplerComparisonState g_smpShadow;
 #endif
 
+//--------------------------------------------------------------------------------------
+// Decode the quantized density of a texel with the range of its brick
+//--------------------------------------------------------------------------------------
+float LoadDensity(uint3 texel)
+{
+	const float2 range = g_txDensityRanges[texel / g_brickSize];
+
+	return g_txDensity[texel] * range.x + range.y;
+}
+
 //--------------------------------------------------------------------------------------
 // Sample density field
 //--------------------------------------------------------------------------------------
-min16float4 GetSample(float3 uvw, float mip = 0.0)
+min16float GetDensity(float3 uvw)
+{
+	float3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// Texels of the trilinear footprint, clamped as the sampler
+	const float3 pos = uvw * gridSize - 0.5;
+	const float3 base = floor(pos);
+	const uint3 lo = clamp(base, 0.0, gridSize - 1.0);
+	const uint3 hi = clamp(base + 1.0, 0.0, gridSize - 1.0);
+	const uint3 brick = lo / g_brickSize;
+
+	float density;
+	if (all(hi / g_brickSize == brick))
+	{
+		// Within one brick, the filtered codes decode with its range at once
+		const float2 range = g_txDensityRanges[brick];
+		density = g_txDensity.SampleLevel(g_smpLinear, uvw, 0.0) * range.x + range.y;
+	}
+	else
+	{
+		// Across bricks, each texel decodes with the range of its own
+		const float3 w = pos - base;
+		float planes[2];
+		[unroll]
+		for (uint k = 0; k < 2; ++k)
+		{
+			const uint z = k ? hi.z : lo.z;
+			const float row0 = lerp(LoadDensity(uint3(lo.x, lo.y, z)), LoadDensity(uint3(hi.x, lo.y, z)), w.x);
+			const float row1 = lerp(LoadDensity(uint3(lo.x, hi.y, z)), LoadDensity(uint3(hi.x, hi.y, z)), w.x);
+			planes[k] = lerp(row0, row1, w.y);
+		}
+		density = lerp(planes[0], planes[1], w.z);
+	}
+
+	return min16float(density);
+}
+
+//--------------------------------------------------------------------------------------
+// Max density under the filter footprint of a texel of the light map or the ambient volume
+// coarser than the grid, from the brick maxima: the view rays read the texel anywhere within
+// one texel of its center
+//--------------------------------------------------------------------------------------
+min16float GetFootprintMax(float3 uvw, float3 size, float3 gridSize)
+{
+	const uint3 extent = GetBrickExtent(gridSize);
+	const uint3 lo = clamp((uvw - 1.0 / size) * gridSize, 0.0, gridSize - 1.0);
+	const uint3 hi = clamp((uvw + 1.0 / size) * gridSize, 0.0, gridSize - 1.0);
+
+	float maxDensity = 0.0;
+	for (uint z = lo.z / extent.z; z <= hi.z / extent.z; ++z)
+		for (uint y = lo.y / extent.y; y <= hi.y / extent.y; ++y)
+			for (uint x = lo.x / extent.x; x <= hi.x / extent.x; ++x)
+				maxDensity = max(g_txDensityMaxima.Load(int4(x, y, z, 0)), maxDensity);
+
+	return min16float(maxDensity);
+}
+
+//--------------------------------------------------------------------------------------
+// Sample density field at a mip level; below level 1, it blends into the full resolution
+//--------------------------------------------------------------------------------------
+min16float GetDensity(float3 uvw, float mip)
 {
-	float4 color = g_txGrid.SampleLevel(g_smpLinear, uvw, mip);
+	if (mip <= 0.0) return GetDensity(uvw);
+
+	const min16float density = min16float(g_txDensityMips.SampleLevel(g_smpLinear, uvw, max(mip - 1.0, 0.0)));
+
+	return mip < 1.0 ? lerp(GetDensity(uvw), density, min16float(mip)) : density;
+}
+
+//--------------------------------------------------------------------------------------
+// Sample color field, premultiplied by the density already sampled there
+//--------------------------------------------------------------------------------------
+min16float4 GetColor(float3 uvw, min16float density, float mip = 0.0)
+{
+	const float3 albedo = g_txColor.SampleLevel(g_smpLinear, uvw, mip);
 	//min16float4 color = min16float4(0.0, 0.5, 1.0, 0.5);
 
-	return min16float4(color);
+	return min16float4(min16float3(albedo) * density, density);
+}
+
+min16float4 GetSample(float3 uvw)
+{
+	return GetColor(uvw, GetDensity(uvw));
 }
 
 //--------------------------------------------------------------------------------------
@@ -72,6 +171,15 @@ min16float4 GetSample(float3 uvw, float mip = 0.0)
 //--------------------------------------------------------------------------------------
 float3 GetDensityGradient(float3 uvw)
 {
+#ifdef _GRADIENT_VOLUME_
+	// One fetch of the gradient cached at the texel centers, filtered as the density
+	const float4 gradient = g_txGradient.SampleLevel(g_smpLinear, uvw, 0.0);
+
+	return gradient.xyz * gradient.w;
+#else
+	float3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
 	static const int3 offsets[] =
 	{
 		int3(-1, 0, 0),
@@ -89,9 +197,10 @@ float3 GetDensityGradient(float3 uvw)
 	
 	float q[6];
 	[unroll]
-	for (uint i = 0; i < 6; ++i) q[i] = g_txGrid.SampleLevel(g_smpLinear, uvw, 0.0, offsets[i]).w;
+	for (uint i = 0; i < 6; ++i) q[i] = GetDensity(uvw + offsets[i] / gridSize);
 
 	return float3(q[1] - q[0], q[3] - q[2], q[5] - q[4]);
+#endif
 }
 
 //--------------------------------------------------------------------------------------
@@ -194,6 +303,55 @@ float3 LocalToTex3DSpace(float3 pos)
 #endif
 }
 
+//--------------------------------------------------------------------------------------
+// Samples of a ray stepping at a fixed step from the position that fall in the coarsest
+// cell of the max-density pyramid around it with a max within the threshold, which can be
+// leapt over; 0 if the brick of the position exceeds it
+//--------------------------------------------------------------------------------------
+uint GetEmptySteps(float3 pos, float3 rayDir, float step, float threshold)
+{
+	float3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	uint3 brickGridSize;
+	uint numLevels;
+	g_txDensityMaxima.GetDimensions(0, brickGridSize.x, brickGridSize.y, brickGridSize.z, numLevels);
+
+	const float3 texel = LocalToTex3DSpace(pos) * gridSize;
+	const uint3 brick = texel / g_brickSize;
+
+	// Coarsest empty cell around the texel; the cells past the brick grid of a finer level
+	// are not covered by the coarser ones, so the climb stops there
+	int level = -1;
+	for (uint i = 0; i < numLevels; ++i)
+	{
+		const uint3 cell = brick >> i;
+		if (any(cell >= max(brickGridSize >> i, 1))) break;
+		if (g_txDensityMaxima.Load(int4(cell, i)) > threshold) break;
+		level = i;
+	}
+	if (level < 0) return 0;
+
+	// Exit of the ray from the cell, in texels
+#ifdef _TEXCOORD_INVERT_Y_
+	const float3 dir = rayDir * float3(0.5, -0.5, 0.5) * gridSize;
+#else
+	const float3 dir = rayDir * 0.5 * gridSize;
+#endif
+	const float cellSize = g_brickSize << level;
+	const float3 cellMin = (brick >> level) * cellSize;
+	float tExit = FLT_MAX;
+	[unroll]
+	for (uint j = 0; j < 3; ++j)
+	{
+		if (dir[j] > 0.0) tExit = min((cellMin[j] + cellSize - texel[j]) / dir[j], tExit);
+		else if (dir[j] < 0.0) tExit = min((cellMin[j] - texel[j]) / dir[j], tExit);
+	}
+
+	// The samples up to the exit, inclusive, have their footprints in the cell and its apron
+	return uint(min(tExit / step, 65535.0)) + 1;
+}
+
 //--------------------------------------------------------------------------------------
 // Get step
 //--------------------------------------------------------------------------------------
@@ -210,34 +368,61 @@ min16float GetStep(float dDensity, min16float transm, min16float density, min16f
 }
 
 //--------------------------------------------------------------------------------------
-// Cast light ray
+// Cast light ray; a footprint schedule cone-traces it: the footprint of a sample spans
+// footprint.x texels at the origin plus footprint.y per texel travelled, the density is
+// sampled at the mip level of that span, and a sample spanning more than its step steps
+// over its footprint and attenuates as the steps it covers
 //--------------------------------------------------------------------------------------
 void CastLightRay(inout min16float transm, float3 rayOrigin, float3 rayDir,
-	min16float stepScale, uint numSamples, uint mipLevel = 0)
+	min16float stepScale, uint numSamples, float2 footprint = 0.0)
 {
-	const float mip = mipLevel;
-	numSamples >>= mipLevel;
+	float3 gridSize;
+	g_txDensity.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+	const float texelsPerUnit = 0.5 * max(gridSize.x, max(gridSize.y, gridSize.z));
 
 	float t = stepScale;
 	min16float step = stepScale;
 	float prevDensity = 0.0;
+	bool isEmpty = true;
 	for (uint i = 0; i < numSamples; ++i)
 	{
 		const float3 pos = rayOrigin + rayDir * t;
 		if (any(abs(pos) > 1.0)) break;
+
+		// After an empty sample, leap over the cells without any density in the steps that
+		// zero density takes, which leaves the samples beyond where they were
+		const min16float emptyStep = GetStep(0.0, transm, 0.0, stepScale);
+		const uint numEmptySteps = isEmpty ? GetEmptySteps(pos, rayDir, emptyStep, 0.0) : 0;
+		if (numEmptySteps > 0)
+		{
+			i += numEmptySteps - 1;
+			step = emptyStep;
+			t += float(step) * numEmptySteps;
+			continue;
+		}
+
 		const float3 uvw = LocalToTex3DSpace(pos);
 
-		// Get a sample along light ray
-		const min16float density = GetSample(uvw, mip).w;
+		// Get a sample along light ray, at the mip level of its footprint
+		const float span = footprint.x + footprint.y * t * texelsPerUnit;
+		const min16float density = GetDensity(uvw, log2(max(span, 1.0)));
+		isEmpty = density <= 0.0;
 
 		// Update step
 		const float dDensity = density - prevDensity;
-		const min16float newStep = GetStep(dDensity, transm, density, stepScale);
+		min16float newStep = GetStep(dDensity, transm, density, stepScale);
 		step = (step + newStep) * 0.5;
 		prevDensity = density;
 
-		// Attenuate ray-throughput along light direction
-		transm *= 1.0 - density * ABSORPTION;
+		// Attenuate ray-throughput along light direction; a sample whose footprint spans more
+		// than its step stands for the steps in it
+		const float weight = span / texelsPerUnit / newStep;
+		if (weight > 1.0)
+		{
+			transm *= min16float(pow(max(1.0 - density * ABSORPTION, 0.0), weight));
+			newStep = min16float(span / texelsPerUnit);
+		}
+		else transm *= 1.0 - density * ABSORPTION;
 		if (transm < ZERO_THRESHOLD) break;
 
 		// Update position along light ray
@@ -250,14 +435,16 @@ void CastLightRay(inout min16float transm, float3 rayOrigin, float3 rayDir,
 // Get light
 //--------------------------------------------------------------------------------------
 #ifdef _LIGHT_PASS_
-float3 GetLight(float3 pos, float3 rayDir, float3 shCoeffs[SH_NUM_COEFF])
+float3 GetLight(float3 pos, float3 lightDir)
 {
+	// The texels of CSRayMarchL.hlsl are lit at their centers over the volume at any light-map
+	// resolution, so the clamped linear filter weighs the 8 around pos trilinearly
 	const float3 uvw = pos * 0.5 + 0.5;
 
 	return g_txLightMap.SampleLevel(g_smpLinear, uvw, 0.0);
 }
 #else
-float3 GetLight(float3 pos, float3 lightDir, float3 shCoeffs[SH_NUM_COEFF])
+float3 GetLight(float3 pos, float3 lightDir)
 {
 	// Transmittance along light ray
 #if defined(_HAS_SHADOW_MAP_) && !defined(_LIGHT_PASS_)
@@ -267,27 +454,15 @@ float3 GetLight(float3 pos, float3 lightDir, float3 shCoeffs[SH_NUM_COEFF])
 #endif
 
 	if (shadow > ZERO_THRESHOLD)
-		CastLightRay(shadow, pos, lightDir, g_lightStep, g_numLightSamples);
-
-#ifdef _HAS_LIGHT_PROBE_
-	min16float ao = 1.0;
-	float3 irradiance = 0.0;
-	if (g_hasLightProbes) // An approximation to GI effect with light probe
-	{
-		const float3 uvw = LocalToTex3DSpace(pos);
-		float3 rayDir = -GetDensityGradient(uvw);
-		rayDir = any(abs(rayDir) > 0.0) ? rayDir : pos; // Avoid 0-gradient caused by uniform density field
-		irradiance = GetIrradiance(shCoeffs, normalize(mul(rayDir, (float3x3)g_world)));
-		rayDir = normalize(rayDir);
-		CastLightRay(ao, pos, rayDir, g_lightStep, g_numLightSamples);
-	}
-#endif
+		CastLightRay(shadow, pos, lightDir, g_lightStep, g_numLightSamples, float2(g_lightFootprint, g_lightSpread));
 
 	const min16float3 lightColor = min16float3(g_lightColor.xyz * g_lightColor.w);
 	min16float3 ambient = min16float3(g_ambient.xyz * g_ambient.w);
 
 #ifdef _HAS_LIGHT_PROBE_
-	ambient = g_hasLightProbes ? min16float3(irradiance) * ao : ambient;
+	// An approximation to GI effect with light probe, occluded along the density gradient; the
+	// texels are lit at their centers over the volume as the light map
+	if (g_hasLightProbes) ambient = min16float3(g_txAmbient.SampleLevel(g_smpLinear, pos * 0.5 + 0.5, 0.0));
 #endif
 
 	return lightColor * shadow + ambient;
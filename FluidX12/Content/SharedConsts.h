@@ -5,5 +5,11 @@
 // _CPU_CUBE_FACE_CULL_: 0 - GPU culling; 1 - CPU computed visibility mask; 2 - CPU computed indexed face list
 #define _CPU_CUBE_FACE_CULL_ 1
 
+// Mips of the cube map, each face ray-marched at its own LOD, packed in 4 bits per face
+#define NUM_CUBE_MAP_MIPS 5
+
+// Longest line of the DCT projection, held as complex in groupshared memory twice
+#define MAX_COSINE_TRANSFORM_SIZE 1024
+
 static const float g_zNear = 1.0f;
 static const float g_zFar = 1000.0f;
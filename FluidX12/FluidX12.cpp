@@ -30,6 +30,7 @@ RenderMethod g_renderMethod = RAY_MARCH_SEPARATE;
 const float g_FOVAngleY = XM_PIDIV4;
 const auto g_rtFormat = Format::R8G8B8A8_UNORM;
 const auto g_dsFormat = Format::D24_UNORM_S8_UINT;
+const float g_maxFrameTime = 0.1f;	// Caps the simulated time after stalls
 
 FluidX::FluidX(uint32_t width, uint32_t height, std::wstring name) :
 	DXFramework(width, height, name),
@@ -37,6 +38,25 @@ FluidX::FluidX(uint32_t width, uint32_t height, std::wstring name) :
 	m_deviceType(DEVICE_DISCRETE),
 	m_maxRaySamples(192),
 	m_maxLightSamples(64),
+	m_lightFootprint(0.0f),
+	m_lightSpread(0.0f),
+	m_lightMapDivisor(1, 1, 1),
+	m_ambientDivisor(2, 2, 2),
+	m_lightPass(Fluid::LIGHT_RAY_MARCH),
+	m_lightMapRefresh(1),
+	m_pcgMaxIterations(128),
+	m_pcgTolerance(1.0e-2f),
+	m_sorOmega(1.8f),
+	m_targetResidual(0.1f),
+	m_projectionMode(Fluid::PROJECT_JACOBI),
+	m_pressureLevel(0),
+	m_velocityLayout(Fluid::VELOCITY_COLLOCATED),
+	m_advectionScheme(Fluid::ADVECT_SEMI_LAGRANGIAN),
+	m_isSparse(false),
+	m_isGradientCached(false),
+	m_cubeMapInterleave(1),
+	m_cflNumber(0.0f),
+	m_maxSubsteps(4),
 	m_useEZ(true),
 	m_showFPS(true),
 	m_isPaused(false),
@@ -195,10 +215,25 @@ void FluidX::LoadAssets()
 
 		// Create fast hybrid fluid simulator
 		m_fluid = make_unique<Fluid>();
+		m_fluid->SetVelocityLayout(m_velocityLayout);
+		m_fluid->SetAdvectionScheme(m_advectionScheme);
+		m_fluid->SetSparseBricks(m_isSparse);
+		m_fluid->SetLightMapDivisor(m_lightMapDivisor);
+		m_fluid->SetAmbientDivisor(m_ambientDivisor);
+		m_fluid->SetGradientCache(m_isGradientCached);
+		m_fluid->SetCheckerboard(m_cubeMapInterleave);
 		if (!m_fluid->Init(pCommandList, m_width, m_height, m_descriptorTableLib,
 			uploaders, g_rtFormat, g_dsFormat, m_gridSize))
 			ThrowIfFailed(E_FAIL);
 		m_fluid->SetMaxSamples(m_maxRaySamples, m_maxLightSamples);
+		m_fluid->SetLightFootprint(m_lightFootprint, m_lightSpread);
+		m_fluid->SetLightPass(m_lightPass);
+		m_fluid->SetLightMapRefresh(m_lightMapRefresh);
+		m_fluid->SetProjectionBudget(m_pcgTolerance, m_pcgMaxIterations);
+		m_fluid->SetOverRelaxation(m_sorOmega);
+		m_fluid->SetAdaptiveBudget(m_targetResidual, 4, 64);
+		m_fluid->SetPressureLevel(m_pressureLevel);
+		m_fluid->SetSubstepping(m_cflNumber, m_maxSubsteps);
 	}
 
 	// EZ
@@ -211,10 +246,25 @@ void FluidX::LoadAssets()
 
 		// Create fast hybrid fluid simulator
 		XUSG_X_RETURN(m_fluidEZ, make_unique<FluidEZ>(), ThrowIfFailed(E_FAIL));
+		m_fluidEZ->SetVelocityLayout(static_cast<FluidEZ::VelocityLayout>(m_velocityLayout));
+		m_fluidEZ->SetAdvectionScheme(static_cast<FluidEZ::AdvectionScheme>(m_advectionScheme));
+		m_fluidEZ->SetSparseBricks(m_isSparse);
+		m_fluidEZ->SetLightMapDivisor(m_lightMapDivisor);
+		m_fluidEZ->SetAmbientDivisor(m_ambientDivisor);
+		m_fluidEZ->SetGradientCache(m_isGradientCached);
+		m_fluidEZ->SetCheckerboard(m_cubeMapInterleave);
 		XUSG_N_RETURN(m_fluidEZ->Init(pCommandList, m_width, m_height,
 			uploaders, g_rtFormat, g_dsFormat, m_gridSize),
 			ThrowIfFailed(E_FAIL));
 		m_fluidEZ->SetMaxSamples(m_maxRaySamples, m_maxLightSamples);
+		m_fluidEZ->SetLightFootprint(m_lightFootprint, m_lightSpread);
+		m_fluidEZ->SetLightPass(static_cast<FluidEZ::LightPass>(m_lightPass));
+		m_fluidEZ->SetLightMapRefresh(m_lightMapRefresh);
+		m_fluidEZ->SetProjectionBudget(m_pcgTolerance, m_pcgMaxIterations);
+		m_fluidEZ->SetOverRelaxation(m_sorOmega);
+		m_fluidEZ->SetAdaptiveBudget(m_targetResidual, 4, 64);
+		m_fluidEZ->SetPressureLevel(m_pressureLevel);
+		m_fluidEZ->SetSubstepping(m_cflNumber, m_maxSubsteps);
 	}
 
 	// Close the command list and execute it to begin the initial GPU setup.
@@ -263,7 +313,10 @@ void FluidX::OnUpdate()
 	float timeStep;
 	const auto totalTime = CalculateFrameStats(&timeStep);
 	pauseTime = m_isPaused ? totalTime - time : pauseTime;
-	timeStep = (m_gridSize.z > 1 ? 2.0f : 1.0f) / m_gridSize.y;
+	// The fixed step is per frame at 60 Hz; under a CFL number, the elapsed time is simulated
+	// at that rate instead, and split into sub-steps by the fluid
+	const auto fixedStep = (m_gridSize.z > 1 ? 2.0f : 1.0f) / m_gridSize.y;
+	timeStep = m_cflNumber > 0.0f ? fixedStep * 60.0f * (min)(timeStep, g_maxFrameTime) : fixedStep;
 	timeStep = m_isPaused ? 0.0f : timeStep;
 	time = totalTime - pauseTime;
 
@@ -330,6 +383,16 @@ void FluidX::OnKeyUp(uint8_t key)
 	case 'X':
 		m_useEZ = !m_useEZ;
 		break;
+	case 'P':
+		m_projectionMode = static_cast<Fluid::ProjectionMode>((m_projectionMode + 1) % Fluid::NUM_PROJECTION_MODE);
+		m_fluid->SetProjectionMode(m_projectionMode);
+		m_fluidEZ->SetProjectionMode(static_cast<FluidEZ::ProjectionMode>(m_projectionMode));
+		break;
+	case 'R':
+		m_pressureLevel = (m_pressureLevel + 1) % 3;
+		m_fluid->SetPressureLevel(m_pressureLevel);
+		m_fluidEZ->SetPressureLevel(m_pressureLevel);
+		break;
 	}
 }
 
@@ -407,6 +470,15 @@ void FluidX::ParseCommandLineArgs(wchar_t* argv[], int argc)
 		else if (wcsncmp(argv[i], L"-uma", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/uma", wcslen(argv[i])) == 0)
 			m_deviceType = DEVICE_UMA;
+		else if (wcsncmp(argv[i], L"-staggered", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/staggered", wcslen(argv[i])) == 0)
+			m_velocityLayout = Fluid::VELOCITY_STAGGERED;
+		else if (wcsncmp(argv[i], L"-maccormack", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/maccormack", wcslen(argv[i])) == 0)
+			m_advectionScheme = Fluid::ADVECT_MACCORMACK;
+		else if (wcsncmp(argv[i], L"-sparse", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/sparse", wcslen(argv[i])) == 0)
+			m_isSparse = true;
 		else if (wcsncmp(argv[i], L"-gridSize", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/gridSize", wcslen(argv[i])) == 0)
 		{
@@ -424,6 +496,77 @@ void FluidX::ParseCommandLineArgs(wchar_t* argv[], int argc)
 		{
 			if (i + 1 < argc) m_maxLightSamples = stoul(argv[++i]);
 		}
+		else if (wcsncmp(argv[i], L"-lightFootprint", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/lightFootprint", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_lightFootprint = stof(argv[++i]);
+			if (i + 1 < argc) m_lightSpread = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-lightMapDivisor", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/lightMapDivisor", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_lightMapDivisor.x = stoul(argv[++i]);
+			if (i + 1 < argc) m_lightMapDivisor.y = stoul(argv[++i]);
+			if (i + 1 < argc) m_lightMapDivisor.z = stoul(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-ambientDivisor", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/ambientDivisor", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_ambientDivisor.x = stoul(argv[++i]);
+			if (i + 1 < argc) m_ambientDivisor.y = stoul(argv[++i]);
+			if (i + 1 < argc) m_ambientDivisor.z = stoul(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-gradientCache", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/gradientCache", wcslen(argv[i])) == 0)
+			m_isGradientCached = true;
+		else if (wcsncmp(argv[i], L"-checkerboard", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/checkerboard", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_cubeMapInterleave = static_cast<uint8_t>(stoul(argv[++i]));
+		}
+		else if (wcsncmp(argv[i], L"-lightSweep", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/lightSweep", wcslen(argv[i])) == 0)
+			m_lightPass = Fluid::LIGHT_SLICE_SWEEP;
+		else if (wcsncmp(argv[i], L"-lightMapRefresh", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/lightMapRefresh", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_lightMapRefresh = stoul(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-pcgTolerance", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/pcgTolerance", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_pcgTolerance = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-pcgMaxIterations", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/pcgMaxIterations", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_pcgMaxIterations = stoul(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-sorOmega", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/sorOmega", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_sorOmega = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-targetResidual", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/targetResidual", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_targetResidual = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-pressureLevel", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/pressureLevel", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_pressureLevel = static_cast<uint8_t>(stoul(argv[++i]));
+		}
+		else if (wcsncmp(argv[i], L"-cfl", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/cfl", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_cflNumber = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-maxSubsteps", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/maxSubsteps", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_maxSubsteps = stoul(argv[++i]);
+		}
 		else if (wcsncmp(argv[i], L"-radiance", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/radiance", wcslen(argv[i])) == 0)
 		{
@@ -699,6 +842,57 @@ double FluidX::CalculateFrameStats(float* pTimeStep)
 			windowText << L"Simple particle rendering";
 		}
 		windowText << L"    [X] " << (m_useEZ ? "XUSG-EZ" : "XUSGCore");
+		windowText << L"    [P] ";
+		switch (m_projectionMode)
+		{
+		case Fluid::PROJECT_MULTIGRID_V:
+			windowText << L"Multigrid V-cycle projection";
+			break;
+		case Fluid::PROJECT_MULTIGRID_F:
+			windowText << L"Multigrid F-cycle projection";
+			break;
+		case Fluid::PROJECT_DCT:
+			windowText << L"DCT direct projection";
+			break;
+		case Fluid::PROJECT_PCG:
+		{
+			const auto& stats = m_useEZ ? m_fluidEZ->GetProjectionStats() : m_fluid->GetProjectionStats();
+			windowText << L"PCG projection (" << stats.NumIterations << L" iterations, residual ";
+			windowText << setprecision(1) << scientific << stats.Residual;
+			windowText << (stats.IsCapped ? L", capped)" : L")");
+			break;
+		}
+		case Fluid::PROJECT_SOR:
+			windowText << L"Red-black SOR projection (\x03c9 = " << setprecision(2) << fixed << m_sorOmega << L")";
+			break;
+		case Fluid::PROJECT_JACOBI_ADAPTIVE:
+		{
+			const auto& stats = m_useEZ ? m_fluidEZ->GetProjectionStats() : m_fluid->GetProjectionStats();
+			windowText << L"Adaptive Jacobi projection (" << stats.NumIterations << L" iterations, residual ";
+			windowText << setprecision(2) << fixed << stats.Residual << L")";
+			break;
+		}
+		default:
+			windowText << L"Jacobi projection";
+		}
+
+		// Pressure resolution and the divergence left after projection
+		{
+			const auto pressureLevel = m_useEZ ? m_fluidEZ->GetPressureLevel() : m_fluid->GetPressureLevel();
+			const auto& stats = m_useEZ ? m_fluidEZ->GetProjectionStats() : m_fluid->GetProjectionStats();
+			windowText << L"    [R] ";
+			if (pressureLevel > 0) windowText << L"1/" << (1 << pressureLevel) << L"-resolution pressure";
+			else windowText << L"Full-resolution pressure";
+			windowText << L" (divergence error " << setprecision(2) << fixed << stats.DivergenceError << L")";
+		}
+
+		// Sub-steps under the CFL number
+		const auto& stepStats = m_useEZ ? m_fluidEZ->GetStepStats() : m_fluid->GetStepStats();
+		if (stepStats.CFLNumber > 0.0f)
+		{
+			windowText << L"    " << stepStats.NumSubsteps << L" sub-step(s) at CFL " << setprecision(2) << fixed << stepStats.CFLNumber;
+			windowText << L" (Courant " << stepStats.Courant << L")";
+		}
 		windowText << L"    [F11] screen shot";
 
 		SetCustomWindowText(windowText.str().c_str());
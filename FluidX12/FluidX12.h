@@ -89,6 +89,25 @@ private:
 	StepTimer	m_timer;
 	uint32_t	m_maxRaySamples;
 	uint32_t	m_maxLightSamples;
+	float		m_lightFootprint;
+	float		m_lightSpread;
+	XMUINT3		m_lightMapDivisor;
+	XMUINT3		m_ambientDivisor;	// Of the ambient volume of the light probe
+	Fluid::LightPass m_lightPass;
+	uint32_t	m_lightMapRefresh;	// Frames of a full light-map refresh
+	uint32_t	m_pcgMaxIterations;
+	float		m_pcgTolerance;
+	float		m_sorOmega;
+	float		m_targetResidual;
+	Fluid::ProjectionMode m_projectionMode;
+	uint8_t		m_pressureLevel;
+	Fluid::VelocityLayout m_velocityLayout;
+	Fluid::AdvectionScheme m_advectionScheme;
+	bool		m_isSparse;
+	bool		m_isGradientCached;
+	uint8_t		m_cubeMapInterleave;	// Of the checkerboard marching, 1, 2 or 4
+	float		m_cflNumber;
+	uint32_t	m_maxSubsteps;
 	bool		m_useEZ;
 	bool		m_showFPS;
 	bool		m_isPaused;